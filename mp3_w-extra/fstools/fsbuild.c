@@ -0,0 +1,374 @@
+/*
+ * fsbuild: assemble a file system image from directories on the host
+ *
+ *   usage: fsbuild [-o image] [-p profile] [-i inodes] [-l] [-z] dir...
+ *          fsbuild -s image
+ *
+ * Regular files of every dir are added, a later dir replaces files of the
+ * same name from an earlier one. The "." and "rtc" dentries are always
+ * created. Names longer than 32 characters are cut, as the kernel does.
+ *
+ * Layout:
+ *  - files are ordered by access count, most used first, ties by name; the
+ *    profile has one "name count" pair per line, missing files count 0
+ *  - dentries follow the same order, so the kernel's linear lookup finds
+ *    the hot files first
+ *  - the data of every file is contiguous and files are packed in order
+ *  - inodes are extents by default, -l writes the original block lists
+ *    instead (files up to 1023 blocks) for kernels without extent support
+ *  - -z compresses the cold files, the ones the profile never saw, when
+ *    that saves at least one block; they are split in LZ4 compressed
+ *    chunks that the kernel decompresses in read_data, see filesystem.h
+ *
+ * -s prints the fragmentation statistics of an existing image, the same
+ * report is printed for every image built.
+ */
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "fsimg.h"
+#include "lz4.h"
+
+#define FILE_MAX    (DENTRY_COUNT_MAX + DIR_BLK_MAX * DENTRY_PER_BLK - 2)
+#define INODE_MIN   64
+
+typedef struct file {
+    char        name[FILENAME_LEN + 1];
+    char        *path;
+    long        size;
+    long        count;      /* access count from the profile */
+    uint8_t     *data;      /* what goes into the data blocks */
+    long        stored;     /* its length, smaller than size when compressed */
+} file_t;
+
+static file_t files[FILE_MAX];
+static int32_t file_count;
+
+static void *
+xmalloc (size_t size)
+{
+    void *p = calloc (1, size);
+
+    if (NULL == p) {
+        fprintf (stderr, "out of memory\n");
+        exit (1);
+    }
+    return p;
+}
+
+/* add the regular files of a directory, replacing ones with the same name */
+static void
+add_dir (const char *dir)
+{
+    DIR *d;
+    struct dirent *ent;
+    struct stat st;
+    char *path;
+    size_t len;
+    int32_t i;
+
+    if (NULL == (d = opendir (dir))) {
+        perror (dir);
+        exit (1);
+    }
+    while (NULL != (ent = readdir (d))) {
+        path = xmalloc (strlen (dir) + strlen (ent->d_name) + 2);
+        sprintf (path, "%s/%s", dir, ent->d_name);
+        if (0 != stat (path, &st) || !S_ISREG (st.st_mode) || 0 == strcmp (ent->d_name, "rtc")) {
+            free (path);
+            continue;
+        }
+        for (i = 0; i < file_count; i++)
+            if (0 == strncmp (files[i].name, ent->d_name, FILENAME_LEN))
+                break;
+        if (i == file_count) {
+            if (FILE_MAX == file_count) {
+                fprintf (stderr, "%s: too many files\n", path);
+                exit (1);
+            }
+            file_count++;
+        } else {
+            free (files[i].path);
+        }
+        len = strlen (ent->d_name);
+        memset (files[i].name, 0, sizeof (files[i].name));
+        memcpy (files[i].name, ent->d_name, len < FILENAME_LEN ? len : FILENAME_LEN);
+        files[i].path = path;
+        files[i].size = st.st_size;
+    }
+    closedir (d);
+}
+
+static void
+read_profile (const char *path)
+{
+    FILE *f;
+    char name[256];
+    long count;
+    int32_t i;
+
+    if (NULL == (f = fopen (path, "r"))) {
+        perror (path);
+        exit (1);
+    }
+    while (2 == fscanf (f, "%255s %ld", name, &count)) {
+        for (i = 0; i < file_count; i++)
+            if (0 == strncmp (files[i].name, name, FILENAME_LEN))
+                files[i].count += count;
+    }
+    fclose (f);
+}
+
+static int
+by_count (const void *a, const void *b)
+{
+    const file_t *fa = a, *fb = b;
+
+    if (fa->count != fb->count)
+        return fa->count > fb->count ? -1 : 1;
+    return strcmp (fa->name, fb->name);
+}
+
+/*
+ * compress a file into chunks, each chunk can be decompressed alone
+ * return: the stored form, NULL if it would not save a block
+ */
+static uint8_t *
+compress_file (const uint8_t *data, long size, long *stored)
+{
+    long chunk_count = (size + LZ4_CHUNK_SIZE - 1) / LZ4_CHUNK_SIZE;
+    long table_len = 4 * (1 + chunk_count), end = 0, raw_len, len, c;
+    uint8_t *out = xmalloc (table_len + LZ4_BOUND (size) + 16 * chunk_count);
+    uint32_t word;
+
+    word = chunk_count;
+    memcpy (out, &word, 4);
+    for (c = 0; c < chunk_count; c++) {
+        raw_len = size - c * LZ4_CHUNK_SIZE < LZ4_CHUNK_SIZE ? size - c * LZ4_CHUNK_SIZE : LZ4_CHUNK_SIZE;
+        len = lz4_compress (data + c * LZ4_CHUNK_SIZE, raw_len, out + table_len + end);
+        word = end + len;
+        /* a chunk that does not shrink is stored as it is */
+        if (len >= raw_len) {
+            memcpy (out + table_len + end, data + c * LZ4_CHUNK_SIZE, raw_len);
+            word = (end + raw_len) | LZ4_CHUNK_RAW;
+            len = raw_len;
+        }
+        memcpy (out + 4 * (1 + c), &word, 4);
+        end += len;
+    }
+    *stored = table_len + end;
+    if ((*stored + BLK_SIZE - 1) / BLK_SIZE >= (size + BLK_SIZE - 1) / BLK_SIZE) {
+        free (out);
+        return NULL;
+    }
+    return out;
+}
+
+/* print how the data of the regular files is spread over the image */
+static void
+report (uint8_t *image, long image_size)
+{
+    boot_blk_t *boot = fsimg_boot (image);
+    dentry_t *dentry;
+    inode_t *inode;
+    uint8_t *seen;
+    int32_t i, j, blk, prev, blk_num, runs;
+    long file_num = 0, frag_num = 0, run_num = 0, used = 0, slack = 0, bytes = 0;
+    long lz4_num = 0, lz4_bytes = 0, lz4_stored = 0;
+
+    seen = xmalloc (boot->inode_count);
+    for (i = 0; i < boot->dir_count; i++) {
+        dentry = fsimg_dentry (image, i);
+        if (REG_TYPE != dentry->filetype || dentry->inode_num < 0 || dentry->inode_num >= boot->inode_count ||
+            seen[dentry->inode_num])
+            continue;
+        seen[dentry->inode_num] = 1;
+        inode = fsimg_inode (image, dentry->inode_num);
+        blk_num = (STORED_LENGTH (inode) + BLK_SIZE - 1) / BLK_SIZE;
+        for (j = 0, runs = 0, prev = -2; j < blk_num; j++, prev = blk) {
+            if (-1 == (blk = fsimg_blk_of (image, inode, j)))
+                break;
+            if (blk != prev + 1)
+                runs++;
+        }
+        file_num++;
+        run_num += runs;
+        frag_num += runs > 1;
+        used += j;
+        bytes += inode->length;
+        slack += (long)j * BLK_SIZE - STORED_LENGTH (inode);
+        if (IS_LZ4_INODE (inode)) {
+            lz4_num++;
+            lz4_bytes += inode->length;
+            lz4_stored += inode->ext.stored_length;
+        }
+    }
+    free (seen);
+
+    printf ("%ld files, %ld bytes in %ld of %d data blocks\n", file_num, bytes, used, boot->data_blk_count);
+    printf ("fragmented files: %ld, runs: %ld (%.2f per file)\n", frag_num, run_num,
+            file_num ? (double)run_num / file_num : 0.0);
+    printf ("tail slack: %ld bytes (%.1f%% of used blocks)\n", slack,
+            used ? 100.0 * slack / ((double)used * BLK_SIZE) : 0.0);
+    if (lz4_num)
+        printf ("compressed files: %ld, %ld bytes stored in %ld\n", lz4_num, lz4_bytes, lz4_stored);
+    printf ("image: %ld bytes, %d inodes, %d dentries\n", image_size, boot->inode_count, boot->dir_count);
+}
+
+static uint8_t *
+load (const char *path, long *size)
+{
+    FILE *f;
+    uint8_t *image;
+
+    if (NULL == (f = fopen (path, "rb"))) {
+        perror (path);
+        exit (1);
+    }
+    fseek (f, 0, SEEK_END);
+    *size = ftell (f);
+    rewind (f);
+    image = xmalloc (*size > BLK_SIZE ? *size : BLK_SIZE);
+    if (*size < BLK_SIZE || 1 != fread (image, *size, 1, f)) {
+        fprintf (stderr, "%s: cannot read image\n", path);
+        exit (1);
+    }
+    fclose (f);
+    return image;
+}
+
+static void
+usage (const char *prog)
+{
+    fprintf (stderr, "usage: %s [-o image] [-p profile] [-i inodes] [-l] [-z] dir...\n"
+                     "       %s -s image\n", prog, prog);
+    exit (1);
+}
+
+int
+main (int argc, char *argv[])
+{
+    const char *out_path = "filesys_img", *profile = NULL;
+    int32_t legacy = 0, compress = 0, inode_count = INODE_MIN;
+    int32_t i, j, blk_num, blk_count, dir_count, dir_blk_count;
+    long image_size, stored;
+    uint8_t *image, *data;
+    boot_blk_t *boot;
+    dentry_t *dentry;
+    inode_t *inode;
+    FILE *f;
+
+    for (i = 1; i < argc && '-' == argv[i][0]; i++) {
+        if (0 == strcmp (argv[i], "-l")) {
+            legacy = 1;
+        } else if (0 == strcmp (argv[i], "-z")) {
+            compress = 1;
+        } else if (0 == strcmp (argv[i], "-s") && i + 2 == argc) {
+            image = load (argv[i + 1], &image_size);
+            if (-1 == fsimg_check (image, image_size)) {
+                fprintf (stderr, "%s: bad boot block\n", argv[i + 1]);
+                return 1;
+            }
+            report (image, image_size);
+            return 0;
+        } else if (i + 1 < argc && 0 == strcmp (argv[i], "-o")) {
+            out_path = argv[++i];
+        } else if (i + 1 < argc && 0 == strcmp (argv[i], "-p")) {
+            profile = argv[++i];
+        } else if (i + 1 < argc && 0 == strcmp (argv[i], "-i")) {
+            inode_count = atoi (argv[++i]);
+        } else {
+            usage (argv[0]);
+        }
+    }
+    if (i == argc)
+        usage (argv[0]);
+    for (; i < argc; i++)
+        add_dir (argv[i]);
+    if (NULL != profile)
+        read_profile (profile);
+    qsort (files, file_count, sizeof (file_t), by_count);
+
+    for (i = 0; i < file_count; i++) {
+        files[i].data = xmalloc (files[i].size + 1);
+        if (NULL == (f = fopen (files[i].path, "rb")) ||
+            (files[i].size && 1 != fread (files[i].data, files[i].size, 1, f))) {
+            perror (files[i].path);
+            return 1;
+        }
+        fclose (f);
+        files[i].stored = files[i].size;
+        /* compressed files need extents */
+        if (compress && !legacy && 0 == files[i].count && NULL != (data = compress_file (files[i].data, files[i].size, &stored))) {
+            free (files[i].data);
+            files[i].data = data;
+            files[i].stored = stored;
+        }
+    }
+
+    /* inode 0 belongs to "." and "rtc" */
+    if (inode_count < file_count + 1)
+        inode_count = file_count + 1;
+    dir_count = file_count + 2;
+    dir_blk_count = dir_count > DENTRY_COUNT_MAX ?
+                    (dir_count - DENTRY_COUNT_MAX + DENTRY_PER_BLK - 1) / DENTRY_PER_BLK : 0;
+    for (i = 0, blk_count = dir_blk_count; i < file_count; i++) {
+        blk_num = (files[i].stored + BLK_SIZE - 1) / BLK_SIZE;
+        if (legacy && blk_num > DATA_BLK_COUNT_MAX) {
+            fprintf (stderr, "%s: too large for a block list inode\n", files[i].path);
+            return 1;
+        }
+        blk_count += blk_num;
+    }
+    image_size = (long)BLK_SIZE * (1 + inode_count + blk_count);
+    image = xmalloc (image_size);
+    boot = fsimg_boot (image);
+    boot->dir_count = dir_count;
+    boot->inode_count = inode_count;
+    boot->data_blk_count = blk_count;
+    boot->dir_blk_count = dir_blk_count;
+    /* directory blocks first, the file data after them stays in one piece */
+    for (i = 0; i < dir_blk_count; i++)
+        boot->dir_blk_index[i] = i;
+
+    strcpy (boot->dentries[0].filename, ".");
+    boot->dentries[0].filetype = DIR_TYPE;
+    strcpy (boot->dentries[1].filename, "rtc");
+    boot->dentries[1].filetype = RTC_TYPE;
+
+    for (i = 0, blk_count = dir_blk_count; i < file_count; i++) {
+        dentry = fsimg_dentry (image, i + 2);
+        memcpy (dentry->filename, files[i].name, FILENAME_LEN);
+        dentry->filetype = REG_TYPE;
+        dentry->inode_num = i + 1;
+
+        inode = fsimg_inode (image, i + 1);
+        inode->length = files[i].size;
+        blk_num = (files[i].stored + BLK_SIZE - 1) / BLK_SIZE;
+        if (legacy) {
+            for (j = 0; j < blk_num; j++)
+                inode->data_blk_index[j] = blk_count + j;
+        } else {
+            inode->ext.magic = EXTENT_MAGIC;
+            inode->ext.extent_count = blk_num ? 1 : 0;
+            inode->ext.extents[0].start = blk_count;
+            inode->ext.extents[0].blk_count = blk_num;
+            if (files[i].stored != files[i].size) {
+                inode->ext.magic = EXTENT_LZ4_MAGIC;
+                inode->ext.stored_length = files[i].stored;
+            }
+        }
+        memcpy (fsimg_blk (image, blk_count), files[i].data, files[i].stored);
+        blk_count += blk_num;
+    }
+
+    if (NULL == (f = fopen (out_path, "wb")) || 1 != fwrite (image, image_size, 1, f) || 0 != fclose (f)) {
+        perror (out_path);
+        return 1;
+    }
+    report (image, image_size);
+    return 0;
+}
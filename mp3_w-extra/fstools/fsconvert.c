@@ -0,0 +1,121 @@
+/*
+ * fsconvert: rewrite a file system image with extent inodes
+ *
+ *   usage: fsconvert <old image> <new image>
+ *
+ * The data blocks of every regular file are copied to consecutive blocks
+ * of the new image, in dentry order, and its inode becomes a single
+ * extent. Directory blocks follow the file data. Images that already use
+ * extents are accepted too, so the tool can also defragment.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fsimg.h"
+
+static uint8_t *in, *out;
+static long in_size;
+
+#define in_boot     fsimg_boot (in)
+#define in_inode(n) fsimg_inode (in, n)
+#define in_blk(n)   fsimg_blk (in, n)
+#define blk_of(inode, n) fsimg_blk_of (in, inode, n)
+
+int
+main (int argc, char *argv[])
+{
+    FILE *f;
+    boot_blk_t *boot;
+    inode_t *src, *dst;
+    dentry_t *dentry;
+    uint8_t *done;
+    int32_t i, j, blk_num, blk_count = 0, dir_blk_count;
+    int32_t moved = 0, runs = 0, extents = 0;
+
+    if (3 != argc) {
+        fprintf (stderr, "usage: %s <old image> <new image>\n", argv[0]);
+        return 1;
+    }
+    if (NULL == (f = fopen (argv[1], "rb"))) {
+        perror (argv[1]);
+        return 1;
+    }
+    fseek (f, 0, SEEK_END);
+    in_size = ftell (f);
+    rewind (f);
+    if (in_size < BLK_SIZE || NULL == (in = malloc (in_size)) || 1 != fread (in, in_size, 1, f)) {
+        fprintf (stderr, "%s: cannot read image\n", argv[1]);
+        return 1;
+    }
+    fclose (f);
+    if (-1 == fsimg_check (in, in_size)) {
+        fprintf (stderr, "%s: bad boot block\n", argv[1]);
+        return 1;
+    }
+    dir_blk_count = in_boot->dir_blk_count;
+
+    /* the new image is never larger than the old one */
+    if (NULL == (out = calloc (1, in_size)) || NULL == (done = calloc (1, in_boot->inode_count))) {
+        fprintf (stderr, "out of memory\n");
+        return 1;
+    }
+    boot = (boot_blk_t *)out;
+    memcpy (boot, in_boot, BLK_SIZE);
+#define out_inode(n) fsimg_inode (out, n)
+#define out_blk(n)   fsimg_blk (out, n)
+
+    for (i = 0; i < in_boot->dir_count; i++) {
+        dentry = fsimg_dentry (in, i);
+        if (REG_TYPE != dentry->filetype || dentry->inode_num < 0 || dentry->inode_num >= in_boot->inode_count ||
+            done[dentry->inode_num])
+            continue;
+        done[dentry->inode_num] = 1;
+        src = in_inode (dentry->inode_num);
+        dst = out_inode (dentry->inode_num);
+        blk_num = (STORED_LENGTH (src) + BLK_SIZE - 1) / BLK_SIZE;
+        for (j = 0; j < blk_num; j++) {
+            if (-1 == blk_of (src, j)) {
+                if (IS_LZ4_INODE (src)) {
+                    fprintf (stderr, "%.32s: bad data block %d in a compressed file\n", dentry->filename, j);
+                    return 1;
+                }
+                fprintf (stderr, "%.32s: bad data block %d, truncated\n", dentry->filename, j);
+                blk_num = j;
+                break;
+            }
+            if (0 == j || blk_of (src, j) != blk_of (src, j - 1) + 1)
+                runs++;
+            memcpy (out_blk (blk_count + j), in_blk (blk_of (src, j)), BLK_SIZE);
+        }
+        dst->length = (src->length < blk_num * BLK_SIZE) ? src->length : blk_num * BLK_SIZE;
+        dst->ext.magic = EXTENT_MAGIC;
+        if (IS_LZ4_INODE (src)) {
+            dst->length = src->length;
+            dst->ext.magic = EXTENT_LZ4_MAGIC;
+            dst->ext.stored_length = src->ext.stored_length;
+        }
+        dst->ext.extent_count = blk_num ? 1 : 0;
+        dst->ext.extents[0].start = blk_count;
+        dst->ext.extents[0].blk_count = blk_num;
+        blk_count += blk_num;
+        extents += dst->ext.extent_count;
+        moved++;
+    }
+
+    /* directory blocks go last, with their dentries already in place */
+    for (i = 0; i < dir_blk_count; i++) {
+        memcpy (out_blk (blk_count), in_blk (in_boot->dir_blk_index[i]), BLK_SIZE);
+        boot->dir_blk_index[i] = blk_count++;
+    }
+    boot->data_blk_count = blk_count;
+
+    if (NULL == (f = fopen (argv[2], "wb")) ||
+        1 != fwrite (out, (size_t)BLK_SIZE * (1 + boot->inode_count + blk_count), 1, f) || 0 != fclose (f)) {
+        perror (argv[2]);
+        return 1;
+    }
+    printf ("%d files, %d runs merged into %d extents, %d data blocks (was %d)\n",
+            moved, runs, extents, blk_count, in_boot->data_blk_count);
+    return 0;
+}
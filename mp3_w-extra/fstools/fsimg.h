@@ -0,0 +1,130 @@
+/*
+ * On-disk layout of the file system image, shared by the host tools.
+ * Must match student-distrib/drivers/filesystem.h.
+ */
+#ifndef FSIMG_H
+#define FSIMG_H
+
+#include <stdint.h>
+
+#define BLK_SIZE            4096
+#define FILENAME_LEN        32
+#define DENTRY_COUNT_MAX    63
+#define DIR_BLK_MAX         12
+#define DENTRY_PER_BLK      64
+#define DATA_BLK_COUNT_MAX  1023
+#define EXTENT_MAGIC        ((int32_t)0xEC5E0001)
+#define EXTENT_COUNT_MAX    510
+#define EXTENT_LZ4_MAGIC    ((int32_t)0xEC5E0002)
+#define LZ4_CHUNK_SIZE      0x4000
+#define LZ4_CHUNK_RAW       0x80000000u
+
+#define RTC_TYPE 0
+#define DIR_TYPE 1
+#define REG_TYPE 2
+
+typedef struct dentry {
+    char        filename[FILENAME_LEN];
+    int32_t     filetype;
+    int32_t     inode_num;
+    uint8_t     reserved[24];
+} dentry_t;
+
+typedef struct boot_blk {
+    int32_t     dir_count;
+    int32_t     inode_count;
+    int32_t     data_blk_count;
+    int32_t     dir_blk_count;
+    int32_t     dir_blk_index[DIR_BLK_MAX];
+    dentry_t    dentries[DENTRY_COUNT_MAX];
+} boot_blk_t;
+
+typedef struct extent {
+    int32_t     start;
+    int32_t     blk_count;
+} extent_t;
+
+typedef struct inode {
+    int32_t     length;
+    union {
+        int32_t     data_blk_index[DATA_BLK_COUNT_MAX];
+        struct {
+            int32_t     magic;
+            int32_t     extent_count;
+            extent_t    extents[EXTENT_COUNT_MAX];
+            int32_t     stored_length;  /* compressed files only */
+        } ext;
+    };
+} inode_t;
+
+#define IS_EXTENT_INODE(inode_ptr) (EXTENT_MAGIC == (inode_ptr)->ext.magic || IS_LZ4_INODE (inode_ptr))
+#define IS_LZ4_INODE(inode_ptr) (EXTENT_LZ4_MAGIC == (inode_ptr)->ext.magic)
+/* bytes held in the data blocks, compressed files keep their original size in length */
+#define STORED_LENGTH(inode_ptr) (IS_LZ4_INODE (inode_ptr) ? (inode_ptr)->ext.stored_length : (inode_ptr)->length)
+
+/* locate the parts of an image loaded at the given address */
+#define fsimg_boot(image)       ((boot_blk_t *)(image))
+#define fsimg_inode(image, n)   ((inode_t *)((uint8_t *)(image) + BLK_SIZE * (1 + (n))))
+#define fsimg_blk(image, n)     ((uint8_t *)(image) + BLK_SIZE * (1 + fsimg_boot (image)->inode_count + (n)))
+
+/*
+ * check the counts of a loaded image against its size, images of the original
+ * format have zeros in place of the directory blocks
+ * return: -1 -- bad boot block, 0 -- ok, the dentry count is clamped to what fits
+ */
+static inline int
+fsimg_check (uint8_t *image, long size)
+{
+    boot_blk_t *boot = fsimg_boot (image);
+    int32_t i;
+
+    if (size < BLK_SIZE || boot->inode_count <= 0 || boot->data_blk_count < 0 ||
+        (long)BLK_SIZE * (1 + boot->inode_count + boot->data_blk_count) > size)
+        return -1;
+    if (boot->dir_blk_count < 0 || boot->dir_blk_count > DIR_BLK_MAX)
+        boot->dir_blk_count = 0;
+    for (i = 0; i < boot->dir_blk_count; i++)
+        if (boot->dir_blk_index[i] < 0 || boot->dir_blk_index[i] >= boot->data_blk_count)
+            boot->dir_blk_count = i;
+    if (boot->dir_count < 0)
+        boot->dir_count = 0;
+    if (boot->dir_count > DENTRY_COUNT_MAX + DENTRY_PER_BLK * boot->dir_blk_count)
+        boot->dir_count = DENTRY_COUNT_MAX + DENTRY_PER_BLK * boot->dir_blk_count;
+    return 0;
+}
+
+/* the i-th dentry, directory blocks hold the ones past the boot block */
+static inline dentry_t *
+fsimg_dentry (uint8_t *image, int32_t i)
+{
+    boot_blk_t *boot = fsimg_boot (image);
+
+    if (i < DENTRY_COUNT_MAX)
+        return &boot->dentries[i];
+    i -= DENTRY_COUNT_MAX;
+    return (dentry_t *)fsimg_blk (image, boot->dir_blk_index[i / DENTRY_PER_BLK]) + i % DENTRY_PER_BLK;
+}
+
+/* index of the n-th data block of a file, -1 if it is out of the image */
+static inline int32_t
+fsimg_blk_of (uint8_t *image, inode_t *inode, int32_t n)
+{
+    int32_t i, blk = -1;
+
+    if (IS_EXTENT_INODE (inode)) {
+        for (i = 0; i < inode->ext.extent_count && i < EXTENT_COUNT_MAX; i++) {
+            if (n < inode->ext.extents[i].blk_count) {
+                blk = inode->ext.extents[i].start + n;
+                break;
+            }
+            n -= inode->ext.extents[i].blk_count;
+        }
+    } else if (n < DATA_BLK_COUNT_MAX) {
+        blk = inode->data_blk_index[n];
+    }
+    if (blk < 0 || blk >= fsimg_boot (image)->data_blk_count)
+        return -1;
+    return blk;
+}
+
+#endif /* FSIMG_H */
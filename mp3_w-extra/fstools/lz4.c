@@ -0,0 +1,88 @@
+/*
+ * Greedy LZ4 block compressor: a hash table of the last position of every
+ * 4 byte sequence finds matches, each sequence is emitted as soon as one is
+ * found. Follows the block format rules, so any LZ4 decoder accepts the
+ * output: the last 5 bytes are literals and no match starts in the last 12.
+ */
+#include <string.h>
+
+#include "lz4.h"
+
+#define HASH_BITS   12
+#define MIN_MATCH   4
+#define LAST_LITERALS   5
+#define MF_LIMIT    12
+#define MAX_OFFSET  65535
+
+static uint32_t
+read32 (const uint8_t *p)
+{
+    uint32_t v;
+
+    memcpy (&v, p, 4);
+    return v;
+}
+
+static uint32_t
+hash (uint32_t v)
+{
+    return (v * 2654435761u) >> (32 - HASH_BITS);
+}
+
+/* a length that does not fit in the token continues in bytes of 255 */
+static uint8_t *
+put_length (uint8_t *op, size_t len)
+{
+    for (; len >= 255; len -= 255)
+        *op++ = 255;
+    *op++ = len;
+    return op;
+}
+
+static uint8_t *
+put_sequence (uint8_t *op, const uint8_t *literals, size_t lit_len, size_t offset, size_t match_len)
+{
+    uint8_t *token = op++;
+
+    *token = (lit_len >= 15 ? 15 : lit_len) << 4;
+    if (lit_len >= 15)
+        op = put_length (op, lit_len - 15);
+    memcpy (op, literals, lit_len);
+    op += lit_len;
+    if (0 == match_len)
+        return op;
+    *op++ = offset & 0xFF;
+    *op++ = offset >> 8;
+    match_len -= MIN_MATCH;
+    *token |= match_len >= 15 ? 15 : match_len;
+    if (match_len >= 15)
+        op = put_length (op, match_len - 15);
+    return op;
+}
+
+size_t
+lz4_compress (const uint8_t *src, size_t len, uint8_t *dst)
+{
+    uint32_t table[1 << HASH_BITS];    /* position + 1, 0 for none */
+    size_t ip = 0, anchor = 0, ref, match_len, h;
+    uint8_t *op = dst;
+
+    memset (table, 0, sizeof (table));
+    while (len > MF_LIMIT && ip < len - MF_LIMIT) {
+        h = hash (read32 (src + ip));
+        ref = table[h];
+        table[h] = ip + 1;
+        if (0 == ref-- || ip - ref > MAX_OFFSET || read32 (src + ref) != read32 (src + ip)) {
+            ip++;
+            continue;
+        }
+        for (match_len = MIN_MATCH; ip + match_len < len - LAST_LITERALS &&
+             src[ref + match_len] == src[ip + match_len]; match_len++)
+            ;
+        op = put_sequence (op, src + anchor, ip - anchor, ip - ref, match_len);
+        ip += match_len;
+        anchor = ip;
+    }
+    op = put_sequence (op, src + anchor, len - anchor, 0, 0);
+    return op - dst;
+}
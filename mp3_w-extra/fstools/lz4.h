@@ -0,0 +1,17 @@
+/*
+ * LZ4 block compressor for the host tools, the kernel decompressor is
+ * lz4_decompress in student-distrib/lib.c.
+ */
+#ifndef LZ4_H
+#define LZ4_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* worst case output size for len input bytes */
+#define LZ4_BOUND(len) ((len) + (len) / 255 + 16)
+
+/* compress len bytes of src into dst, which has room for LZ4_BOUND(len) bytes; returns the output size */
+size_t lz4_compress (const uint8_t *src, size_t len, uint8_t *dst);
+
+#endif /* LZ4_H */
@@ -0,0 +1,325 @@
+/**
+ * @file ata.c
+ * @brief IDE/ATA driver. Every request is one 4KB block. With bus master DMA a
+ *        channel keeps a queue of requests, the head is in flight and the channel
+ *        interrupt completes it and starts the next one. Without it, requests are
+ *        done with polled PIO when they are submitted.
+ * @version 0.1
+ * @date 2022-05-27
+ */
+
+#include "ata.h"
+#include "pci.h"
+#include "i8259.h"
+
+typedef struct ata_drive
+{
+    ata_channel_t*  ch;
+    uint8_t         slave;
+} ata_drive_t;
+
+static ata_channel_t channels[2] = {
+    {ATA_PRIMARY_IO, ATA_PRIMARY_CTRL, 0, ATA_PRIMARY_IRQ, NULL, NULL},
+    {ATA_SECONDARY_IO, ATA_SECONDARY_CTRL, 0, ATA_SECONDARY_IRQ, NULL, NULL},
+};
+static ata_drive_t drives[ATA_DRIVE_MAX];
+static blk_dev_t devs[ATA_DRIVE_MAX];
+static int32_t dev_count = 0;
+static const int8_t* ata_names[ATA_DRIVE_MAX] = {"hda", "hdb", "hdc", "hdd"};
+
+/* 400ns for the drive to put its status on the bus, reading the alternate status takes 100ns */
+static void ata_delay(ata_channel_t* ch)
+{
+    inb(ch->ctrl);
+    inb(ch->ctrl);
+    inb(ch->ctrl);
+    inb(ch->ctrl);
+}
+
+/**
+ * @brief wait until the drive is not busy
+ * @return the status, -1 on timeout
+ */
+static int32_t ata_wait_idle(ata_channel_t* ch)
+{
+    int32_t i, status;
+    for (i = 0; i < ATA_TIMEOUT; i++) {
+        status = inb(ch->io + ATA_REG_STATUS);
+        if (!(status & ATA_SR_BSY))
+            return status;
+    }
+    return -1;
+}
+
+/**
+ * @brief wait until the drive wants to transfer a sector
+ * @return 0 ready, -1 error or timeout
+ */
+static int32_t ata_wait_drq(ata_channel_t* ch)
+{
+    int32_t i, status;
+    for (i = 0; i < ATA_TIMEOUT; i++) {
+        status = inb(ch->io + ATA_REG_STATUS);
+        if (status & ATA_SR_BSY)
+            continue;
+        if (status & (ATA_SR_ERR | ATA_SR_DF))
+            return -1;
+        if (status & ATA_SR_DRQ)
+            return 0;
+    }
+    return -1;
+}
+
+/* select the drive and load the address of a block, LBA28 */
+static void ata_setup(ata_channel_t* ch, uint8_t slave, uint32_t blk)
+{
+    uint32_t lba = blk * BLK_SECTORS;
+    outb(0xE0 | (slave << 4) | ((lba >> 24) & 0x0F), ch->io + ATA_REG_DRIVE);
+    ata_delay(ch);
+    ata_wait_idle(ch);
+    outb(BLK_SECTORS, ch->io + ATA_REG_SECCOUNT);
+    outb(lba & 0xFF, ch->io + ATA_REG_LBA0);
+    outb((lba >> 8) & 0xFF, ch->io + ATA_REG_LBA1);
+    outb((lba >> 16) & 0xFF, ch->io + ATA_REG_LBA2);
+}
+
+/**
+ * @brief transfer a block with polled PIO
+ * @return 1 success, -1 error
+ */
+static int32_t ata_pio(ata_drive_t* drive, blk_req_t* req)
+{
+    ata_channel_t* ch = drive->ch;
+    uint16_t* data = (uint16_t*)req->buf;
+    int32_t s, i;
+
+    ata_setup(ch, drive->slave, req->blk);
+    outb(req->write ? ATA_CMD_WRITE_PIO : ATA_CMD_READ_PIO, ch->io + ATA_REG_COMMAND);
+    for (s = 0; s < BLK_SECTORS; s++) {
+        if (-1 == ata_wait_drq(ch))
+            return -1;
+        for (i = 0; i < ATA_SECTOR_SIZE / 2; i++, data++) {
+            if (req->write)
+                outw(*data, ch->io + ATA_REG_DATA);
+            else
+                *data = inw(ch->io + ATA_REG_DATA);
+        }
+    }
+    if (req->write) {
+        outb(ATA_CMD_FLUSH, ch->io + ATA_REG_COMMAND);
+        ata_delay(ch);
+    }
+    s = ata_wait_idle(ch);
+    return (-1 == s || (s & (ATA_SR_ERR | ATA_SR_DF))) ? -1 : 1;
+}
+
+/* start the DMA of the request at the head of the queue */
+static void ata_dma_start(ata_channel_t* ch)
+{
+    blk_req_t* req = ch->head;
+    ata_drive_t* drive = (ata_drive_t*)req->priv;
+    uint8_t dir = req->write ? 0 : ATA_BM_CMD_READ;
+
+    ch->prd.addr = (uint32_t)req->buf;
+    ch->prd.count = BLK_SIZE;
+    ch->prd.flags = ATA_PRD_EOT;
+    outb(0, ch->bmide + ATA_BM_COMMAND);
+    outl((uint32_t)&ch->prd, ch->bmide + ATA_BM_PRDT);
+    outb(ATA_BM_SR_ERR | ATA_BM_SR_IRQ, ch->bmide + ATA_BM_STATUS);     // write 1 to clear
+    outb(dir, ch->bmide + ATA_BM_COMMAND);
+
+    ata_setup(ch, drive->slave, req->blk);
+    outb(req->write ? ATA_CMD_WRITE_DMA : ATA_CMD_READ_DMA, ch->io + ATA_REG_COMMAND);
+    outb(dir | ATA_BM_CMD_START, ch->bmide + ATA_BM_COMMAND);
+}
+
+/* complete the request in flight if the controller is done with it, then start the next one */
+static void ata_dma_finish(ata_channel_t* ch)
+{
+    blk_req_t* req = ch->head;
+    int32_t bm_status, status;
+
+    if (NULL == req)
+        return;
+    bm_status = inb(ch->bmide + ATA_BM_STATUS);
+    if (!(bm_status & ATA_BM_SR_IRQ))
+        return;
+    outb(0, ch->bmide + ATA_BM_COMMAND);
+    status = inb(ch->io + ATA_REG_STATUS);      // also acknowledges the drive's interrupt
+    outb(ATA_BM_SR_ERR | ATA_BM_SR_IRQ, ch->bmide + ATA_BM_STATUS);
+
+    ch->head = req->next;
+    if (NULL == ch->head)
+        ch->tail = NULL;
+    blk_complete(req, ((bm_status & ATA_BM_SR_ERR) || (status & (ATA_SR_ERR | ATA_SR_DF))) ? -1 : 1);
+    if (NULL != ch->head)
+        ata_dma_start(ch);
+}
+
+/**
+ * @brief submit operation of an ATA disk
+ * @return 0 queued (or already done with PIO), -1 bad request
+ */
+static int32_t ata_submit(blk_dev_t* dev, blk_req_t* req)
+{
+    ata_drive_t* drive = (ata_drive_t*)dev->priv;
+    ata_channel_t* ch = drive->ch;
+    uint32_t flags;
+
+    if (req->blk >= dev->blk_count)
+        return -1;
+    req->priv = drive;
+    req->next = NULL;
+    if (0 == ch->bmide) {
+        blk_complete(req, ata_pio(drive, req));
+        return 0;
+    }
+    cli_and_save(flags);
+    if (NULL == ch->tail) {
+        ch->head = ch->tail = req;
+        ata_dma_start(ch);
+    } else {
+        ch->tail->next = req;
+        ch->tail = req;
+    }
+    restore_flags(flags);
+    return 0;
+}
+
+/**
+ * @brief poll operation, completes the DMA in flight when the interrupt cannot be waited for
+ */
+static void ata_poll(blk_dev_t* dev)
+{
+    ata_channel_t* ch = ((ata_drive_t*)dev->priv)->ch;
+    if (ch->bmide)
+        ata_dma_finish(ch);
+}
+
+static void ata_handler(ata_channel_t* ch)
+{
+    if (ch->bmide)
+        ata_dma_finish(ch);     // does nothing if the interrupt was already handled by polling
+    else
+        inb(ch->io + ATA_REG_STATUS);
+    send_eoi(ch->irq);
+}
+
+/**
+ * @brief interrupt handler of the primary channel (IRQ 14)
+ */
+void ata_primary_handler(void)
+{
+    ata_handler(&channels[0]);
+}
+
+/**
+ * @brief interrupt handler of the secondary channel (IRQ 15)
+ */
+void ata_secondary_handler(void)
+{
+    ata_handler(&channels[1]);
+}
+
+/**
+ * @brief IDENTIFY a drive
+ * @return number of sectors, 0 if there is no ATA disk
+ */
+static uint32_t ata_identify(ata_channel_t* ch, uint8_t slave)
+{
+    uint16_t id[ATA_SECTOR_SIZE / 2];
+    int32_t i, status;
+
+    outb(0xA0 | (slave << 4), ch->io + ATA_REG_DRIVE);
+    ata_delay(ch);
+    outb(0, ch->io + ATA_REG_SECCOUNT);
+    outb(0, ch->io + ATA_REG_LBA0);
+    outb(0, ch->io + ATA_REG_LBA1);
+    outb(0, ch->io + ATA_REG_LBA2);
+    outb(ATA_CMD_IDENTIFY, ch->io + ATA_REG_COMMAND);
+    status = inb(ch->io + ATA_REG_STATUS);
+    if (0 == status || 0xFF == status)      // no drive, or floating bus
+        return 0;
+    if (-1 == ata_wait_idle(ch))
+        return 0;
+    // ATAPI and SATA devices put their signature here
+    if (inb(ch->io + ATA_REG_LBA1) || inb(ch->io + ATA_REG_LBA2))
+        return 0;
+    if (-1 == ata_wait_drq(ch))
+        return 0;
+    for (i = 0; i < ATA_SECTOR_SIZE / 2; i++)
+        id[i] = inw(ch->io + ATA_REG_DATA);
+    return id[ATA_IDENTIFY_LBA28] | (id[ATA_IDENTIFY_LBA28 + 1] << 16);
+}
+
+/* any IDE controller, the legacy channels are driven whatever it is */
+static const pci_id_t ata_pci_ids[] = {
+    {PCI_ANY_ID, PCI_ANY_ID, PCI_CLASS_STORAGE, PCI_SUBCLASS_IDE},
+    {0, 0, 0, 0}
+};
+
+/**
+ * @brief probe of the IDE controller, enables bus master DMA if it has it
+ * @return SUCCESS if the channels use DMA
+ */
+static int32_t ata_pci_probe(pci_func_t* dev)
+{
+    // bit 7 of prog_if: the controller can do bus master DMA, its registers are in BAR4
+    if (0 != channels[0].bmide || !(dev->header.prog_if & 0x80) || !dev->bar[4].is_io || 0 == dev->bar[4].base)
+        return FAIL;
+    channels[0].bmide = dev->bar[4].base;
+    channels[1].bmide = dev->bar[4].base + 8;
+    pci_enable(dev, PCI_COMMAND_IO | PCI_COMMAND_BUS_MASTER);
+    return SUCCESS;
+}
+
+static pci_driver_t ata_pci_driver = {"ata", ata_pci_ids, ata_pci_probe};
+
+/**
+ * @brief find the disks of both channels, enable bus master DMA if the IDE controller has it
+ */
+void ata_init(void)
+{
+    uint32_t sectors;
+    int32_t c, slave, found;
+    ata_channel_t* ch;
+
+    pci_register_driver(&ata_pci_driver);
+
+    for (c = 0; c < 2; c++) {
+        ch = &channels[c];
+        outb(ATA_CTRL_NIEN, ch->ctrl);
+        found = 0;
+        for (slave = 0; slave < 2; slave++) {
+            if (0 == (sectors = ata_identify(ch, slave)) || sectors < BLK_SECTORS)
+                continue;
+            drives[dev_count].ch = ch;
+            drives[dev_count].slave = slave;
+            devs[dev_count].name = ata_names[2 * c + slave];
+            devs[dev_count].blk_count = sectors / BLK_SECTORS;
+            devs[dev_count].priv = &drives[dev_count];
+            devs[dev_count].submit = ata_submit;
+            devs[dev_count].poll = ata_poll;
+            printf("ATA %s: %d blocks, %s\n", ata_names[2 * c + slave], sectors / BLK_SECTORS, ch->bmide ? "DMA" : "PIO");
+            dev_count++;
+            found = 1;
+        }
+        // PIO is polled, only DMA uses the interrupt
+        if (found && ch->bmide) {
+            outb(0, ch->ctrl);
+            enable_irq(ch->irq);
+        }
+    }
+}
+
+/**
+ * @brief get a disk found by ata_init
+ * @param i - index in the order of probing: primary master, primary slave, secondary master, secondary slave
+ * @return the block device, NULL if there are not that many disks
+ */
+blk_dev_t* ata_get_dev(int32_t i)
+{
+    if (i < 0 || i >= dev_count)
+        return NULL;
+    return &devs[i];
+}
@@ -0,0 +1,93 @@
+/**
+ * @file ata.h
+ * @brief IDE/ATA disks on the two legacy channels. Transfers use bus master DMA
+ *        with completion on the channel interrupt when the PCI IDE controller
+ *        supports it, polled PIO otherwise.
+ * @version 0.1
+ * @date 2022-05-27
+ * @ref https://wiki.osdev.org/ATA_PIO_Mode
+ *      https://wiki.osdev.org/ATA/ATAPI_using_DMA
+ */
+
+#ifndef _ATA_H
+#define _ATA_H
+
+#include "../types.h"
+#include "../lib.h"
+#include "bcache.h"
+
+#define ATA_PRIMARY_IO          0x1F0
+#define ATA_PRIMARY_CTRL        0x3F6
+#define ATA_SECONDARY_IO        0x170
+#define ATA_SECONDARY_CTRL      0x376
+#define ATA_PRIMARY_IRQ         14
+#define ATA_SECONDARY_IRQ       15
+
+/* task file registers, offsets from the io base */
+#define ATA_REG_DATA            0
+#define ATA_REG_ERROR           1
+#define ATA_REG_SECCOUNT        2
+#define ATA_REG_LBA0            3
+#define ATA_REG_LBA1            4
+#define ATA_REG_LBA2            5
+#define ATA_REG_DRIVE           6
+#define ATA_REG_STATUS          7
+#define ATA_REG_COMMAND         7
+
+#define ATA_SR_BSY              0x80
+#define ATA_SR_DF               0x20
+#define ATA_SR_DRQ              0x08
+#define ATA_SR_ERR              0x01
+#define ATA_CTRL_NIEN           0x02    // device control: no interrupts
+
+#define ATA_CMD_READ_PIO        0x20
+#define ATA_CMD_WRITE_PIO       0x30
+#define ATA_CMD_READ_DMA        0xC8
+#define ATA_CMD_WRITE_DMA       0xCA
+#define ATA_CMD_FLUSH           0xE7
+#define ATA_CMD_IDENTIFY        0xEC
+
+/* bus master registers, offsets from BAR4 (+8 for the secondary channel) */
+#define ATA_BM_COMMAND          0
+#define ATA_BM_STATUS           2
+#define ATA_BM_PRDT             4
+#define ATA_BM_CMD_START        0x01
+#define ATA_BM_CMD_READ         0x08    // the controller writes to memory
+#define ATA_BM_SR_ERR           0x02
+#define ATA_BM_SR_IRQ           0x04
+#define ATA_PRD_EOT             0x8000
+
+#define ATA_SECTOR_SIZE         512
+#define ATA_IDENTIFY_LBA28      60      // word index of the 28 bit sector count
+#define ATA_DRIVE_MAX           4
+#define ATA_TIMEOUT             0x100000
+
+/* physical region descriptor, one block per request so one entry */
+typedef struct ata_prd
+{
+    uint32_t    addr;
+    uint16_t    count;
+    uint16_t    flags;
+} __attribute__((packed)) ata_prd_t;
+
+typedef struct ata_channel
+{
+    uint16_t    io;
+    uint16_t    ctrl;
+    uint16_t    bmide;          // 0 without bus master DMA
+    uint32_t    irq;
+    blk_req_t*  head;           // in flight
+    blk_req_t*  tail;
+    ata_prd_t   prd __attribute__((aligned(8)));
+} ata_channel_t;
+
+/* probe the drives, after pci_init and i8259_init */
+void ata_init(void);
+/* the i-th disk found, NULL if there is none */
+blk_dev_t* ata_get_dev(int32_t i);
+
+/* interrupt handlers of the two channels */
+void ata_primary_handler(void);
+void ata_secondary_handler(void);
+
+#endif /* _ATA_H */
@@ -0,0 +1,303 @@
+/**
+ * @file bcache.c
+ * @brief Buffer cache with LRU replacement and write back, over one block device.
+ *        Callers hold the file system lock, so the cache itself is not locked; it
+ *        runs with interrupts disabled except while sleeping in blk_wait.
+ * @version 0.1
+ * @date 2022-05-27
+ */
+
+#include "bcache.h"
+#include "../kernel/schedule.h"
+
+int32_t blk_sleep_ok = 0;
+
+/* processes waiting for any request of any device */
+static wait_queue_t blk_wq;
+
+static blk_dev_t* cache_dev = NULL;
+static buf_t bufs[BCACHE_BUF_MAX];
+static int32_t buf_count = 0;
+static buf_t* hash_table[BCACHE_HASH_SIZE];
+static buf_t* lru_head = NULL;
+static buf_t* lru_tail = NULL;
+static bcache_stats_t stats;
+
+/**
+ * @brief called by a device driver when a request finishes, usually from its interrupt handler
+ * @param req - the request
+ * @param status - 1 success, -1 error
+ */
+void blk_complete(blk_req_t* req, int32_t status)
+{
+    req->done = status;
+    wake_up(&blk_wq);
+}
+
+/**
+ * @brief wait for a request to finish, called with interrupts disabled
+ * @param dev - device the request was submitted to
+ * @param req - the request
+ * @return 1 success, -1 error
+ */
+int32_t blk_wait(blk_dev_t* dev, blk_req_t* req)
+{
+    while (0 == req->done) {
+        if (blk_sleep_ok)
+            sleep_on(&blk_wq);
+        else
+            dev->poll(dev);
+    }
+    return req->done;
+}
+
+/**
+ * @brief read or write one block synchronously, without the cache
+ * @return 1 success, -1 error
+ */
+int32_t blk_rw(blk_dev_t* dev, uint32_t blk, uint8_t* buf, int32_t write)
+{
+    blk_req_t req;
+    req.blk = blk;
+    req.buf = buf;
+    req.write = write;
+    req.done = 0;
+    req.next = NULL;
+    if (blk >= dev->blk_count || -1 == dev->submit(dev, &req))
+        return -1;
+    return blk_wait(dev, &req);
+}
+
+/* move a buffer to the most recently used end */
+static void lru_touch(buf_t* b)
+{
+    if (lru_head == b)
+        return;
+    // unlink
+    b->lru_prev->lru_next = b->lru_next;
+    if (b->lru_next) b->lru_next->lru_prev = b->lru_prev;
+    else lru_tail = b->lru_prev;
+    // put at the head
+    b->lru_prev = NULL;
+    b->lru_next = lru_head;
+    lru_head->lru_prev = b;
+    lru_head = b;
+}
+
+static void hash_remove(buf_t* b)
+{
+    buf_t** p = &hash_table[b->blk % BCACHE_HASH_SIZE];
+    while (*p && *p != b)
+        p = &(*p)->hash_next;
+    if (*p) *p = b->hash_next;
+}
+
+static buf_t* hash_find(uint32_t blk)
+{
+    buf_t* b = hash_table[blk % BCACHE_HASH_SIZE];
+    while (b && b->blk != blk)
+        b = b->hash_next;
+    return b;
+}
+
+/* start a read or write of a buffer */
+static void buf_start(buf_t* b, int32_t write)
+{
+    b->req.blk = b->blk;
+    b->req.buf = b->data;
+    b->req.write = write;
+    b->req.done = 0;
+    b->req.next = NULL;
+    if (b->blk >= cache_dev->blk_count || -1 == cache_dev->submit(cache_dev, &b->req))
+        b->req.done = -1;
+}
+
+/**
+ * @brief take the least recently used idle buffer for blk, writing it back first if dirty
+ * @return the buffer with refcnt 0 and no valid data, NULL if every buffer is in use
+ */
+static buf_t* buf_claim(uint32_t blk)
+{
+    buf_t* b;
+    for (b = lru_tail; b; b = b->lru_prev) {
+        if (0 != b->refcnt || 0 == b->req.done)
+            continue;
+        if (b->dirty) {
+            buf_start(b, 1);
+            if (1 != blk_wait(cache_dev, &b->req))
+                continue;   // keep it dirty, try another one
+            b->dirty = 0;
+            stats.writebacks++;
+        }
+        if (b->valid)
+            stats.evictions++;
+        hash_remove(b);
+        b->blk = blk;
+        b->valid = 0;
+        b->req.write = 1;   // no read started for the new block
+        b->hash_next = hash_table[blk % BCACHE_HASH_SIZE];
+        hash_table[blk % BCACHE_HASH_SIZE] = b;
+        return b;
+    }
+    return NULL;
+}
+
+/**
+ * @brief set the device and the memory of the cache
+ * @param dev - block device
+ * @param area - count * BLK_SIZE bytes for the buffers
+ * @param count - number of buffers, at most BCACHE_BUF_MAX
+ */
+void bcache_init(blk_dev_t* dev, uint8_t* area, int32_t count)
+{
+    int32_t i;
+    if (count > BCACHE_BUF_MAX) count = BCACHE_BUF_MAX;
+    cache_dev = dev;
+    buf_count = count;
+    memset(&stats, 0, sizeof(stats));
+    for (i = 0; i < BCACHE_HASH_SIZE; i++)
+        hash_table[i] = NULL;
+    lru_head = lru_tail = NULL;
+    for (i = count - 1; i >= 0; i--) {
+        bufs[i].blk = (uint32_t)-1;
+        bufs[i].valid = 0;
+        bufs[i].dirty = 0;
+        bufs[i].refcnt = 0;
+        bufs[i].req.done = 1;
+        bufs[i].data = area + BLK_SIZE * i;
+        bufs[i].hash_next = NULL;
+        // every buffer starts at the head, so buffer 0 is used first
+        bufs[i].lru_prev = NULL;
+        bufs[i].lru_next = lru_head;
+        if (lru_head) lru_head->lru_prev = &bufs[i];
+        else lru_tail = &bufs[i];
+        lru_head = &bufs[i];
+    }
+}
+
+/**
+ * @brief get a cached block, reading it if needed
+ * @param blk - block of the device
+ * @return the buffer, to be given back with brelse; NULL on error
+ */
+buf_t* bread(uint32_t blk)
+{
+    buf_t* b = hash_find(blk);
+    if (NULL != b)
+        stats.hits++;
+    else if (NULL == (b = buf_claim(blk)))
+        return NULL;
+    else
+        stats.misses++;
+    b->refcnt++;
+    lru_touch(b);
+
+    // a write back or a prefetch may be in flight
+    if (0 == b->req.done)
+        blk_wait(cache_dev, &b->req);
+    if (!b->valid && !b->req.write && 1 == b->req.done)
+        b->valid = 1;       // prefetched
+    if (!b->valid) {
+        buf_start(b, 0);
+        if (1 != blk_wait(cache_dev, &b->req)) {
+            b->refcnt--;
+            return NULL;
+        }
+        b->valid = 1;
+    }
+    return b;
+}
+
+/**
+ * @brief get a block that the caller overwrites completely, it is not read
+ * @param blk - block of the device
+ * @return the buffer, to be given back with brelse; NULL if the cache is full
+ */
+buf_t* bget(uint32_t blk)
+{
+    buf_t* b = hash_find(blk);
+    if (NULL == b && NULL == (b = buf_claim(blk)))
+        return NULL;
+    b->refcnt++;
+    lru_touch(b);
+    if (0 == b->req.done)
+        blk_wait(cache_dev, &b->req);
+    b->valid = 1;
+    return b;
+}
+
+/**
+ * @brief start reading a block, a later bread finds it cached or in flight
+ * @param blk - block of the device
+ */
+void bprefetch(uint32_t blk)
+{
+    buf_t* b;
+    if (blk >= cache_dev->blk_count || NULL != hash_find(blk) || NULL == (b = buf_claim(blk)))
+        return;
+    lru_touch(b);
+    buf_start(b, 0);
+    stats.prefetches++;
+}
+
+/**
+ * @brief mark a buffer modified
+ */
+void bdirty(buf_t* b)
+{
+    b->dirty = 1;
+    b->valid = 1;
+}
+
+/**
+ * @brief give a buffer back to the cache
+ */
+void brelse(buf_t* b)
+{
+    if (b->refcnt > 0)
+        b->refcnt--;
+}
+
+/**
+ * @brief write back all dirty buffers
+ * @return 0 success, -1 if some write failed (those buffers stay dirty)
+ */
+int32_t bsync(void)
+{
+    int32_t i, retval = 0;
+    if (NULL == cache_dev)
+        return 0;
+    // queue them all first, so that the device has them in flight together
+    for (i = 0; i < buf_count; i++) {
+        if (bufs[i].dirty && 0 != bufs[i].req.done)
+            buf_start(&bufs[i], 1);
+    }
+    for (i = 0; i < buf_count; i++) {
+        if (!bufs[i].dirty)
+            continue;
+        if (1 == blk_wait(cache_dev, &bufs[i].req)) {
+            bufs[i].dirty = 0;
+            stats.writebacks++;
+        } else
+            retval = -1;
+    }
+    return retval;
+}
+
+/**
+ * @brief counters of the cache and how many buffers hold data
+ * @param out - filled in
+ * @return 1 if there is a cache, 0 for the file system in memory
+ */
+int32_t bcache_get_stats(bcache_stats_t* out)
+{
+    int32_t i;
+    *out = stats;
+    out->buffers = buf_count;
+    out->valid = out->dirty = 0;
+    for (i = 0; i < buf_count; i++) {
+        out->valid += (0 != bufs[i].valid);
+        out->dirty += (0 != bufs[i].dirty);
+    }
+    return NULL != cache_dev;
+}
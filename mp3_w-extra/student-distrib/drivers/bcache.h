@@ -0,0 +1,101 @@
+/**
+ * @file bcache.h
+ * @brief Block devices and the buffer cache above them. A device takes requests
+ *        for 4KB blocks, completes them later (from its interrupt handler or from
+ *        poll) and calls blk_complete. The cache keeps recently used blocks in
+ *        LRU order and writes modified ones back when they are evicted or synced.
+ * @version 0.1
+ * @date 2022-05-27
+ */
+
+#ifndef _BCACHE_H
+#define _BCACHE_H
+
+#include "../types.h"
+#include "../lib.h"
+
+#define BLK_SIZE            0x1000      // block of a device and of the cache, same as the file system
+#define BLK_SECTORS         8           // 512 byte sectors in a block
+#define BCACHE_BUF_MAX      1024        // buffer headers, the buffers live in memory given to bcache_init
+#define BCACHE_HASH_SIZE    256
+
+/* a request for one block, buf is a kernel address (identity mapped, so also physical) */
+typedef struct blk_req
+{
+    uint32_t            blk;
+    uint8_t*            buf;
+    int32_t             write;
+    volatile int32_t    done;       // 0 while in flight, 1 success, -1 error
+    struct blk_req*     next;       // queue of the device
+    void*               priv;       // set by the driver on submit
+} blk_req_t;
+
+typedef struct blk_dev
+{
+    const int8_t*   name;
+    uint32_t        blk_count;
+    void*           priv;
+    /* queue a request, -1 if it cannot be queued */
+    int32_t         (*submit)(struct blk_dev* dev, blk_req_t* req);
+    /* complete requests without interrupts, used when the caller cannot sleep */
+    void            (*poll)(struct blk_dev* dev);
+} blk_dev_t;
+
+typedef struct buf
+{
+    uint32_t        blk;
+    int32_t         valid;          // data holds the block
+    int32_t         dirty;          // data is newer than the device
+    int32_t         refcnt;
+    blk_req_t       req;            // the read or write in flight, req.done is 0 while busy
+    uint8_t*        data;
+    struct buf*     hash_next;
+    struct buf*     lru_prev;       // most recently used at the head
+    struct buf*     lru_next;
+} buf_t;
+
+/* counters since bcache_init, and the state of the buffers now */
+typedef struct bcache_stats
+{
+    uint32_t        hits;           // bread found the block cached or in flight
+    uint32_t        misses;         // bread had to read it
+    uint32_t        prefetches;
+    uint32_t        evictions;      // a valid block dropped for another one
+    uint32_t        writebacks;     // dirty blocks written to the device
+    uint32_t        buffers;
+    uint32_t        valid;
+    uint32_t        dirty;
+} bcache_stats_t;
+
+/*
+ * Set by the holder of the file system lock: 1 if waiting for a device may sleep,
+ * i.e. the caller is a process that entered the kernel with interrupts enabled.
+ * Otherwise (boot, interrupt handlers) requests are polled.
+ */
+extern int32_t blk_sleep_ok;
+
+/* called by a device when a request finishes, status is 1 or -1 */
+void blk_complete(blk_req_t* req, int32_t status);
+/* wait for a request, sleeping or polling */
+int32_t blk_wait(blk_dev_t* dev, blk_req_t* req);
+/* read or write one block and wait for it, bypassing the cache */
+int32_t blk_rw(blk_dev_t* dev, uint32_t blk, uint8_t* buf, int32_t write);
+
+/* use count buffers of BLK_SIZE at area for dev, drops whatever was cached before */
+void bcache_init(blk_dev_t* dev, uint8_t* area, int32_t count);
+/* get a block, read from the device unless cached */
+buf_t* bread(uint32_t blk);
+/* get a block whose old content does not matter, it is going to be overwritten */
+buf_t* bget(uint32_t blk);
+/* start reading a block into the cache without waiting for it */
+void bprefetch(uint32_t blk);
+/* the buffer was modified, it is written back later */
+void bdirty(buf_t* b);
+/* done with a buffer */
+void brelse(buf_t* b);
+/* write every dirty buffer back, all writes are in flight together */
+int32_t bsync(void);
+/* copy the counters, 0 if there is no cache (the file system is in memory) */
+int32_t bcache_get_stats(bcache_stats_t* stats);
+
+#endif /* _BCACHE_H */
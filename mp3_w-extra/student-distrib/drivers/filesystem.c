@@ -6,6 +6,625 @@
  */
 
 #include "filesystem.h"
+#include "../kernel/paging.h"
+#include "../kernel/schedule.h"
+#include "../kernel/trace.h"
+
+#define BITS_PER_WORD 32
+#define EFLAGS_IF 0x200
+#define fs_data_blk_max (FS_PHY_SIZE / blk_size - 1 - fs_inode_max)
+#define fs_disk_blk_max 0x10000     // data blocks of a disk file system, 256MB
+#define fs_readahead 32             // blocks of a disk read kept in flight together
+#define inode_at(inode) ((inode_t *)(boot_blk_ptr + 1 + (inode))) // +1 to jump over the boot block
+#define data_blk_at(blk) ((uint8_t *)(boot_blk_ptr + 1 + boot_blk_ptr->inode_count + (blk)))
+/*
+ * A disk file system keeps its boot block, inodes and directory blocks in the file system
+ * area (at the same places as a mounted module, the directory blocks after fs_inode_max
+ * inodes), the data blocks are read and written through the buffer cache after them
+ */
+#define disk_dir_buf ((uint8_t *)FS_PHY_BEGIN + blk_size * (1 + fs_inode_max))
+#define disk_cache_area (disk_dir_buf + blk_size * dir_blk_max)
+#define disk_blk(blk) (1 + boot_blk_ptr->inode_count + (blk)) // device block of a data block
+#define dir_blk_at(i) (NULL == fs_dev ? data_blk_at(boot_blk_ptr->dir_blk_index[i]) : disk_dir_buf + blk_size * (i))
+/* data that can be used in place, NULL on a disk */
+#define data_ptr(addr) (NULL == fs_dev ? data_blk_at(0) + (addr) : NULL)
+#define stored_length(inode_ptr) (IS_LZ4_INODE(inode_ptr) ? (inode_ptr)->ext.stored_length : (inode_ptr)->length)
+#define map_test(map, i) ((map)[(i) / BITS_PER_WORD] & (0x1 << ((i) % BITS_PER_WORD)))
+#define map_set(map, i) ((map)[(i) / BITS_PER_WORD] |= (0x1 << ((i) % BITS_PER_WORD)))
+#define map_clear(map, i) ((map)[(i) / BITS_PER_WORD] &= ~(0x1 << ((i) % BITS_PER_WORD)))
+
+/* allocation bitmaps built at mount, 1 for used */
+static uint32_t inode_map[fs_inode_max / BITS_PER_WORD];
+static uint32_t data_blk_map[fs_disk_blk_max / BITS_PER_WORD];
+/* number of open fds per inode, an open file cannot be unlinked */
+static int32_t inode_open_count[fs_inode_max];
+/* where the next block search starts when there is no better goal */
+static uint32_t data_blk_hint = 0;
+/* scratch space to build the extents of an inode at mount */
+static extent_t extent_buf[extent_count_max];
+/* last chunk of a compressed file that was read partially, and where it came from */
+static uint8_t lz4_cache[lz4_chunk_size];
+static int32_t lz4_cached_inode = -1;
+static uint32_t lz4_cached_chunk;
+/* compressed chunk gathered from separate extents */
+static uint8_t lz4_src[lz4_chunk_size];
+/* 0 if the image did not fit in the file system area and is used in place (read only) */
+static int32_t fs_writable = 0;
+/* the disk the file system is on, NULL for the module in memory */
+static blk_dev_t *fs_dev = NULL;
+/* metadata changed since the last fs_sync, 1 bit per inode, and the boot and directory blocks */
+static uint32_t inode_dirty_map[fs_inode_max / BITS_PER_WORD];
+static int32_t meta_dirty = 0;
+/* boot block of a disk, checked before anything is replaced; a bus master reads it
+   with one PRD, which must not cross a 64KB boundary */
+static uint8_t disk_boot[blk_size] __attribute__((aligned(blk_size)));
+/* held while a process uses the file system, it may sleep waiting for the disk */
+static int32_t fs_busy = 0;
+static wait_queue_t fs_wq;
+
+/**
+ * brief: take the file system lock
+ * input: flags -- filled with the saved flags, interrupts are disabled until fs_unlock
+ * return: -1 -- the lock is held and the caller cannot sleep (boot or an interrupt handler)
+ *          0 -- success
+ * side effect: the disk is waited for by sleeping only if the caller had interrupts enabled
+ */
+static int32_t fs_lock(uint32_t *flags)
+{
+    uint32_t saved;
+    cli_and_save(saved);
+    *flags = saved;
+    while (fs_busy)
+    {
+        if (!(saved & EFLAGS_IF))
+        {
+            restore_flags(saved);
+            return -1;
+        }
+        sleep_on(&fs_wq);
+    }
+    fs_busy = 1;
+    blk_sleep_ok = (saved & EFLAGS_IF) ? 1 : 0;
+    return 0;
+}
+
+/**
+ * brief: release the file system lock
+ * input: flags -- from fs_lock
+ * return: none
+ */
+static void fs_unlock(uint32_t flags)
+{
+    fs_busy = 0;
+    wake_up(&fs_wq);
+    restore_flags(flags);
+}
+
+/**
+ * brief: copy between a buffer and the data area, through the buffer cache on a disk
+ * input: addr -- byte address in the data area, from inode_run
+ *        buf -- source or destination, NULL to write zeros
+ *        len -- bytes to copy
+ *        write -- 1 to copy buf into the data area
+ * return: -1 -- device error
+ *          0 -- success
+ * side effect: a read keeps the next fs_readahead blocks in flight
+ */
+static int32_t data_copy(uint32_t addr, uint8_t *buf, uint32_t len, int32_t write)
+{
+    uint32_t blk, end, off, cp_length;
+    buf_t *b;
+
+    if (NULL == fs_dev)
+    {
+        if (!write) memcpy(buf, data_blk_at(0) + addr, len);
+        else if (NULL != buf) memcpy(data_blk_at(0) + addr, buf, len);
+        else memset(data_blk_at(0) + addr, 0, len);
+        return 0;
+    }
+
+    end = (addr + len + blk_size - 1) / blk_size;
+    for (blk = addr / blk_size; !write && blk < end && blk < addr / blk_size + fs_readahead; blk++)
+        bprefetch(disk_blk(blk));
+    while (len > 0)
+    {
+        blk = addr / blk_size;
+        off = addr % blk_size;
+        cp_length = (len > blk_size - off) ? blk_size - off : len;
+        // a block that is overwritten completely is not read first
+        b = (write && blk_size == cp_length) ? bget(disk_blk(blk)) : bread(disk_blk(blk));
+        if (NULL == b)
+            return -1;
+        if (!write)
+        {
+            memcpy(buf, b->data + off, cp_length);
+            if (blk + fs_readahead < end)
+                bprefetch(disk_blk(blk + fs_readahead));
+        }
+        else
+        {
+            if (NULL != buf) memcpy(b->data + off, buf, cp_length);
+            else memset(b->data + off, 0, cp_length);
+            bdirty(b);
+        }
+        brelse(b);
+        addr += cp_length;
+        len -= cp_length;
+        if (NULL != buf) buf += cp_length;
+    }
+    return 0;
+}
+
+/**
+ * brief: write a block of metadata through the cache
+ * input: blk -- device block
+ *        src -- the block
+ * return: -1 -- the cache is full
+ *          0 -- success
+ */
+static int32_t meta_write(uint32_t blk, void *src)
+{
+    buf_t *b = bget(blk);
+    if (NULL == b)
+        return -1;
+    memcpy(b->data, src, blk_size);
+    bdirty(b);
+    brelse(b);
+    return 0;
+}
+
+/**
+ * brief: write the changed metadata and every dirty data block to the disk
+ * return: -1 -- device error
+ *          0 -- success, or the file system is in memory
+ * side effect: called with the file system lock held
+ */
+static int32_t fs_sync(void)
+{
+    int32_t i, retval = 0;
+    if (NULL == fs_dev)
+        return 0;
+    if (meta_dirty)
+    {
+        retval |= meta_write(0, boot_blk_ptr);
+        for (i = 0; i < boot_blk_ptr->dir_blk_count; i++)
+            retval |= meta_write(disk_blk(boot_blk_ptr->dir_blk_index[i]), disk_dir_buf + blk_size * i);
+        meta_dirty = 0;
+    }
+    for (i = 0; i < boot_blk_ptr->inode_count; i++)
+    {
+        if (!map_test(inode_dirty_map, i))
+            continue;
+        retval |= meta_write(1 + i, inode_at(i));
+        map_clear(inode_dirty_map, i);
+    }
+    return (0 != retval || -1 == bsync()) ? -1 : 0;
+}
+
+/**
+ * brief: get the dentry of the given index, in the boot block or in a directory block
+ * input: index -- must be smaller than dir_count
+ * return: pointer to the dentry inside the file system
+ */
+static dentry_t *dentry_at(uint32_t index)
+{
+    if (index < dentry_count_max)
+        return boot_blk_ptr->dentries + index;
+    index -= dentry_count_max;
+    return (dentry_t *)dir_blk_at(index / dentry_per_blk) + index % dentry_per_blk;
+}
+
+/**
+ * brief: locate the data at an offset of a file
+ * input: inode_ptr -- the inode
+ *        offset -- offset in the file, smaller than its length
+ *        run -- filled with the number of contiguous bytes from there, to the end of the
+ *               extent (or of the run of consecutive block indices in the original format)
+ * return: -1 -- bad block index
+ *         byte address of the data in the data area otherwise
+ */
+static int32_t inode_run(inode_t *inode_ptr, uint32_t offset, uint32_t *run)
+{
+    int32_t i, first, blk, blk_num;
+    uint32_t ext_len;
+
+    if (IS_EXTENT_INODE(inode_ptr))
+    {
+        for (i = 0; i < inode_ptr->ext.extent_count && i < extent_count_max; i++)
+        {
+            ext_len = inode_ptr->ext.extents[i].blk_count * blk_size;
+            if (offset >= ext_len)
+            {
+                offset -= ext_len;
+                continue;
+            }
+            if (inode_ptr->ext.extents[i].start < 0 ||
+                inode_ptr->ext.extents[i].start + inode_ptr->ext.extents[i].blk_count > boot_blk_ptr->data_blk_count)
+                return -1;
+            *run = ext_len - offset;
+            return inode_ptr->ext.extents[i].start * blk_size + offset;
+        }
+        return -1;
+    }
+
+    blk = offset / blk_size;
+    blk_num = (inode_ptr->length + blk_size - 1) / blk_size;
+    if (blk_num > data_blk_count_max) blk_num = data_blk_count_max;
+    if (blk >= blk_num) return -1;
+    first = inode_ptr->data_blk_index[blk];
+    for (i = blk + 1; i < blk_num && inode_ptr->data_blk_index[i] == first + (i - blk); i++);
+    if (first < 0 || first + (i - blk) > boot_blk_ptr->data_blk_count)
+        return -1;
+    *run = (i - blk) * blk_size - offset % blk_size;
+    return first * blk_size + offset % blk_size;
+}
+
+/**
+ * brief: rewrite an inode of the original format as extents,
+ *        it is left unchanged if it has more than extent_count_max runs
+ * input: inode_ptr -- the inode
+ * return: none
+ */
+static void inode_to_extents(inode_t *inode_ptr)
+{
+    int32_t i, count = 0;
+    int32_t blk_num = (inode_ptr->length + blk_size - 1) / blk_size;
+
+    if (IS_EXTENT_INODE(inode_ptr))
+        return;
+    if (blk_num > data_blk_count_max) blk_num = data_blk_count_max;
+    for (i = 0; i < blk_num; i++)
+    {
+        if (count > 0 && extent_buf[count - 1].start + extent_buf[count - 1].blk_count == inode_ptr->data_blk_index[i])
+        {
+            extent_buf[count - 1].blk_count++;
+            continue;
+        }
+        if (extent_count_max == count)
+            return;
+        extent_buf[count].start = inode_ptr->data_blk_index[i];
+        extent_buf[count].blk_count = 1;
+        count++;
+    }
+    inode_ptr->ext.magic = extent_magic;
+    inode_ptr->ext.extent_count = count;
+    memcpy(inode_ptr->ext.extents, extent_buf, count * sizeof(extent_t));
+}
+
+/**
+ * brief: drop directory blocks and dentries a boot block cannot have
+ * input: boot -- the boot block
+ *        image_blks -- data blocks of the image
+ * return: none
+ */
+static void boot_blk_check(boot_blk_t *boot, int32_t image_blks)
+{
+    int32_t i;
+
+    /* images of the original format have no directory blocks */
+    if (boot->dir_blk_count < 0 || boot->dir_blk_count > dir_blk_max)
+        boot->dir_blk_count = 0;
+    for (i = 0; i < boot->dir_blk_count; i++)
+    {
+        if (boot->dir_blk_index[i] < 0 || boot->dir_blk_index[i] >= image_blks)
+            boot->dir_blk_count = i;
+    }
+    if (boot->dir_count > dentry_count_max + dentry_per_blk * boot->dir_blk_count)
+        boot->dir_count = dentry_count_max + dentry_per_blk * boot->dir_blk_count;
+}
+
+/**
+ * brief: build the inode and data block bitmaps from the directory of the mounted file system
+ * input: image_inodes -- inodes of the image, dentries pointing past them are ignored
+ *        image_blks -- data blocks of the image, the ones after it are free
+ * return: none
+ * side effect: inodes of the original format are rewritten as extents
+ */
+static void fs_build_maps(int32_t image_inodes, int32_t image_blks)
+{
+    int32_t i, j, blk, addr;
+    uint32_t offset, run;
+    dentry_t *dentry;
+    inode_t *inode_ptr;
+
+    memset(inode_map, 0, sizeof(inode_map));
+    memset(data_blk_map, 0, sizeof(data_blk_map));
+    /* inode 0 is used by the rtc and directory dentries */
+    map_set(inode_map, 0);
+    for (i = 0; i < boot_blk_ptr->dir_blk_count; i++)
+        map_set(data_blk_map, boot_blk_ptr->dir_blk_index[i]);
+    for (i = 0; i < boot_blk_ptr->dir_count; i++)
+    {
+        dentry = dentry_at(i);
+        if (REG_TYPE != dentry->filetype || dentry->inode_num < 0 || dentry->inode_num >= image_inodes)
+            continue;
+        map_set(inode_map, dentry->inode_num);
+        inode_ptr = inode_at(dentry->inode_num);
+        if (!IS_EXTENT_INODE(inode_ptr))
+        {
+            inode_to_extents(inode_ptr);
+            map_set(inode_dirty_map, dentry->inode_num);
+        }
+        for (offset = 0; offset < stored_length(inode_ptr); offset += run)
+        {
+            if (-1 == (addr = inode_run(inode_ptr, offset, &run)))
+                break;
+            blk = addr / blk_size;
+            for (j = 0; j < (run + blk_size - 1) / blk_size; j++)
+                map_set(data_blk_map, blk + j);
+        }
+    }
+    data_blk_hint = image_blks;
+    fs_writable = 1;
+}
+
+/**
+ * brief: copy the file system module into the file system area, leaving room for
+ *        fs_inode_max inodes and filling the rest of the area with free data blocks,
+ *        then build the inode and data block bitmaps from the directory
+ * input: image -- the file system module
+ * output: boot_blk_ptr points to the mounted file system
+ * return: none
+ * side effect: called before paging is enabled, the area is accessed physically
+ */
+void fs_mount(boot_blk_t *image)
+{
+    /* does not fit, keep the module read only */
+    if (image->inode_count > fs_inode_max || image->data_blk_count > fs_data_blk_max)
+    {
+        boot_blk_ptr = image;
+        return;
+    }
+
+    /* data block indices are relative to the first data block, so they stay valid */
+    boot_blk_ptr = (boot_blk_t *)FS_PHY_BEGIN;
+    memcpy(boot_blk_ptr, image, blk_size * (1 + image->inode_count));
+    memset(boot_blk_ptr + 1 + image->inode_count, 0, blk_size * (fs_inode_max - image->inode_count));
+    memcpy(boot_blk_ptr + 1 + fs_inode_max, image + 1 + image->inode_count, blk_size * image->data_blk_count);
+    boot_blk_ptr->inode_count = fs_inode_max;
+    boot_blk_ptr->data_blk_count = fs_data_blk_max;
+    boot_blk_check(boot_blk_ptr, image->data_blk_count);
+    fs_build_maps(image->inode_count, image->data_blk_count);
+}
+
+/**
+ * brief: mount the file system of a disk in place of the module. The boot block, inodes
+ *        and directory blocks are read into the file system area, the rest of the area
+ *        becomes the buffer cache for the data blocks. The data area grows to the end of
+ *        the device, so an image padded with zeros has that much free space.
+ * input: dev -- block device holding an image made by fsbuild (or fsconvert)
+ * return: -1 -- no file system on the device, or a read error
+ *          0 -- success
+ * side effect: called at boot before any file is open. The module stays mounted if the boot
+ *              block is not a file system; a read error after that leaves no file system.
+ */
+int32_t fs_mount_disk(blk_dev_t *dev)
+{
+    boot_blk_t *boot = (boot_blk_t *)disk_boot;
+    int32_t i, image_blks;
+    buf_t *b;
+
+    // nothing else identifies an image, so check what fsimg_check does and that "." comes first
+    if (1 != blk_rw(dev, 0, disk_boot, 0) || boot->inode_count <= 0 || boot->inode_count > fs_inode_max ||
+        boot->data_blk_count < 0 || boot->dir_count <= 0 ||
+        1 + boot->inode_count + boot->data_blk_count > dev->blk_count ||
+        DIR_TYPE != boot->dentries[0].filetype || 0 != strncmp(boot->dentries[0].filename, ".", filename_len_max))
+        return -1;
+    boot_blk_check(boot, boot->data_blk_count);
+    image_blks = boot->data_blk_count;
+
+    fs_dev = dev;
+    fs_writable = 0;
+    bcache_init(dev, disk_cache_area, ((uint8_t *)FS_PHY_BEGIN + FS_PHY_SIZE - disk_cache_area) / blk_size);
+    boot_blk_ptr = (boot_blk_t *)FS_PHY_BEGIN;
+    memcpy(boot_blk_ptr, disk_boot, blk_size);
+
+    // every read in flight before waiting for the first one
+    for (i = 0; i < boot_blk_ptr->inode_count; i++)
+        bprefetch(1 + i);
+    for (i = 0; i < boot_blk_ptr->dir_blk_count; i++)
+        bprefetch(disk_blk(boot_blk_ptr->dir_blk_index[i]));
+    for (i = 0; i < boot_blk_ptr->inode_count + boot_blk_ptr->dir_blk_count; i++)
+    {
+        if (i < boot_blk_ptr->inode_count)
+            b = bread(1 + i);
+        else
+            b = bread(disk_blk(boot_blk_ptr->dir_blk_index[i - boot_blk_ptr->inode_count]));
+        if (NULL == b)
+        {
+            printf("fs: read error on %s\n", dev->name);
+            boot_blk_ptr->dir_count = 0;
+            return -1;
+        }
+        if (i < boot_blk_ptr->inode_count)
+            memcpy(inode_at(i), b->data, blk_size);
+        else
+            memcpy(disk_dir_buf + blk_size * (i - boot_blk_ptr->inode_count), b->data, blk_size);
+        brelse(b);
+    }
+
+    memset(inode_dirty_map, 0, sizeof(inode_dirty_map));
+    boot_blk_ptr->data_blk_count = dev->blk_count - 1 - boot_blk_ptr->inode_count;
+    if (boot_blk_ptr->data_blk_count > fs_disk_blk_max)
+        boot_blk_ptr->data_blk_count = fs_disk_blk_max;
+    meta_dirty = (boot_blk_ptr->data_blk_count != image_blks);
+    fs_build_maps(boot_blk_ptr->inode_count, image_blks);
+    printf("fs: %s mounted, %d inodes, %d data blocks\n", dev->name, boot_blk_ptr->inode_count, boot_blk_ptr->data_blk_count);
+    return 0;
+}
+
+/**
+ * brief: find a free data block, starting from goal
+ * input: goal -- preferred block, e.g. the one right after the last extent of a file
+ * return: -1 -- no free block
+ *         block index otherwise
+ */
+static int32_t data_blk_alloc(uint32_t goal)
+{
+    uint32_t i, blk;
+    for (i = 0; i < boot_blk_ptr->data_blk_count; i++)
+    {
+        blk = (goal + i) % boot_blk_ptr->data_blk_count;
+        if (map_test(data_blk_map, blk))
+            continue;
+        map_set(data_blk_map, blk);
+        data_blk_hint = blk + 1;
+        return blk;
+    }
+    return -1;
+}
+
+/**
+ * brief: find a free inode, inode 0 is never given out
+ * return: -1 -- no free inode
+ *         inode index otherwise, with length 0
+ */
+static int32_t inode_alloc(void)
+{
+    int32_t i;
+    for (i = 1; i < boot_blk_ptr->inode_count; i++)
+    {
+        if (map_test(inode_map, i))
+            continue;
+        map_set(inode_map, i);
+        map_set(inode_dirty_map, i);
+        // new files always use extents
+        inode_at(i)->length = 0;
+        inode_at(i)->ext.magic = extent_magic;
+        inode_at(i)->ext.extent_count = 0;
+        return i;
+    }
+    return -1;
+}
+
+/**
+ * brief: free the last blocks of a file
+ * input: inode_ptr -- the inode
+ *        blk_old -- number of blocks the file has
+ *        blk_new -- number of blocks to keep
+ * return: none
+ */
+static void inode_blks_drop(inode_t *inode_ptr, int32_t blk_old, int32_t blk_new)
+{
+    int32_t i;
+    extent_t *last;
+
+    if (!IS_EXTENT_INODE(inode_ptr))
+    {
+        for (i = blk_new; i < blk_old; i++)
+            map_clear(data_blk_map, inode_ptr->data_blk_index[i]);
+        return;
+    }
+    for (i = blk_new; i < blk_old && inode_ptr->ext.extent_count > 0; i++)
+    {
+        last = &inode_ptr->ext.extents[inode_ptr->ext.extent_count - 1];
+        map_clear(data_blk_map, last->start + last->blk_count - 1);
+        if (0 == --last->blk_count)
+            inode_ptr->ext.extent_count--;
+    }
+}
+
+/**
+ * brief: give a file zero filled blocks at its end
+ * input: inode_ptr -- the inode
+ *        blk_old -- number of blocks the file has
+ *        blk_new -- number of blocks it needs
+ * return: -1 -- out of data blocks or extents, the file is left unchanged
+ *          0 -- success
+ */
+static int32_t inode_blks_add(inode_t *inode_ptr, int32_t blk_old, int32_t blk_new)
+{
+    int32_t i, blk, count;
+    extent_t *last;
+
+    for (i = blk_old; i < blk_new; i++)
+    {
+        if (!IS_EXTENT_INODE(inode_ptr))
+        {
+            if (i >= data_blk_count_max || -1 == (blk = data_blk_alloc(data_blk_hint)))
+                break;
+            inode_ptr->data_blk_index[i] = blk;
+        }
+        else
+        {
+            count = inode_ptr->ext.extent_count;
+            last = &inode_ptr->ext.extents[count - 1];
+            // the block right after the last extent just makes the extent longer
+            if (-1 == (blk = data_blk_alloc(count > 0 ? last->start + last->blk_count : data_blk_hint)))
+                break;
+            if (count > 0 && blk == last->start + last->blk_count)
+                last->blk_count++;
+            else if (count < extent_count_max)
+            {
+                inode_ptr->ext.extents[count].start = blk;
+                inode_ptr->ext.extents[count].blk_count = 1;
+                inode_ptr->ext.extent_count++;
+            }
+            else
+            {
+                map_clear(data_blk_map, blk);
+                break;
+            }
+        }
+        if (-1 == data_copy(blk * blk_size, NULL, blk_size, 1))
+        {
+            // the block is already in the file
+            inode_blks_drop(inode_ptr, i + 1, blk_old);
+            return -1;
+        }
+    }
+    if (i < blk_new)
+    {
+        inode_blks_drop(inode_ptr, i, blk_old);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * brief: change the length of a file, new blocks are zero filled, blocks past the end are freed
+ * input: inode_ptr -- the inode
+ *        length -- new length in Byte
+ * return: -1 -- too large or out of data blocks, the file is left unchanged
+ *          0 -- success
+ */
+static int32_t inode_resize(inode_t *inode_ptr, uint32_t length)
+{
+    int32_t blk_old = (inode_ptr->length + blk_size - 1) / blk_size;
+    int32_t blk_new = (length + blk_size - 1) / blk_size;
+    int32_t tail;
+    uint32_t run;
+
+    if (blk_new > blk_old && -1 == inode_blks_add(inode_ptr, blk_old, blk_new))
+        return -1;
+    map_set(inode_dirty_map, inode_ptr - inode_at(0));
+    if (blk_new < blk_old)
+        inode_blks_drop(inode_ptr, blk_old, blk_new);
+
+    /* the bytes between the old end and the end of its block read as zeros after growing */
+    if (length > inode_ptr->length && 0 != inode_ptr->length % blk_size &&
+        -1 != (tail = inode_run(inode_ptr, inode_ptr->length, &run)))
+        data_copy(tail, NULL, blk_size - inode_ptr->length % blk_size, 1);
+    inode_ptr->length = length;
+    return 0;
+}
+
+/**
+ * brief: find the index of the dentry with the given name
+ * input: fname -- file name
+ * return: -1 -- not found
+ *         dentry index otherwise
+ */
+static int32_t find_dentry(const uint8_t *fname)
+{
+    int32_t i;
+    for (i = 0; i < boot_blk_ptr->dir_count; i++)
+    {
+        if (strncmp((int8_t *)fname, dentry_at(i)->filename, filename_len_max) == 0)
+            return i;
+    }
+    return -1;
+}
 
 
 /**
@@ -70,18 +689,13 @@ int32_t read_dentry_by_name(const uint8_t *fname, dentry_t *dentry)
         return -1;
 
     // serach through all the directory entries
-    int i;
-    for (i = 0; i < dentry_count_max; i++)
-    {
-        if (strncmp((int8_t *)fname, boot_blk_ptr->dentries[i].filename, filename_len_max) == 0)
-        {
-            // copy dentry info
-            memcpy(dentry, boot_blk_ptr->dentries + i, dentry_size);
-            return 0;
-        }
-    }
+    int32_t i = find_dentry(fname);
     // file not exist
-    return -1;
+    if (-1 == i)
+        return -1;
+    // copy dentry info
+    memcpy(dentry, dentry_at(i), dentry_size);
+    return 0;
 }
 
 /**
@@ -98,7 +712,7 @@ int32_t read_dentry_by_index(uint32_t index, dentry_t *dentry)
     if (index >= boot_blk_ptr->dir_count)   return -1;
 
     // copy dentry info
-    memcpy(dentry, boot_blk_ptr->dentries + index, dentry_size);
+    memcpy(dentry, dentry_at(index), dentry_size);
 
     return 0;
 }
@@ -106,66 +720,181 @@ int32_t read_dentry_by_index(uint32_t index, dentry_t *dentry)
 
 
 /**
- * brief: fill in the buf with data read from inode, offset with length
- * input: inode -- inode id
- *        offset -- offset for file data
- *        length -- read data length
- * output: if success, copy the matched content into the given buf
+ * brief: copy the bytes stored in the blocks of a file
+ * input: inode_ptr -- the inode
+ *        offset -- offset of the first byte
+ *        buf -- destination
+ *        length -- bytes to copy
+ *        end -- bytes stored in the file
  * return: len -- read length
- *          -1 -- fail
- * side effect: none
+ *          -1 -- bad block index or device error
  */
-int32_t read_data(uint32_t inode, uint32_t offset, uint8_t *buf, uint32_t length)
+static int32_t inode_read(inode_t *inode_ptr, uint32_t offset, uint8_t *buf, uint32_t length, uint32_t end)
 {
-    inode_t *inode_ptr;
-    int32_t copy_end; // the offest (index) of the last byte to be copied +1
-    int32_t blk_index;
-    uint8_t *blk_ptr;
-    int32_t blk_offset; // offest inside a block
-    int32_t blk_cp_length; // length to copy inside a block
+    uint32_t copy_end; // the offest (index) of the last byte to be copied +1
+    int32_t addr;
+    uint32_t run; // contiguous bytes at offset
+    uint32_t cp_length; // length to copy from this run
     int32_t len_copied = 0;
-    
-    // bad input arguments
-    if (inode >= boot_blk_ptr->inode_count || buf == NULL) return -1;
-    // initialize the loop
-    inode_ptr = (inode_t *)(boot_blk_ptr + 1 + inode); // +1 to jump over the boot block
-    copy_end = (offset + length) > inode_ptr->length ? inode_ptr->length : offset + length;
 
+    copy_end = (offset + length) > end ? end : offset + length;
+
+    // one copy per extent (or per run of consecutive blocks in the original format)
     while (offset < copy_end)
     {
-        // update block index, block pointer
-        blk_index = (inode_ptr->data_blk_index)[offset / blk_size];
-        if (blk_index >= boot_blk_ptr->data_blk_count) return -1; // bad block index
-        blk_ptr = (uint8_t *)(boot_blk_ptr + 1 + boot_blk_ptr->inode_count + blk_index);
-
-        // compute offest inside a block and blk_cp_length (number of bytes to be copied inside a block)
-        blk_offset = offset % blk_size;
-        blk_cp_length = (copy_end - offset) > (blk_size - blk_offset) ? blk_size - blk_offset : copy_end - offset;
+        if (-1 == (addr = inode_run(inode_ptr, offset, &run))) return -1; // bad block index
+        cp_length = (copy_end - offset) > run ? run : copy_end - offset;
 
         // copy the content to buf and update length copied
-        memcpy(buf, blk_ptr + blk_offset, blk_cp_length);
-        len_copied += blk_cp_length;
+        if (-1 == data_copy(addr, buf, cp_length, 0)) return -1;
+        len_copied += cp_length;
 
         // update buf pointer, and offset
-        buf += blk_cp_length;
-        offset += blk_cp_length;
+        buf += cp_length;
+        offset += cp_length;
     }
     return len_copied;
 }
 
+/**
+ * brief: decompress one chunk of a compressed file
+ * input: inode_ptr -- the inode
+ *        chunk -- chunk index
+ *        dst -- destination, room for lz4_chunk_size bytes
+ * return: -1 -- corrupted file
+ *          number of bytes in the chunk otherwise
+ */
+static int32_t lz4_chunk_load(inode_t *inode_ptr, uint32_t chunk, uint8_t *dst)
+{
+    uint32_t stored = inode_ptr->ext.stored_length;
+    uint32_t count, table_end, start = 0, end, raw_len, run, is_raw;
+    int32_t addr;
+    uint8_t *src;
+
+    raw_len = inode_ptr->length - chunk * lz4_chunk_size;
+    if (raw_len > lz4_chunk_size) raw_len = lz4_chunk_size;
+    if (4 != inode_read(inode_ptr, 0, (uint8_t *)&count, 4, stored) || chunk >= count)
+        return -1;
+    if ((chunk > 0 && 4 != inode_read(inode_ptr, 4 * chunk, (uint8_t *)&start, 4, stored)) ||
+        4 != inode_read(inode_ptr, 4 * (chunk + 1), (uint8_t *)&end, 4, stored))
+        return -1;
+    table_end = 4 * (1 + count);
+    is_raw = end & lz4_chunk_raw;
+    start &= ~lz4_chunk_raw;
+    end &= ~lz4_chunk_raw;
+    if (end < start || end - start > lz4_chunk_size || table_end + end > stored)
+        return -1;
+
+    if (is_raw)
+        return (end - start == raw_len && raw_len == inode_read(inode_ptr, table_end + start, dst, raw_len, stored)) ? raw_len : -1;
+    // fsbuild keeps the chunks contiguous, otherwise (or on a disk) gather the chunk first
+    if (-1 == (addr = inode_run(inode_ptr, table_end + start, &run)))
+        return -1;
+    src = data_ptr(addr);
+    if (NULL == src || run < end - start)
+    {
+        if (end - start != inode_read(inode_ptr, table_end + start, lz4_src, end - start, stored))
+            return -1;
+        src = lz4_src;
+    }
+    return (raw_len == lz4_decompress(src, end - start, dst, raw_len)) ? raw_len : -1;
+}
+
+/**
+ * brief: read from a compressed file, only the chunks covering the range are decompressed
+ * input: inode -- inode index
+ *        offset -- offset in the uncompressed data
+ *        buf -- destination
+ *        length -- bytes to read
+ * return: len -- read length
+ *          -1 -- corrupted file
+ * side effect: whole chunks go straight into buf, the others through the chunk cache,
+ *              called with the file system lock held
+ */
+static int32_t lz4_read(uint32_t inode, uint32_t offset, uint8_t *buf, uint32_t length)
+{
+    inode_t *inode_ptr = inode_at(inode);
+    uint32_t copy_end, chunk, chunk_off, chunk_len, cp_length;
+    int32_t len_copied = 0;
+
+    copy_end = (offset + length) > inode_ptr->length ? inode_ptr->length : offset + length;
+    while (offset < copy_end)
+    {
+        chunk = offset / lz4_chunk_size;
+        chunk_off = offset % lz4_chunk_size;
+        chunk_len = inode_ptr->length - chunk * lz4_chunk_size;
+        if (chunk_len > lz4_chunk_size) chunk_len = lz4_chunk_size;
+        cp_length = (copy_end - offset) > (chunk_len - chunk_off) ? chunk_len - chunk_off : copy_end - offset;
+
+        if (0 == chunk_off && chunk_len == cp_length)
+        {
+            if (-1 == lz4_chunk_load(inode_ptr, chunk, buf))
+                break;
+        }
+        else
+        {
+            if (lz4_cached_inode != inode || lz4_cached_chunk != chunk)
+            {
+                lz4_cached_inode = -1;
+                if (-1 == lz4_chunk_load(inode_ptr, chunk, lz4_cache))
+                    break;
+                lz4_cached_inode = inode;
+                lz4_cached_chunk = chunk;
+            }
+            memcpy(buf, lz4_cache + chunk_off, cp_length);
+        }
+        len_copied += cp_length;
+        buf += cp_length;
+        offset += cp_length;
+    }
+    return (offset < copy_end) ? -1 : len_copied;
+}
+
+/**
+ * brief: fill in the buf with data read from inode, offset with length
+ * input: inode -- inode id
+ *        offset -- offset for file data
+ *        length -- read data length
+ * output: if success, copy the matched content into the given buf
+ * return: len -- read length
+ *          -1 -- fail
+ * side effect: compressed files are decompressed on the fly, might sleep waiting for the disk
+ */
+int32_t read_data(uint32_t inode, uint32_t offset, uint8_t *buf, uint32_t length)
+{
+    inode_t *inode_ptr;
+    int32_t retval;
+    uint32_t flags;
+
+    // bad input arguments
+    if (inode >= boot_blk_ptr->inode_count || buf == NULL) return -1;
+    inode_ptr = inode_at(inode);
+    if (-1 == fs_lock(&flags)) return -1;
+    TRACE(TRACE_FS_READ_ENTER, inode, length);
+    if (IS_LZ4_INODE(inode_ptr))
+        retval = lz4_read(inode, offset, buf, length);
+    else
+        retval = inode_read(inode_ptr, offset, buf, length, inode_ptr->length);
+    TRACE(TRACE_FS_READ_EXIT, inode, retval);
+    fs_unlock(flags);
+    return retval;
+}
+
 /*#####################################################################
  * Here goes the file operations defined for regular file and directory
 ######################################################################*/
 
 /**
  * brief: open operation for regular file (type 2)
- * input: none
+ * input: inode -- inode index
  * output: none
  * return: 0 -- sucess
- * side effect: none
+ * side effect: counts the open fds of the inode
  */
-int32_t file_open(void)
+int32_t file_open(uint32_t inode)
 {
+    if (inode < fs_inode_max)
+        inode_open_count[inode]++;
     return 0;
 }
 
@@ -187,61 +916,195 @@ int32_t file_read(uint32_t inode_num, uint32_t position, void *buf, uint32_t len
 }
 
 /**
- * brief: writes data into the file specified by the inode number
+ * brief: writes data into the file specified by the inode number, the file grows
+ *        (new blocks allocated) if the write goes past its end
  * input: buf -- store the bytes that will be written into the file
  *        length -- number of bytes need to write
+ *        position -- offset in the file where the write starts
  * output: put bytes from buf into the file specified by the inode number
  * return: -1 -- fail
- * side effect: none
+ *         length -- success
+ * side effect: might allocate data blocks, on a disk the data is written back when the file is closed
  */
-int32_t file_write(uint32_t inode, void *buf, uint32_t length)
+int32_t file_write(uint32_t inode, void *buf, uint32_t length, uint32_t position)
 {
     inode_t *inode_ptr;
-    int32_t write_end; // the offest (index) of the last byte to be copied +1
-    int32_t blk_index;
-    uint8_t *blk_ptr;
-    int32_t blk_wt_length; // length to copy inside a block
-    int32_t blk_num_total; // total number of data blocks available for an inode
-    int32_t offset; // offset of data written realatively to the whole file
-    
+    uint32_t write_end; // the offest (index) of the last byte to be written +1
+    int32_t addr;
+    uint32_t run; // contiguous bytes at position
+    uint32_t wt_length; // length to copy into this run
+    uint32_t flags;
+
     // bad input arguments
-    if (inode >= boot_blk_ptr->inode_count || buf == NULL) return -1;
-    // initialize the loop
-    inode_ptr = (inode_t *)(boot_blk_ptr + 1 + inode); // +1 to jump over the boot block
-    blk_num_total = (inode_ptr->length)/blk_size + (int32_t)(((inode_ptr->length) % blk_size) > 0);
-    write_end = length > blk_num_total*blk_size ? blk_num_total*blk_size : length;
-    offset = 0;
+    if (!fs_writable || inode >= boot_blk_ptr->inode_count || buf == NULL) return -1;
+    if (IS_LZ4_INODE(inode_at(inode))) return -1; // compressed files are read only
+    if (position + length < position) return -1; // overflow
+    inode_ptr = inode_at(inode);
+    write_end = position + length;
 
-    while (offset < write_end)
+    if (-1 == fs_lock(&flags)) return -1;
+    if (write_end > inode_ptr->length && -1 == inode_resize(inode_ptr, write_end))
     {
-        // update block index, block pointer
-        blk_index = (inode_ptr->data_blk_index)[offset / blk_size];
-        if (blk_index >= boot_blk_ptr->data_blk_count) return -1; // bad block index
-        blk_ptr = (uint8_t *)(boot_blk_ptr + 1 + boot_blk_ptr->inode_count + blk_index);
+        fs_unlock(flags);
+        return -1;
+    }
 
-        // compute offest inside a block and blk_wt_length (number of bytes to be written inside a block)
-        blk_wt_length = (write_end - offset) > blk_size ? blk_size : write_end - offset;
+    while (position < write_end)
+    {
+        if (-1 == (addr = inode_run(inode_ptr, position, &run))) break; // bad block index
+        wt_length = (write_end - position) > run ? run : write_end - position;
 
-        // copy the content to buf and update length copied
-        memcpy(blk_ptr, (uint8_t *)buf + offset, blk_wt_length);
+        // copy the content from buf
+        if (-1 == data_copy(addr, buf, wt_length, 1)) break;
 
-        // update buf pointer, and offset
-        offset += blk_wt_length;
+        // update buf pointer, and position
+        buf = (uint8_t *)buf + wt_length;
+        position += wt_length;
+    }
+    fs_unlock(flags);
+    return (position < write_end) ? -1 : length;
+}
+
+/**
+ * brief: create an empty regular file
+ * input: fname -- file name, at most filename_len_max characters
+ * return: -1 -- bad name, file exists, or out of inodes/dentries
+ *          0 -- success
+ * side effect: might allocate a directory block, the metadata is written to the disk
+ */
+int32_t fs_create(const uint8_t *fname)
+{
+    int32_t inode, blk, index;
+    dentry_t *dentry;
+    uint32_t flags;
+
+    if (!fs_writable || fname == NULL || '\0' == *fname || strlen((int8_t *)fname) > filename_len_max)
+        return -1;
+
+    if (-1 == fs_lock(&flags))
+        return -1;
+    if (-1 != find_dentry(fname) || boot_blk_ptr->dir_count >= dentry_total_max || -1 == (inode = inode_alloc()))
+    {
+        fs_unlock(flags);
+        return -1;
+    }
+    index = boot_blk_ptr->dir_count;
+    // first dentry of a new directory block
+    if (index >= dentry_count_max && 0 == (index - dentry_count_max) % dentry_per_blk)
+    {
+        if (-1 == (blk = data_blk_alloc(data_blk_hint)))
+        {
+            map_clear(inode_map, inode);
+            fs_unlock(flags);
+            return -1;
+        }
+        boot_blk_ptr->dir_blk_index[boot_blk_ptr->dir_blk_count++] = blk;
+        memset(dir_blk_at(boot_blk_ptr->dir_blk_count - 1), 0, blk_size);
+    }
+
+    dentry = dentry_at(index);
+    memset(dentry, 0, dentry_size);
+    strncpy(dentry->filename, (int8_t *)fname, filename_len_max);
+    dentry->filetype = REG_TYPE;
+    dentry->inode_num = inode;
+    boot_blk_ptr->dir_count++;
+    meta_dirty = 1;
+    fs_sync();
+    fs_unlock(flags);
+    return 0;
+}
+
+/**
+ * brief: remove a regular file, the last dentry is moved into its place
+ * input: fname -- file name
+ * return: -1 -- no such regular file, or it is open
+ *          0 -- success
+ * side effect: frees the inode, its data blocks and maybe a directory block,
+ *              the metadata is written to the disk
+ */
+int32_t fs_unlink(const uint8_t *fname)
+{
+    int32_t index, last, inode;
+    uint32_t flags;
+
+    if (!fs_writable || fname == NULL || strlen((int8_t *)fname) > filename_len_max)
+        return -1;
+
+    if (-1 == fs_lock(&flags))
+        return -1;
+    index = find_dentry(fname);
+    if (-1 == index || REG_TYPE != dentry_at(index)->filetype ||
+        0 != inode_open_count[(inode = dentry_at(index)->inode_num)])
+    {
+        fs_unlock(flags);
+        return -1;
+    }
+    // a compressed file is freed as the plain bytes it stores
+    if (IS_LZ4_INODE(inode_at(inode)))
+    {
+        inode_at(inode)->length = inode_at(inode)->ext.stored_length;
+        inode_at(inode)->ext.magic = extent_magic;
+        if (lz4_cached_inode == inode) lz4_cached_inode = -1;
+    }
+    inode_resize(inode_at(inode), 0);
+    map_clear(inode_map, inode);
+
+    last = boot_blk_ptr->dir_count - 1;
+    if (index != last)
+        memcpy(dentry_at(index), dentry_at(last), dentry_size);
+    boot_blk_ptr->dir_count--;
+    // the last directory block became empty
+    if (last >= dentry_count_max && 0 == (last - dentry_count_max) % dentry_per_blk)
+    {
+        boot_blk_ptr->dir_blk_count--;
+        map_clear(data_blk_map, boot_blk_ptr->dir_blk_index[boot_blk_ptr->dir_blk_count]);
     }
-    // update file length
-    inode_ptr->length = write_end;
-    return write_end;
+    meta_dirty = 1;
+    fs_sync();
+    fs_unlock(flags);
+    return 0;
+}
+
+/**
+ * brief: set the length of a file, growing fills with zeros
+ * input: inode -- inode index
+ *        length -- new length in Byte
+ * return: -1 -- fail
+ *          0 -- success
+ */
+int32_t fs_truncate(uint32_t inode, uint32_t length)
+{
+    int32_t retval;
+    uint32_t flags;
+    if (!fs_writable || 0 == inode || inode >= boot_blk_ptr->inode_count || !map_test(inode_map, inode) ||
+        IS_LZ4_INODE(inode_at(inode)))
+        return -1;
+    if (-1 == fs_lock(&flags))
+        return -1;
+    retval = inode_resize(inode_at(inode), length);
+    if (-1 == fs_sync())
+        retval = -1;
+    fs_unlock(flags);
+    return retval;
 }
 
 /**
  * brief: close operation for regular file (type 2)
- * input: none
+ * input: inode -- inode index
  * output: none
  * return: 0 -- sucess
- * side effect: none
+ * side effect: counts the open fds of the inode, closing the last one writes the file back to the disk
  */
-int32_t file_close(void)
+int32_t file_close(uint32_t inode)
 {
+    uint32_t flags;
+    if (inode < fs_inode_max && inode_open_count[inode] > 0)
+        inode_open_count[inode]--;
+    if (NULL != fs_dev && inode < fs_inode_max && 0 == inode_open_count[inode] && -1 != fs_lock(&flags))
+    {
+        fs_sync();
+        fs_unlock(flags);
+    }
     return 0;
 }
 
@@ -292,18 +1155,26 @@ int32_t dir_read(uint32_t inode_num, int32_t position, void *buf, uint32_t lengt
 
 
 /**
- * brief: write directory
- * input: position -- which dentry in a directory to write
- *        buf -- the data to write
- *        length -- self-explained
+ * brief: write directory, creates an empty regular file with the name in buf
+ * input: inode_num -- ignored
+ *        buf -- the file name, not necessarily terminated
+ *        length -- length of the name
  * output: 
- * return: -1
- * side effect: none
- * It will be called when system call read() is called. 
+ * return: -1 -- fail
+ *         length -- success
+ * side effect: adds a dentry
+ * It will be called when system call write() is called. 
  */
-int32_t dir_write(int32_t position, void *buf, uint32_t length)
+int32_t dir_write(uint32_t inode_num, void *buf, uint32_t length)
 {
-    return -1;
+    uint8_t fname[filename_len_max + 1];
+    if (buf == NULL || 0 == length || length > filename_len_max)
+        return -1;
+    memcpy(fname, buf, length);
+    fname[length] = '\0';
+    if (-1 == fs_create(fname))
+        return -1;
+    return length;
 }
 
 
@@ -319,3 +1190,24 @@ int32_t dir_close(void)
 {
     return 0;
 }
+
+
+/**
+ * brief: how full the file system is
+ * input: stats -- filled in
+ * return: none
+ */
+void fs_get_stats(fs_stats_t *stats)
+{
+    uint32_t i;
+    stats->device = (NULL == fs_dev) ? "memory" : fs_dev->name;
+    stats->writable = fs_writable;
+    stats->files = boot_blk_ptr->dir_count;
+    stats->inodes = boot_blk_ptr->inode_count;
+    stats->blocks = boot_blk_ptr->data_blk_count;
+    stats->inodes_used = stats->blocks_used = 0;
+    for (i = 0; i < stats->inodes; i++)
+        stats->inodes_used += (0 != map_test(inode_map, i));
+    for (i = 0; i < stats->blocks; i++)
+        stats->blocks_used += (0 != map_test(data_blk_map, i));
+}
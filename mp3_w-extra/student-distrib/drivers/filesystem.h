@@ -11,6 +11,7 @@
 #include "../types.h"
 #include "../multiboot.h"
 #include "../lib.h"
+#include "bcache.h"
 
 #define blk_size 4096
 #define boot_blk_reserved_len 52
@@ -19,6 +20,15 @@
 #define dentry_reserved_len 24
 #define filename_len_max 32
 #define data_blk_count_max 1023
+#define dir_blk_max 12          // directory blocks listed in the boot block
+#define dentry_per_blk 64       // blk_size / dentry_size
+#define dentry_total_max (dentry_count_max + dir_blk_max * dentry_per_blk)
+#define fs_inode_max 256        // inodes after mount, the image is relocated to make room
+#define extent_magic ((int32_t)0xEC5E0001) // first word of an extent inode, never a valid block index
+#define extent_count_max 510    // extents that fit in an inode
+#define extent_lz4_magic ((int32_t)0xEC5E0002) // extent inode whose data is compressed
+#define lz4_chunk_size 0x4000   // compressed files are split into chunks of this size before compression
+#define lz4_chunk_raw 0x80000000 // set in a chunk end offset when the chunk is stored uncompressed
 
 #define RTC_TYPE 0
 #define DIR_TYPE 1
@@ -38,23 +48,71 @@ typedef struct boot_blk
     int32_t     dir_count;
     int32_t     inode_count;
     int32_t     data_blk_count;
-    int8_t      reserved[boot_blk_reserved_len];
+    /* dentries after the first dentry_count_max live in directory blocks (the reserved bytes of the original format) */
+    int32_t     dir_blk_count;
+    int32_t     dir_blk_index[dir_blk_max];
     dentry_t    dentries[dentry_count_max];
 } boot_blk_t;
 
+typedef struct extent
+{
+    int32_t     start;      // first data block
+    int32_t     blk_count;  // number of contiguous data blocks
+} extent_t;
+
 typedef struct inode
 {
     int32_t     length; // file length in Byte
-    int32_t     data_blk_index[data_blk_count_max];
+    union
+    {
+        int32_t     data_blk_index[data_blk_count_max];     // original format, one index per block
+        struct
+        {
+            int32_t     magic;          // extent_magic
+            int32_t     extent_count;
+            extent_t    extents[extent_count_max];
+            int32_t     stored_length;  // bytes in the extents, compressed files only
+        } ext;                                              // revision 1, runs of contiguous blocks
+    };
 } inode_t;
 
+#define IS_EXTENT_INODE(inode_ptr) (extent_magic == (inode_ptr)->ext.magic || IS_LZ4_INODE(inode_ptr))
+/*
+ * A compressed file keeps its uncompressed size in length, its extents hold
+ *   uint32_t chunk_count;
+ *   uint32_t chunk_end[chunk_count];   end of every chunk after the table, may have lz4_chunk_raw set
+ *   the chunks, LZ4 blocks of lz4_chunk_size bytes each, the last one shorter
+ * so any chunk can be decompressed alone. Compressed files are read only.
+ */
+#define IS_LZ4_INODE(inode_ptr) (extent_lz4_magic == (inode_ptr)->ext.magic)
+
 /* global pointer for boot_blk */
 boot_blk_t *boot_blk_ptr;
 
-/* get filesystem module address */
-#define init_filesystem(mbi) boot_blk_ptr = (boot_blk_t*)(((module_t*)mbi->mods_addr)->mod_start) // Note that filesystem module is the first module
+/* get filesystem module address and mount it */
+#define init_filesystem(mbi) fs_mount((boot_blk_t*)(((module_t*)mbi->mods_addr)->mod_start)) // Note that filesystem module is the first module
 #define GET_FILE_SIZE(dentry_ptr) ((inode_t *)(boot_blk_ptr + 1 + dentry_ptr->inode_num))->length // +1 to jump over the boot block
 
+/* copy the image into the writable file system area and build the allocation bitmaps */
+void fs_mount(boot_blk_t *image);
+
+/* use the file system on a disk instead, -1 if the device does not hold one */
+int32_t fs_mount_disk(blk_dev_t *dev);
+
+/* usage of the mounted file system */
+typedef struct fs_stats
+{
+    const int8_t    *device;        // name of the disk, "memory" for the module
+    int32_t         writable;
+    uint32_t        files;
+    uint32_t        inodes;
+    uint32_t        inodes_used;
+    uint32_t        blocks;
+    uint32_t        blocks_used;
+} fs_stats_t;
+
+void fs_get_stats(fs_stats_t *stats);
+
 /* show the content of show the content of the given dentry */
 void show_dentry(dentry_t *dentry);
 
@@ -70,24 +128,33 @@ int32_t read_dentry_by_index(uint32_t index, dentry_t *dentry);
 /* read data from data block basing on specified inode, and copy them into buf */
 int32_t read_data(uint32_t inode, uint32_t offset, uint8_t *buf, uint32_t length);
 
+/* create an empty regular file */
+int32_t fs_create(const uint8_t *fname);
+
+/* remove a regular file and free its inode and data blocks */
+int32_t fs_unlink(const uint8_t *fname);
+
+/* grow (zero filled) or shrink a file */
+int32_t fs_truncate(uint32_t inode, uint32_t length);
+
 /* open operation for regular file (type 2) */
-int32_t file_open(void);
+int32_t file_open(uint32_t inode);
 
 /* read data from data block basing on specified inode, and copy them into buf */
 int32_t file_read(uint32_t inode_num, uint32_t position, void *buf, uint32_t length);
 
 /* writes data into the file specified by the inode number */
-int32_t file_write(uint32_t inode_num, void *buf, uint32_t length);
+int32_t file_write(uint32_t inode_num, void *buf, uint32_t length, uint32_t position);
 
 /* close operation for regular file (type 2) */
-int32_t file_close(void);
+int32_t file_close(uint32_t inode);
 
 /* directory operations */
 int32_t dir_open(void);
 
 int32_t dir_read(uint32_t inode_num, int32_t position, void *buf, uint32_t length);
 
-int32_t dir_write(int32_t position, void *buf, uint32_t length);
+int32_t dir_write(uint32_t inode_num, void *buf, uint32_t length);
 
 int32_t dir_close(void);
 
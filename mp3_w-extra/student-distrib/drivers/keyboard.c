@@ -10,6 +10,8 @@
  */
 
 #include "keyboard.h"
+#include "../kernel/trace.h"
+#include "scrollback.h"
 
 char scancode_set[NUM_MODE][NUM_SCAN] = {
 /* mode 0: CAPS_FLAG =0 and SHIFT_FLAG =0 */  
@@ -90,7 +92,11 @@ void keyboard_handler(void){
     switch(scancode) {
         
         case TAB:
-            tabpressed();
+            // file name completion edits the line, a raw reader gets the tab
+            if (current_terminal->mode & TERM_CANON)
+                tabpressed();
+            else
+                terminal_input('\t');
             break;
         case CTRL_RELEASE:
             CTRL_FLAG = 0;
@@ -121,22 +127,12 @@ void keyboard_handler(void){
             CAPS_FLAG ^= 1;
             break;
         case BACKSPACE:
-            if (current_terminal->TERMINAL_READ_FLAG) {
-                if (current_terminal->buf_index == 0)
-                    break;
-                else
-                    current_terminal->buf_index--;
-            }
             key_pressed = BACKSPACE;
-            backspace();
+            terminal_input('\b');
             break;
 
         case ENTER_PRESS:
-            current_terminal->TERMINAL_READ_FLAG = 0;
-            current_terminal->buffer[current_terminal->buf_index]='\n';
-            current_terminal->buf_index = 0;
-            //printf("%c", '\n');
-            putk('\n');
+            terminal_input('\n');
             // record key
             key_pressed = ENTER_PRESS;
             break;
@@ -155,11 +151,26 @@ void keyboard_handler(void){
                 terminal_switch(terminal_2);
             }
             break;
+        case F12_PRESS:
+            // send the kernel trace to COM1, the PIT handler writes it as the UART drains
+            trace_dump_request();
+            break;
         case UP_PRESS:
-            search_history(UP);
+            if (current_terminal->mode & TERM_CANON)
+                search_history(UP);
             break;
         case DOWN_PRESS:
-            search_history(DOWN);
+            if (current_terminal->mode & TERM_CANON)
+                search_history(DOWN);
+            break;
+        case PGUP_PRESS:
+            // shift+pgup/pgdn move through the scrollback of the shown terminal
+            if (L_SHIFT_FLAG || R_SHIFT_FLAG)
+                scrollback_scroll(SCROLLBACK_PAGE);
+            break;
+        case PGDN_PRESS:
+            if (L_SHIFT_FLAG || R_SHIFT_FLAG)
+                scrollback_scroll(-SCROLLBACK_PAGE);
             break;
         default :
             if(CTRL_FLAG) {
@@ -175,6 +186,10 @@ void keyboard_handler(void){
                         putk(current_terminal->buffer[i]);
                     }
                 }
+                //interrupt the program on the shown terminal when ctrl+c pressed
+                if(scancode_set[SCAN_MODE][scancode]=='c'||scancode_set[SCAN_MODE][scancode]=='C'){
+                    terminal_interrupt();
+                }
                 break;
             }else{  
 
@@ -191,13 +206,9 @@ void keyboard_handler(void){
                     terminal_switch(terminal_2);
                     break;
                 }
-                if (current_terminal->buf_index < KB_BUF_SIZE-1){
-                    current_terminal->buffer[current_terminal->buf_index] = scancode_set[SCAN_MODE][scancode];// pig
-                    current_terminal->buf_index++;
-                    putk(scancode_set[SCAN_MODE][scancode]);
-                    // record key pressed
-                    key_pressed = scancode_set[SCAN_MODE][scancode];
-                }
+                terminal_input(scancode_set[SCAN_MODE][scancode]);
+                // record key pressed
+                key_pressed = scancode_set[SCAN_MODE][scancode];
             }
     }
     //  sti();   // end of critical section
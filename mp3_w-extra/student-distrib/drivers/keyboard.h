@@ -53,8 +53,11 @@
 #define F1_PRESS        0x3B
 #define F2_PRESS        0x3C
 #define F3_PRESS        0x3D
+#define F12_PRESS       0x58
 #define UP_PRESS                  0x48
 #define DOWN_PRESS                0x50
+#define PGUP_PRESS                0x49
+#define PGDN_PRESS                0x51
 #define UP                  1
 #define DOWN                0
 
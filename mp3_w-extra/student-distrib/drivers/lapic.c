@@ -0,0 +1,54 @@
+/* lapic.c - Functions to interact with the local APIC
+ * vim:ts=4 noexpandtab
+ */
+
+#include "lapic.h"
+#include "../lib.h"
+#include "../kernel/paging.h"
+
+/* registers of the local APIC, NULL until lapic_init */
+static volatile uint8_t* lapic_base = NULL;
+
+#define lapic_reg(offset) (*(volatile uint32_t*)(lapic_base + (offset)))
+
+/* Map and enable the local APIC
+ * Inputs: none
+ * Outputs: -1 if the CPU has no local APIC, 0 otherwise
+ * Side Effects: the 4MB page holding the registers is identity mapped,
+ *               LINT0 passes the 8259 through, so the legacy lines keep working */
+int32_t lapic_init(void) {
+    uint32_t eax, ebx, ecx, edx, lo, hi;
+
+    eax = 1;
+    asm volatile ("cpuid" : "+a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx));
+    if (!(edx & LAPIC_CPUID_BIT))
+        return -1;
+    asm volatile ("rdmsr" : "=a" (lo), "=d" (hi) : "c" (LAPIC_BASE_MSR));
+    lapic_base = (volatile uint8_t*)(lo & 0xFFFFF000);
+    if (-1 == map_mmio_4M((uint32_t)lapic_base))
+        return -1;
+
+    lapic_reg(LAPIC_REG_LVT_LINT0) = LAPIC_LVT_EXTINT;
+    lapic_reg(LAPIC_REG_LVT_LINT1) = LAPIC_LVT_NMI;
+    lapic_reg(LAPIC_REG_TPR) = 0;
+    lapic_reg(LAPIC_REG_SVR) = LAPIC_SVR_ENABLE | LAPIC_SPURIOUS_VECTOR;
+    return 0;
+}
+
+/* 1 if lapic_init succeeded */
+int32_t lapic_present(void) {
+    return NULL != lapic_base;
+}
+
+/* Id of this CPU's APIC
+ * Inputs: none
+ * Outputs: the 8 bit APIC id */
+uint32_t lapic_id(void) {
+    return lapic_reg(LAPIC_REG_ID) >> 24;
+}
+
+/* End of interrupt for a vector delivered by the local APIC, MSI vectors need
+ * nothing else: no PIC, and being edge triggered no level to clear first */
+void lapic_eoi(void) {
+    lapic_reg(LAPIC_REG_EOI) = 0;
+}
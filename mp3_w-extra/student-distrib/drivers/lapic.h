@@ -0,0 +1,43 @@
+/* lapic.h - Defines used in interactions with the local APIC, which
+ * receives the MSI messages of PCI devices. The 8259 keeps delivering
+ * the legacy lines through LINT0 in virtual wire mode.
+ * vim:ts=4 noexpandtab
+ */
+
+#ifndef _LAPIC_H
+#define _LAPIC_H
+
+#include "../types.h"
+
+#define LAPIC_BASE_MSR          0x1B
+#define LAPIC_DEFAULT_BASE      0xFEE00000
+#define LAPIC_CPUID_BIT         (1 << 9)    // edx of cpuid leaf 1
+
+/* register offsets, in bytes */
+#define LAPIC_REG_ID            0x020
+#define LAPIC_REG_TPR           0x080
+#define LAPIC_REG_EOI           0x0B0
+#define LAPIC_REG_SVR           0x0F0
+#define LAPIC_REG_LVT_LINT0     0x350
+#define LAPIC_REG_LVT_LINT1     0x360
+
+#define LAPIC_SVR_ENABLE        0x100
+#define LAPIC_SPURIOUS_VECTOR   0xFF
+#define LAPIC_LVT_EXTINT        0x700
+#define LAPIC_LVT_NMI           0x400
+
+/* MSI messages are writes to this window, the destination APIC id at bit 12 */
+#define MSI_ADDRESS_BASE        0xFEE00000
+
+/* Externally-visible functions */
+
+/* Map and enable the local APIC, 0 on success, -1 if the CPU has none */
+int32_t lapic_init(void);
+/* 1 if lapic_init succeeded */
+int32_t lapic_present(void);
+/* Id of this CPU's APIC, the destination of MSI messages */
+uint32_t lapic_id(void);
+/* End of interrupt for a vector delivered by the local APIC */
+void lapic_eoi(void);
+
+#endif /* _LAPIC_H */
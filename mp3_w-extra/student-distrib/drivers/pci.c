@@ -1,7 +1,7 @@
 /**
  * @file pci.c
  * @author your name (you@domain.com)
- * @brief PCI is initialized only for registering VGA and RTL8139
+ * @brief PCI enumeration into a registry of functions, and drivers matched against it
  * @version 0.1
  * @date 2022-04-27
  * 
@@ -10,71 +10,413 @@
  * 
  */
 #include "pci.h"
+#include "i8259.h"
+#include "lapic.h"
+#include "../kernel/idt.h"
+#include "../kernel/paging.h"
 
+/* handlers of the shared PCI interrupt lines */
+static struct {
+    uint8_t irq;
+    void (*handler)(void* data);
+    void* data;
+} pci_irq_handlers[PCI_IRQ_HANDLER_MAX];
+static int32_t pci_irq_handler_count = 0;
+
+
+
+/* every function found at boot, and the drivers bound to them */
+static pci_func_t pci_funcs[PCI_DEV_MAX];
+static int32_t pci_func_count = 0;
+static pci_driver_t* pci_drivers[PCI_DRIVER_MAX];
+static int32_t pci_driver_count = 0;
+
+static void pci_scan_bus(uint8_t bus);
 
 
-#if 1
 
 /**
- * @brief check all devices on the bus
+ * @brief read a dword of a function's configuration space
  * 
  * @param bus 
- * @return int32_t 
+ * @param device 
+ * @param func 
+ * @param reg - dword index
+ * @return uint32_t 
  */
-int32_t checkDevice(uint8_t bus)
+uint32_t pci_config_read(uint8_t bus, uint8_t device, uint8_t func, uint8_t reg)
 {
-    int32_t device;
-    for (device = 0; device < PCI_COUNT_DEVICE; device++) {
-        pci_device_t target_dev;
-        if (SUCCESS == checkFunc(bus, device, &target_dev)) 
-            return SUCCESS;
-        continue;
-    } return FAIL;
+    pci_addr_t addr;
+    addr.val = 0;
+    addr.bus_num = bus;
+    addr.device_num = device;
+    addr.func_num = func;
+    addr.reg_num = reg;
+    addr.enable = 1;
+    outl(addr.val, PCI_REG_ADDR);
+    return inl(PCI_REG_DATA);
 }
 
 
 /**
- * @brief check and register the QEMU VGA device
+ * @brief write a dword of a function's configuration space
  * 
  * @param bus 
  * @param device 
- * @param target_dev 
- * @return int32_t 
+ * @param func 
+ * @param reg - dword index
+ * @param val 
  */
-int32_t checkFunc(uint8_t bus, uint8_t device, pci_device_t* target_dev)
+void pci_config_write(uint8_t bus, uint8_t device, uint8_t func, uint8_t reg, uint32_t val)
 {
     pci_addr_t addr;
-    int32_t func;
     addr.val = 0;
     addr.bus_num = bus;
     addr.device_num = device;
+    addr.func_num = func;
+    addr.reg_num = reg;
     addr.enable = 1;
+    outl(addr.val, PCI_REG_ADDR);
+    outl(val, PCI_REG_DATA);
+}
+
+
+/**
+ * @brief add a handler to a legacy interrupt line and enable the line
+ * 
+ * @param irq - 5, 9, 10 or 11, the lines with a linkage
+ * @param handler - called with data on every interrupt of the line
+ * @param data 
+ * @return SUCCESS or FAIL
+ */
+int32_t pci_irq_register(uint8_t irq, void (*handler)(void* data), void* data)
+{
+    if (pci_irq_handler_count == PCI_IRQ_HANDLER_MAX || (5 != irq && 9 != irq && 10 != irq && 11 != irq))
+        return FAIL;
+    pci_irq_handlers[pci_irq_handler_count].irq = irq;
+    pci_irq_handlers[pci_irq_handler_count].handler = handler;
+    pci_irq_handlers[pci_irq_handler_count].data = data;
+    pci_irq_handler_count++;
+    enable_irq(irq);
+    return SUCCESS;
+}
+
+
+/**
+ * @brief interrupt of a shared line, every device on it is asked
+ * 
+ * @param irq 
+ */
+void pci_irq_handler(uint32_t irq)
+{
+    int32_t i;
+    for (i = 0; i < pci_irq_handler_count; i++) {
+        if (pci_irq_handlers[i].irq == irq)
+            pci_irq_handlers[i].handler(pci_irq_handlers[i].data);
+    }
+    send_eoi(irq);
+}
 
-    for (func = 0; func < PCI_COUNT_FUNC; func++) {
-        addr.func_num = func;
-        /* Register upper bound, 0x10 for standard devices, 0x12 for CardBus */
-        /* 0x10 = 16. Every time we read 4 bytes and 16*4 = 64 bytes */
-        uint8_t reg_bound = 0x10;
-        for (addr.reg_num = 0; addr.reg_num < reg_bound; addr.reg_num++) {
-            outl(addr.val, PCI_REG_ADDR);
-            target_dev->val[addr.reg_num] = inl(PCI_REG_DATA);
+
+/**
+ * @brief decode the BARs of a function, the size is found by writing all ones
+ * 
+ * @param dev - function with its header read
+ */
+static void pci_decode_bars(pci_func_t* dev)
+{
+    int32_t i, count;
+    uint32_t val, mask;
+
+    // bridges have 2 BARs, cardbus bridges none that we use
+    count = (PCI_TYPE_STANDARD == (dev->header.header_type & ~PCI_HEADER_MULTIFUNC)) ? PCI_BAR_COUNT :
+            (PCI_TYPE_PCI_PCI == (dev->header.header_type & ~PCI_HEADER_MULTIFUNC)) ? 2 : 0;
+    // no decoding while the BARs hold all ones
+    pci_config_write(dev->bus, dev->device, dev->func, PCI_REG_COMMAND,
+                     dev->header.command & ~(PCI_COMMAND_IO | PCI_COMMAND_MEMORY));
+    for (i = 0; i < count; i++) {
+        val = dev->header.device.bar[i];
+        pci_config_write(dev->bus, dev->device, dev->func, 4 + i, 0xFFFFFFFF);
+        mask = pci_config_read(dev->bus, dev->device, dev->func, 4 + i);
+        pci_config_write(dev->bus, dev->device, dev->func, 4 + i, val);
+        if (0 == mask || 0xFFFFFFFF == mask)
+            continue;
+        dev->bar[i].is_io = val & 0x1;
+        if (dev->bar[i].is_io) {
+            dev->bar[i].base = val & PCI_MASK_BAR_IOSPACE;
+            dev->bar[i].size = ~(mask & PCI_MASK_BAR_IOSPACE) & 0xFFFF;
+        } else {
+            dev->bar[i].base = val & PCI_MASK_BAR_MEMSPACE;
+            dev->bar[i].size = ~(mask & PCI_MASK_BAR_MEMSPACE);
+            dev->bar[i].prefetchable = (val >> 3) & 0x1;
+            // type 2 is a 64 bit BAR, the kernel only uses addresses below 4GB
+            dev->bar[i].is_64 = (0x2 == ((val >> 1) & 0x3));
         }
+        dev->bar[i].size++;
+        if (dev->bar[i].is_64)
+            i++;
+    }
+    pci_config_write(dev->bus, dev->device, dev->func, PCI_REG_COMMAND, dev->header.command);
+}
+
+
+/**
+ * @brief walk the capability list and remember the interrupt capabilities
+ * 
+ * @param dev - function with its header read
+ */
+static void pci_find_caps(pci_func_t* dev)
+{
+    uint32_t cap;
+    uint8_t offset;
+    int32_t n;
+
+    if (!(dev->header.status & PCI_STATUS_CAP_LIST))
+        return;
+    offset = pci_config_read(dev->bus, dev->device, dev->func, PCI_REG_CAP_PTR / 4) & 0xFC;
+    // the list is at most 48 entries long, a loop in it must not hang the boot
+    for (n = 0; 0 != offset && n < 48; n++) {
+        cap = pci_config_read(dev->bus, dev->device, dev->func, offset / 4);
+        if (PCI_CAP_ID_MSI == (cap & 0xFF))
+            dev->msi_cap = offset;
+        if (PCI_CAP_ID_MSIX == (cap & 0xFF))
+            dev->msix_cap = offset;
+        offset = (cap >> 8) & 0xFC;
+    }
+}
 
-        /* target info read finishes */
-        if (target_dev->vendor_id == PCI_INVALID_ID || target_dev->device_id == PCI_INVALID_ID) 
+
+/**
+ * @brief add a function to the registry, a PCI-PCI bridge is followed to its secondary bus
+ * 
+ * @param bus 
+ * @param device 
+ * @param func 
+ */
+static void pci_scan_func(uint8_t bus, uint8_t device, uint8_t func)
+{
+    pci_func_t* dev;
+    int32_t reg;
+
+    if (PCI_DEV_MAX == pci_func_count) {
+        printf("PCI registry full, %x:%x.%x dropped\n", bus, device, func);
+        return;
+    }
+    dev = &pci_funcs[pci_func_count++];
+    memset(dev, 0, sizeof(pci_func_t));
+    dev->bus = bus;
+    dev->device = device;
+    dev->func = func;
+    for (reg = 0; reg < 0x10; reg++)
+        dev->header.val[reg] = pci_config_read(bus, device, func, reg);
+    printf("PCI device %x:%x.%x: %x:%x class %x:%x\n", bus, device, func,
+           dev->header.vendor_id, dev->header.device_id, dev->header.class_code, dev->header.subclass);
+
+    pci_decode_bars(dev);
+    pci_find_caps(dev);
+    // the firmware writes 0xFF for a function without a legacy line, pin 0 means none is used
+    dev->irq = (0 != dev->header.device.interrupt_pin) ? dev->header.device.interrupt_line : 0xFF;
+
+    if (PCI_CLASS_BRIDGE == dev->header.class_code && PCI_SUBCLASS_PCI_BRIDGE == dev->header.subclass &&
+        dev->header.pci_bridge.secondary_bus_num > bus)
+        pci_scan_bus(dev->header.pci_bridge.secondary_bus_num);
+}
+
+
+/**
+ * @brief scan the 32 devices of a bus, every function of a multifunction device
+ * 
+ * @param bus 
+ */
+static void pci_scan_bus(uint8_t bus)
+{
+    int32_t device, func;
+    uint32_t id, header_type;
+
+    for (device = 0; device < PCI_COUNT_DEVICE; device++) {
+        id = pci_config_read(bus, device, 0, 0);
+        if (PCI_INVALID_ID == (id & 0xFFFF))
             continue;
-        printf("PCI device %x:%x.%x: %x:%x\n", bus, device, func, target_dev->vendor_id, target_dev->device_id);
-        if (target_dev->vendor_id == PCI_QEMUVGA_VENDOR_ID && target_dev->device_id == PCI_QEMUVGA_DEVICE_ID) {
-            qemu_vga_addr = target_dev->device.bar[0] & PCI_MASK_BAR_MEMSPACE;
-            printf("\n### QEMU VGA Adapter detected, vram=%x ###\n", qemu_vga_addr);
-            return SUCCESS;
+        pci_scan_func(bus, device, 0);
+        header_type = (pci_config_read(bus, device, 0, 3) >> 16) & 0xFF;
+        if (!(header_type & PCI_HEADER_MULTIFUNC))
+            continue;
+        for (func = 1; func < PCI_COUNT_FUNC; func++) {
+            if (PCI_INVALID_ID != (pci_config_read(bus, device, func, 0) & 0xFFFF))
+                pci_scan_func(bus, device, func);
         }
     }
-    return FAIL;
 }
-#endif
 
 
+/**
+ * @brief set bits of the command register of a function
+ * 
+ * @param dev 
+ * @param command - PCI_COMMAND_* bits
+ */
+void pci_enable(pci_func_t* dev, uint16_t command)
+{
+    dev->header.command |= command;
+    pci_config_write(dev->bus, dev->device, dev->func, PCI_REG_COMMAND, dev->header.command);
+}
+
+
+
+/**
+ * @brief switch a function from its legacy line to message signaled interrupts,
+ *        MSI when it has the capability, otherwise entry 0 of its MSI-X table.
+ *        Messages go straight to the local APIC, so nothing is shared and
+ *        the handler needs no check of whether its device raised it.
+ * 
+ * @param dev 
+ * @param handler - runs on every message, with data
+ * @param data 
+ * @return the vector, FAIL if the function or the CPU cannot do it
+ */
+int32_t pci_enable_msi(pci_func_t* dev, void (*handler)(void* data), void* data)
+{
+    int32_t vector;
+    uint32_t ctrl, table, addr;
+    volatile uint32_t* entry;
+    pci_bar_t* bar;
+
+    if (!lapic_present() || (0 == dev->msi_cap && 0 == dev->msix_cap))
+        return FAIL;
+    if (0 == dev->msi_cap) {
+        // the MSI-X table must be reachable before a vector is taken
+        table = pci_config_read(dev->bus, dev->device, dev->func, dev->msix_cap / 4 + 1);
+        bar = &dev->bar[table & PCI_MSIX_BIR_MASK];
+        if ((table & PCI_MSIX_BIR_MASK) >= PCI_BAR_COUNT || 0 == bar->base || bar->is_io ||
+            -1 == map_mmio_4M(bar->base + (table & ~PCI_MSIX_BIR_MASK)))
+            return FAIL;
+    }
+    if (-1 == (vector = idt_alloc_vector(handler, data)))
+        return FAIL;
+    addr = MSI_ADDRESS_BASE | (lapic_id() << 12);
+
+    if (0 != dev->msi_cap) {
+        ctrl = pci_config_read(dev->bus, dev->device, dev->func, dev->msi_cap / 4);
+        pci_config_write(dev->bus, dev->device, dev->func, dev->msi_cap / 4 + 1, addr);
+        if ((ctrl >> 16) & PCI_MSI_CTRL_64BIT) {
+            pci_config_write(dev->bus, dev->device, dev->func, dev->msi_cap / 4 + 2, 0);
+            pci_config_write(dev->bus, dev->device, dev->func, dev->msi_cap / 4 + 3, vector);
+        } else {
+            pci_config_write(dev->bus, dev->device, dev->func, dev->msi_cap / 4 + 2, vector);
+        }
+        ctrl &= ~(PCI_MSI_CTRL_MME << 16);
+        ctrl |= PCI_MSI_CTRL_ENABLE << 16;
+        pci_config_write(dev->bus, dev->device, dev->func, dev->msi_cap / 4, ctrl);
+    } else {
+        pci_enable(dev, PCI_COMMAND_MEMORY);
+        entry = (volatile uint32_t*)(bar->base + (table & ~PCI_MSIX_BIR_MASK));
+
+        // program entry 0 with the whole function masked
+        ctrl = pci_config_read(dev->bus, dev->device, dev->func, dev->msix_cap / 4);
+        ctrl |= (PCI_MSIX_CTRL_ENABLE | PCI_MSIX_CTRL_MASKALL) << 16;
+        pci_config_write(dev->bus, dev->device, dev->func, dev->msix_cap / 4, ctrl);
+        entry[0] = addr;
+        entry[1] = 0;
+        entry[2] = vector;
+        entry[3] &= ~PCI_MSIX_ENTRY_MASKED;
+        ctrl &= ~(PCI_MSIX_CTRL_MASKALL << 16);
+        pci_config_write(dev->bus, dev->device, dev->func, dev->msix_cap / 4, ctrl);
+    }
+    pci_enable(dev, PCI_COMMAND_INTX_DISABLE);
+    return vector;
+}
+
+/**
+ * @brief undo pci_enable_msi: the function goes back to its legacy line and the
+ *        vector is freed
+ * 
+ * @param dev 
+ * @param vector - returned by pci_enable_msi
+ */
+void pci_disable_msi(pci_func_t* dev, int32_t vector)
+{
+    uint32_t ctrl;
+
+    if (0 != dev->msi_cap) {
+        ctrl = pci_config_read(dev->bus, dev->device, dev->func, dev->msi_cap / 4);
+        ctrl &= ~(PCI_MSI_CTRL_ENABLE << 16);
+        pci_config_write(dev->bus, dev->device, dev->func, dev->msi_cap / 4, ctrl);
+    } else {
+        ctrl = pci_config_read(dev->bus, dev->device, dev->func, dev->msix_cap / 4);
+        ctrl &= ~((PCI_MSIX_CTRL_ENABLE | PCI_MSIX_CTRL_MASKALL) << 16);
+        pci_config_write(dev->bus, dev->device, dev->func, dev->msix_cap / 4, ctrl);
+    }
+    dev->header.command &= ~PCI_COMMAND_INTX_DISABLE;
+    pci_config_write(dev->bus, dev->device, dev->func, PCI_REG_COMMAND, dev->header.command);
+    idt_free_vector(vector);
+}
+
+
+/* does a function match one entry of an id table */
+static int32_t pci_match(const pci_id_t* ids, pci_func_t* dev)
+{
+    for (; 0 != ids->vendor_id; ids++) {
+        if ((PCI_ANY_ID == ids->vendor_id || ids->vendor_id == dev->header.vendor_id) &&
+            (PCI_ANY_ID == ids->device_id || ids->device_id == dev->header.device_id) &&
+            (PCI_ANY_ID == ids->class_code || ids->class_code == dev->header.class_code) &&
+            (PCI_ANY_ID == ids->subclass || ids->subclass == dev->header.subclass))
+            return 1;
+    }
+    return 0;
+}
+
+
+/**
+ * @brief add a driver, its probe runs right away on every matching function without a driver
+ * 
+ * @param driver 
+ * @return SUCCESS or FAIL (too many drivers)
+ */
+int32_t pci_register_driver(pci_driver_t* driver)
+{
+    int32_t i;
+    if (PCI_DRIVER_MAX == pci_driver_count)
+        return FAIL;
+    pci_drivers[pci_driver_count++] = driver;
+    for (i = 0; i < pci_func_count; i++) {
+        if (NULL != pci_funcs[i].driver || !pci_match(driver->ids, &pci_funcs[i]))
+            continue;
+        if (SUCCESS == driver->probe(&pci_funcs[i]))
+            pci_funcs[i].driver = driver;
+    }
+    return SUCCESS;
+}
+
+
+/**
+ * @brief get a function of the registry
+ * 
+ * @param i 
+ * @return pci_func_t* - NULL past the last one
+ */
+pci_func_t* pci_get_func(int32_t i)
+{
+    if (i < 0 || i >= pci_func_count)
+        return NULL;
+    return &pci_funcs[i];
+}
+
+
+/* the QEMU VGA adapter, its frame buffer is in BAR0 */
+static const pci_id_t qemu_vga_ids[] = {
+    {PCI_QEMUVGA_VENDOR_ID, PCI_QEMUVGA_DEVICE_ID, PCI_ANY_ID, PCI_ANY_ID},
+    {0, 0, 0, 0}
+};
+
+static int32_t qemu_vga_probe(pci_func_t* dev)
+{
+    qemu_vga_addr = dev->bar[0].base;
+    printf("\n### QEMU VGA Adapter detected, vram=%x ###\n", qemu_vga_addr);
+    return SUCCESS;
+}
+
+static pci_driver_t qemu_vga_driver = {"qemu-vga", qemu_vga_ids, qemu_vga_probe};
+
 
 /**
  * @brief void pci_init()
@@ -82,17 +424,21 @@ int32_t checkFunc(uint8_t bus, uint8_t device, pci_device_t* target_dev)
  * description: scans every slot of the PCI bus, detects and initializes everything.
  */
 void pci_init() {
-    uint8_t bus;
-
-    // Smart scan of the whole PCI bus.
-    // Start with bus 0, and if a PCI bridge is detected, add that bridge into list.
-    for(bus = 0; bus < PCI_COUNT_BUS; bus++) {
-        printf("PCI scan on bus %d\n", bus);
-        if (SUCCESS == checkDevice(bus)) {
-            printf("PCI scan complete\n");
-            return;
+    uint32_t header_type;
+    int32_t func;
+
+    // bus 0 is behind host bridge 0:0.0, a multifunction host bridge has one bus per function
+    header_type = (pci_config_read(0, 0, 0, 3) >> 16) & 0xFF;
+    if (!(header_type & PCI_HEADER_MULTIFUNC)) {
+        pci_scan_bus(0);
+    } else {
+        for (func = 0; func < PCI_COUNT_FUNC; func++) {
+            if (PCI_INVALID_ID != (pci_config_read(0, 0, func, 0) & 0xFFFF))
+                pci_scan_bus(func);
         }
     }
+    printf("PCI scan complete, %d functions\n", pci_func_count);
+    pci_register_driver(&qemu_vga_driver);
 }
 
 
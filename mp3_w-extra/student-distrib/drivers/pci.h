@@ -37,6 +37,19 @@
 #define PCI_QEMUVGA_DEVICE_ID       0x1111
 #define PCI_INVALID_ID              0xFFFF
 
+/* command register, the low half of dword 1 */
+#define PCI_REG_COMMAND             1
+#define PCI_COMMAND_IO              0x1
+#define PCI_COMMAND_MEMORY          0x2
+#define PCI_COMMAND_BUS_MASTER      0x4
+#define PCI_COMMAND_INTX_DISABLE    0x400
+
+#define PCI_CLASS_STORAGE           0x01
+#define PCI_SUBCLASS_IDE            0x01
+
+/* legacy interrupt lines the firmware gives PCI devices, each has a linkage in the IDT */
+#define PCI_IRQ_HANDLER_MAX         8
+
 #define PCI_TYPE_STANDARD           0
 #define PCI_TYPE_PCI_PCI            1       // PCI-PCI Bridge
 #define PCI_TYPE_CARDBUS            2       // PCI-CardBus bridge
@@ -169,10 +182,91 @@ typedef union {
 
 
 
-/* functions to initialize the VGA */
+#define PCI_BAR_COUNT               6
+#define PCI_DEV_MAX                 32      // functions kept in the registry
+#define PCI_DRIVER_MAX              8
+#define PCI_ANY_ID                  0xFFFF  // matches any value in a pci_id_t
+
+#define PCI_HEADER_MULTIFUNC        0x80    // in header_type
+#define PCI_CLASS_BRIDGE            0x06
+#define PCI_SUBCLASS_PCI_BRIDGE     0x04
+#define PCI_STATUS_CAP_LIST         0x10    // in the status register, the function has capabilities
+#define PCI_REG_CAP_PTR             0x34    // byte offset of the first capability
+#define PCI_CAP_ID_MSI              0x05
+#define PCI_CAP_ID_MSIX             0x11
+
+/* MSI capability: message control in the upper half of the first dword, then the address and data */
+#define PCI_MSI_CTRL_ENABLE         0x0001
+#define PCI_MSI_CTRL_MME            0x0070  // multiple message enable, 0 for one vector
+#define PCI_MSI_CTRL_64BIT          0x0080
+/* MSI-X capability: table BAR and offset in the second dword, 16 byte entries */
+#define PCI_MSIX_CTRL_MASKALL       0x4000
+#define PCI_MSIX_CTRL_ENABLE        0x8000
+#define PCI_MSIX_BIR_MASK           0x7
+#define PCI_MSIX_ENTRY_MASKED       0x1
+
+/* a decoded base address register */
+typedef struct pci_bar {
+    uint32_t base;          // 0 if the BAR is not implemented
+    uint32_t size;
+    uint8_t is_io;
+    uint8_t prefetchable;
+    uint8_t is_64;          // the next BAR holds the upper half of the address
+} pci_bar_t;
+
+struct pci_driver;
+
+/* a function found by pci_init */
+typedef struct pci_func {
+    uint8_t bus;
+    uint8_t device;
+    uint8_t func;
+    pci_device_t header;    // first 64 bytes of the configuration space, read once at boot
+    pci_bar_t bar[PCI_BAR_COUNT];
+    uint8_t irq;            // legacy interrupt line assigned by the firmware, 0xFF for none
+    uint8_t msi_cap;        // offset of the MSI capability, 0 if absent
+    uint8_t msix_cap;       // offset of the MSI-X capability, 0 if absent
+    struct pci_driver* driver;
+} pci_func_t;
+
+/* ids a driver handles, any field may be PCI_ANY_ID, a table ends with vendor_id 0 */
+typedef struct pci_id {
+    uint16_t vendor_id;
+    uint16_t device_id;
+    uint16_t class_code;
+    uint16_t subclass;
+} pci_id_t;
+
+typedef struct pci_driver {
+    const int8_t* name;
+    const pci_id_t* ids;
+    /* called for every matching function, SUCCESS binds the function to the driver */
+    int32_t (*probe)(pci_func_t* dev);
+} pci_driver_t;
+
+/* scan every bus behind the host bridges and fill the registry */
 void pci_init();
-int32_t checkDevice(uint8_t bus);
-int32_t checkFunc(uint8_t bus, uint8_t device, pci_device_t* target_dev);
+
+/* configuration space access, reg is the index of a dword */
+uint32_t pci_config_read(uint8_t bus, uint8_t device, uint8_t func, uint8_t reg);
+void pci_config_write(uint8_t bus, uint8_t device, uint8_t func, uint8_t reg, uint32_t val);
+/* set bits of the command register, e.g. PCI_COMMAND_BUS_MASTER */
+void pci_enable(pci_func_t* dev, uint16_t command);
+
+/* add a driver and probe it on the functions it matches that have no driver yet */
+int32_t pci_register_driver(pci_driver_t* driver);
+/* the i-th function of the registry, NULL past the end */
+pci_func_t* pci_get_func(int32_t i);
+
+/* share a legacy interrupt line (5, 9, 10 or 11) with other PCI devices, the handler checks its own device */
+int32_t pci_irq_register(uint8_t irq, void (*handler)(void* data), void* data);
+/* called by the linkage of a line, runs every handler registered on it */
+void pci_irq_handler(uint32_t irq);
+/* deliver the interrupts of a function as messages to a vector of its own, instead
+ * of the legacy line; returns the vector, FAIL if there is no MSI/MSI-X or no vector */
+int32_t pci_enable_msi(pci_func_t* dev, void (*handler)(void* data), void* data);
+/* back to the legacy line, after a probe that enabled MSI failed */
+void pci_disable_msi(pci_func_t* dev, int32_t vector);
 
 
 #endif
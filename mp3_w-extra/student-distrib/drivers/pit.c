@@ -2,6 +2,10 @@
 #include "../types.h"
 #include "pit.h"
 #include "i8259.h"
+#include "../kernel/signal.h"
+#include "../kernel/poll.h"
+#include "../kernel/trace.h"
+#include "scrollback.h"
 // Add more if necessary
 
 
@@ -63,6 +67,9 @@ void pit_handler(void)
     // Change the next line to schedule handler later...
     //printf("PIT interrupt received!\n");
     char time[] = "00:00:00";
+    signal_tick();
+    poll_tick();
+    trace_dump_tick();
     if (++second_counter == SECOND_RATE) {
         if (++second == MINUTE) {
             second = 0;
@@ -81,11 +88,8 @@ void pit_handler(void)
         pit_counter = 0;
     }
     if (show_picture == 0 && ++pit_counter == FRESH_COUNTER) {
-        vga_color_t font, back;
-        font.val = TERMINAL_FONT_COLOR;
-        back.val = TERMINAL_BACKGROUND_COLOR;
-        terminal_t* current_terminal = get_active_terminal();
-        vbe_transfer((uint8_t*)current_terminal->screen_buffer, current_picture_addr(), &font, &back);
+        // the live screen, or the scrollback the user is looking at
+        scrollback_render();
         icon_update(current_active_termid);
         //vbe_mouse_update(cursor_x, cursor_y);
         pit_counter = 0;
@@ -9,9 +9,13 @@
  */
 
 #include "rtc.h"
+#include "../kernel/schedule.h"
+#include "../kernel/poll.h"
 
 // The flag denotes rtc interrupts happening 
 volatile int32_t rtc_flag;
+// readers and poll calls waiting for the next interrupt
+static wait_queue_t rtc_wq;
 
 /* 
  * rtc_init
@@ -114,12 +118,13 @@ void rtc_handler(void)
         // This line read the data from data port but throw it away
         inb(DATA_PORT);		    // just throw away contents
 
-        // clear rtc_flag to make read ends
+        // set rtc_flag to make read ends
         // rtc_flag = 0;
         int i;
         for (i = 0; i < TERMINAL_NUM; i++) {
-            multi_terminals[i].rtc_flag = 0;
+            multi_terminals[i].rtc_flag = 1;
         }
+        wake_up(&rtc_wq);
 
         // sti();
 
@@ -141,6 +146,8 @@ int32_t rtc_open(void)
 {
     int32_t retval;
     retval = set_rate(BOTTOM_RATE);
+    // the first read waits for an interrupt after the open
+    (process_terminal)->rtc_flag = 0;
     if (retval == -1) {
         return -1;
     } else {
@@ -152,32 +159,52 @@ int32_t rtc_open(void)
 
 /* 
  * rtc_read
- *  DESCRIPTION: read data from rtc 
- *  INPUTS: none
+ *  DESCRIPTION: read data from rtc, wait for an interrupt unless one came
+ *               since the last read (rtc_flag of the terminal is set)
+ *  INPUTS: fd_flags - with O_NONBLOCK, fail instead of waiting
  *  OUTPUTS: none
- *  RETURN VALUE: 0 always after an interrupt occurs
- *  SIDE EFFECTS: none
+ *  RETURN VALUE: 0 always after an interrupt occurs, -1 if there was none and
+ *                the fd does not block, or if a signal kills the program meanwhile
+ *  SIDE EFFECTS: clears rtc_flag of the terminal
  */
-int32_t rtc_read(uint32_t inode_num, int32_t position, void* buf, int32_t nbytes)
+int32_t rtc_read(uint32_t inode_num, int32_t position, void* buf, int32_t nbytes, int32_t fd_flags)
 {
-    /* it is tricky because we have no idea when the IF is clear
-     * we have to add a sti here to enable rtc interrupt */
-    // sti();
-    // set a flag 
-    // vga_color_t fontcolor;
-    // fontcolor.val = 0xFFFFFF;
-    // vga_color_t backcolor;
-    // backcolor.val = 0x000000;
-    // vbe_transfer((uint8_t*)multi_terminals[get_active_pcb()->terminalid].screen_buffer, current_running_addr(), &fontcolor, &backcolor);
-    (process_terminal)->rtc_flag = 1;
-
-    // wait until the interrupt handler cleans it
-    while((process_terminal)->rtc_flag);
+    terminal_t* term = process_terminal;
+    uint32_t flags;
+
+    cli_and_save(flags);
+    // wait until the interrupt handler sets it
+    while (!term->rtc_flag) {
+        if ((fd_flags & O_NONBLOCK) || signal_fatal_pending()) {
+            restore_flags(flags);
+            return -1;
+        }
+        sleep_on(&rtc_wq);
+    }
+    term->rtc_flag = 0;
+    restore_flags(flags);
 
     // return 0 always after an interrupt occurs
     return 0;
 }
 
+/* 
+ * rtc_poll
+ *  DESCRIPTION: whether rtc_read would return at once, the interrupt handler
+ *               wakes the poll call
+ *  INPUTS: pt - the poll call, NULL to only ask
+ *  OUTPUTS: none
+ *  RETURN VALUE: POLLOUT, and POLLIN if an interrupt came since the last read
+ *  SIDE EFFECTS: none
+ */
+int32_t rtc_poll(uint32_t inode_num, poll_table_t* pt)
+{
+    poll_wait(&rtc_wq, pt);
+    if ((process_terminal)->rtc_flag)
+        return POLLIN | POLLOUT;
+    return POLLOUT;
+}
+
 
 /* 
  * rtc_write
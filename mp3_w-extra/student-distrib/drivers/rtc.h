@@ -83,8 +83,12 @@ void rtc_init(void);
 void rtc_handler(void);
 /* open rtc file */
 int32_t rtc_open(void);
+struct poll_table;
+
 /* read data from rtc */
-int32_t rtc_read(uint32_t inode_num, int32_t position, void* buf, int32_t nbytes);
+int32_t rtc_read(uint32_t inode_num, int32_t position, void* buf, int32_t nbytes, int32_t fd_flags);
+/* whether a read of the rtc would block, for poll */
+int32_t rtc_poll(uint32_t inode_num, struct poll_table* pt);
 /* write data to rtc */
 int32_t rtc_write(int32_t fd, const void* buf, int32_t nbytes);
 /* close rtc file descriptor and make it available for return from later calls to open*/
@@ -0,0 +1,119 @@
+/**
+ * @file scrollback.c
+ * @brief Scrollback of the terminals, see scrollback.h. The rings live in their own
+ *        4MB of physical memory, identity mapped for the kernel. A view is composed
+ *        in a text page, the old lines above the top of the live screen, and drawn
+ *        with vbe_transfer like the live screen is.
+ * @version 0.1
+ * @date 2022-06-03
+ */
+
+#include "scrollback.h"
+#include "terminal.h"
+#include "vbe.h"
+#include "../kernel/paging.h"
+
+/* row n of the ring, counted from the first line ever pushed */
+#define line_of(sb, n)  ((sb)->lines + ((n) & (SCROLLBACK_LINES - 1)) * NUM_COLS)
+/* lines the ring still holds */
+#define kept(sb)        ((sb)->head < SCROLLBACK_LINES ? (sb)->head : SCROLLBACK_LINES)
+
+static scrollback_t scrollbacks[TERMINAL_NUM];
+/* text page a view is composed in */
+static uint16_t view_page[NUM_ROWS * NUM_COLS];
+
+/**
+ * @brief give every terminal its ring, they are empty
+ */
+void scrollback_init(void)
+{
+    int32_t i;
+
+    for (i = 0; i < TERMINAL_NUM; i++) {
+        scrollbacks[i].lines = (uint16_t*)(SCROLLBACK_PHY_BEGIN + i * SCROLLBACK_LINES * NUM_COLS * sizeof(uint16_t));
+        scrollbacks[i].head = 0;
+        scrollbacks[i].view = 0;
+    }
+}
+
+/**
+ * @brief keep a row that scrolls off the top of a terminal, the oldest line is overwritten
+ * @param tid - the terminal
+ * @param row - NUM_COLS character and attribute cells
+ */
+void scrollback_push(int32_t tid, const uint8_t* row)
+{
+    scrollback_t* sb = &scrollbacks[tid];
+
+    memcpy(line_of(sb, sb->head), row, NUM_COLS * sizeof(uint16_t));
+    sb->head++;
+    // a view stays on the lines it shows, as long as the ring has them
+    if (sb->view && sb->view < kept(sb))
+        sb->view++;
+}
+
+/**
+ * @brief whether a terminal shows old lines instead of its live screen
+ * @param tid - the terminal
+ * @return nonzero if it does
+ */
+int32_t scrollback_viewing(int32_t tid)
+{
+    return 0 != scrollbacks[tid].view;
+}
+
+/**
+ * @brief move the view of the shown terminal and draw it
+ * @param lines - how far, back into the scrollback if positive
+ */
+void scrollback_scroll(int32_t lines)
+{
+    scrollback_t* sb = &scrollbacks[current_active_termid];
+    int32_t view = (int32_t)sb->view + lines;
+
+    if (!qemu_vga_enabled || show_picture)
+        return;
+    if (view < 0)
+        view = 0;
+    if (view > (int32_t)kept(sb))
+        view = kept(sb);
+    if (view == sb->view)
+        return;
+    sb->view = view;
+    scrollback_render();
+}
+
+/**
+ * @brief the shown terminal goes back to its live screen
+ */
+void scrollback_reset(void)
+{
+    if (!scrollbacks[current_active_termid].view)
+        return;
+    scrollbacks[current_active_termid].view = 0;
+    scrollback_render();
+}
+
+/**
+ * @brief draw the shown terminal to its VBE screen: the live screen, or the view
+ *        made of the last lines of the ring and the top of the live screen
+ */
+void scrollback_render(void)
+{
+    terminal_t* term = get_active_terminal();
+    scrollback_t* sb = &scrollbacks[current_active_termid];
+    uint16_t* screen = (uint16_t*)term->screen_buffer;
+    int32_t row;
+
+    if (0 == sb->view) {
+        vbe_transfer((uint8_t*)screen, current_picture_addr());
+        return;
+    }
+    for (row = 0; row < NUM_ROWS; row++) {
+        if ((uint32_t)row < sb->view)
+            memcpy(&view_page[row * NUM_COLS], line_of(sb, sb->head - sb->view + row), NUM_COLS * sizeof(uint16_t));
+        else
+            memcpy(&view_page[row * NUM_COLS], &screen[(row - sb->view) * NUM_COLS], NUM_COLS * sizeof(uint16_t));
+    }
+    vbe_transfer((uint8_t*)view_page, current_picture_addr());
+}
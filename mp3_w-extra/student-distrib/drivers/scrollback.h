@@ -0,0 +1,43 @@
+/**
+ * @file scrollback.h
+ * @brief Scrollback of the terminals. The line that scrolls off the top of a
+ *        terminal is copied into a ring of SCROLLBACK_LINES lines of that terminal,
+ *        so keeping it costs one line copy and a head increment, and old lines are
+ *        overwritten in place. Shift+PgUp/PgDn move a view over the ring and the
+ *        live screen; the view is rendered to the VBE screen of the terminal and
+ *        stays on the same lines while output goes on. A keystroke that echoes
+ *        goes back to the live screen. Only with VBE, the text mode screen is the
+ *        VGA memory itself.
+ * @version 0.1
+ * @date 2022-06-03
+ */
+
+#ifndef _SCROLLBACK_H
+#define _SCROLLBACK_H
+
+#include "../types.h"
+
+#define SCROLLBACK_LINES    4096        // lines kept per terminal, a power of 2
+#define SCROLLBACK_PAGE     23          // lines moved by Shift+PgUp/PgDn, one less than the text rows
+
+typedef struct scrollback
+{
+    uint16_t*   lines;                  // SCROLLBACK_LINES rows of NUM_COLS cells
+    uint32_t    head;                   // lines pushed so far, the next goes to head % SCROLLBACK_LINES
+    uint32_t    view;                   // lines the view is scrolled back, 0 for the live screen
+} scrollback_t;
+
+/* give every terminal its ring in the scrollback frames */
+void scrollback_init(void);
+/* keep the top row of a terminal that is about to scroll off */
+void scrollback_push(int32_t tid, const uint8_t* row);
+/* the terminal shows old lines, its output must not be drawn on the VBE screen */
+int32_t scrollback_viewing(int32_t tid);
+/* move the view of the shown terminal back (lines > 0) or forward */
+void scrollback_scroll(int32_t lines);
+/* back to the live screen of the shown terminal */
+void scrollback_reset(void);
+/* draw the shown terminal, its view or its live screen */
+void scrollback_render(void);
+
+#endif /* _SCROLLBACK_H */
@@ -0,0 +1,135 @@
+/**
+ * @file serial.c
+ * @brief COM1 output through a transmit ring. Any context may write, so the
+ *        ring is updated with interrupts disabled. The THRI interrupt is only
+ *        enabled while the ring has bytes for the UART.
+ * @version 0.1
+ * @date 2022-05-29
+ */
+
+#include "serial.h"
+#include "i8259.h"
+
+static int32_t serial_found = 0;
+
+static int8_t tx_ring[SERIAL_TX_SIZE];
+static uint32_t tx_head = 0;        // next byte to send
+static uint32_t tx_tail = 0;        // next free byte, head == tail when empty
+
+/**
+ * @brief set COM1 to 115200 8N1 with the FIFOs on, and check that it is there
+ * @return 0 success, -1 if no UART answers
+ */
+int32_t serial_init(void)
+{
+    outb(0x00, COM1_PORT + UART_IER);
+    outb(UART_LCR_DLAB, COM1_PORT + UART_LCR);
+    outb((UART_BAUD_BASE / UART_BAUD) & 0xFF, COM1_PORT + UART_DATA);
+    outb((UART_BAUD_BASE / UART_BAUD) >> 8, COM1_PORT + UART_IER);
+    outb(UART_LCR_8N1, COM1_PORT + UART_LCR);
+    outb(UART_FCR_ENABLE, COM1_PORT + UART_FCR);
+    outb(UART_MCR_DTR_RTS | UART_MCR_OUT2, COM1_PORT + UART_MCR);
+    // nothing decodes the port if it reads back as all ones
+    if (0xFF == inb(COM1_PORT + UART_LSR))
+        return -1;
+    serial_found = 1;
+    enable_irq(COM1_IRQ);
+    return 0;
+}
+
+/* 1 if serial_init found the UART */
+int32_t serial_present(void)
+{
+    return serial_found;
+}
+
+/**
+ * @brief move bytes from the ring to the UART if its FIFO is empty, and ask for
+ *        an interrupt when it is empty again; called with interrupts disabled
+ */
+static void serial_tx_fill(void)
+{
+    int32_t i;
+    if (inb(COM1_PORT + UART_LSR) & UART_LSR_THRE) {
+        for (i = 0; i < UART_FIFO_SIZE && tx_head != tx_tail; i++, tx_head++)
+            outb(tx_ring[tx_head & (SERIAL_TX_SIZE - 1)], COM1_PORT + UART_DATA);
+    }
+    outb(tx_head == tx_tail ? 0 : UART_IER_THRI, COM1_PORT + UART_IER);
+}
+
+/* append one byte, sending by polling while the ring is full */
+static void serial_tx_push(int8_t c)
+{
+    while (SERIAL_TX_SIZE == tx_tail - tx_head) {
+        while (!(inb(COM1_PORT + UART_LSR) & UART_LSR_THRE));
+        serial_tx_fill();
+    }
+    tx_ring[tx_tail & (SERIAL_TX_SIZE - 1)] = c;
+    tx_tail++;
+}
+
+/**
+ * @brief free space in the transmit ring, all of it if there is no UART since writes are dropped
+ */
+int32_t serial_tx_room(void)
+{
+    return SERIAL_TX_SIZE - (tx_tail - tx_head);
+}
+
+/**
+ * @brief queue one byte
+ */
+void serial_putc(int8_t c)
+{
+    serial_write(&c, 1);
+}
+
+/**
+ * @brief queue n bytes, "\n" goes out as "\r\n" for terminals on the host
+ */
+void serial_write(const int8_t* buf, int32_t n)
+{
+    uint32_t flags;
+    int32_t i;
+
+    if (!serial_found)
+        return;
+    cli_and_save(flags);
+    for (i = 0; i < n; i++) {
+        if ('\n' == buf[i])
+            serial_tx_push('\r');
+        serial_tx_push(buf[i]);
+    }
+    serial_tx_fill();
+    restore_flags(flags);
+}
+
+/**
+ * @brief wait until the ring is empty and the UART has sent everything, by polling
+ *        so that it also works with interrupts disabled (e.g. before shutting down)
+ */
+void serial_flush(void)
+{
+    uint32_t flags;
+
+    if (!serial_found)
+        return;
+    cli_and_save(flags);
+    while (tx_head != tx_tail) {
+        while (!(inb(COM1_PORT + UART_LSR) & UART_LSR_THRE));
+        serial_tx_fill();
+    }
+    // the transmitter itself is empty too
+    while (!(inb(COM1_PORT + UART_LSR) & UART_LSR_TEMT));
+    restore_flags(flags);
+}
+
+/**
+ * @brief COM1 interrupt, the only source enabled is THRI; reading IIR acknowledges it
+ */
+void serial_handler(void)
+{
+    inb(COM1_PORT + UART_IIR);
+    serial_tx_fill();
+    send_eoi(COM1_IRQ);
+}
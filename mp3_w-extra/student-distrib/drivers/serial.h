@@ -0,0 +1,58 @@
+/**
+ * @file serial.h
+ * @brief COM1, a 16550 UART, for output that the host can capture
+ *        (qemu -serial stdio or -serial file:log). Writers only copy into a
+ *        transmit ring; the UART interrupt refills its 16 byte FIFO from it,
+ *        so a write costs a copy and not 10 bit times per byte.
+ * @version 0.1
+ * @date 2022-05-29
+ * @ref https://wiki.osdev.org/Serial_Ports
+ */
+
+#ifndef _SERIAL_H
+#define _SERIAL_H
+
+#include "../types.h"
+#include "../lib.h"
+
+#define COM1_PORT           0x3F8
+#define COM1_IRQ            4
+
+/* registers, offsets from the port */
+#define UART_DATA           0       // THR on write, RBR on read; divisor low with DLAB
+#define UART_IER            1       // divisor high with DLAB
+#define UART_IIR            2       // on read
+#define UART_FCR            2       // on write
+#define UART_LCR            3
+#define UART_MCR            4
+#define UART_LSR            5
+
+#define UART_IER_THRI       0x02    // interrupt when the transmit holding register empties
+#define UART_LCR_8N1        0x03
+#define UART_LCR_DLAB       0x80
+#define UART_FCR_ENABLE     0xC7    // enable and clear the FIFOs, 14 byte threshold
+#define UART_MCR_DTR_RTS    0x03
+#define UART_MCR_OUT2       0x08    // gates the interrupt line of the UART
+#define UART_LSR_THRE       0x20    // the transmit holding register is empty
+#define UART_LSR_TEMT       0x40    // the shift register is empty as well
+#define UART_BAUD_BASE      115200
+#define UART_BAUD           115200
+#define UART_FIFO_SIZE      16
+
+#define SERIAL_TX_SIZE      8192    // transmit ring, a power of 2
+
+/* set up COM1, 0 on success, -1 if there is no UART */
+int32_t serial_init(void);
+/* 1 if serial_init found the UART */
+int32_t serial_present(void);
+/* bytes that can be queued without waiting, "\n" takes two */
+int32_t serial_tx_room(void);
+/* queue bytes for COM1, waits only if the ring is full */
+void serial_write(const int8_t* buf, int32_t n);
+void serial_putc(int8_t c);
+/* wait until everything queued is sent */
+void serial_flush(void);
+/* interrupt handler of COM1 */
+void serial_handler(void);
+
+#endif /* _SERIAL_H */
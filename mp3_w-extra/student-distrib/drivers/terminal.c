@@ -8,6 +8,31 @@
  */
 
 #include "terminal.h"
+#include "serial.h"
+#include "scrollback.h"
+#include "../kernel/schedule.h"
+#include "../kernel/poll.h"
+
+/* readers of each terminal waiting for its input ring */
+static wait_queue_t read_wq[TERMINAL_NUM];
+
+/**
+ * @brief put bytes into an input ring, all of them or none, called by the keyboard handler
+ * @return nonzero if they are in
+ */
+static int32_t input_put(input_ring_t* in, const uint8_t* data, int32_t n)
+{
+    int32_t i;
+
+    if (INPUT_RING_SIZE - (in->head - in->tail) < (uint32_t)n)
+        return 0;
+    for (i = 0; i < n; i++)
+        in->buf[(in->head + i) & (INPUT_RING_SIZE - 1)] = data[i];
+    // the bytes are in the ring before the reader can see the new head
+    asm volatile ("" : : : "memory");
+    in->head += n;
+    return 1;
+}
 
 /*
  * terminal_open
@@ -61,10 +86,13 @@ int32_t terminal_open(void)
 int32_t terminal_close(void)
 {
     terminal_t* current_terminal = get_active_terminal();
+    terminal_t* run_terminal = process_terminal;
     int i;
 
     // mark the terminal is off
     current_terminal->terminal_active = 0;
+    // a program that ends in raw mode leaves a canonical terminal behind
+    run_terminal->mode = TERM_MODE_DEFAULT;
 
     // clear screen
     //clear();
@@ -80,60 +108,183 @@ int32_t terminal_close(void)
 
 /*
  * terminal_read
- *   DESCRIPTION: read from the terminal. Keystroke will be stored into keyboard
- *                buffer and echo on the screen. Reading terminates when caller
- *                presses ENTER. the maximum # of bytes read is 128 and the last
- *                byte is '\n'. Caller needs to allocate space for buf
+ *   DESCRIPTION: read from the terminal of the running process. Keys typed
+ *                before the read are kept in its input ring. In canonical mode
+ *                the ring only gets whole lines and a read returns at most one,
+ *                '\n' included; in raw mode it returns the keys there are. Waits
+ *                on the terminal's wait queue while the ring is empty.
  *   INPUTS: buf: destination of character reading. Must be at least nbytes large
- *        nbytes: # of bytes read from terminal
- *   OUTPUTS: echoes for keystroke
- *   RETURN VALUE: # of elements read (including '\n')
- *   SIDE EFFECTS: arg buf is filled. Keyboard buffer is cleared.
+ *        nbytes: # of bytes read from terminal, the rest of a line is kept for the next read
+ *        fd_flags: with O_NONBLOCK an empty ring fails instead of waiting
+ *   OUTPUTS: none
+ *   RETURN VALUE: # of elements read, -1 if a signal kills the program meanwhile
+ *                 or if there is nothing to read and the fd does not block
+ *   SIDE EFFECTS: arg buf is filled. The bytes leave the input ring.
  */
-int32_t terminal_read(uint32_t inode_num, int32_t position, char *buf, int32_t nbytes)
+int32_t terminal_read(uint32_t inode_num, int32_t position, char *buf, int32_t nbytes, int32_t fd_flags)
 {
-    cli();
     terminal_t* current_terminal = &multi_terminals[get_active_pcb()->terminalid];
+    input_ring_t* in = &current_terminal->input;
+    uint32_t flags;
+    int32_t bytes_num = 0;
+    uint8_t c;
+
     if (buf == NULL || nbytes < 0)
         return -1;
-    
-    int32_t i;
+    if (0 == nbytes)
+        return 0;
+
+    cli_and_save(flags);
+    while (in->head == in->tail) {
+        // a signal that kills the program ends the wait, as if nothing was typed
+        if ((fd_flags & O_NONBLOCK) || signal_fatal_pending()) {
+            restore_flags(flags);
+            return -1;
+        }
+        sleep_on(&read_wq[current_terminal->tid]);
+    }
+    restore_flags(flags);
+
+    /* only this side moves tail, the keyboard handler may add keys meanwhile */
+    while (bytes_num < nbytes && in->tail != in->head) {
+        c = in->buf[in->tail & (INPUT_RING_SIZE - 1)];
+        in->tail++;
+        buf[bytes_num++] = c;
+        if ('\n' == c && (current_terminal->mode & TERM_CANON))
+            break;
+    }
+    return bytes_num;
+}
 
-    /* signal interrupt handler to store char into buffer */
-    current_terminal->TERMINAL_READ_FLAG = 1;
-    int32_t bytes_num = 0;
-    /* clear keyboard buffer */
-    current_terminal->buf_index = 0;
-    /* wait until interrupt handler clear TERMINAL_READ_FLAG
-     * i.e. ENTER is pressed by user
-     */
-    sti();
+/*
+ * terminal_poll
+ *   DESCRIPTION: whether terminal_read would return at once, the keyboard
+ *                handler wakes the poll call when the input ring gets bytes
+ *   INPUTS: pt: the poll call, NULL to only ask
+ *   OUTPUTS: none
+ *   RETURN VALUE: POLLOUT, and POLLIN if the input ring of the terminal of the
+ *                 running process has something (a whole line in canonical mode)
+ *   SIDE EFFECTS: none
+ */
+int32_t terminal_poll(uint32_t inode_num, poll_table_t* pt)
+{
+    terminal_t* current_terminal = process_terminal;
 
-    while (current_terminal->TERMINAL_READ_FLAG);
+    poll_wait(&read_wq[current_terminal->tid], pt);
+    if (current_terminal->input.head != current_terminal->input.tail)
+        return POLLIN | POLLOUT;
+    return POLLOUT;
+}
 
-    
-    for (i = 0; i < BUFFER_SIZE; i++){
-        /* copy from keyboard buffer to history buffer*/
-        current_terminal->history[current_terminal->history_num][i] = current_terminal->buffer[i];
-
-        if (current_terminal->buffer[i] == '\n' || current_terminal->buffer[i] == '\r'){
-            current_terminal->terminal_active = 1;
-            //if (bytes_num > i)
-            if(i < BUFFER_SIZE) bytes_num = i + 1;
-            
-            /* copy from keyboard buffer to caller's buffer*/
-            (void)strncpy((int8_t *)buf, (int8_t *)current_terminal->buffer, bytes_num);
-            memset((void *)current_terminal->buffer, 0, (uint32_t)BUFFER_SIZE);
-            break;
+/*
+ * terminal_ioctl
+ *   DESCRIPTION: get or set the line discipline of the terminal of the running
+ *                process. Leaving canonical mode drops the line being edited.
+ *   INPUTS: request: TERM_GETMODE or TERM_SETMODE
+ *           arg: the mode bits for TERM_SETMODE
+ *   OUTPUTS: none
+ *   RETURN VALUE: the mode bits for TERM_GETMODE, 0 for TERM_SETMODE, -1 for failure
+ *   SIDE EFFECTS: none
+ */
+int32_t terminal_ioctl(int32_t request, int32_t arg)
+{
+    terminal_t* term = process_terminal;
+    uint32_t flags;
+
+    switch (request) {
+    case TERM_GETMODE:
+        return term->mode;
+    case TERM_SETMODE:
+        if (arg & ~TERM_MODE_DEFAULT)
+            return -1;
+        cli_and_save(flags);
+        if (!(arg & TERM_CANON))
+            term->buf_index = 0;
+        term->mode = arg;
+        restore_flags(flags);
+        return 0;
+    default:
+        return -1;
+    }
+}
+
+/*
+ * terminal_input
+ *   DESCRIPTION: the line discipline of the shown terminal, called by the
+ *                keyboard handler. In raw mode every key goes to the input ring.
+ *                In canonical mode keys edit the line in the terminal's buffer
+ *                ('\b' erases) and '\n' moves the line to the ring and to the
+ *                history. Readers are woken when the ring gets bytes.
+ *   INPUTS: c: the key, '\n' for enter and '\b' for backspace
+ *   OUTPUTS: the echo, if TERM_ECHO is set
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: a full ring drops the key or the line
+ */
+void terminal_input(uint8_t c)
+{
+    terminal_t* current_terminal = get_active_terminal();
+    int32_t echo = current_terminal->mode & TERM_ECHO;
+    int32_t len;
+
+    if (!(current_terminal->mode & TERM_CANON)) {
+        if (!input_put(&current_terminal->input, &c, 1))
+            return;
+        if (echo && '\b' == c)
+            backspace();
+        else if (echo && (c >= ' ' || '\n' == c))
+            putk(c);
+        wake_up(&read_wq[current_terminal->tid]);
+        return;
+    }
+
+    switch (c) {
+    case '\b':
+        if (0 == current_terminal->buf_index)
+            return;
+        current_terminal->buf_index--;
+        if (echo)
+            backspace();
+        return;
+    case '\n':
+        current_terminal->buffer[current_terminal->buf_index] = '\n';
+        len = current_terminal->buf_index + 1;
+        current_terminal->buf_index = 0;
+        if (echo)
+            putk('\n');
+        // update the history info
+        if (current_terminal->history_num < HITORY_BUF_SIZE) {
+            memcpy(current_terminal->history[current_terminal->history_num], current_terminal->buffer, len);
+            current_terminal->history_num++;
         }
-        bytes_num = bytes_num + 1;
+        current_terminal->history_index = current_terminal->history_num - 1;
+        if (input_put(&current_terminal->input, (uint8_t*)current_terminal->buffer, len))
+            wake_up(&read_wq[current_terminal->tid]);
+        return;
+    default:
+        if (current_terminal->buf_index >= BUFFER_SIZE - 1)
+            return;
+        current_terminal->buffer[current_terminal->buf_index++] = c;
+        if (echo)
+            putk(c);
     }
-    bytes_num = (nbytes < bytes_num) ? nbytes : bytes_num;
-    // update the history info
-    current_terminal->history_num++;
-    current_terminal->history_index = current_terminal->history_num - 1;  
-    
-    return bytes_num;
+}
+
+/*
+ * terminal_interrupt
+ *   DESCRIPTION: ctrl+c on the shown terminal, its program gets SIG_INTERRUPT
+ *                and a read it sleeps in wakes up to die
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: the line being edited is dropped
+ */
+void terminal_interrupt(void)
+{
+    if (NULL == scheduled_process[current_active_termid])
+        return;
+    get_active_terminal()->buf_index = 0;
+    signal_send(scheduled_process[current_active_termid]->leader, SIG_INTERRUPT);
+    wake_up(&read_wq[current_active_termid]);
 }
 
 /*
@@ -152,17 +303,30 @@ int32_t terminal_write(int32_t fd, char *buf, int32_t nbytes)
     {
         return -1;
     }
+    terminal_t* term = process_terminal;
+    int32_t idx, start;
+    /* the serial port gets the runs of bytes between NULs, which the screen skips too */
+    if (term->output & TERM_OUT_SERIAL) {
+        for (idx = start = 0; idx <= nbytes; idx++) {
+            if (idx == nbytes || !buf[idx]) {
+                serial_write(buf + start, idx - start);
+                start = idx + 1;
+            }
+        }
+    }
+    if (!(term->output & TERM_OUT_SCREEN))
+        return nbytes;
     cli();
-    /* iterate over char in buf and put it on screen */
-    int32_t idx;
+    /* iterate over char in buf, the escape sequences are interpreted */
     for (idx = 0; idx < nbytes; idx++)
     {
         if (!buf[idx])
             continue;
         // display
-        putc(buf[idx]);
+        vt100_putc(term, buf[idx]);
     }
-    //printf("\n");
+    if (term->tid == current_active_termid)
+        update_cursor(term->cursor_x, term->cursor_y);
     sti();
     return nbytes;
 }
@@ -250,20 +414,25 @@ int32_t terminal_init()
     int i;
     for (i = 0; i < TERMINAL_NUM; i++) {
         multi_terminals[i].tid = i;
-        multi_terminals[i].TERMINAL_READ_FLAG = 1;
         multi_terminals[i].terminal_active = 0;
         multi_terminals[i].buf_index = 0;
+        multi_terminals[i].mode = TERM_MODE_DEFAULT;
+        multi_terminals[i].input.head = 0;
+        multi_terminals[i].input.tail = 0;
         multi_terminals[i].cursor_x = 0;
         multi_terminals[i].cursor_y = 0;
         multi_terminals[i].put_mode = 1;
         multi_terminals[i].screen_buffer = (uint32_t*) (TERM_VID_BEGIN + VID_SIZE*i);
         multi_terminals[i].rtc_flag = 0;
         multi_terminals[i].rtc_rate = 2; // bottom rate
+        multi_terminals[i].output = TERM_OUT_SCREEN;
         multi_terminals[i].history_num = 0; //total number of history
         multi_terminals[i].history_index = -1; //current index of history
         multi_terminals[i].history_size = 100;
+        vt100_init(&multi_terminals[i].vt);
     }
     current_active_termid = 0;
+    scrollback_init();
     return 0;
 }
 /*
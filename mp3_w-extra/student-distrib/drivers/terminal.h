@@ -13,6 +13,7 @@
 #include "../kernel/pcb.h"
 #include "vbe.h"
 #include "statusbar.h"
+#include "vt100.h"
 
 #ifndef _TERMINAL_H
 #define _TERMINAL_H
@@ -32,23 +33,53 @@
 
 #define HITORY_BUF_SIZE     100
 
+/* where terminal_write puts the output, a terminal on COM1 skips the rendering */
+#define TERM_OUT_SCREEN     0x1
+#define TERM_OUT_SERIAL     0x2
+
+#define INPUT_RING_SIZE     512         // type-ahead kept per terminal, a power of 2
+
+/* line discipline, the mode bits of a terminal */
+#define TERM_CANON          0x1         // reads get whole lines, edited with backspace, tab and history
+#define TERM_ECHO           0x2         // keys are echoed on the screen
+#define TERM_MODE_DEFAULT   (TERM_CANON | TERM_ECHO)
+
+/* requests of ioctl on a terminal fd */
+#define TERM_GETMODE        1           // returns the mode bits
+#define TERM_SETMODE        2           // arg is the new mode bits
+
+/* keys waiting to be read, the keyboard handler is the only producer and
+ * terminal_read the only consumer; each side writes only its own index, so
+ * the handler never waits for a reader */
+typedef struct input_ring
+{
+    volatile uint32_t   head;           // bytes put so far, by the keyboard handler
+    volatile uint32_t   tail;           // bytes taken so far, by the reader
+    uint8_t             buf[INPUT_RING_SIZE];
+} input_ring_t;
+
+struct poll_table;
+
 typedef struct terminal
 { 
-    /* whether the terminal is reading from keystrokes */
-    volatile int32_t TERMINAL_READ_FLAG;
     /* stand for whether this terminal has been opened */
     volatile int32_t terminal_active;
-    /* store user's keystrokes to the terminal */
     int32_t tid;
+    /* the line being edited in canonical mode, it goes to the input ring on enter */
     char buffer[BUFFER_SIZE];
     /* track the position of latest char in the buffer */
     int buf_index;
+    /* TERM_CANON and TERM_ECHO bits */
+    int32_t mode;
+    /* keys and lines for terminal_read */
+    input_ring_t input;
     /* store cursor position */
     int32_t cursor_x;
     int32_t cursor_y;
     int32_t put_mode;
-    int32_t rtc_flag;
+    int32_t rtc_flag;   // an rtc interrupt came since the last rtc read
     int32_t rtc_rate;
+    int32_t output;     // TERM_OUT_* bits
 
     char history[HITORY_BUF_SIZE][BUFFER_SIZE];
     int32_t history_num;
@@ -57,6 +88,8 @@ typedef struct terminal
 
     /* screen buffer to store the video content for current terminal */
     uint32_t* screen_buffer;
+    /* escape sequence parser of terminal_write */
+    vt100_t vt;
 } terminal_t;
 
 void terminal_switch(int32_t new_ter);
@@ -77,7 +110,15 @@ int32_t terminal_close(void);
 /* write to the terminal from arg buf */
 int32_t terminal_write(int32_t fd, char *buf, int32_t nbytes);
 /* read from the terminal. */
-int32_t terminal_read(uint32_t inode_num, int32_t position, char *buf, int32_t nbytes);
+int32_t terminal_read(uint32_t inode_num, int32_t position, char *buf, int32_t nbytes, int32_t fd_flags);
+/* whether a read of the terminal would block, for poll */
+int32_t terminal_poll(uint32_t inode_num, struct poll_table* pt);
+/* TERM_GETMODE and TERM_SETMODE on the terminal of the running process */
+int32_t terminal_ioctl(int32_t request, int32_t arg);
+/* a key of the shown terminal, through its line discipline */
+void terminal_input(uint8_t c);
+/* ctrl+c on the shown terminal */
+void terminal_interrupt(void);
 /* initialize terminals */
 int32_t terminal_init();
 /* get avtive terminal */
@@ -198,6 +198,43 @@ uint32_t vbe_get_pixel(uint16_t scr_x, uint16_t scr_y)
 }
 
 
+/* the 16 colors of a VGA attribute nibble as pixels, 0 and 7 (ATTRIB) are the terminal's own */
+static const uint32_t vbe_palette[VBE_PALETTE_SIZE] = {
+    TERMINAL_BACKGROUND_COLOR, 0x0000AA, 0x00AA00, 0x00AAAA,
+    0xAA0000, 0xAA00AA, 0xAA5500, TERMINAL_FONT_COLOR,
+    0x555555, 0x5555FF, 0x55FF55, 0x55FFFF,
+    0xFF5555, 0xFF55FF, 0xFFFF55, 0xFFFFFF
+};
+
+
+/**
+ * @brief draw a glyph with its gap column, a row of pixels at a time
+ * 
+ * @param scr_x - screen x (up-left corner of the character)
+ * @param scr_y - screen y
+ * @param c     - char
+ * @param font  - pixel of the set bits
+ * @param back  - pixel of the clear bits and of the gap
+ * @param display_vidmem - the VBE screen
+ */
+static void vbe_draw_glyph(uint16_t scr_x, uint16_t scr_y, uint8_t c, uint32_t font, uint32_t back, uint32_t display_vidmem)
+{
+    uint32_t* row = (uint32_t*)display_vidmem + scr_y * FONT_DATA_HEIGHT * qemu_vga_xres + scr_x * FONT_ACTUAL_WIDTH;
+    int w, h;
+
+    font &= RGB32_MASK;
+    back &= RGB32_MASK;
+    for (h = 0; h < FONT_DATA_HEIGHT; h++, row += qemu_vga_xres) {
+        uint8_t bits = font_data[c][h];
+        for (w = 0; w < FONT_DATA_WIDTH; w++)
+            row[w] = (bits & (1 << (7 - w))) ? font : back;
+        /* the actual width of a char is 9 as there is one pixel gap between characters */
+        for (w = FONT_DATA_WIDTH; w < FONT_ACTUAL_WIDTH; w++)
+            row[w] = back;
+    }
+}
+
+
 /**
  * @brief put character into current active memory
  * 
@@ -211,29 +248,11 @@ void vbe_putc(uint16_t scr_x, uint16_t scr_y, uint8_t c, vga_color_t* fontcolor,
 {
     /* check availability */
     if (!qemu_vga_enabled)  return;
-    int w, h;
-
-    for (h = 0; h < FONT_DATA_HEIGHT; h++) {
-        for (w = 0; w < FONT_DATA_WIDTH; w++) {
-            uint8_t mask = 1<<(7 - w);
-            if(font_data[c][h] & mask) 
-                vbe_onepixel_color_set(scr_x*FONT_ACTUAL_WIDTH + w, scr_y*FONT_DATA_HEIGHT + h, current_running_addr(), fontcolor);
-            else 
-                vbe_onepixel_color_set(scr_x*FONT_ACTUAL_WIDTH + w, scr_y*FONT_DATA_HEIGHT + h, current_running_addr(), backbolor);
-        }
-        /* the actual width of a char is 9 as there is one pixel gap between characters */
-        for (w = FONT_DATA_WIDTH; w < FONT_ACTUAL_WIDTH; w++) 
-            vbe_onepixel_color_set(scr_x*FONT_ACTUAL_WIDTH + w, scr_y*FONT_DATA_HEIGHT + h, current_running_addr(), backbolor);
-    }
-    return;
+    if (scr_x >= SCREEN_COL || scr_y >= SCREEN_ROW)    return;
+    vbe_draw_glyph(scr_x, scr_y, c, fontcolor->val, backbolor->val, current_running_addr());
 }
 
 
-
-
-
-
-
 /**
  * @brief put character into current displaying memory
  * 
@@ -247,54 +266,47 @@ void vbe_putk(uint16_t scr_x, uint16_t scr_y, uint8_t c, vga_color_t* fontcolor,
 {
     /* check availability */
     if (!qemu_vga_enabled)  return;
-    int w, h;
+    if (scr_x >= SCREEN_COL || scr_y >= SCREEN_ROW)    return;
+    vbe_draw_glyph(scr_x, scr_y, c, fontcolor->val, backbolor->val, current_picture_addr());
+}
 
-    for (h = 0; h < FONT_DATA_HEIGHT; h++) {
-        for (w = 0; w < FONT_DATA_WIDTH; w++) {
-            uint8_t mask = 1<<(7 - w);
-            if(font_data[c][h] & mask) 
-                vbe_onepixel_color_set(scr_x*FONT_ACTUAL_WIDTH + w, scr_y*FONT_DATA_HEIGHT + h, current_picture_addr(), fontcolor);
-            else 
-                vbe_onepixel_color_set(scr_x*FONT_ACTUAL_WIDTH + w, scr_y*FONT_DATA_HEIGHT + h, current_picture_addr(), backbolor);
-        }
-        /* the actual width of a char is 9 as there is one pixel gap between characters */
-        for (w = FONT_DATA_WIDTH; w < FONT_ACTUAL_WIDTH; w++) 
-            vbe_onepixel_color_set(scr_x*FONT_ACTUAL_WIDTH + w, scr_y*FONT_DATA_HEIGHT + h, current_picture_addr(), backbolor);
-    }
-    return;
+
+/**
+ * @brief draw a cell of a text page, its attribute gives the colors
+ * 
+ * @param scr_x - screen x (up-left corner of the character)
+ * @param scr_y - screen y
+ * @param cell  - the character in the low byte, the VGA attribute in the high one
+ * @param display - 1 for the displaying memory, 0 for the current active one
+ */
+void vbe_putcell(uint16_t scr_x, uint16_t scr_y, uint16_t cell, int display)
+{
+    /* check availability */
+    if (!qemu_vga_enabled)  return;
+    if (scr_x >= SCREEN_COL || scr_y >= SCREEN_ROW)    return;
+    vbe_draw_glyph(scr_x, scr_y, cell & 0xFF, vbe_palette[(cell >> 8) & 0xF], vbe_palette[(cell >> 12) & 0xF],
+                   display == 1 ? current_picture_addr() : current_running_addr());
 }
 
 
 /**
- * @brief it transfers the text video memory into the display video memory
+ * @brief it transfers the text video memory into the display video memory,
+ *        each cell in the colors of its attribute
  * 
  * @param text_vidmem 
  * @param display_vidmem 
- * @param fontcolor 
- * @param backcolor 
  */
-void vbe_transfer(uint8_t* text_vidmem, uint32_t display_vidmem, vga_color_t* fontcolor, vga_color_t* backcolor)
+void vbe_transfer(uint8_t* text_vidmem, uint32_t display_vidmem)
 {
     /* check availability */
     if (!qemu_vga_enabled || show_picture)  return;
 
+    uint16_t* cells = (uint16_t*)text_vidmem;
     int scr_x, scr_y;
     for (scr_y = 1; scr_y < SCREEN_ROW; scr_y++) {
         for (scr_x = 0; scr_x < SCREEN_COL; scr_x++) {
-            uint8_t c = *(uint8_t *)(text_vidmem + ((NUM_COLS * scr_y + scr_x) << 1));
-            int w, h;
-            for (h = 0; h < FONT_DATA_HEIGHT; h++) {
-                for (w = 0; w < FONT_DATA_WIDTH; w++) {
-                    uint8_t mask = 1<<(7 - w);
-                    if(font_data[c][h] & mask) 
-                        vbe_onepixel_color_set(scr_x*FONT_ACTUAL_WIDTH + w, scr_y*FONT_DATA_HEIGHT + h, display_vidmem, fontcolor);
-                    else 
-                        vbe_onepixel_color_set(scr_x*FONT_ACTUAL_WIDTH + w, scr_y*FONT_DATA_HEIGHT + h, display_vidmem, backcolor);
-                }
-                /* the actual width of a char is 9 as there is one pixel gap between characters */
-                for (w = FONT_DATA_WIDTH; w < FONT_ACTUAL_WIDTH; w++) 
-                    vbe_onepixel_color_set(scr_x*FONT_ACTUAL_WIDTH + w, scr_y*FONT_DATA_HEIGHT + h, display_vidmem, backcolor);
-            }
+            uint16_t cell = cells[NUM_COLS * scr_y + scr_x];
+            vbe_draw_glyph(scr_x, scr_y, cell & 0xFF, vbe_palette[(cell >> 8) & 0xF], vbe_palette[(cell >> 12) & 0xF], display_vidmem);
         }
     } return;
 }
@@ -114,6 +114,7 @@
 #define VBEFAIL                         -1
 #define DESKTOP1                        3
 #define DESKTOP2                        4
+#define VBE_PALETTE_SIZE                16
 
 
 
@@ -187,7 +188,8 @@ uint32_t current_running_addr();
 uint32_t vbe_get_pixel(uint16_t scr_x, uint16_t scr_y);
 void vbe_putc(uint16_t scr_x, uint16_t scr_y, uint8_t c, vga_color_t* fontcolor, vga_color_t* backbolor);
 void vbe_putk(uint16_t scr_x, uint16_t scr_y, uint8_t c, vga_color_t* fontcolor, vga_color_t* backbolor);
-void vbe_transfer(uint8_t* text_vidmem, uint32_t display_vidmem, vga_color_t* fontcolor, vga_color_t* backbolor);
+void vbe_putcell(uint16_t scr_x, uint16_t scr_y, uint16_t cell, int display);
+void vbe_transfer(uint8_t* text_vidmem, uint32_t display_vidmem);
 void vbe_rollup(int display);
 
 /* functions to draw mouse */
@@ -0,0 +1,254 @@
+/**
+ * @file virtio_blk.c
+ * @brief virtio-blk driver. Requests go into free slots of the virtqueue right away
+ *        and the device is notified once per submit; when every slot is busy they
+ *        wait in a list and are started from the interrupt handler as slots free up.
+ * @version 0.1
+ * @date 2022-05-28
+ */
+
+#include "virtio_blk.h"
+#include "pci.h"
+
+static virtio_blk_t vblks[VIRTIO_BLK_MAX];
+static int32_t vblk_count = 0;
+/* ring memory of every device, page aligned as the legacy interface requires */
+static uint8_t vring_mem[VIRTIO_BLK_MAX][VIRTIO_RING_SIZE] __attribute__((aligned(VIRTQ_ALIGN)));
+static const int8_t* vblk_names[VIRTIO_BLK_MAX] = {"vda", "vdb"};
+
+/* put a request into a free slot and make it available to the device, interrupts disabled */
+static void vblk_start(virtio_blk_t* vb, blk_req_t* req)
+{
+    int32_t slot;
+    virtq_desc_t* d;
+
+    for (slot = 0; NULL != vb->slots[slot].req; slot++);
+    vb->slots[slot].req = req;
+    vb->slots[slot].hdr.type = req->write ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_IN;
+    vb->slots[slot].hdr.reserved = 0;
+    vb->slots[slot].hdr.sector = req->blk * BLK_SECTORS;
+    vb->slots[slot].hdr.sector_high = 0;
+    vb->slots[slot].status = 0xFF;
+
+    d = &vb->desc[3 * slot];
+    d[0].addr = (uint32_t)&vb->slots[slot].hdr;
+    d[0].addr_high = 0;
+    d[0].len = sizeof(virtio_blk_hdr_t);
+    d[0].flags = VIRTQ_DESC_F_NEXT;
+    d[0].next = 3 * slot + 1;
+    d[1].addr = (uint32_t)req->buf;
+    d[1].addr_high = 0;
+    d[1].len = BLK_SIZE;
+    d[1].flags = VIRTQ_DESC_F_NEXT | (req->write ? 0 : VIRTQ_DESC_F_WRITE);
+    d[1].next = 3 * slot + 2;
+    d[2].addr = (uint32_t)&vb->slots[slot].status;
+    d[2].addr_high = 0;
+    d[2].len = 1;
+    d[2].flags = VIRTQ_DESC_F_WRITE;
+    d[2].next = 0;
+
+    vb->avail->ring[vb->avail->idx % vb->queue_size] = 3 * slot;
+    // the descriptors must be visible before the index that publishes them
+    asm volatile ("" : : : "memory");
+    vb->avail->idx++;
+    vb->in_flight++;
+}
+
+/* complete the requests the device is done with and fill the freed slots, interrupts disabled */
+static void vblk_reap(virtio_blk_t* vb)
+{
+    virtq_used_elem_t* e;
+    virtio_blk_slot_t* slot;
+    blk_req_t* req;
+    int32_t started = 0;
+
+    while (vb->last_used != vb->used->idx) {
+        e = &vb->used->ring[vb->last_used % vb->queue_size];
+        vb->last_used++;
+        if (e->id >= 3 * vb->slot_count || NULL == (slot = &vb->slots[e->id / 3])->req)
+            continue;
+        req = slot->req;
+        slot->req = NULL;
+        vb->in_flight--;
+        blk_complete(req, (VIRTIO_BLK_S_OK == slot->status) ? 1 : -1);
+    }
+    while (NULL != vb->head && vb->in_flight < vb->slot_count) {
+        req = vb->head;
+        vb->head = req->next;
+        if (NULL == vb->head)
+            vb->tail = NULL;
+        vblk_start(vb, req);
+        started = 1;
+    }
+    if (started)
+        outw(0, vb->io + VIRTIO_REG_QUEUE_NOTIFY);
+}
+
+/**
+ * @brief submit operation of a virtio disk
+ * @return 0 queued, -1 bad request
+ */
+static int32_t vblk_submit(blk_dev_t* dev, blk_req_t* req)
+{
+    virtio_blk_t* vb = (virtio_blk_t*)dev->priv;
+    uint32_t flags;
+
+    if (req->blk >= dev->blk_count)
+        return -1;
+    req->next = NULL;
+    cli_and_save(flags);
+    if (vb->in_flight < vb->slot_count) {
+        vblk_start(vb, req);
+        outw(0, vb->io + VIRTIO_REG_QUEUE_NOTIFY);
+    } else {
+        if (NULL == vb->tail) vb->head = req;
+        else vb->tail->next = req;
+        vb->tail = req;
+    }
+    restore_flags(flags);
+    return 0;
+}
+
+/**
+ * @brief poll operation, completes what the device finished without waiting for the interrupt
+ */
+static void vblk_poll(blk_dev_t* dev)
+{
+    vblk_reap((virtio_blk_t*)dev->priv);
+}
+
+/* handler on the shared PCI line, reading the ISR acknowledges the interrupt */
+static void vblk_handler(void* data)
+{
+    virtio_blk_t* vb = (virtio_blk_t*)data;
+    if (inb(vb->io + VIRTIO_REG_ISR) & 0x1)
+        vblk_reap(vb);
+}
+
+/* handler of the MSI-X vector, the queue is the only source, so no ISR read */
+static void vblk_msi_handler(void* data)
+{
+    vblk_reap((virtio_blk_t*)data);
+}
+
+/**
+ * @brief reset a device and set up its only queue
+ * @return 0 success, -1 if the device cannot be driven
+ */
+static int32_t vblk_setup(virtio_blk_t* vb, uint8_t* ring)
+{
+    uint32_t size;
+
+    outb(0, vb->io + VIRTIO_REG_STATUS);
+    outb(VIRTIO_STATUS_ACK, vb->io + VIRTIO_REG_STATUS);
+    outb(VIRTIO_STATUS_ACK | VIRTIO_STATUS_DRIVER, vb->io + VIRTIO_REG_STATUS);
+    // no optional feature is needed, requests are plain 4KB reads and writes
+    inl(vb->io + VIRTIO_REG_DEVICE_FEATURES);
+    outl(0, vb->io + VIRTIO_REG_GUEST_FEATURES);
+
+    outw(0, vb->io + VIRTIO_REG_QUEUE_SELECT);
+    size = inw(vb->io + VIRTIO_REG_QUEUE_SIZE);
+    if (size < 3 || size > VIRTIO_QUEUE_MAX) {
+        outb(VIRTIO_STATUS_FAILED, vb->io + VIRTIO_REG_STATUS);
+        return -1;
+    }
+    vb->queue_size = size;
+    // legacy layout: descriptors, available ring, then the used ring on the next page
+    memset(ring, 0, VIRTIO_RING_SIZE);
+    vb->desc = (virtq_desc_t*)ring;
+    vb->avail = (virtq_avail_t*)(ring + sizeof(virtq_desc_t) * size);
+    vb->used = (virtq_used_t*)(ring + ((sizeof(virtq_desc_t) * size + 6 + 2 * size + VIRTQ_ALIGN - 1) & ~(VIRTQ_ALIGN - 1)));
+    vb->last_used = 0;
+    vb->slot_count = size / 3;
+    vb->in_flight = 0;
+    vb->head = vb->tail = NULL;
+    memset(vb->slots, 0, sizeof(vb->slots));
+    outl((uint32_t)ring / VIRTQ_ALIGN, vb->io + VIRTIO_REG_QUEUE_PFN);
+    if (-1 != vb->msi_vector) {
+        // queue 0 to entry 0 of the table, configuration changes to no entry
+        outw(VIRTIO_MSI_NO_VECTOR, vb->io + VIRTIO_REG_MSI_CONFIG);
+        outw(0, vb->io + VIRTIO_REG_MSI_QUEUE);
+        if (0 != inw(vb->io + VIRTIO_REG_MSI_QUEUE)) {
+            outb(VIRTIO_STATUS_FAILED, vb->io + VIRTIO_REG_STATUS);
+            return -1;
+        }
+    }
+
+    outb(VIRTIO_STATUS_ACK | VIRTIO_STATUS_DRIVER | VIRTIO_STATUS_DRIVER_OK, vb->io + VIRTIO_REG_STATUS);
+    return 0;
+}
+
+static const pci_id_t vblk_pci_ids[] = {
+    {VIRTIO_VENDOR_ID, VIRTIO_BLK_DEVICE_ID, PCI_ANY_ID, PCI_ANY_ID},
+    {0, 0, 0, 0}
+};
+
+/**
+ * @brief probe of a virtio-blk function, sets up the device and its interrupt
+ * @return SUCCESS if the disk can be used
+ */
+static int32_t vblk_pci_probe(pci_func_t* pci_dev)
+{
+    virtio_blk_t* vb;
+    uint32_t sectors;
+
+    // the legacy registers are in an io BAR
+    if (VIRTIO_BLK_MAX == vblk_count || !pci_dev->bar[0].is_io || 0 == pci_dev->bar[0].base)
+        return FAIL;
+    vb = &vblks[vblk_count];
+    vb->io = pci_dev->bar[0].base;
+    vb->irq = pci_dev->irq;
+    pci_enable(pci_dev, PCI_COMMAND_IO | PCI_COMMAND_BUS_MASTER);
+    // MSI-X moves the device registers, so it is chosen before the setup
+    vb->msi_vector = pci_enable_msi(pci_dev, vblk_msi_handler, vb);
+    vb->cfg = vb->io + (-1 == vb->msi_vector ? VIRTIO_REG_CONFIG : VIRTIO_REG_CONFIG_MSIX);
+    if (-1 == vblk_setup(vb, vring_mem[vblk_count])) {
+        // the function is left as it was found, and the vector to another device
+        if (-1 != vb->msi_vector)
+            pci_disable_msi(pci_dev, vb->msi_vector);
+        return FAIL;
+    }
+    // requests are waited for by sleeping, so the interrupt is required
+    if (-1 == vb->msi_vector && FAIL == pci_irq_register(vb->irq, vblk_handler, vb)) {
+        printf("virtio-blk: IRQ %d is not routed\n", vb->irq);
+        outb(VIRTIO_STATUS_FAILED, vb->io + VIRTIO_REG_STATUS);
+        return FAIL;
+    }
+    // 28 bits of blocks are plenty for the file system
+    sectors = inl(vb->cfg + VIRTIO_BLK_CAPACITY);
+    if (inl(vb->cfg + VIRTIO_BLK_CAPACITY + 4))
+        sectors = 0xFFFFFFF8;
+    vb->dev.name = vblk_names[vblk_count];
+    vb->dev.blk_count = sectors / BLK_SECTORS;
+    vb->dev.priv = vb;
+    vb->dev.submit = vblk_submit;
+    vb->dev.poll = vblk_poll;
+    if (-1 == vb->msi_vector)
+        printf("virtio-blk %s: %d blocks, queue of %d, IRQ %d\n", vb->dev.name, vb->dev.blk_count, vb->queue_size, vb->irq);
+    else
+        printf("virtio-blk %s: %d blocks, queue of %d, MSI-X vector 0x%x\n", vb->dev.name, vb->dev.blk_count, vb->queue_size, vb->msi_vector);
+    vblk_count++;
+    return SUCCESS;
+}
+
+static pci_driver_t vblk_pci_driver = {"virtio-blk", vblk_pci_ids, vblk_pci_probe};
+
+/**
+ * @brief register the driver, the disks are set up as they are matched
+ */
+void virtio_blk_init(void)
+{
+    pci_register_driver(&vblk_pci_driver);
+}
+
+/**
+ * @brief get a disk found by virtio_blk_init
+ * @param i - index in the order of the PCI scan
+ * @return the block device, NULL if there are not that many disks
+ */
+blk_dev_t* virtio_blk_get_dev(int32_t i)
+{
+    if (i < 0 || i >= vblk_count)
+        return NULL;
+    return &vblks[i].dev;
+}
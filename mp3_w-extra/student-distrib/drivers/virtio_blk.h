@@ -0,0 +1,126 @@
+/**
+ * @file virtio_blk.h
+ * @brief virtio block devices through the legacy PCI interface. One virtqueue
+ *        holds many requests in flight, each a chain of three descriptors
+ *        (header, 4KB of data, status byte), completed by the device interrupt,
+ *        an MSI-X message when the system has a local APIC, the legacy line otherwise.
+ * @version 0.1
+ * @date 2022-05-28
+ * @ref https://docs.oasis-open.org/virtio/virtio/v1.1/virtio-v1.1.html (legacy interface, 4.1.4.8)
+ *      https://wiki.osdev.org/Virtio
+ */
+
+#ifndef _VIRTIO_BLK_H
+#define _VIRTIO_BLK_H
+
+#include "../types.h"
+#include "../lib.h"
+#include "bcache.h"
+
+#define VIRTIO_VENDOR_ID            0x1AF4
+#define VIRTIO_BLK_DEVICE_ID        0x1001  // transitional device, has the legacy interface
+
+/* legacy registers, offsets from BAR0 (io space) */
+#define VIRTIO_REG_DEVICE_FEATURES  0x00
+#define VIRTIO_REG_GUEST_FEATURES   0x04
+#define VIRTIO_REG_QUEUE_PFN        0x08
+#define VIRTIO_REG_QUEUE_SIZE       0x0C
+#define VIRTIO_REG_QUEUE_SELECT     0x0E
+#define VIRTIO_REG_QUEUE_NOTIFY     0x10
+#define VIRTIO_REG_STATUS           0x12
+#define VIRTIO_REG_ISR              0x13
+#define VIRTIO_REG_CONFIG           0x14    // device specific registers start here...
+#define VIRTIO_REG_CONFIG_MSIX      0x18    // ...or here while MSI-X is enabled
+#define VIRTIO_REG_MSI_CONFIG       0x14    // MSI-X entry of configuration changes
+#define VIRTIO_REG_MSI_QUEUE        0x16    // MSI-X entry of the selected queue
+#define VIRTIO_MSI_NO_VECTOR        0xFFFF
+#define VIRTIO_BLK_CAPACITY         0x00    // 64 bit, in 512 byte sectors, from the device registers
+
+#define VIRTIO_STATUS_ACK           0x01
+#define VIRTIO_STATUS_DRIVER        0x02
+#define VIRTIO_STATUS_DRIVER_OK     0x04
+#define VIRTIO_STATUS_FAILED        0x80
+
+#define VIRTQ_DESC_F_NEXT           0x1
+#define VIRTQ_DESC_F_WRITE          0x2     // the device writes the buffer
+#define VIRTQ_ALIGN                 0x1000
+
+#define VIRTIO_BLK_T_IN             0
+#define VIRTIO_BLK_T_OUT            1
+#define VIRTIO_BLK_S_OK             0
+
+#define VIRTIO_QUEUE_MAX            256     // largest queue the ring memory has room for
+#define VIRTIO_RING_SIZE            (3 * VIRTQ_ALIGN)   // descriptors, available and used rings of VIRTIO_QUEUE_MAX
+#define VIRTIO_SLOT_MAX             (VIRTIO_QUEUE_MAX / 3)
+#define VIRTIO_BLK_MAX              2
+
+typedef struct virtq_desc
+{
+    uint32_t    addr;
+    uint32_t    addr_high;
+    uint32_t    len;
+    uint16_t    flags;
+    uint16_t    next;
+} __attribute__((packed)) virtq_desc_t;
+
+typedef struct virtq_avail
+{
+    uint16_t            flags;
+    volatile uint16_t   idx;
+    uint16_t            ring[];
+} __attribute__((packed)) virtq_avail_t;
+
+typedef struct virtq_used_elem
+{
+    uint32_t    id;         // head of the descriptor chain
+    uint32_t    len;
+} __attribute__((packed)) virtq_used_elem_t;
+
+typedef struct virtq_used
+{
+    uint16_t            flags;
+    volatile uint16_t   idx;
+    virtq_used_elem_t   ring[];
+} __attribute__((packed)) virtq_used_t;
+
+typedef struct virtio_blk_hdr
+{
+    uint32_t    type;
+    uint32_t    reserved;
+    uint32_t    sector;
+    uint32_t    sector_high;
+} __attribute__((packed)) virtio_blk_hdr_t;
+
+/* a request in flight, it uses descriptors 3 * slot to 3 * slot + 2 */
+typedef struct virtio_blk_slot
+{
+    virtio_blk_hdr_t    hdr;
+    volatile uint8_t    status;
+    blk_req_t*          req;        // NULL if the slot is free
+} virtio_blk_slot_t;
+
+typedef struct virtio_blk
+{
+    uint16_t            io;
+    uint8_t             irq;
+    uint16_t            cfg;            // io address of the device specific registers
+    int32_t             msi_vector;     // -1 on the legacy line
+    uint16_t            queue_size;
+    virtq_desc_t*       desc;
+    virtq_avail_t*      avail;
+    virtq_used_t*       used;
+    uint16_t            last_used;      // used ring entries up to here are handled
+    int32_t             slot_count;
+    int32_t             in_flight;
+    virtio_blk_slot_t   slots[VIRTIO_SLOT_MAX];
+    blk_req_t*          head;           // waiting for a free slot
+    blk_req_t*          tail;
+    blk_dev_t           dev;
+} virtio_blk_t;
+
+/* register the driver, the disks are set up as pci_init found them; after i8259_init */
+void virtio_blk_init(void);
+/* the i-th virtio disk, NULL if there is none */
+blk_dev_t* virtio_blk_get_dev(int32_t i);
+
+#endif /* _VIRTIO_BLK_H */
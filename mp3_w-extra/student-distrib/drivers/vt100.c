@@ -0,0 +1,468 @@
+/**
+ * @file vt100.c
+ * @brief VT100/ANSI escape sequences, see vt100.h. The text page of a terminal is
+ *        the one putc writes: the VGA page while it is shown (under VBE that page
+ *        maps its screen buffer), its screen buffer otherwise. Every cell that
+ *        changes is drawn on the VBE screen of the terminal right away, unless the
+ *        scrollback is shown; the whole screen scrolling by one line moves pixels
+ *        like putc does, other scrolls redraw the rows of the region.
+ * @version 0.1
+ * @date 2022-06-03
+ */
+
+#include "vt100.h"
+#include "terminal.h"
+#include "scrollback.h"
+#include "vbe.h"
+
+#define ESC             0x1B
+#define CAN             0x18
+#define SUB             0x1A
+#define BEL             0x07
+#define DEL             0x7F
+#define COLOR_DEFAULT_FG 7      // the terminal's colors, ATTRIB
+#define COLOR_DEFAULT_BG 0
+#define COLOR_BRIGHT    0x8
+
+/* ANSI color numbers (black red green yellow blue magenta cyan white) to VGA ones */
+static const uint8_t ansi_to_vga[8] = { 0, 4, 2, 6, 1, 5, 3, 7 };
+
+#define vt_shown(term)  ((term)->tid == current_active_termid)
+#define vt_clamp(v, lo, hi) ((v) < (lo) ? (lo) : ((v) > (hi) ? (hi) : (v)))
+
+/* the page putc writes for this terminal */
+static uint16_t* vt_text(terminal_t* term)
+{
+    return vt_shown(term) ? (uint16_t*)PHYSICAL_VMEM_BEGIN : (uint16_t*)term->screen_buffer;
+}
+
+/* draw one cell on the VBE screen of the terminal */
+static void vt_draw(terminal_t* term, int32_t x, int32_t y)
+{
+    uint16_t cell = vt_text(term)[y * NUM_COLS + x];
+
+    if (!qemu_vga_enabled || scrollback_viewing(term->tid))
+        return;
+    if (!vt_shown(term))
+        vbe_putcell(x, y, cell, 0);
+    else if (!show_picture)
+        vbe_putcell(x, y, cell, 1);
+}
+
+static void vt_draw_rows(terminal_t* term, int32_t first, int32_t last)
+{
+    int32_t x, y;
+
+    for (y = first; y <= last; y++)
+        for (x = 0; x < NUM_COLS; x++)
+            vt_draw(term, x, y);
+}
+
+/* blank the cells [from, to) of the page, counted from the top left, and draw them */
+static void vt_erase(terminal_t* term, int32_t from, int32_t to, int32_t draw)
+{
+    uint16_t* text = vt_text(term);
+    uint16_t blank = (term->vt.attrib << 8) | ' ';
+    int32_t i;
+
+    for (i = from; i < to; i++) {
+        text[i] = blank;
+        if (draw)
+            vt_draw(term, i % NUM_COLS, i / NUM_COLS);
+    }
+}
+
+/**
+ * @brief move rows first + n ~ last up to first, blank the n rows at the bottom
+ * @param keep - the rows that leave the top of the screen go to the scrollback
+ */
+static void vt_scroll_up(terminal_t* term, int32_t first, int32_t last, int32_t n, int32_t keep)
+{
+    uint16_t* text = vt_text(term);
+    int32_t rows = last - first + 1, i;
+    int32_t whole = (0 == first && NUM_ROWS - 1 == last);
+
+    n = vt_clamp(n, 1, rows);
+    if (keep && whole)
+        for (i = 0; i < n; i++)
+            scrollback_push(term->tid, (uint8_t*)&text[i * NUM_COLS]);
+    memmove(&text[first * NUM_COLS], &text[(first + n) * NUM_COLS], (rows - n) * NUM_COLS * sizeof(uint16_t));
+    vt_erase(term, (last - n + 1) * NUM_COLS, (last + 1) * NUM_COLS, 0);
+    if (whole && 1 == n && qemu_vga_enabled && !scrollback_viewing(term->tid) &&
+        !(vt_shown(term) && show_picture)) {
+        // the pixels of the rows move, only the new row is drawn
+        vbe_rollup(vt_shown(term));
+        vt_draw_rows(term, last, last);
+    } else {
+        vt_draw_rows(term, first, last);
+    }
+}
+
+/* move rows first ~ last - n down to first + n, blank the n rows at the top */
+static void vt_scroll_down(terminal_t* term, int32_t first, int32_t last, int32_t n)
+{
+    uint16_t* text = vt_text(term);
+    int32_t rows = last - first + 1;
+
+    n = vt_clamp(n, 1, rows);
+    memmove(&text[(first + n) * NUM_COLS], &text[first * NUM_COLS], (rows - n) * NUM_COLS * sizeof(uint16_t));
+    vt_erase(term, first * NUM_COLS, (first + n) * NUM_COLS, 0);
+    vt_draw_rows(term, first, last);
+}
+
+/* next line, the scroll region scrolls when the cursor is on its last row */
+static void vt_linefeed(terminal_t* term)
+{
+    if (term->cursor_y == term->vt.scroll_bottom)
+        vt_scroll_up(term, term->vt.scroll_top, term->vt.scroll_bottom, 1, 1);
+    else if (term->cursor_y < NUM_ROWS - 1)
+        term->cursor_y++;
+}
+
+/* previous line, the scroll region scrolls back when the cursor is on its first row */
+static void vt_reverse_index(terminal_t* term)
+{
+    if (term->cursor_y == term->vt.scroll_top)
+        vt_scroll_down(term, term->vt.scroll_top, term->vt.scroll_bottom, 1);
+    else if (term->cursor_y > 0)
+        term->cursor_y--;
+}
+
+/* shift the rest of the cursor row right (n > 0, ICH) or left (n < 0, DCH) */
+static void vt_shift_line(terminal_t* term, int32_t n)
+{
+    uint16_t* row = vt_text(term) + term->cursor_y * NUM_COLS;
+    int32_t x = term->cursor_x, left = NUM_COLS - x, i;
+
+    n = (n > 0) ? vt_clamp(n, 1, left) : vt_clamp(n, -left, -1);
+    if (n > 0) {
+        memmove(&row[x + n], &row[x], (left - n) * sizeof(uint16_t));
+        vt_erase(term, term->cursor_y * NUM_COLS + x, term->cursor_y * NUM_COLS + x + n, 0);
+    } else {
+        memmove(&row[x], &row[x - n], (left + n) * sizeof(uint16_t));
+        vt_erase(term, (term->cursor_y + 1) * NUM_COLS + n, (term->cursor_y + 1) * NUM_COLS, 0);
+    }
+    for (i = x; i < NUM_COLS; i++)
+        vt_draw(term, i, term->cursor_y);
+}
+
+static void vt_update_attrib(vt100_t* vt)
+{
+    uint8_t fg = vt->fg | (vt->bold ? COLOR_BRIGHT : 0), bg = vt->bg;
+
+    vt->attrib = vt->reverse ? ((fg << 4) | bg) : ((bg << 4) | fg);
+}
+
+/* SGR, the attributes of the text written next */
+static void vt_sgr(vt100_t* vt)
+{
+    int32_t i, p;
+
+    if (0 == vt->nparams)
+        vt->params[vt->nparams++] = 0;
+    for (i = 0; i < vt->nparams; i++) {
+        p = vt->params[i];
+        if (0 == p) {
+            vt->fg = COLOR_DEFAULT_FG;
+            vt->bg = COLOR_DEFAULT_BG;
+            vt->bold = 0;
+            vt->reverse = 0;
+        } else if (1 == p) {
+            vt->bold = 1;
+        } else if (22 == p) {
+            vt->bold = 0;
+        } else if (7 == p) {
+            vt->reverse = 1;
+        } else if (27 == p) {
+            vt->reverse = 0;
+        } else if (p >= 30 && p <= 37) {
+            vt->fg = ansi_to_vga[p - 30];
+        } else if (39 == p) {
+            vt->fg = COLOR_DEFAULT_FG;
+        } else if (p >= 40 && p <= 47) {
+            vt->bg = ansi_to_vga[p - 40];
+        } else if (49 == p) {
+            vt->bg = COLOR_DEFAULT_BG;
+        } else if (p >= 90 && p <= 97) {
+            vt->fg = ansi_to_vga[p - 90] | COLOR_BRIGHT;
+        } else if (p >= 100 && p <= 107) {
+            vt->bg = ansi_to_vga[p - 100] | COLOR_BRIGHT;
+        }
+    }
+    vt_update_attrib(vt);
+}
+
+static void vt_save(terminal_t* term)
+{
+    term->vt.saved_x = term->cursor_x;
+    term->vt.saved_y = term->cursor_y;
+    term->vt.saved_attrib = term->vt.attrib;
+}
+
+static void vt_restore(terminal_t* term)
+{
+    term->cursor_x = term->vt.saved_x;
+    term->cursor_y = term->vt.saved_y;
+    term->vt.attrib = term->vt.saved_attrib;
+}
+
+/* the final byte of a CSI sequence */
+static void vt_csi(terminal_t* term, uint8_t c)
+{
+    vt100_t* vt = &term->vt;
+    int32_t p0 = vt->nparams > 0 ? vt->params[0] : 0;
+    int32_t p1 = vt->nparams > 1 ? vt->params[1] : 0;
+    int32_t n = p0 ? p0 : 1;
+    int32_t cursor = term->cursor_y * NUM_COLS + term->cursor_x;
+
+    vt->state = VT_NORMAL;
+    vt->wrap = 0;
+    if (vt->private)
+        return;
+    switch (c) {
+    case 'A':   // CUU
+        term->cursor_y = vt_clamp(term->cursor_y - n, 0, NUM_ROWS - 1);
+        break;
+    case 'B':   // CUD
+        term->cursor_y = vt_clamp(term->cursor_y + n, 0, NUM_ROWS - 1);
+        break;
+    case 'C':   // CUF
+        term->cursor_x = vt_clamp(term->cursor_x + n, 0, NUM_COLS - 1);
+        break;
+    case 'D':   // CUB
+        term->cursor_x = vt_clamp(term->cursor_x - n, 0, NUM_COLS - 1);
+        break;
+    case 'E':   // CNL
+        term->cursor_y = vt_clamp(term->cursor_y + n, 0, NUM_ROWS - 1);
+        term->cursor_x = 0;
+        break;
+    case 'F':   // CPL
+        term->cursor_y = vt_clamp(term->cursor_y - n, 0, NUM_ROWS - 1);
+        term->cursor_x = 0;
+        break;
+    case 'G':   // CHA
+        term->cursor_x = vt_clamp(n - 1, 0, NUM_COLS - 1);
+        break;
+    case 'd':   // VPA
+        term->cursor_y = vt_clamp(n - 1, 0, NUM_ROWS - 1);
+        break;
+    case 'H':   // CUP
+    case 'f':   // HVP
+        term->cursor_y = vt_clamp((p0 ? p0 : 1) - 1, 0, NUM_ROWS - 1);
+        term->cursor_x = vt_clamp((p1 ? p1 : 1) - 1, 0, NUM_COLS - 1);
+        break;
+    case 'J':   // ED
+        if (0 == p0)
+            vt_erase(term, cursor, NUM_ROWS * NUM_COLS, 1);
+        else if (1 == p0)
+            vt_erase(term, 0, cursor + 1, 1);
+        else if (2 == p0)
+            vt_erase(term, 0, NUM_ROWS * NUM_COLS, 1);
+        break;
+    case 'K':   // EL
+        if (0 == p0)
+            vt_erase(term, cursor, (term->cursor_y + 1) * NUM_COLS, 1);
+        else if (1 == p0)
+            vt_erase(term, term->cursor_y * NUM_COLS, cursor + 1, 1);
+        else if (2 == p0)
+            vt_erase(term, term->cursor_y * NUM_COLS, (term->cursor_y + 1) * NUM_COLS, 1);
+        break;
+    case 'X':   // ECH
+        vt_erase(term, cursor, cursor + vt_clamp(n, 0, NUM_COLS - term->cursor_x), 1);
+        break;
+    case 'L':   // IL
+        if (term->cursor_y >= vt->scroll_top && term->cursor_y <= vt->scroll_bottom) {
+            vt_scroll_down(term, term->cursor_y, vt->scroll_bottom, n);
+            term->cursor_x = 0;
+        }
+        break;
+    case 'M':   // DL
+        if (term->cursor_y >= vt->scroll_top && term->cursor_y <= vt->scroll_bottom) {
+            vt_scroll_up(term, term->cursor_y, vt->scroll_bottom, n, 0);
+            term->cursor_x = 0;
+        }
+        break;
+    case '@':   // ICH
+        vt_shift_line(term, n);
+        break;
+    case 'P':   // DCH
+        vt_shift_line(term, -n);
+        break;
+    case 'm':   // SGR
+        vt_sgr(vt);
+        break;
+    case 'r':   // DECSTBM, the cursor goes home
+        p0 = (p0 ? p0 : 1) - 1;
+        p1 = (p1 ? p1 : NUM_ROWS) - 1;
+        if (p0 < p1 && p1 < NUM_ROWS) {
+            vt->scroll_top = p0;
+            vt->scroll_bottom = p1;
+            term->cursor_x = 0;
+            term->cursor_y = 0;
+        }
+        break;
+    case 's':
+        vt_save(term);
+        break;
+    case 'u':
+        vt_restore(term);
+        break;
+    default:
+        break;
+    }
+}
+
+/* the byte after ESC */
+static void vt_esc(terminal_t* term, uint8_t c)
+{
+    vt100_t* vt = &term->vt;
+
+    vt->state = VT_NORMAL;
+    switch (c) {
+    case '[':
+        vt->state = VT_CSI;
+        vt->nparams = 0;
+        vt->private = 0;
+        return;
+    case '7':   // DECSC
+        vt_save(term);
+        break;
+    case '8':   // DECRC
+        vt_restore(term);
+        break;
+    case 'D':   // IND
+        vt_linefeed(term);
+        break;
+    case 'E':   // NEL
+        term->cursor_x = 0;
+        vt_linefeed(term);
+        break;
+    case 'M':   // RI
+        vt_reverse_index(term);
+        break;
+    case 'c':   // RIS
+        vt100_init(vt);
+        vt_erase(term, 0, NUM_ROWS * NUM_COLS, 1);
+        term->cursor_x = 0;
+        term->cursor_y = 0;
+        break;
+    default:
+        break;
+    }
+    vt->wrap = 0;
+}
+
+/**
+ * @brief default state: light gray on black, the whole screen scrolls
+ * @param vt - parser state of a terminal
+ */
+void vt100_init(vt100_t* vt)
+{
+    vt->state = VT_NORMAL;
+    vt->nparams = 0;
+    vt->private = 0;
+    vt->wrap = 0;
+    vt->scroll_top = 0;
+    vt->scroll_bottom = NUM_ROWS - 1;
+    vt->saved_x = 0;
+    vt->saved_y = 0;
+    vt->fg = COLOR_DEFAULT_FG;
+    vt->bg = COLOR_DEFAULT_BG;
+    vt->bold = 0;
+    vt->reverse = 0;
+    vt_update_attrib(vt);
+    vt->saved_attrib = vt->attrib;
+}
+
+/**
+ * @brief feed one byte written to a terminal, the cursor is left in the terminal
+ *        and the caller moves the hardware cursor
+ * @param term - terminal of the running process
+ * @param c - the byte
+ */
+void vt100_putc(terminal_t* term, uint8_t c)
+{
+    vt100_t* vt = &term->vt;
+
+    // putc or putk moved the cursor since the last column was written
+    if (vt->wrap && term->cursor_x != NUM_COLS - 1)
+        vt->wrap = 0;
+
+    /* controls act in the middle of a sequence too */
+    switch (c) {
+    case ESC:
+        vt->state = VT_ESC;
+        return;
+    case CAN:
+    case SUB:
+        vt->state = VT_NORMAL;
+        return;
+    case '\n':
+    case '\v':
+    case '\f':
+        vt->wrap = 0;
+        term->cursor_x = 0;
+        vt_linefeed(term);
+        return;
+    case '\r':
+        vt->wrap = 0;
+        term->cursor_x = 0;
+        return;
+    case '\b':
+        vt->wrap = 0;
+        if (term->cursor_x > 0)
+            term->cursor_x--;
+        return;
+    case '\t':
+        term->cursor_x = vt_clamp((term->cursor_x / VT_TAB + 1) * VT_TAB, 0, NUM_COLS - 1);
+        return;
+    case BEL:
+    case DEL:
+        return;
+    default:
+        if (c < ' ')
+            return;
+        break;
+    }
+
+    if (VT_ESC == vt->state) {
+        vt_esc(term, c);
+        return;
+    }
+    if (VT_CSI == vt->state) {
+        if (c >= '0' && c <= '9') {
+            if (0 == vt->nparams)
+                vt->params[vt->nparams++] = 0;
+            // saturated, so a long number cannot wrap around to a negative count
+            if (vt->nparams <= VT_PARAMS_MAX)
+                vt->params[vt->nparams - 1] = vt_clamp(vt->params[vt->nparams - 1] * 10 + c - '0', 0, VT_PARAM_LIMIT);
+        } else if (';' == c) {
+            if (0 == vt->nparams)
+                vt->params[vt->nparams++] = 0;
+            if (vt->nparams < VT_PARAMS_MAX)
+                vt->params[vt->nparams] = 0;
+            vt->nparams++;
+        } else if ('?' == c) {
+            vt->private = 1;
+        } else if (c >= '@' && c <= '~') {
+            if (vt->nparams > VT_PARAMS_MAX)
+                vt->nparams = VT_PARAMS_MAX;
+            vt_csi(term, c);
+        }
+        // intermediate bytes are ignored
+        return;
+    }
+
+    /* a printable character at the cursor */
+    if (vt->wrap) {
+        vt->wrap = 0;
+        term->cursor_x = 0;
+        vt_linefeed(term);
+    }
+    vt_text(term)[term->cursor_y * NUM_COLS + term->cursor_x] = (vt->attrib << 8) | c;
+    vt_draw(term, term->cursor_x, term->cursor_y);
+    if (NUM_COLS - 1 == term->cursor_x)
+        vt->wrap = 1;
+    else
+        term->cursor_x++;
+}
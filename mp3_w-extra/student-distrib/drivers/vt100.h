@@ -0,0 +1,56 @@
+/**
+ * @file vt100.h
+ * @brief VT100/ANSI escape sequences in terminal_write. Each terminal has its own
+ *        parser state, fed a byte at a time, so a sequence may be split across
+ *        writes. Supported: cursor movement and positioning (CUU CUD CUF CUB CNL
+ *        CPL CHA VPA CUP HVP), erase in display and line (ED EL ECH), insert and
+ *        delete of lines and characters (IL DL ICH DCH), SGR colors, bold and
+ *        reverse, scroll regions (DECSTBM, IND, RI), save and restore of the
+ *        cursor (DECSC DECRC, CSI s u) and reset (RIS). '\r' returns the carriage,
+ *        '\n' starts a new line, '\b' and '\t' move the cursor.
+ * @version 0.1
+ * @date 2022-06-03
+ * @ref https://vt100.net/docs/vt100-ug/chapter3.html
+ */
+
+#ifndef _VT100_H
+#define _VT100_H
+
+#include "../types.h"
+
+#define VT_PARAMS_MAX   8
+#define VT_PARAM_LIMIT  9999    // a longer number stops growing here
+#define VT_TAB          8
+
+/* parser states */
+#define VT_NORMAL       0
+#define VT_ESC          1       // after ESC
+#define VT_CSI          2       // after ESC [
+
+typedef struct vt100
+{
+    int32_t     state;
+    int32_t     params[VT_PARAMS_MAX];
+    int32_t     nparams;        // params given so far, the one being read included
+    int32_t     private;        // '?' right after the CSI, the sequence is ignored
+    int32_t     wrap;           // the last column was written, the next char wraps first
+    int32_t     scroll_top;     // scroll region, rows scroll_top ~ scroll_bottom
+    int32_t     scroll_bottom;
+    int32_t     saved_x;        // DECSC
+    int32_t     saved_y;
+    uint8_t     saved_attrib;
+    uint8_t     fg;             // colors of the text, VGA numbering
+    uint8_t     bg;
+    uint8_t     bold;
+    uint8_t     reverse;
+    uint8_t     attrib;         // the attribute byte written with the text
+} vt100_t;
+
+struct terminal;
+
+/* default state, the whole screen as the scroll region */
+void vt100_init(vt100_t* vt);
+/* one byte of terminal_write for a terminal of the running process */
+void vt100_putc(struct terminal* term, uint8_t c);
+
+#endif /* _VT100_H */
@@ -21,6 +21,12 @@
 #include "drivers/vbe.h"
 #include "data/desktop.h"
 #include "drivers/mouse.h"
+#include "kernel/shm.h"
+#include "drivers/ata.h"
+#include "drivers/virtio_blk.h"
+#include "drivers/lapic.h"
+#include "drivers/serial.h"
+#include "kernel/trace.h"
 
 #define RUN_TESTS
 
@@ -28,11 +34,43 @@
 /* Check if the bit BIT in FLAGS is set. */
 #define CHECK_FLAG(flags, bit)   ((flags) & (1 << (bit)))
 
+/* is opt one of the space separated words of the command line */
+static int32_t cmdline_has(const int8_t* cmdline, const int8_t* opt)
+{
+    uint32_t len = strlen(opt);
+    while (*cmdline) {
+        if (0 == strncmp(cmdline, opt, len) && (' ' == cmdline[len] || '\0' == cmdline[len]))
+            return 1;
+        while (*cmdline && ' ' != *cmdline) cmdline++;
+        while (' ' == *cmdline) cmdline++;
+    }
+    return 0;
+}
+
+/* copy the value of a "name=value" word of the command line into buf, 0 if found */
+static int32_t cmdline_get(const int8_t* cmdline, const int8_t* name, int8_t* buf, uint32_t size)
+{
+    uint32_t len = strlen(name), i;
+    while (*cmdline) {
+        if (0 == strncmp(cmdline, name, len)) {
+            cmdline += len;
+            for (i = 0; i + 1 < size && cmdline[i] && ' ' != cmdline[i]; i++)
+                buf[i] = cmdline[i];
+            buf[i] = '\0';
+            return 0;
+        }
+        while (*cmdline && ' ' != *cmdline) cmdline++;
+        while (' ' == *cmdline) cmdline++;
+    }
+    return -1;
+}
+
 /* Check if MAGIC is valid and print the Multiboot information structure
    pointed by ADDR. */
 void entry(unsigned long magic, unsigned long addr) {
 
     multiboot_info_t *mbi;
+    int32_t i, mounted, console = TERM_OUT_SCREEN;
 
     /* Clear the screen. */
     clear();
@@ -58,8 +96,16 @@ void entry(unsigned long magic, unsigned long addr) {
         printf("boot_device = 0x%#x\n", (unsigned)mbi->boot_device);
 
     /* Is the command line passed? */
-    if (CHECK_FLAG(mbi->flags, 2))
+    if (CHECK_FLAG(mbi->flags, 2)) {
         printf("cmdline = %s\n", (char *)mbi->cmdline);
+        /* console=serial: terminal 0 writes to COM1 only, console=both: to the screen and COM1 */
+        if (cmdline_has((int8_t*)mbi->cmdline, "console=serial"))
+            console = TERM_OUT_SERIAL;
+        else if (cmdline_has((int8_t*)mbi->cmdline, "console=both"))
+            console = TERM_OUT_SCREEN | TERM_OUT_SERIAL;
+        /* init=prog runs prog instead of the shell on terminal 0, for headless runs */
+        cmdline_get((int8_t*)mbi->cmdline, "init=", (int8_t*)init_command, INIT_COMMAND_LEN);
+    }
 
     if (CHECK_FLAG(mbi->flags, 3)) {
         int mod_count = 0;
@@ -171,6 +217,14 @@ void entry(unsigned long magic, unsigned long addr) {
     /* Init the PIC */
     i8259_init();
 
+    /* enable the local APIC for MSI, the PIC stays behind it on LINT0 */
+    if (-1 == lapic_init())
+        printf("no local APIC, PCI devices use their legacy lines\n");
+
+    /* COM1 for the console and the trace dumps (F12), then start tracing */
+    serial_init();
+    trace_init();
+
     /* initialize keyboard*/
     keyboard_init();
 
@@ -183,16 +237,32 @@ void entry(unsigned long magic, unsigned long addr) {
   
     /* initialize file operation tables */
     terminal_init();
+    if (serial_present() && (console & TERM_OUT_SERIAL)) {
+        multi_terminals[0].output = console;
+        printf_serial = 1;
+    }
 
     /* initialize scheduled process array */
     schedule_init();
 
+    /* initialize shared memory segments */
+    shm_init();
+
     /* initialize pit */
     pit_init();
 
     /* initialize mouse */
     mouse_init();
 
+    /* find the disks, the first one holding a file system replaces the module, virtio disks are faster */
+    virtio_blk_init();
+    ata_init();
+    mounted = 0;
+    for (i = 0; !mounted && NULL != virtio_blk_get_dev(i); i++)
+        mounted = (0 == fs_mount_disk(virtio_blk_get_dev(i)));
+    for (i = 0; !mounted && NULL != ata_get_dev(i); i++)
+        mounted = (0 == fs_mount_disk(ata_get_dev(i)));
+
     /* Enable interrupts */
     /* Do not enable the following until after you have set up your
      * IDT correctly otherwise QEMU will triple fault and simple close
@@ -208,11 +278,12 @@ void entry(unsigned long magic, unsigned long addr) {
     /* Execute the first program ("shell") ... */
     //vbe_displaying_set(0);
     //statusbar_init();
-    boot_animation();
+    if (0 == strncmp((int8_t*)init_command, "shell", sizeof("shell")))
+        boot_animation();
     transparent_sb();
     show_desktop(DESKTOP_IMAGE_HEIGHT, DESKTOP_IMAGE_WIDTH, (uint8_t*)DESKTOP_IMAGE_DATA);
     vbe_mouse_init();
-    execute((uint8_t*)"shell");
+    execute(init_command);
 
 
     /* Spin (nicely, so we don't chew up cycles) */
@@ -7,6 +7,10 @@
  */
 #ifndef ASM_LINKAGE_H
 #define ASM_LINKAGE_H
+
+// number of entries in jump_table, system call numbers are 1 ~ SYSCALL_NUM
+#define SYSCALL_NUM 28
+
 #ifndef ASM
 
 
@@ -14,6 +18,9 @@
 #include "../drivers/keyboard.h"
 #include "../drivers/pit.h"
 #include "../drivers/mouse.h"
+#include "../drivers/ata.h"
+#include "../drivers/pci.h"
+#include "../drivers/serial.h"
 #include "system_call.h"
 
 
@@ -22,9 +29,21 @@ extern void rtc_handler_linkage();
 extern void keyboard_handler_linkage();
 extern void pit_handler_linkage();
 extern void mouse_handler_linkage();
+extern void serial_handler_linkage();
+extern void ata_primary_handler_linkage();
+extern void ata_secondary_handler_linkage();
+extern void pci_irq5_linkage();
+extern void pci_irq9_linkage();
+extern void pci_irq10_linkage();
+extern void pci_irq11_linkage();
+extern void (*msi_linkage_table[])();
+extern void spurious_linkage();
 
 // linkages for system call
 extern void system_call_linkage();
 
+// linkages for the exceptions 0 ~ EXCEPTION_NUM - 1
+extern void (*exception_linkage_table[])();
+
 #endif
 #endif
@@ -0,0 +1,98 @@
+/**
+ * @file futex.c
+ * @brief Futexes. Sleepers of all futexes hashing to the same bucket share its wait
+ *        queue, and every pid records the physical address it sleeps on, so a wake
+ *        picks only the sleepers of its own futex out of the bucket. The value is
+ *        compared and the caller put to sleep with interrupts off, so a wake between
+ *        the user's check and the system call cannot be lost.
+ * @version 0.1
+ * @date 2022-06-02
+ */
+
+#include "futex.h"
+#include "pcb.h"
+#include "paging.h"
+#include "schedule.h"
+#include "signal.h"
+
+#define futex_hash(key) ((((key) >> 2) ^ ((key) >> 12)) & (FUTEX_HASH_SIZE - 1))
+
+static wait_queue_t futex_queues[FUTEX_HASH_SIZE];
+/* physical address each pid sleeps on, 0 if it is not in futex_wait */
+static uint32_t futex_keys[process_num_max];
+
+/**
+ * @brief sleep until woken, unless the word no longer holds val
+ * @return 0 when woken, -1 if the value differed or a signal kills the program meanwhile
+ */
+static int32_t futex_wait(uint32_t* uaddr, uint32_t key, int32_t val)
+{
+    int32_t pid = get_active_pcb()->pid;
+    uint32_t flags;
+
+    cli_and_save(flags);
+    if (*(volatile int32_t*)uaddr != val) {
+        restore_flags(flags);
+        return -1;
+    }
+    futex_keys[pid] = key;
+    // only futex_wake takes us off the queue, and it clears the key first
+    while (0 != futex_keys[pid]) {
+        if (signal_fatal_pending()) {
+            // off the queue ourselves, a later futex_wake must not count us
+            futex_keys[pid] = 0;
+            futex_queues[futex_hash(key)].waiters &= ~(0x1 << pid);
+            restore_flags(flags);
+            return -1;
+        }
+        sleep_on(&futex_queues[futex_hash(key)]);
+    }
+    restore_flags(flags);
+    return 0;
+}
+
+/**
+ * @brief wake at most count sleepers of the futex, lowest pid first
+ * @return the number woken
+ */
+static int32_t futex_wake(uint32_t key, int32_t count)
+{
+    int32_t pid, woken = 0;
+    uint32_t flags;
+
+    cli_and_save(flags);
+    for (pid = 0; pid < process_num_max && woken < count; pid++) {
+        if (futex_keys[pid] != key)
+            continue;
+        futex_keys[pid] = 0;
+        wake_up_one(&futex_queues[futex_hash(key)], pid);
+        woken++;
+    }
+    restore_flags(flags);
+    return woken;
+}
+
+/**
+ * @brief system call, wait on or wake a futex
+ * @param uaddr - 4 byte aligned user word
+ * @param op - FUTEX_WAIT or FUTEX_WAKE
+ * @param val - the expected value for FUTEX_WAIT, the most to wake for FUTEX_WAKE
+ * @return FUTEX_WAIT: 0 when woken, -1 if *uaddr != val or a signal kills the program;
+ *         FUTEX_WAKE: the number woken;
+ *         -1 for a bad address or op
+ */
+int32_t futex(uint32_t* uaddr, int32_t op, int32_t val)
+{
+    uint32_t key;
+
+    if ((uint32_t)uaddr & (sizeof(uint32_t) - 1) || 0 == (key = user_to_phys((uint32_t)uaddr)))
+        return -1;
+    switch (op) {
+    case FUTEX_WAIT:
+        return futex_wait(uaddr, key, val);
+    case FUTEX_WAKE:
+        return (val < 0) ? -1 : futex_wake(key, val);
+    default:
+        return -1;
+    }
+}
@@ -0,0 +1,23 @@
+/**
+ * @file futex.h
+ * @brief Futexes: a thread sleeps on a user word only if it still holds the value
+ *        it expects, and is woken by another thread or process that changed it.
+ *        Waiters are keyed by the physical address of the word, so threads of a
+ *        process and processes sharing a shm segment meet on the same futex.
+ * @version 0.1
+ * @date 2022-06-02
+ */
+
+#ifndef _FUTEX_H
+#define _FUTEX_H
+
+#include "../types.h"
+
+#define FUTEX_WAIT          0           // sleep if *uaddr == val
+#define FUTEX_WAKE          1           // wake at most val sleepers
+#define FUTEX_HASH_SIZE     16          // wait queues, the physical address picks one
+
+/* system call */
+int32_t futex(uint32_t* uaddr, int32_t op, int32_t val);
+
+#endif /* _FUTEX_H */
@@ -8,307 +8,53 @@
  *             2022.3.22 - add system call  entry
  *             2022.4.22 - add pit
  *             2022.4.30 - add mouse
+ *             2022.6.3 - one exception handler, exceptions in user mode become signals
  */
 
 
 
 #include "idt.h"
+#include "../drivers/lapic.h"
+#include "trace.h"
 
+uint32_t irq_count[NUM_VEC];
 
-/* DIVIDE_BY_ZERO
- * 
- * Deal with exception: DIVIDE_BY_ZERO
- * Inputs: None
- * Outputs: None
- * Side Effects: stop processing; blue screen; print exception
- */
-void DIVIDE_BY_ZERO(){
-    cli();
-    printf("\nException Happened: Divide by Zero\n");
-    sti();
-    halt(EXCEPTION_STATUS);
-}
-
-/* DEBUG
- * 
- * Deal with exception: DEBUG
- * Inputs: None
- * Outputs: None
- * Side Effects: stop processing; blue screen; print exception
- */
-void DEBUG(){
-	cli();
-    printf("Exception Happened: Debug Exception");
-    sti();
-    halt(EXCEPTION_STATUS);
-}
-
-/* NON_MASKABLE
- * 
- * Deal with exception: NON_MASKABLE
- * Inputs: None
- * Outputs: None
- * Side Effects: stop processing; blue screen; print exception
- */
-void NON_MASKABLE(){
-	cli();
-	clear();
-    printf("Exception Happened: Non Maskable Interrupt Exception");
-    sti();
-    halt(EXCEPTION_STATUS);
-}
-
-/* BREAKPOINT
- * 
- * Deal with exception: BREAKPOINT
- * Inputs: None
- * Outputs: None
- * Side Effects: stop processing; blue screen; print exception
- */
-void BREAKPOINT(){
-	cli();
-    printf("Exception Happened: Breakpoint Exception");
-    sti();
-    halt(EXCEPTION_STATUS);
-}
-
-/* OVERFLOW
- * 
- * Deal with exception: OVERFLOW
- * Inputs: None
- * Outputs: None
- * Side Effects: stop processing; blue screen; print exception
- */
-void OVERFLOW(){
-	cli();
-	clear();
-    printf("Exception Happened: Overflow Exception");
-    sti();
-    halt(EXCEPTION_STATUS);
-}
-
-/* BOUND_RANGE_EXCEEDED
- * 
- * Deal with exception: BOUND_RANGE_EXCEEDED
- * Inputs: None
- * Outputs: None
- * Side Effects: stop processing; blue screen; print exception
- */
-void BOUND_RANGE_EXCEEDED(){
-	cli();
-	clear();
-    printf("Exception Happened: Bound Range Exceeded Exception");
-    sti();
-    halt(EXCEPTION_STATUS);
-}
-
-/* INVALID_OPCODE_EXCEPTION
- * 
- * Deal with exception: INVALID_OPCODE_EXCEPTION
- * Inputs: None
- * Outputs: None
- * Side Effects: stop processing; blue screen; print exception
- */
-void INVALID_OPCODE_EXCEPTION(){
-	cli();
-	clear();
-    printf("Exception Happened: Invalid Opcode Exception");
-    sti();
-    halt(EXCEPTION_STATUS);
-}
-
-/* DEVICE_NOT_AVAILABLE
- * 
- * Deal with exception: DEVICE_NOT_AVAILABLE
- * Inputs: None
- * Outputs: None
- * Side Effects: stop processing; blue screen; print exception
- */
-void DEVICE_NOT_AVAILABLE(){
-	cli();
-	clear();
-    printf("Exception Happened: Device Not Available Exception");
-    sti();
-    halt(EXCEPTION_STATUS);
-}
-
-/* DOUBLE_FAULT
- * 
- * Deal with exception: DOUBLE_FAULT
- * Inputs: None
- * Outputs: None
- * Side Effects: stop processing; blue screen; print exception
- */
-void DOUBLE_FAULT(){
-	cli();
-	clear();
-    printf("Exception Happened: Double Fault Exception");
-    sti();
-    halt(EXCEPTION_STATUS);
-}
-
-/* COPROCESSOR_SEGMENT_OVERRUN
- * 
- * Deal with exception: COPROCESSOR_SEGMENT_OVERRUN
- * Inputs: None
- * Outputs: None
- * Side Effects: stop processing; blue screen; print exception
- */
-void COPROCESSOR_SEGMENT_OVERRUN(){
-	cli();
-	clear();
-    printf("Exception Happened: Coprocessor Segment Exception");
-    sti();
-    halt(EXCEPTION_STATUS);
-}
-
-/* INVALID_TSS
- * 
- * Deal with exception: INVALID_TSS
- * Inputs: None
- * Outputs: None
- * Side Effects: stop processing; blue screen; print exception
- */
-void INVALID_TSS(){
-	cli();
-	clear();
-    printf("Exception Happened: Invalid TSS Exception");
-    sti();
-    halt(EXCEPTION_STATUS);
-}
-
-/* SEG_NOT_PRESENT
- * 
- * Deal with exception: SEG_NOT_PRESENT
- * Inputs: None
- * Outputs: None
- * Side Effects: stop processing; blue screen; print exception
- */
-void SEG_NOT_PRESENT(){
-	cli();
-	clear();
-    printf("Exception Happened: Segment Not Present");
-    sti();
-    halt(EXCEPTION_STATUS);
-}
-
-/* STACK_SEGMENT_FAULT
- * 
- * Deal with exception: STACK_SEGMENT_FAULT
- * Inputs: None
- * Outputs: None
- * Side Effects: stop processing; blue screen; print exception
- */
-void STACK_SEGMENT_FAULT(){
-	cli();
-	clear();
-    printf("Exception Happened: Stack Fault Exception");
-    sti();
-    halt(EXCEPTION_STATUS);
-}
-
-/* GENERAL_PROTECTION_FAULT
- * 
- * Deal with exception: GENERAL_PROTECTION_FAULT
- * Inputs: None
- * Outputs: None
- * Side Effects: stop processing; blue screen; print exception
- */
-void GENERAL_PROTECTION_FAULT(){
-	cli();
-    printf("Exception Happened: General Protection Exception");
-    sti();
-    halt(EXCEPTION_STATUS);
-}
-
-/* PAGE_FAULT
- * 
- * Deal with exception: PAGE_FAULT
- * Inputs: None
- * Outputs: None
- * Side Effects: stop processing; blue screen; print exception
- */
-void PAGE_FAULT(){
-	cli();
-    printf("\nException Happened: Page Fault Exception\n");
-    sti();
-    halt(EXCEPTION_STATUS);
-}
 
-/* FLOAT_FAULT
- * 
- * Deal with exception: FLOAT_FAULT
- * Inputs: None
- * Outputs: None
- * Side Effects: stop processing; blue screen; print exception
- */
-void FLOAT_FAULT(){
-	cli();
-	clear();
-    printf("Exception Happened: Floating Point Exception");
-    sti();
-    halt(EXCEPTION_STATUS);
-}
+/* what is printed for an exception that kills, indexed by vector */
+static const char* exception_names[EXCEPTION_NUM] = {
+    "Divide by Zero", "Debug Exception", "Non Maskable Interrupt Exception",
+    "Breakpoint Exception", "Overflow Exception", "Bound Range Exceeded Exception",
+    "Invalid Opcode Exception", "Device Not Available Exception", "Double Fault Exception",
+    "Coprocessor Segment Exception", "Invalid TSS Exception", "Segment Not Present",
+    "Stack Fault Exception", "General Protection Exception", "Page Fault Exception",
+    "Reserved Exception", "Floating Point Exception", "Alignment Check Exception",
+    "Machine Check Exception", "SIMD Floating Point Exception"
+};
 
-/* ALIGNMENT_CHECK
+/* exception_handler
  * 
- * Deal with exception: ALIGNMENT_CHECK Fault
- * Inputs: None
+ * Deal with an exception, called by the exception linkages.
+ * Inputs: ctx - registers saved by the linkage, with the vector and error code
  * Outputs: None
- * Side Effects: stop processing; blue screen; print exception
+ * Side Effects: in user mode the exception is sent as a signal if the program
+ *               has a handler for it; otherwise print the exception and halt
  */
-void ALIGNMENT_CHECK(){
+void exception_handler(hw_context_t* ctx){
+    uint32_t cr2;
+    int32_t signum = (DIVIDE_ERROR == ctx->vector) ? SIG_DIV_ZERO : SIG_SEGFAULT;
 	cli();
-	clear();
-    printf("Exception Happened: Alignment Check Exception");
-    sti();
-    halt(EXCEPTION_STATUS);
-}
-
-/* MACHINE_CHECK
- * 
- * Deal with exception: MACHINE_CHECK Fault
- * Inputs: None
- * Outputs: None
- * Side Effects: stop processing; blue screen; print exception
- */
-void MACHINE_CHECK(){
-	cli();
-	clear();
-    printf("Exception Happened: Machine Check Exception");
+    if (PAGE_FAULT == ctx->vector) {
+        asm volatile ("movl %%cr2, %0" : "=r" (cr2));
+        TRACE(TRACE_PAGE_FAULT, cr2, 0);
+    }
+    // the handler runs on the way back to user mode
+    if (DPL_USER == (ctx->cs & DPL_USER) && 0 == signal_exception(signum))
+        return;
+    printf("\nException Happened: %s\n", exception_names[ctx->vector]);
     sti();
     halt(EXCEPTION_STATUS);
 }
 
-/* SIMD_FLOATING_POINT
- * 
- * Deal with exception: SIMD_FLOATING_POINT
- * Inputs: None
- * Outputs: None
- * Side Effects: stop processing; blue screen; print exception
- */
-void SIMD_FLOATING_POINT(){
-	cli();
-	clear();
-    printf("Exception Happened: SIMD Floating Poicase" );
-    sti();
-    halt(EXCEPTION_STATUS);
-}
-
-/* SYSTEM_CALL
- * 
- * Deal with system call
- * Inputs: None
- * Outputs: None
- * Side Effects: stop processing; blue screen; print syscall
- */
-void SYSTEM_CALL(){
-	cli();
-    printf("\nSystem Call Happened\n" );
-    while(1);
-    sti();
-}
-
 
 
 
@@ -346,26 +92,14 @@ void interrupt_init(void){
     }
 
 
-    // Seg idt entries
-    SET_IDT_ENTRY(idt[0], DIVIDE_BY_ZERO);
-	SET_IDT_ENTRY(idt[1], DEBUG);
-	SET_IDT_ENTRY(idt[2], NON_MASKABLE);
-	SET_IDT_ENTRY(idt[3], BREAKPOINT);            idt[3].dpl = DPL_USER;
-	SET_IDT_ENTRY(idt[4], OVERFLOW);              idt[4].dpl = DPL_USER;
-	SET_IDT_ENTRY(idt[5], BOUND_RANGE_EXCEEDED);  idt[5].dpl = DPL_USER;
-	SET_IDT_ENTRY(idt[6], INVALID_OPCODE_EXCEPTION);
-	SET_IDT_ENTRY(idt[7], DEVICE_NOT_AVAILABLE);
-	SET_IDT_ENTRY(idt[8], DOUBLE_FAULT);
-	SET_IDT_ENTRY(idt[9], COPROCESSOR_SEGMENT_OVERRUN);
-	SET_IDT_ENTRY(idt[10], INVALID_TSS);
-	SET_IDT_ENTRY(idt[11], SEG_NOT_PRESENT);
-	SET_IDT_ENTRY(idt[12], STACK_SEGMENT_FAULT);
-	SET_IDT_ENTRY(idt[13], GENERAL_PROTECTION_FAULT);
-	SET_IDT_ENTRY(idt[14], PAGE_FAULT);
-	SET_IDT_ENTRY(idt[16], FLOAT_FAULT);
-	SET_IDT_ENTRY(idt[17], ALIGNMENT_CHECK);
-	SET_IDT_ENTRY(idt[18], MACHINE_CHECK);
-    SET_IDT_ENTRY(idt[19], SIMD_FLOATING_POINT);
+    // Seg idt entries, 15 is reserved
+    for (i = 0; i < EXCEPTION_NUM; i++)
+        if (i != 15)
+            SET_IDT_ENTRY(idt[i], exception_linkage_table[i]);
+    // int3, into and bound can be used by the user
+    idt[3].dpl = DPL_USER;
+    idt[4].dpl = DPL_USER;
+    idt[5].dpl = DPL_USER;
 
     // Temp added for system call.
     SET_IDT_ENTRY(idt[SYSCALL], system_call_linkage);
@@ -377,4 +111,78 @@ void interrupt_init(void){
     SET_IDT_ENTRY(idt[RTC], rtc_handler_linkage); 
     SET_IDT_ENTRY(idt[KEYBOARD], keyboard_handler_linkage);
     SET_IDT_ENTRY(idt[MOUSE], mouse_handler_linkage);
+    SET_IDT_ENTRY(idt[SERIAL], serial_handler_linkage);
+    SET_IDT_ENTRY(idt[ATA_PRIMARY], ata_primary_handler_linkage);
+    SET_IDT_ENTRY(idt[ATA_SECONDARY], ata_secondary_handler_linkage);
+    SET_IDT_ENTRY(idt[PCI_IRQ5], pci_irq5_linkage);
+    SET_IDT_ENTRY(idt[PCI_IRQ9], pci_irq9_linkage);
+    SET_IDT_ENTRY(idt[PCI_IRQ10], pci_irq10_linkage);
+    SET_IDT_ENTRY(idt[PCI_IRQ11], pci_irq11_linkage);
+    for (i = 0; i < MSI_VECTOR_COUNT; i++)
+        SET_IDT_ENTRY(idt[MSI_VECTOR_BASE + i], msi_linkage_table[i]);
+    SET_IDT_ENTRY(idt[SPURIOUS], spurious_linkage);
+}
+
+
+
+/* handlers of the MSI vectors, NULL while free */
+static struct {
+    void (*handler)(void*);
+    void* data;
+} msi_vectors[MSI_VECTOR_COUNT];
+
+/* idt_alloc_vector
+ * 
+ * Take a free MSI vector.
+ * Inputs: handler - called on every message, with data
+ * Outputs: the vector, -1 if all are taken
+ * Side Effects: None
+ */
+int32_t idt_alloc_vector(void (*handler)(void*), void* data){
+    uint32_t flags;
+    int32_t i;
+    cli_and_save(flags);
+    for (i = 0; i < MSI_VECTOR_COUNT; i++) {
+        if (NULL == msi_vectors[i].handler) {
+            msi_vectors[i].data = data;
+            msi_vectors[i].handler = handler;
+            restore_flags(flags);
+            return MSI_VECTOR_BASE + i;
+        }
+    }
+    restore_flags(flags);
+    return -1;
+}
+
+/* idt_free_vector
+ * 
+ * Give back an MSI vector, its messages are ignored from now on.
+ * Inputs: vector - returned by idt_alloc_vector
+ * Outputs: None
+ * Side Effects: None
+ */
+void idt_free_vector(int32_t vector){
+    uint32_t i = vector - MSI_VECTOR_BASE;
+    uint32_t flags;
+    if (i >= MSI_VECTOR_COUNT)
+        return;
+    cli_and_save(flags);
+    msi_vectors[i].handler = NULL;
+    msi_vectors[i].data = NULL;
+    restore_flags(flags);
+}
+
+/* msi_handler
+ * 
+ * Run the handler of an MSI vector. Messages come through the local APIC
+ * and not the PIC, so the EOI goes there.
+ * Inputs: vector - the vector taken
+ * Outputs: None
+ * Side Effects: None
+ */
+void msi_handler(uint32_t vector){
+    uint32_t i = vector - MSI_VECTOR_BASE;
+    if (i < MSI_VECTOR_COUNT && NULL != msi_vectors[i].handler)
+        msi_vectors[i].handler(msi_vectors[i].data);
+    lapic_eoi();
 }
@@ -12,17 +12,42 @@
 #include "../x86_desc.h"
 #include "../lib.h"
 #include "asm_linkage.h"
+#include "signal.h"
 								
 
 #define SYSCALL 	0x80
 #define PIT 		0x20
 #define KEYBOARD 	0x21
+#define SERIAL      0x24
 #define RTC 		0x28
 #define MOUSE       0x2C
+#define ATA_PRIMARY 0x2E
+#define ATA_SECONDARY 0x2F
+#define PCI_IRQ5    0x25
+#define PCI_IRQ9    0x29
+#define PCI_IRQ10   0x2A
+#define PCI_IRQ11   0x2B
+#define MSI_VECTOR_BASE  0x30   // vectors handed out to MSI capable devices
+#define MSI_VECTOR_COUNT 16
+#define SPURIOUS    0xFF        // spurious vector of the local APIC
 #define DPL_KERNEL  0
 #define DPL_USER    3
 #define EXCEPTION_STATUS 256
+#define EXCEPTION_NUM   20      // vectors 0 ~ 19 are the CPU's exceptions
+#define DIVIDE_ERROR    0
+#define PAGE_FAULT      14
+
+/* interrupts taken on each vector, counted by the linkages */
+extern uint32_t irq_count[NUM_VEC];
 
 void interrupt_init(void);
+/* called by the exception linkages */
+void exception_handler(hw_context_t* ctx);
+/* take a free MSI vector for handler, -1 if none is left */
+int32_t idt_alloc_vector(void (*handler)(void*), void* data);
+/* give back a vector of idt_alloc_vector */
+void idt_free_vector(int32_t vector);
+/* called by the MSI linkages */
+void msi_handler(uint32_t vector);
 
 #endif
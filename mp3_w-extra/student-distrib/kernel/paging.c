@@ -129,6 +129,57 @@ void paging_init_kernel(void) {
             kernel_page_dir[i].MByte.base_address       = i;
         }
     }
+
+    /* program images are identity mapped for the kernel only,
+     * so that the kernel can copy into a process that is not running (pipes) */
+    {
+        for (i = PROGRAM_PHY_BEGIN >> (table_field_len + offset_field_len); i < PROGRAM_PHY_END >> (table_field_len + offset_field_len); i++) {
+            kernel_page_dir[i].val = 0;
+            kernel_page_dir[i].MByte.present        = 0x1;
+            kernel_page_dir[i].MByte.read_or_write  = 0x1;
+            kernel_page_dir[i].MByte.page_size      = 0x1;
+            kernel_page_dir[i].MByte.base_address   = i;
+        }
+    }
+
+    /* the writable file system is identity mapped for the kernel only */
+    {
+        for (i = FS_PHY_BEGIN >> (table_field_len + offset_field_len); i < (FS_PHY_BEGIN + FS_PHY_SIZE) >> (table_field_len + offset_field_len); i++) {
+            kernel_page_dir[i].val = 0;
+            kernel_page_dir[i].MByte.present        = 0x1;
+            kernel_page_dir[i].MByte.read_or_write  = 0x1;
+            kernel_page_dir[i].MByte.page_size      = 0x1;
+            kernel_page_dir[i].MByte.base_address   = i;
+        }
+    }
+
+    /* the scrollback rings are identity mapped for the kernel only */
+    {
+        i = SCROLLBACK_PHY_BEGIN >> (table_field_len + offset_field_len);
+        kernel_page_dir[i].val = 0;
+        kernel_page_dir[i].MByte.present        = 0x1;
+        kernel_page_dir[i].MByte.read_or_write  = 0x1;
+        kernel_page_dir[i].MByte.page_size      = 0x1;
+        kernel_page_dir[i].MByte.base_address   = i;
+    }
+
+    /* shared memory: the frame pool is identity mapped for the kernel only,
+     * and the user window points to user_shm_4K, which is filled on demand */
+    {
+        kernel_page_dir[SHM_PHY_BEGIN >> (table_field_len + offset_field_len)].val = 0;
+        kernel_page_dir[SHM_PHY_BEGIN >> (table_field_len + offset_field_len)].MByte.present        = 0x1;
+        kernel_page_dir[SHM_PHY_BEGIN >> (table_field_len + offset_field_len)].MByte.read_or_write  = 0x1;
+        kernel_page_dir[SHM_PHY_BEGIN >> (table_field_len + offset_field_len)].MByte.page_size      = 0x1;
+        kernel_page_dir[SHM_PHY_BEGIN >> (table_field_len + offset_field_len)].MByte.base_address   = SHM_PHY_BEGIN >> (table_field_len + offset_field_len);
+
+        for (i = 0; i < ENTRY_NUM; i++)
+            user_shm_4K[i].val = 0x0;
+        kernel_page_dir[SHM_VIR_BEGIN >> (table_field_len + offset_field_len)].val = 0;
+        kernel_page_dir[SHM_VIR_BEGIN >> (table_field_len + offset_field_len)].KByte.present            = 0x1;
+        kernel_page_dir[SHM_VIR_BEGIN >> (table_field_len + offset_field_len)].KByte.read_or_write      = 0x1;
+        kernel_page_dir[SHM_VIR_BEGIN >> (table_field_len + offset_field_len)].KByte.user_or_supervisor = 0x1;  // user level
+        kernel_page_dir[SHM_VIR_BEGIN >> (table_field_len + offset_field_len)].KByte.base_address       = ((uint32_t)user_shm_4K) >> offset_field_len;
+    }
     load_CR3((uint32_t)kernel_page_dir);
     enable_paging();
 }
@@ -167,6 +218,30 @@ int32_t map_vir_to_phy_4M(uint32_t vir_addr, uint32_t phy_addr)
     return 0;
 }
 
+/**
+ * brief: identity map the 4M page holding the registers of a device (local APIC, MSI-X table)
+ * input: phy_addr -- any address in the page
+ * return -1 -- fail, the page is used for something else
+ *         0 -- success
+ */
+int32_t map_mmio_4M(uint32_t phy_addr)
+{
+    page_directory_entry_t* pde = &kernel_page_dir[phy_addr >> (table_field_len + offset_field_len)];
+
+    if (pde->MByte.present)
+        return (pde->MByte.page_size && pde->MByte.base_address == phy_addr >> (table_field_len + offset_field_len) &&
+                !pde->MByte.user_or_supervisor) ? 0 : -1;
+    pde->val = 0;
+    pde->MByte.present          = 0x1;
+    pde->MByte.read_or_write    = 0x1;
+    pde->MByte.cache_disabled   = 0x1;
+    pde->MByte.page_size        = 0x1;
+    pde->MByte.base_address     = phy_addr >> (table_field_len + offset_field_len);
+    // flush the TLB
+    load_CR3((uint32_t)kernel_page_dir);
+    return 0;
+}
+
 /**
  * brief: unmap 4M page entry in page_dir
  * input: vir_addr to be unmapped
@@ -299,6 +374,83 @@ int32_t unmap_usr_vidmem(uint32_t vir_addr)
     return 0;
 }
 
+/**
+ * @brief map a run of 4KB shared memory frames into the user shm window
+ * 
+ * @param vir_addr - first virtual page, inside [SHM_VIR_BEGIN, SHM_VIR_BEGIN + 4MB)
+ * @param frames - physical address of each frame
+ * @param page_num - number of pages to map
+ * @return 0 for success, -1 for failure
+ */
+int32_t map_usr_shm(uint32_t vir_addr, const uint32_t* frames, uint32_t page_num)
+{
+    uint32_t i;
+    uint32_t page_tbl_id = (vir_addr & table_field) >> offset_field_len;
+
+    /* sanity check */
+    if ((vir_addr & offset_field) || frames == NULL) return -1;
+    if ((vir_addr >> (table_field_len + offset_field_len)) != (SHM_VIR_BEGIN >> (table_field_len + offset_field_len))) return -1;
+    if (page_tbl_id + page_num > ENTRY_NUM) return -1;
+
+    for (i = 0; i < page_num; i++) {
+        user_shm_4K[page_tbl_id + i].val                        = 0x0;
+        user_shm_4K[page_tbl_id + i].KByte.present              = 0x1;
+        user_shm_4K[page_tbl_id + i].KByte.read_or_write        = 0x1;
+        user_shm_4K[page_tbl_id + i].KByte.user_or_supervisor   = 0x1;
+        user_shm_4K[page_tbl_id + i].KByte.base_address         = frames[i] >> offset_field_len;
+    }
+
+    /* flush the TLB */
+    load_CR3((uint32_t)kernel_page_dir);
+    return 0;
+}
+
+/**
+ * @brief unmap a run of 4KB pages of the user shm window
+ * 
+ * @param vir_addr - first virtual page
+ * @param page_num - number of pages to unmap
+ * @return 0 for success, -1 for failure
+ */
+int32_t unmap_usr_shm(uint32_t vir_addr, uint32_t page_num)
+{
+    uint32_t i;
+    uint32_t page_tbl_id = (vir_addr & table_field) >> offset_field_len;
+
+    /* sanity check */
+    if (vir_addr & offset_field) return -1;
+    if ((vir_addr >> (table_field_len + offset_field_len)) != (SHM_VIR_BEGIN >> (table_field_len + offset_field_len))) return -1;
+    if (page_tbl_id + page_num > ENTRY_NUM) return -1;
+
+    for (i = 0; i < page_num; i++)
+        user_shm_4K[page_tbl_id + i].val = 0x0;
+
+    /* flush the TLB */
+    load_CR3((uint32_t)kernel_page_dir);
+    return 0;
+}
+
+/**
+ * @brief physical address of a user address in the mappings of the running process
+ * 
+ * @param vir_addr - user virtual address
+ * @return the physical address, 0 if the page is not mapped for the user
+ */
+uint32_t user_to_phys(uint32_t vir_addr)
+{
+    page_directory_entry_t pde = kernel_page_dir[vir_addr >> (table_field_len + offset_field_len)];
+    page_table_entry_t pte;
+
+    if (!pde.KByte.present || !pde.KByte.user_or_supervisor)
+        return 0;
+    if (pde.KByte.page_size)
+        return (pde.MByte.base_address << (table_field_len + offset_field_len)) | (vir_addr & ~dir_field);
+    pte = ((page_table_entry_t*)(pde.KByte.base_address << offset_field_len))[(vir_addr & table_field) >> offset_field_len];
+    if (!pte.KByte.present || !pte.KByte.user_or_supervisor)
+        return 0;
+    return (pte.KByte.base_address << offset_field_len) | (vir_addr & offset_field);
+}
+
 /**
  * brief: set up user page dir
  * input: page_dir
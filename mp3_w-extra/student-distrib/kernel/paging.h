@@ -24,6 +24,15 @@
 #define TERMINAL_VID_BEGIN  0x00300000      // 3MB as the start of the terminal video memory
 #define VIDMEM_SIZE         0x00001000      // 4KB size for video memory
 #define VGA_MEM_SIZE        0x01000000      // 16MB space for vga/vbe memory
+#define SHM_VIR_BEGIN       0x10400000      // user window for shared memory, right after the vidmap page table
+#define SHM_PHY_BEGIN       0x02800000      // 40MB, the frames above the 8 program images
+#define SHM_PHY_SIZE        0x00400000      // 4MB pool of 4KB frames for shared memory
+#define FS_PHY_BEGIN        0x02C00000      // right after the shm pool, the file system is copied here at mount
+#define FS_PHY_SIZE         0x01000000      // 16MB for the writable file system
+#define SCROLLBACK_PHY_BEGIN 0x03C00000     // right after the file system, the scrollback rings of the terminals
+#define SCROLLBACK_PHY_SIZE 0x00400000      // 4MB
+#define PROGRAM_PHY_BEGIN   0x00800000      // 8MB, physical image of pid 0
+#define PROGRAM_PHY_END     0x02800000      // end of the 8 program images, identity mapped for the kernel
 #define TERM_NUM            3
 #define PAGE_SIZE           1024
 
@@ -83,6 +92,9 @@ page_table_entry_t kernel_page_table_0_4M[PAGE_SIZE] __attribute__((aligned(4 *
 /* this page is set for user to access the video memory in differrnt process */
 page_table_entry_t user_page_4K[PAGE_SIZE] __attribute__((aligned(4 * PAGE_SIZE)));
 
+/* this page table maps the shared memory segments attached by the running process */
+page_table_entry_t user_shm_4K[PAGE_SIZE] __attribute__((aligned(4 * PAGE_SIZE)));
+
 /** initialize page directory and page tabel in memory */
 void paging_init_kernel(void);
 
@@ -92,6 +104,9 @@ int32_t map_vir_to_phy_4M(uint32_t vir_addr, uint32_t phy_addr);
 /* unmap 4M page entry in page_dir */
 int32_t unmap_vir_to_phy_4M(uint32_t vir_addr);
 
+/* identity map the 4M page holding device registers, kernel only and uncached */
+int32_t map_mmio_4M(uint32_t phy_addr);
+
 /* initialize the 4KB page set up for user vid */
 int32_t set_usr_vidmem(uint8_t* vir_vmem, uint32_t phy_vmem);
 
@@ -101,6 +116,15 @@ int32_t update_usr_vidmem(int32_t terminal_id);
 /* undo the mapping of set_usr_vidmem */
 int32_t unmap_usr_vidmem(uint32_t vir_addr);
 
+/* map a run of 4KB shared memory frames into the user shm window */
+int32_t map_usr_shm(uint32_t vir_addr, const uint32_t* frames, uint32_t page_num);
+
+/* unmap a run of 4KB pages of the user shm window */
+int32_t unmap_usr_shm(uint32_t vir_addr, uint32_t page_num);
+
+/* physical address of a user address of the running process, 0 if not mapped */
+uint32_t user_to_phys(uint32_t vir_addr);
+
 /* set up user page dir */
 // int32_t setup_user_paging(page_directory_entry_t *page_dir, uint32_t vir_addr, uint32_t phy_addr);
 
@@ -8,6 +8,7 @@
  */
 
 #include "pcb.h"
+#include "trace.h"
 
 // free pcbs map
 int8_t pcbs_map = 0x00;
@@ -30,15 +31,26 @@ int32_t create_pcb(void)
         /* set up pcb struct */
         pcb_addr = (pcb_t *)(bottom - block_size * (i + 1)); // static pcb addr
         pcb_addr->pid = i; // assign process id
+        pcb_addr->leader = pcb_addr;
         pcb_addr->execute_esp = bottom - block_size * i;
         pcb_addr->sched_esp = 0x0;
-        pcb_addr->signal = 0;
+        pcb_addr->sig_pending = 0;
+        pcb_addr->sig_masked = 0;
+        memset(pcb_addr->sig_handlers, 0, sizeof(pcb_addr->sig_handlers));
+        pcb_addr->state = PROC_RUNNABLE;
+        pcb_addr->background = 0;
+        pcb_addr->user_ticks = 0;
+        pcb_addr->kernel_ticks = 0;
+        pcb_addr->user_tsc = 0;
+        pcb_addr->kernel_tsc = 0;
+        pcb_addr->acct_mark = rdtsc();
+        pcb_addr->acct_state = ACCT_KERNEL;
         memset(pcb_addr->args, '\0', args_size);
 
         if (NULL == scheduled_process[running_process_index]) // no parent process in current terminal
             pcb_addr->terminalid = running_process_index;
         else
-            pcb_addr->terminalid = current_active_termid;
+            pcb_addr->terminalid = get_active_pcb()->terminalid; // children stay in their parent's terminal
 
         if (NULL == scheduled_process[running_process_index]) // no parent process in current terminal
             pcb_addr->parent_pcb = NULL;
@@ -55,6 +67,9 @@ int32_t create_pcb(void)
             pcb_addr->file_array[j].flags = 0;
             pcb_addr->file_array[j].position = 0;
         }
+        /* no shared memory mapped */
+        for (j = 0; j < SHM_SLOT_NUM; j++)
+            pcb_addr->shm_ids[j] = -1;
         // update pcbs_map
         pcbs_map = pcbs_map | (0x1 << i);
         
@@ -75,3 +90,28 @@ int32_t remove_pcb(void)
     pcbs_map = pcbs_map & ~(0x1 << get_active_pcb()->pid);
     return 0;
 }
+
+
+/**
+ * @brief free the pcb of a process or thread that is not running, e.g. a joined thread
+ * @param pid
+ * @return 0
+ */
+int32_t free_pcb(int32_t pid)
+{
+    pcbs_map = pcbs_map & ~(0x1 << pid);
+    return 0;
+}
+
+
+/**
+ * @brief check whether a pid is currently allocated
+ * @param pid
+ * @return 1 if the pcb is in use, 0 otherwise
+ */
+int32_t pcb_in_use(int32_t pid)
+{
+    if (pid < 0 || pid >= process_num_max)
+        return 0;
+    return 0 != (pcbs_map & (0x1 << pid));
+}
@@ -15,6 +15,8 @@
 #include "../drivers/filesystem.h"
 #include "../drivers/terminal.h"
 #include "../drivers/rtc.h"
+#include "shm.h"
+#include "signal.h"
 
 /* constants */
 #define process_num_max 8
@@ -38,10 +40,26 @@
 #define CLOSE 1
 #define READ  2
 #define WRITE 3
+#define POLL  4
+#define FOPS_NUM 5
+
+// file_array_entry_t.flags is nonzero while the fd is open, O_NONBLOCK is one of its bits
+#define O_NONBLOCK 0x2
 
 // for scheduler
 #define ACTIVE_SIZE 3
 
+// process states
+#define PROC_RUNNABLE   0   // running or ready to run
+#define PROC_BLOCKED    1   // sleeping on a wait queue
+#define PROC_WAITING    2   // parked in execute until its child halts
+#define PROC_ZOMBIE     3   // thread that has halted, its slot is kept until it is joined
+
+// what a process is doing, for its CPU time
+#define ACCT_USER       0
+#define ACCT_KERNEL     1
+#define ACCT_IDLE       2   // asleep in hlt, the time is nobody's
+
 typedef int32_t(*func_ptr)();
 
 typedef struct file_array_entry
@@ -60,11 +78,24 @@ struct pcb
     int32_t             pid; // since the mapping is static, pid is used to decide the mapping
     int32_t             terminalid;
     pcb_t               *parent_pcb;
+    pcb_t               *leader; // process the thread belongs to, itself for the main thread
     uint32_t            execute_esp; // used in execute
     uint32_t            sched_esp; // used in scheduler
-    int32_t             signal;
+    uint32_t            sig_pending; // bit per signal sent to this thread and not delivered yet
+    int32_t             sig_masked; // in a handler, the next one waits for its sigreturn
+    uint32_t            sig_handlers[NUM_SIGNALS]; // user handlers, 0 for the default; the leader's count
     uint8_t             args[args_size];
+    uint8_t             name[filename_len_max + 1]; // file name of the program
+    uint32_t            user_ticks; // PIT ticks that interrupted it in user mode
+    uint32_t            kernel_ticks; // PIT ticks that interrupted it in the kernel
+    uint64_t            user_tsc; // TSC cycles it ran in user mode
+    uint64_t            kernel_tsc; // TSC cycles it ran in the kernel
+    uint64_t            acct_mark; // TSC when its cycles were last charged
+    int32_t             acct_state; // ACCT_USER, ACCT_KERNEL or ACCT_IDLE, what the cycles since acct_mark were
     file_array_entry_t  file_array[file_array_len];
+    int32_t             shm_ids[SHM_SLOT_NUM]; // mapped shared memory segments, -1 for empty slot
+    int32_t             state; // PROC_RUNNABLE, PROC_BLOCKED, PROC_WAITING or PROC_ZOMBIE
+    int32_t             background; // started with '&', the parent does not wait for it
 };
 
 // The list contains the current active processes' pcb ptr
@@ -72,12 +103,18 @@ pcb_t *scheduled_process[ACTIVE_SIZE];
 // index of current running process in scheduled_process array
 uint8_t running_process_index;
 
-#define get_pcb(pid) (pcb_t *)(bottom - block_size * (pid + 1));
+#define get_pcb(pid) ((pcb_t *)(bottom - block_size * ((pid) + 1)))
 
 extern inline pcb_t* get_active_pcb(void);
+/* the process of the running thread, it holds the program page, files, shm and args */
+#define get_active_proc() (get_active_pcb()->leader)
 
 int32_t create_pcb(void);
 
 int32_t remove_pcb(void);
 
+int32_t free_pcb(int32_t pid);
+
+int32_t pcb_in_use(int32_t pid);
+
 #endif
@@ -0,0 +1,368 @@
+/**
+ * @file pipe.c
+ * @brief Anonymous pipes. Data normally goes through a 4KB ring buffer in the kernel,
+ *        a reader sleeps while the ring is empty and a writer sleeps while it is full.
+ *        Program images are single 4MB pages, so pages cannot be flipped between two
+ *        processes; instead a blocked reader posts its buffer and a write of a page or
+ *        more is copied once, straight into the reader's image (identity mapped for the
+ *        kernel), skipping the ring and the ping-pong of small chunks.
+ * @version 0.1
+ * @date 2022-05-25
+ */
+
+#include "pipe.h"
+#include "pcb.h"
+#include "paging.h"
+#include "signal.h"
+
+/* kernel address of a user buffer of thread tid, the program page is its process' */
+#define image_addr(tid, addr) (PROGRAM_PHY_BEGIN + program_size * get_pcb(tid)->leader->pid + ((uint32_t)(addr) - program_mem))
+
+pipe_t pipes[PIPE_MAX];
+
+func_ptr pipe_reader_operations[FOPS_NUM] = {pipe_reader_open, pipe_reader_close, pipe_read, pipe_reader_write, pipe_reader_poll};
+func_ptr pipe_writer_operations[FOPS_NUM] = {pipe_writer_open, pipe_writer_close, pipe_writer_read, pipe_write, pipe_writer_poll};
+
+/**
+ * @brief get the pipe of a file array entry
+ * @param inode_num - pipe index
+ * @return pointer to the pipe, NULL if it is not in use
+ */
+static pipe_t* pipe_get(uint32_t inode_num)
+{
+    if (inode_num >= PIPE_MAX || !pipes[inode_num].in_use)
+        return NULL;
+    return &pipes[inode_num];
+}
+
+/**
+ * @brief copy from the ring buffer, called with interrupts disabled
+ * @return number of bytes copied
+ */
+static int32_t pipe_ring_get(pipe_t* p, uint8_t* buf, int32_t nbytes)
+{
+    int32_t n = (nbytes < (int32_t)p->count) ? nbytes : (int32_t)p->count;
+    int32_t first = PIPE_BUF_SIZE - p->head;
+    if (first > n) first = n;
+
+    memcpy(buf, p->buf + p->head, first);
+    memcpy(buf + first, p->buf, n - first);
+    p->head = (p->head + n) % PIPE_BUF_SIZE;
+    p->count -= n;
+    return n;
+}
+
+/**
+ * @brief copy into the ring buffer, called with interrupts disabled
+ * @return number of bytes copied
+ */
+static int32_t pipe_ring_put(pipe_t* p, const uint8_t* buf, int32_t nbytes)
+{
+    int32_t space = PIPE_BUF_SIZE - p->count;
+    int32_t n = (nbytes < space) ? nbytes : space;
+    uint32_t tail = (p->head + p->count) % PIPE_BUF_SIZE;
+    int32_t first = PIPE_BUF_SIZE - tail;
+    if (first > n) first = n;
+
+    memcpy(p->buf + tail, buf, first);
+    memcpy(p->buf, buf + first, n - first);
+    p->count += n;
+    return n;
+}
+
+/**
+ * @brief free the pipe once both ends are closed everywhere
+ */
+static void pipe_put(pipe_t* p)
+{
+    if (0 == p->readers && 0 == p->writers)
+        p->in_use = 0;
+}
+
+/**
+ * @brief one more reference to the read end (inherited or duplicated fd)
+ * @param inode_num - pipe index
+ * @return 0 for success, -1 for failure
+ */
+int32_t pipe_reader_open(uint32_t inode_num)
+{
+    uint32_t flags;
+    pipe_t* p = pipe_get(inode_num);
+    if (NULL == p) return -1;
+    cli_and_save(flags);
+    p->readers++;
+    restore_flags(flags);
+    return 0;
+}
+
+/**
+ * @brief drop a reference to the read end, writers fail once no reader is left
+ * @param inode_num - pipe index
+ * @return 0 for success, -1 for failure
+ */
+int32_t pipe_reader_close(uint32_t inode_num)
+{
+    uint32_t flags;
+    pipe_t* p = pipe_get(inode_num);
+    if (NULL == p) return -1;
+    cli_and_save(flags);
+    p->readers--;
+    wake_up(&p->write_wq);
+    pipe_put(p);
+    restore_flags(flags);
+    return 0;
+}
+
+/**
+ * @brief read from a pipe, block until some data is available
+ * 
+ * @param inode_num - pipe index
+ * @param position - ignored
+ * @param buf - user buffer
+ * @param nbytes - size of buf
+ * @param fd_flags - with O_NONBLOCK an empty pipe fails instead
+ * @return number of bytes read, 0 if the pipe is empty and has no writer,
+ *         -1 for failure or if a signal kills the program meanwhile
+ */
+int32_t pipe_read(uint32_t inode_num, int32_t position, void* buf, int32_t nbytes, int32_t fd_flags)
+{
+    uint32_t flags;
+    int32_t n;
+    pipe_t* p = pipe_get(inode_num);
+    pcb_t* pcb = get_active_pcb();
+
+    if (NULL == p || NULL == buf || nbytes < 0) return -1;
+    if (0 == nbytes) return 0;
+
+    cli_and_save(flags);
+    while (1) {
+        if (p->count > 0) {
+            n = pipe_ring_get(p, (uint8_t*)buf, nbytes);
+            wake_up(&p->write_wq);
+            break;
+        }
+        if (0 == p->writers) {
+            n = 0;
+            break;
+        }
+        if ((fd_flags & O_NONBLOCK) || signal_fatal_pending()) {
+            n = -1;
+            break;
+        }
+
+        /* post the buffer if it lies in the program image, a large write may fill it directly */
+        if (-1 == p->direct_pid &&
+            (uint32_t)buf >= program_mem &&
+            (uint32_t)buf + nbytes <= program_mem + program_size) {
+            p->direct_pid = pcb->pid;
+            p->direct_buf = (uint8_t*)buf;
+            p->direct_len = nbytes;
+            p->direct_done = 0;
+        }
+        sleep_on(&p->read_wq);
+
+        if (pcb->pid == p->direct_pid) {
+            n = p->direct_done;
+            p->direct_pid = -1;
+            if (n > 0) break;
+        }
+    }
+    restore_flags(flags);
+    return n;
+}
+
+/**
+ * @brief the read end cannot be written
+ * @return -1
+ */
+int32_t pipe_reader_write(uint32_t inode_num, const void* buf, int32_t nbytes)
+{
+    return -1;
+}
+
+/**
+ * @brief what a read of the pipe would do, writes wake the poll call
+ * @param inode_num - pipe index
+ * @param pt - the poll call, NULL to only ask
+ * @return POLLIN if there is data, POLLHUP if no writer is left
+ */
+int32_t pipe_reader_poll(uint32_t inode_num, poll_table_t* pt)
+{
+    int32_t mask = 0;
+    pipe_t* p = pipe_get(inode_num);
+
+    if (NULL == p) return POLLERR;
+    poll_wait(&p->read_wq, pt);
+    if (p->count > 0) mask |= POLLIN;
+    if (0 == p->writers) mask |= POLLHUP;
+    return mask;
+}
+
+/**
+ * @brief one more reference to the write end (inherited or duplicated fd)
+ * @param inode_num - pipe index
+ * @return 0 for success, -1 for failure
+ */
+int32_t pipe_writer_open(uint32_t inode_num)
+{
+    uint32_t flags;
+    pipe_t* p = pipe_get(inode_num);
+    if (NULL == p) return -1;
+    cli_and_save(flags);
+    p->writers++;
+    restore_flags(flags);
+    return 0;
+}
+
+/**
+ * @brief drop a reference to the write end, readers see end of file once no writer is left
+ * @param inode_num - pipe index
+ * @return 0 for success, -1 for failure
+ */
+int32_t pipe_writer_close(uint32_t inode_num)
+{
+    uint32_t flags;
+    pipe_t* p = pipe_get(inode_num);
+    if (NULL == p) return -1;
+    cli_and_save(flags);
+    p->writers--;
+    wake_up(&p->read_wq);
+    pipe_put(p);
+    restore_flags(flags);
+    return 0;
+}
+
+/**
+ * @brief the write end cannot be read
+ * @return -1
+ */
+int32_t pipe_writer_read(uint32_t inode_num, int32_t position, void* buf, int32_t nbytes)
+{
+    return -1;
+}
+
+/**
+ * @brief write to a pipe, block while the ring is full
+ * 
+ * @param inode_num - pipe index
+ * @param buf - user buffer
+ * @param nbytes - number of bytes to write
+ * @param position - ignored
+ * @param fd_flags - with O_NONBLOCK only what fits in the ring is written, as after a
+ *                   signal that kills the program
+ * @return number of bytes written, -1 if there is no reader or nothing fits
+ */
+int32_t pipe_write(uint32_t inode_num, const void* buf, int32_t nbytes, int32_t position, int32_t fd_flags)
+{
+    uint32_t flags;
+    int32_t n, written = 0;
+    pipe_t* p = pipe_get(inode_num);
+
+    if (NULL == p || NULL == buf || nbytes < 0) return -1;
+
+    cli_and_save(flags);
+    while (written < nbytes) {
+        if (0 == p->readers) break;
+
+        /* a reader is blocked on an empty ring: hand a large chunk over in one copy */
+        if (-1 != p->direct_pid && 0 == p->direct_done && 0 == p->count &&
+            nbytes - written >= PIPE_DIRECT_MIN) {
+            n = (nbytes - written < p->direct_len) ? nbytes - written : p->direct_len;
+            memcpy((void*)image_addr(p->direct_pid, p->direct_buf), (uint8_t*)buf + written, n);
+            p->direct_done = n;
+            written += n;
+            wake_up(&p->read_wq);
+            continue;
+        }
+
+        if (PIPE_BUF_SIZE == p->count) {
+            if ((fd_flags & O_NONBLOCK) || signal_fatal_pending()) break;
+            sleep_on(&p->write_wq);
+            continue;
+        }
+        written += pipe_ring_put(p, (const uint8_t*)buf + written, nbytes - written);
+        wake_up(&p->read_wq);
+    }
+    restore_flags(flags);
+
+    /* broken pipe, or full */
+    if (0 == written && nbytes > 0) return -1;
+    return written;
+}
+
+/**
+ * @brief what a write to the pipe would do, reads wake the poll call
+ * @param inode_num - pipe index
+ * @param pt - the poll call, NULL to only ask
+ * @return POLLOUT if the ring has room, POLLERR if no reader is left
+ */
+int32_t pipe_writer_poll(uint32_t inode_num, poll_table_t* pt)
+{
+    int32_t mask = 0;
+    pipe_t* p = pipe_get(inode_num);
+
+    if (NULL == p) return POLLERR;
+    poll_wait(&p->write_wq, pt);
+    if (p->count < PIPE_BUF_SIZE) mask |= POLLOUT;
+    if (0 == p->readers) mask |= POLLERR;
+    return mask;
+}
+
+/**
+ * @brief create a pipe and open both ends in the calling process
+ * 
+ * @param fds - fds[0] gets the read end, fds[1] the write end
+ * @return 0 for success, -1 for failure
+ */
+int32_t pipe(int32_t* fds)
+{
+    int32_t index, rfd, wfd;
+    uint32_t flags;
+    pcb_t* pcb = get_active_proc();
+
+    /* sanity check */
+    if (fds == NULL ||
+        (uint32_t) fds <= PROGRAM_IMG_BEGIN ||
+        (uint32_t) (fds + 2) >= PRPGRAM_IMG_END)
+        return -1;
+
+    cli_and_save(flags);
+    for (index = 0; index < PIPE_MAX; index++)
+        if (!pipes[index].in_use) break;
+    for (rfd = 2; rfd < file_array_len; rfd++)
+        if (0 == pcb->file_array[rfd].flags) break;
+    for (wfd = rfd + 1; wfd < file_array_len; wfd++)
+        if (0 == pcb->file_array[wfd].flags) break;
+    if (PIPE_MAX == index || wfd >= file_array_len) {
+        restore_flags(flags);
+        return -1;
+    }
+
+    pipes[index].in_use = 1;
+    pipes[index].readers = 1;
+    pipes[index].writers = 1;
+    pipes[index].head = 0;
+    pipes[index].count = 0;
+    pipes[index].read_wq.waiters = 0;
+    pipes[index].read_wq.polls = NULL;
+    pipes[index].write_wq.waiters = 0;
+    pipes[index].write_wq.polls = NULL;
+    pipes[index].direct_pid = -1;
+
+    pcb->file_array[rfd].fops_ptr = pipe_reader_operations;
+    pcb->file_array[rfd].type = PIPE_TYPE;
+    pcb->file_array[rfd].inode_num = index;
+    pcb->file_array[rfd].position = 0;
+    pcb->file_array[rfd].flags = 1;
+
+    pcb->file_array[wfd].fops_ptr = pipe_writer_operations;
+    pcb->file_array[wfd].type = PIPE_TYPE;
+    pcb->file_array[wfd].inode_num = index;
+    pcb->file_array[wfd].position = 0;
+    pcb->file_array[wfd].flags = 1;
+    restore_flags(flags);
+
+    fds[0] = rfd;
+    fds[1] = wfd;
+    return 0;
+}
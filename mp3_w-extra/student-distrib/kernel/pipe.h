@@ -0,0 +1,56 @@
+/**
+ * @file pipe.h
+ * @brief Anonymous pipes: a kernel ring buffer between a read end and a write end
+ * @version 0.1
+ * @date 2022-05-25
+ */
+
+#ifndef _PIPE_H
+#define _PIPE_H
+
+#include "../types.h"
+#include "schedule.h"
+#include "poll.h"
+
+#define PIPE_MAX            8           // pipes in the whole system
+#define PIPE_BUF_SIZE       0x1000      // 4KB ring buffer per pipe
+#define PIPE_DIRECT_MIN     0x1000      // writes of a page or more go straight into a waiting reader
+#define PIPE_TYPE           3           // file array type of both ends, not a file system type
+
+typedef struct pipe
+{
+    int32_t         in_use;
+    int32_t         readers;        // open read ends, over all processes
+    int32_t         writers;        // open write ends, over all processes
+    uint32_t        head;           // index of the next byte to read
+    uint32_t        count;          // bytes in the ring
+    wait_queue_t    read_wq;        // readers waiting for data
+    wait_queue_t    write_wq;       // writers waiting for space
+    /* a blocked reader posts its buffer here, see pipe_write */
+    int32_t         direct_pid;     // -1 if no buffer is posted
+    uint8_t*        direct_buf;     // user address in the reader's program image
+    int32_t         direct_len;
+    int32_t         direct_done;    // bytes the writer has put into direct_buf
+    uint8_t         buf[PIPE_BUF_SIZE];
+} pipe_t;
+
+/* file operations of the two ends, inode_num of the file array entry is the pipe index */
+extern func_ptr pipe_reader_operations[FOPS_NUM];
+extern func_ptr pipe_writer_operations[FOPS_NUM];
+
+int32_t pipe_reader_open(uint32_t inode_num);
+int32_t pipe_reader_close(uint32_t inode_num);
+int32_t pipe_read(uint32_t inode_num, int32_t position, void* buf, int32_t nbytes, int32_t fd_flags);
+int32_t pipe_reader_write(uint32_t inode_num, const void* buf, int32_t nbytes);
+int32_t pipe_reader_poll(uint32_t inode_num, poll_table_t* pt);
+
+int32_t pipe_writer_open(uint32_t inode_num);
+int32_t pipe_writer_close(uint32_t inode_num);
+int32_t pipe_writer_read(uint32_t inode_num, int32_t position, void* buf, int32_t nbytes);
+int32_t pipe_write(uint32_t inode_num, const void* buf, int32_t nbytes, int32_t position, int32_t fd_flags);
+int32_t pipe_writer_poll(uint32_t inode_num, poll_table_t* pt);
+
+/* system call */
+int32_t pipe(int32_t* fds);
+
+#endif /* _PIPE_H */
@@ -0,0 +1,180 @@
+/**
+ * @file poll.c
+ * @brief poll, see poll.h. Everything runs with interrupts disabled, so a wake
+ *        up between asking a driver and going to sleep cannot be missed: it sets
+ *        a ready bit that is looked at before sleeping.
+ * @version 0.1
+ * @date 2022-06-03
+ */
+
+#include "poll.h"
+#include "pcb.h"
+#include "paging.h"
+#include "signal.h"
+
+/* timed polls are hooked here, woken every tick */
+static wait_queue_t tick_wq;
+static volatile uint32_t poll_ticks;
+
+/**
+ * @brief hook the poll call on a wait queue, nothing if it is not sleeping (pt NULL)
+ * @param wq - a queue the driver wakes when the fd may have become ready
+ * @param pt - the poll call
+ */
+void poll_wait(wait_queue_t* wq, poll_table_t* pt)
+{
+    poll_entry_t* entry;
+
+    if (NULL == pt || POLL_ENTRIES_MAX == pt->nentries)
+        return;
+    entry = &pt->entries[pt->nentries++];
+    entry->wq = wq;
+    entry->table = pt;
+    entry->bit = pt->bit;
+    entry->next = wq->polls;
+    wq->polls = entry;
+}
+
+/**
+ * @brief mark the pollfds of the entries hooked on a queue and wake their pollers
+ * @param wq - the queue being woken
+ */
+void poll_wake(wait_queue_t* wq)
+{
+    poll_entry_t* entry;
+
+    for (entry = wq->polls; NULL != entry; entry = entry->next) {
+        entry->table->ready |= entry->bit;
+        wake_up(&entry->table->wq);
+    }
+}
+
+/**
+ * @brief unhook every entry of a poll call from its queue
+ */
+static void poll_unwait(poll_table_t* pt)
+{
+    poll_entry_t** link;
+    int32_t i;
+
+    for (i = 0; i < pt->nentries; i++) {
+        for (link = &pt->entries[i].wq->polls; NULL != *link; link = &(*link)->next) {
+            if (*link == &pt->entries[i]) {
+                *link = pt->entries[i].next;
+                break;
+            }
+        }
+    }
+    pt->nentries = 0;
+}
+
+/**
+ * @brief one more PIT tick, the timed polls check their deadline
+ */
+void poll_tick(void)
+{
+    poll_ticks++;
+    if (NULL != tick_wq.polls)
+        wake_up(&tick_wq);
+}
+
+/**
+ * @brief poll operation of regular files, directories and proc files
+ * @return POLLIN | POLLOUT, they never block
+ */
+int32_t poll_ready(uint32_t inode_num, poll_table_t* pt)
+{
+    return POLLIN | POLLOUT;
+}
+
+/**
+ * @brief ask the driver of a pollfd what is ready
+ * @param pfd - the pollfd
+ * @param pt - the poll call to hook on the driver's queues, NULL to only ask
+ * @return its revents
+ */
+static int32_t poll_fd(pollfd_t* pfd, poll_table_t* pt)
+{
+    file_array_entry_t* file;
+    int32_t mask;
+
+    if (pfd->fd < 0)
+        return 0;
+    if (pfd->fd >= MAX_FD || 0 == get_active_proc()->file_array[pfd->fd].flags)
+        return POLLNVAL;
+    file = &get_active_proc()->file_array[pfd->fd];
+    mask = (*(file->fops_ptr[POLL]))(file->inode_num, pt);
+    return mask & (pfd->events | POLLERR | POLLHUP);
+}
+
+/**
+ * @brief system call, wait until one of the fds is ready
+ *
+ * @param fds - nfds pollfds, revents is filled
+ * @param nfds - at most POLL_FDS_MAX
+ * @param timeout - in ms, 0 to return at once, negative to wait for good
+ * @return number of pollfds with a nonzero revents, 0 on timeout,
+ *         -1 for failure or if a signal kills the program meanwhile
+ */
+int32_t poll(pollfd_t* fds, int32_t nfds, int32_t timeout)
+{
+    poll_table_t pt;
+    int32_t revents[POLL_FDS_MAX];
+    int32_t i, count = 0;
+    uint32_t flags, ready, deadline = 0;
+
+    /* sanity check */
+    if (nfds < 0 || nfds > POLL_FDS_MAX)
+        return -1;
+    if (nfds > 0 && (NULL == fds ||
+        (uint32_t) fds <= PROGRAM_IMG_BEGIN ||
+        (uint32_t) (fds + nfds) >= PRPGRAM_IMG_END))
+        return -1;
+
+    pt.nentries = 0;
+    pt.ready = 0;
+    pt.wq.waiters = 0;
+    pt.wq.polls = NULL;
+
+    cli_and_save(flags);
+    /* every fd once, hooked on its queues unless the call returns at once */
+    for (i = 0; i < nfds; i++) {
+        pt.bit = 1 << i;
+        revents[i] = poll_fd(&fds[i], timeout ? &pt : NULL);
+        if (revents[i])
+            count++;
+    }
+    if (timeout > 0) {
+        deadline = poll_ticks + (timeout + POLL_TICK_MS - 1) / POLL_TICK_MS;
+        pt.bit = POLL_TIMER_BIT;
+        poll_wait(&tick_wq, &pt);
+    }
+
+    while (0 == count && 0 != timeout) {
+        // a signal that kills the program ends the wait
+        if (signal_fatal_pending()) {
+            count = -1;
+            break;
+        }
+        if (timeout > 0 && (int32_t)(poll_ticks - deadline) >= 0)
+            break;
+        if (0 == pt.ready)
+            sleep_on(&pt.wq);
+        ready = pt.ready;
+        pt.ready = 0;
+        /* only the fds whose queues were woken are asked again */
+        for (i = 0; i < nfds; i++) {
+            if (0 == (ready & (1 << i)))
+                continue;
+            revents[i] = poll_fd(&fds[i], NULL);
+            if (revents[i])
+                count++;
+        }
+    }
+    poll_unwait(&pt);
+    restore_flags(flags);
+
+    for (i = 0; i < nfds; i++)
+        fds[i].revents = (count > 0) ? revents[i] : 0;
+    return count;
+}
@@ -0,0 +1,69 @@
+/**
+ * @file poll.h
+ * @brief poll: wait until one of several fds can be read or written without
+ *        blocking. The first pass asks every fd and hooks an entry on each wait
+ *        queue its driver may wake; a wake_up on such a queue marks the fd and
+ *        wakes the poller, which then asks only the marked fds again.
+ * @version 0.1
+ * @date 2022-06-03
+ */
+
+#ifndef _POLL_H
+#define _POLL_H
+
+#include "../types.h"
+#include "schedule.h"
+
+/* events of a pollfd */
+#define POLLIN              0x01        // read does not block
+#define POLLOUT             0x04        // write does not block
+#define POLLERR             0x08        // the other end is gone, write fails
+#define POLLHUP             0x10        // the other end is gone, read returns 0
+#define POLLNVAL            0x20        // fd is not open
+
+#define POLL_FDS_MAX        file_array_len
+#define POLL_ENTRIES_MAX    (2 * POLL_FDS_MAX)      // the fds' wait queues and the timer
+#define POLL_TIMER_BIT      0x80000000              // ready bit of the timer entry
+#define POLL_TICK_MS        10                      // PIT period
+
+typedef struct pollfd
+{
+    int32_t     fd;                     // negative to skip the entry
+    int16_t     events;                 // POLLIN and POLLOUT asked for
+    int16_t     revents;                // what is ready, POLLERR POLLHUP POLLNVAL always count
+} pollfd_t;
+
+struct poll_table;
+
+/* a poll call hooked on a wait queue */
+typedef struct poll_entry
+{
+    struct poll_entry*  next;           // next entry on the same queue
+    wait_queue_t*       wq;
+    struct poll_table*  table;
+    uint32_t            bit;            // ready bit of the pollfd it stands for
+} poll_entry_t;
+
+/* state of one poll call, on its kernel stack */
+typedef struct poll_table
+{
+    poll_entry_t        entries[POLL_ENTRIES_MAX];
+    int32_t             nentries;
+    uint32_t            bit;            // bit of the pollfd being asked, for poll_wait
+    volatile uint32_t   ready;          // bits of the pollfds whose queues were woken
+    wait_queue_t        wq;             // the poller sleeps here
+} poll_table_t;
+
+/* called by the poll operation of a driver for each queue it wakes, pt may be NULL */
+void poll_wait(wait_queue_t* wq, poll_table_t* pt);
+/* called by wake_up for the entries hooked on a queue */
+void poll_wake(wait_queue_t* wq);
+/* called by pit_handler every tick, for the timeouts */
+void poll_tick(void);
+/* poll operation of the files that never block */
+int32_t poll_ready(uint32_t inode_num, poll_table_t* pt);
+
+/* system call */
+int32_t poll(pollfd_t* fds, int32_t nfds, int32_t timeout);
+
+#endif /* _POLL_H */
@@ -0,0 +1,369 @@
+/**
+ * @file procfs.c
+ * @brief Text of the synthetic files. A read generates the whole text into one
+ *        buffer with interrupts off and copies the part at the fd position, so
+ *        every read sees a consistent table; reads of a long file in several
+ *        pieces may see the tables change in between.
+ * @version 0.1
+ * @date 2022-05-31
+ */
+
+#include "procfs.h"
+#include "paging.h"
+#include "schedule.h"
+#include "shm.h"
+#include "idt.h"
+#include "sysstats.h"
+#include "trace.h"
+#include "poll.h"
+#include "../lib.h"
+#include "../drivers/bcache.h"
+#include "../drivers/filesystem.h"
+
+#define KB                  1024
+
+/* end of the kernel image and its data, from the linker */
+extern uint8_t _end[];
+
+func_ptr procfs_operations[FOPS_NUM] = {procfs_open, procfs_close, procfs_read, procfs_write, poll_ready};
+
+static int8_t text[PROCFS_BUF_SIZE];
+static uint32_t text_len;
+
+static void gen_list(void);
+static void gen_ps(void);
+static void gen_mem(void);
+static void gen_irq(void);
+static void gen_sched(void);
+static void gen_fs(void);
+static void gen_syscalls(void);
+static void gen_cpu(void);
+
+/* the files, index 0 is "proc" itself */
+static const struct {
+    const int8_t*   name;
+    void            (*generate)(void);
+} procfs_files[] = {
+    { "proc",           gen_list },
+    { "proc/ps",        gen_ps },
+    { "proc/mem",       gen_mem },
+    { "proc/irq",       gen_irq },
+    { "proc/sched",     gen_sched },
+    { "proc/fs",        gen_fs },
+    { "proc/syscalls",  gen_syscalls },
+    { "proc/cpu",       gen_cpu },
+};
+#define PROCFS_FILE_NUM (sizeof(procfs_files) / sizeof(procfs_files[0]))
+
+/* append a string, what does not fit is cut */
+static void out_str(const int8_t* s)
+{
+    while (*s && text_len < PROCFS_BUF_SIZE)
+        text[text_len++] = *s++;
+}
+
+/* append a string padded with spaces to width columns */
+static void out_pad(const int8_t* s, uint32_t width)
+{
+    uint32_t len = strlen(s);
+    out_str(s);
+    for (; len < width; len++)
+        out_str(" ");
+}
+
+/* append a number right aligned in width columns */
+static void out_num(uint32_t value, uint32_t width)
+{
+    int8_t num[16];
+    uint32_t len;
+    itoa(value, num, 10);
+    for (len = strlen(num); len < width; len++)
+        out_str(" ");
+    out_str(num);
+}
+
+static void out_hex(uint32_t value)
+{
+    int8_t num[16];
+    out_str("0x");
+    out_str(itoa(value, num, 16));
+}
+
+/* "name:" padded, the value, the unit and a new line */
+static void out_line(const int8_t* name, uint32_t value, const int8_t* unit)
+{
+    out_pad(name, 16);
+    out_num(value, 10);
+    if ('\0' != *unit)
+        out_str(" ");
+    out_str(unit);
+    out_str("\n");
+}
+
+static void gen_list(void)
+{
+    uint32_t i;
+    for (i = 1; i < PROCFS_FILE_NUM; i++) {
+        out_str(procfs_files[i].name);
+        out_str("\n");
+    }
+}
+
+/* the process table, the running process is the one reading */
+static void gen_ps(void)
+{
+    static const int8_t* states[] = { "run", "sleep", "wait", "exit" };
+    int32_t pid;
+    pcb_t* pcb;
+
+    out_str("pid ppid term state  bg     user   kernel  name\n");
+    for (pid = 0; pid < process_num_max; pid++) {
+        if (!pcb_in_use(pid))
+            continue;
+        pcb = get_pcb(pid);
+        out_num(pid, 3);
+        if (NULL == pcb->parent_pcb)
+            out_str("    -");
+        else
+            out_num(pcb->parent_pcb->pid, 5);
+        out_num(pcb->terminalid, 5);
+        out_str(" ");
+        out_pad(pcb == get_active_pcb() ? "run*" :
+                (pcb->state >= 0 && pcb->state <= PROC_ZOMBIE) ? states[pcb->state] : "?", 6);
+        out_str(pcb->background ? "  &" : "   ");
+        out_num(pcb->user_ticks, 9);
+        out_num(pcb->kernel_ticks, 9);
+        out_str("  ");
+        out_str((int8_t*)pcb->name);
+        out_str("\n");
+    }
+}
+
+static void gen_mem(void)
+{
+    int32_t pid, procs = 0;
+    fs_stats_t fs;
+    bcache_stats_t bc;
+
+    for (pid = 0; pid < process_num_max; pid++)
+        procs += pcb_in_use(pid);
+    fs_get_stats(&fs);
+
+    out_line("kernel:", kernel_mem / KB, "KB page");
+    out_line("kernel used:", ((uint32_t)_end - kernel_mem) / KB, "KB image and data");
+    out_line("stacks:", procs * block_size / KB, "KB of kernel stacks and pcbs");
+    out_line("programs:", procs * program_size / KB, "KB in program pages");
+    out_line("program free:", (process_num_max - procs) * program_size / KB, "KB");
+    out_line("shm used:", shm_frames_used() * SHM_PAGE_SIZE / KB, "KB");
+    out_line("shm free:", (SHM_FRAME_NUM - shm_frames_used()) * SHM_PAGE_SIZE / KB, "KB");
+    out_line("shm segments:", shm_segs_used(), "");
+    out_line("fs area:", FS_PHY_SIZE / KB, "KB");
+    if (bcache_get_stats(&bc))
+        out_line("block cache:", bc.buffers * BLK_SIZE / KB, "KB");
+    else
+        out_line("fs data:", fs.blocks_used * blk_size / KB, "KB used in memory");
+}
+
+/* names of the vectors in use, NULL for the others */
+static const int8_t* irq_name(uint32_t vector)
+{
+    if (vector >= MSI_VECTOR_BASE && vector < MSI_VECTOR_BASE + MSI_VECTOR_COUNT)
+        return "msi";
+    switch (vector) {
+    case PIT:           return "pit";
+    case KEYBOARD:      return "keyboard";
+    case SERIAL:        return "serial";
+    case PCI_IRQ5:      return "pci irq 5";
+    case RTC:           return "rtc";
+    case PCI_IRQ9:      return "pci irq 9";
+    case PCI_IRQ10:     return "pci irq 10";
+    case PCI_IRQ11:     return "pci irq 11";
+    case MOUSE:         return "mouse";
+    case ATA_PRIMARY:   return "ata0";
+    case ATA_SECONDARY: return "ata1";
+    default:            return NULL;
+    }
+}
+
+static void gen_irq(void)
+{
+    uint32_t vector;
+    const int8_t* name;
+
+    out_str("vector      count  device\n");
+    for (vector = 0; vector < NUM_VEC; vector++) {
+        if (0 == irq_count[vector] || NULL == (name = irq_name(vector)))
+            continue;
+        out_str("  ");
+        out_hex(vector);
+        out_num(irq_count[vector], 12);
+        out_str("  ");
+        out_str(name);
+        out_str("\n");
+    }
+}
+
+static void gen_sched(void)
+{
+    int32_t pid, count[PROC_WAITING + 1] = {0};
+
+    for (pid = 0; pid < process_num_max; pid++)
+        if (pcb_in_use(pid) && get_pcb(pid)->state >= 0 && get_pcb(pid)->state <= PROC_WAITING)
+            count[get_pcb(pid)->state]++;
+    out_line("ticks:", sched_stats.ticks, "of 10 ms");
+    out_line("switches:", sched_stats.switches, "");
+    out_line("idle ticks:", sched_stats.idle_ticks, "every process asleep");
+    out_line("wakeups:", sched_stats.wakeups, "");
+    out_line("runnable:", count[PROC_RUNNABLE], "processes");
+    out_line("sleeping:", count[PROC_BLOCKED], "processes");
+    out_line("waiting:", count[PROC_WAITING], "processes in execute");
+}
+
+static void gen_fs(void)
+{
+    fs_stats_t fs;
+    bcache_stats_t bc;
+
+    fs_get_stats(&fs);
+    out_pad("device:", 16);
+    out_str(fs.device);
+    out_str(fs.writable ? "\n" : ", read only\n");
+    out_line("files:", fs.files, "");
+    out_line("inodes used:", fs.inodes_used, "");
+    out_line("inodes:", fs.inodes, "");
+    out_line("blocks used:", fs.blocks_used, "of 4KB");
+    out_line("blocks:", fs.blocks, "of 4KB");
+    if (!bcache_get_stats(&bc))
+        return;
+    out_line("cache buffers:", bc.buffers, "");
+    out_line("cache valid:", bc.valid, "");
+    out_line("cache dirty:", bc.dirty, "");
+    out_line("cache hits:", bc.hits, "");
+    out_line("cache misses:", bc.misses, "");
+    out_line("prefetches:", bc.prefetches, "");
+    out_line("evictions:", bc.evictions, "");
+    out_line("writebacks:", bc.writebacks, "");
+}
+
+/* the system wide counters of sysstats, mean cycles of the timed calls */
+static void gen_syscalls(void)
+{
+    sysstats_entry_t* table = sysstats_get(SYSSTATS_GLOBAL);
+    uint32_t num, i, timed;
+    uint64_t mean;
+
+    out_str("num      calls   errors  mean cycles\n");
+    for (num = 1; num <= SYSCALL_NUM; num++) {
+        if (0 == table[num].calls)
+            continue;
+        for (timed = 0, i = 0; i < SYSSTATS_HIST_SIZE; i++)
+            timed += table[num].hist[i];
+        out_num(num, 3);
+        out_num(table[num].calls, 11);
+        out_num(table[num].errors, 9);
+        if (0 == timed) {
+            out_str("            -\n");
+            continue;
+        }
+        // no 64 bit division in the kernel, shift both sides until the total fits
+        mean = table[num].cycles;
+        for (i = timed; mean >> 32; mean >>= 1, i >>= 1);
+        out_num(i ? (uint32_t)mean / i : 0, 13);
+        out_str("\n");
+    }
+}
+
+/* TSC cycles to ms, no 64 bit division in the kernel so divl does it, clamped */
+static uint32_t tsc_to_ms(uint64_t tsc)
+{
+    uint32_t khz = rdtsc_khz(), ms, rem;
+
+    if (0 == khz)
+        return 0;
+    if ((uint32_t)(tsc >> 32) >= khz)
+        return 0xFFFFFFFF;
+    asm ("divl %4" : "=a" (ms), "=d" (rem) : "a" ((uint32_t)tsc), "d" ((uint32_t)(tsc >> 32)), "rm" (khz));
+    return ms;
+}
+
+/* CPU time of every process, in PIT ticks where they were interrupted and in TSC ms */
+static void gen_cpu(void)
+{
+    int32_t pid;
+    pcb_t* pcb;
+
+    out_line("ticks:", sched_stats.ticks, "of 10 ms");
+    out_line("idle ticks:", sched_stats.idle_ticks, "of 10 ms");
+    out_line("idle:", tsc_to_ms(sched_stats.idle_tsc), "ms");
+    out_line("tsc:", rdtsc_khz(), "kHz");
+    out_str("pid     user   kernel   user ms kernel ms  name\n");
+    for (pid = 0; pid < process_num_max; pid++) {
+        if (!pcb_in_use(pid))
+            continue;
+        pcb = get_pcb(pid);
+        out_num(pid, 3);
+        out_num(pcb->user_ticks, 9);
+        out_num(pcb->kernel_ticks, 9);
+        out_num(tsc_to_ms(pcb->user_tsc), 10);
+        out_num(tsc_to_ms(pcb->kernel_tsc), 10);
+        out_str("  ");
+        out_str((int8_t*)pcb->name);
+        out_str("\n");
+    }
+}
+
+/**
+ * @brief find a synthetic file
+ * @param name - file name given to open
+ * @return index of the file, -1 if it is none
+ */
+int32_t procfs_lookup(const uint8_t* name)
+{
+    uint32_t i;
+    for (i = 0; i < PROCFS_FILE_NUM; i++)
+        if (0 == strncmp((int8_t*)name, procfs_files[i].name, strlen(procfs_files[i].name) + 1))
+            return i;
+    return -1;
+}
+
+int32_t procfs_open(uint32_t index)
+{
+    return (index < PROCFS_FILE_NUM) ? 0 : -1;
+}
+
+int32_t procfs_close(uint32_t index)
+{
+    return 0;
+}
+
+/**
+ * @brief generate the text and copy the part from position on
+ * @param index - the file
+ * @param position - offset in the text, the fd position
+ * @param buf - user buffer
+ * @param nbytes - most bytes to copy
+ * @return bytes copied, 0 at the end of the text, -1 for a bad file
+ */
+int32_t procfs_read(uint32_t index, int32_t position, void* buf, int32_t nbytes)
+{
+    uint32_t flags;
+
+    if (index >= PROCFS_FILE_NUM || position < 0)
+        return -1;
+    cli_and_save(flags);
+    text_len = 0;
+    procfs_files[index].generate();
+    if (position >= text_len)
+        nbytes = 0;
+    else if (nbytes > text_len - position)
+        nbytes = text_len - position;
+    memcpy(buf, text + position, nbytes);
+    restore_flags(flags);
+    return nbytes;
+}
+
+/* the files are read only */
+int32_t procfs_write(uint32_t index, const void* buf, int32_t nbytes)
+{
+    return -1;
+}
@@ -0,0 +1,30 @@
+/**
+ * @file procfs.h
+ * @brief Synthetic files under the name prefix "proc/", next to the file system.
+ *        Their text is generated from the kernel's tables on every read, so cat
+ *        shows the state of the moment; "proc" alone lists them.
+ * @version 0.1
+ * @date 2022-05-31
+ */
+
+#ifndef _PROCFS_H
+#define _PROCFS_H
+
+#include "../types.h"
+#include "pcb.h"
+
+#define PROC_TYPE           4           // file array type, not a file system type
+#define PROCFS_BUF_SIZE     4096        // longest text of a file
+
+/* file operations, inode_num of the file array entry is the index of the file */
+extern func_ptr procfs_operations[FOPS_NUM];
+
+/* index of the synthetic file called name, -1 if it is not one */
+int32_t procfs_lookup(const uint8_t* name);
+
+int32_t procfs_open(uint32_t index);
+int32_t procfs_close(uint32_t index);
+int32_t procfs_read(uint32_t index, int32_t position, void* buf, int32_t nbytes);
+int32_t procfs_write(uint32_t index, const void* buf, int32_t nbytes);
+
+#endif /* _PROCFS_H */
@@ -0,0 +1,204 @@
+/**
+ * @file profile.c
+ * @brief Samples of the PIT tick. The tick comes through an interrupt gate, so a
+ *        sample is taken with interrupts off and the system call only needs cli
+ *        around its changes. The stack is walked through the saved frame pointers
+ *        (nothing is built with -fomit-frame-pointer), bounded by the 8KB kernel
+ *        stack for kernel samples and by the program page for user samples.
+ * @version 0.1
+ * @date 2022-05-31
+ */
+
+#include "profile.h"
+#include "pcb.h"
+#include "paging.h"
+#include "../lib.h"
+#include "../drivers/serial.h"
+
+#define PROF_PID_NONE       0xFF        // before the first shell
+#define PROF_NAME_LEN       (filename_len_max + 1)
+
+/* a program started by a pid, in effect from sample index on */
+typedef struct prof_exec
+{
+    uint32_t    index;
+    uint8_t     pid;
+    int8_t      name[PROF_NAME_LEN];
+} prof_exec_t;
+
+static volatile int32_t prof_enabled = 0;
+static prof_sample_t prof_samples[PROF_SAMPLE_MAX];
+static uint32_t prof_count = 0;
+static uint32_t prof_dropped = 0;
+static prof_exec_t prof_execs[PROF_EXEC_MAX];
+static uint32_t prof_exec_count = 0;
+
+/**
+ * @brief follow the frame pointer chain from ebp while the frames stay inside [lo, hi)
+ * @return number of return addresses stored in callers
+ */
+static uint8_t prof_walk(uint32_t ebp, uint32_t lo, uint32_t hi, uint32_t* callers)
+{
+    uint8_t depth = 0;
+    uint32_t* fp;
+
+    while (depth < PROF_DEPTH_MAX && ebp >= lo && ebp + 8 <= hi && 0 == (ebp & 3)) {
+        fp = (uint32_t*)ebp;
+        if (0 == fp[1])
+            break;
+        callers[depth++] = fp[1];
+        // frames only go up the stack, anything else is not a frame pointer
+        if (fp[0] <= ebp)
+            break;
+        ebp = fp[0];
+    }
+    return depth;
+}
+
+/**
+ * @brief record where the tick interrupted, the user stack is readable as the
+ *        interrupted process is the one mapped
+ * @param frame - registers saved by pit_handler_linkage
+ */
+void profile_tick(hw_context_t* frame)
+{
+    prof_sample_t* s;
+    uint32_t stack_top;
+
+    if (!prof_enabled)
+        return;
+    if (prof_count >= PROF_SAMPLE_MAX) {
+        prof_dropped++;
+        return;
+    }
+    s = &prof_samples[prof_count++];
+    s->eip = frame->eip;
+    s->cpl = frame->cs & 0x3;
+    s->pid = (NULL == scheduled_process[0]) ? PROF_PID_NONE : get_active_pcb()->pid;
+    if (0 == s->cpl) {
+        // frame is on the kernel stack of the process, which ends at the next 8KB boundary
+        stack_top = ((uint32_t)frame | (block_size - 1)) + 1;
+        s->depth = prof_walk(frame->ebp, (uint32_t)frame, stack_top, s->callers);
+    } else {
+        s->depth = prof_walk(frame->ebp, program_mem, program_mem + program_size, s->callers);
+    }
+}
+
+/**
+ * @brief remember that pid runs the program name from the next sample on
+ * @param pid - the process
+ * @param name - file name of the program
+ */
+void profile_exec(int32_t pid, const uint8_t* name)
+{
+    uint32_t flags;
+    prof_exec_t* e;
+
+    cli_and_save(flags);
+    if (prof_enabled && prof_exec_count < PROF_EXEC_MAX) {
+        e = &prof_execs[prof_exec_count++];
+        e->index = prof_count;
+        e->pid = pid;
+        strncpy(e->name, (int8_t*)name, PROF_NAME_LEN - 1);
+        e->name[PROF_NAME_LEN - 1] = '\0';
+    }
+    restore_flags(flags);
+}
+
+/* put val as width hex digits into buf */
+static void prof_hex(int8_t* buf, uint32_t val, int32_t width)
+{
+    static const int8_t digits[] = "0123456789abcdef";
+    while (width-- > 0) {
+        buf[width] = digits[val & 0xF];
+        val >>= 4;
+    }
+}
+
+static void prof_dump_exec(prof_exec_t* e)
+{
+    int8_t line[10 + 2 + 1];
+
+    strcpy(line, "PROF EXEC ");
+    prof_hex(line + 10, e->pid, 2);
+    line[12] = ' ';
+    serial_write(line, 13);
+    serial_write(e->name, strlen(e->name));
+    serial_write("\n", 1);
+}
+
+/**
+ * @brief write the samples to COM1 as text:
+ *            PROF BEGIN <version> <Hz> <samples> <dropped>
+ *            PROF EXEC <pid> <program>                 pid runs program from here on
+ *            <pid> <cpl> <eip> <return address>...     one line per sample
+ *            PROF END
+ */
+static void prof_dump(void)
+{
+    int8_t line[2 + 1 + 1 + 1 + 9 * (1 + PROF_DEPTH_MAX)];
+    uint32_t i, e = 0, j, len;
+    prof_sample_t* s;
+
+    serial_write("PROF BEGIN 1 ", 13);
+    prof_hex(line, PROF_HZ, 8);
+    line[8] = ' ';
+    prof_hex(line + 9, prof_count, 8);
+    line[17] = ' ';
+    prof_hex(line + 18, prof_dropped, 8);
+    line[26] = '\n';
+    serial_write(line, 27);
+    for (i = 0; i < prof_count; i++) {
+        while (e < prof_exec_count && prof_execs[e].index <= i)
+            prof_dump_exec(&prof_execs[e++]);
+        s = &prof_samples[i];
+        prof_hex(line, s->pid, 2);
+        line[2] = ' ';
+        prof_hex(line + 3, s->cpl, 1);
+        line[4] = ' ';
+        prof_hex(line + 5, s->eip, 8);
+        len = 13;
+        for (j = 0; j < s->depth; j++) {
+            line[len] = ' ';
+            prof_hex(line + len + 1, s->callers[j], 8);
+            len += 9;
+        }
+        line[len++] = '\n';
+        serial_write(line, len);
+    }
+    serial_write("PROF END\n", 9);
+}
+
+/**
+ * @brief system call, start or stop the profiler
+ * @param cmd - PROF_START drops the samples of the last run and starts sampling,
+ *              PROF_STOP stops and dumps the samples to COM1
+ * @return 0 for success, -1 for a bad command or stopping when not started
+ */
+int32_t profile(int32_t cmd)
+{
+    int32_t pid;
+
+    switch (cmd) {
+    case PROF_START:
+        cli();
+        prof_count = 0;
+        prof_dropped = 0;
+        prof_exec_count = 0;
+        prof_enabled = 1;
+        sti();
+        // the programs running already
+        for (pid = 0; pid < process_num_max; pid++)
+            if (pcb_in_use(pid))
+                profile_exec(pid, get_pcb(pid)->name);
+        return 0;
+    case PROF_STOP:
+        if (!prof_enabled)
+            return -1;
+        prof_enabled = 0;
+        prof_dump();
+        return 0;
+    default:
+        return -1;
+    }
+}
@@ -0,0 +1,45 @@
+/**
+ * @file profile.h
+ * @brief Sampling profiler. While it is on, every PIT tick records where the CPU
+ *        was interrupted: the pid, the privilege level, the EIP and the return
+ *        addresses found by following the frame pointers. The profile system call
+ *        starts it and stops it; stopping dumps the samples to COM1, where
+ *        tracetools/profreport symbolizes them against bootimg and the user ELFs.
+ * @version 0.1
+ * @date 2022-05-31
+ */
+
+#ifndef _PROFILE_H
+#define _PROFILE_H
+
+#include "../types.h"
+#include "signal.h"
+
+#define PROF_SAMPLE_MAX     4096        // 41 s at 100 Hz, later ticks are counted as dropped
+#define PROF_DEPTH_MAX      6           // return addresses kept per sample
+#define PROF_EXEC_MAX       256         // programs started while profiling
+#define PROF_HZ             100         // the PIT rate
+
+/* profile system call commands */
+#define PROF_STOP           0           // stop and dump the samples
+#define PROF_START          1           // drop the old samples and start
+
+typedef struct prof_sample
+{
+    uint32_t    eip;
+    uint8_t     pid;
+    uint8_t     cpl;
+    uint8_t     depth;                  // valid entries of callers
+    uint8_t     reserved;
+    uint32_t    callers[PROF_DEPTH_MAX];    // return addresses, innermost first
+} prof_sample_t;
+
+/* called by pit_handler_linkage with the interrupted registers */
+void profile_tick(hw_context_t* frame);
+/* execute tells which program a pid runs, so the samples can be symbolized */
+void profile_exec(int32_t pid, const uint8_t* name);
+
+/* system call */
+int32_t profile(int32_t cmd);
+
+#endif /* _PROFILE_H */
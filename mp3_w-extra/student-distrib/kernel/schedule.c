@@ -6,10 +6,18 @@
  */
 
 #include "schedule.h"
+#include "trace.h"
+#include "poll.h"
  
 #define block_size 0x2000 // 8KB
 #define bottom 0x800000   // 8MB
 
+// process chosen by schedule_handler, read back by get_next_shched_esp
+static pcb_t* next_sched_pcb = NULL;
+
+sched_stats_t sched_stats;
+volatile uint32_t pit_tick_cpl = 0;
+
  /* 
  *  DESCRIPTION: initialize the active processes' pcb list
  *  INPUTS: none
@@ -22,34 +30,50 @@ void schedule_init(void)
 	int i;
 	//clear the contant
 	for(i = 0; i < ACTIVE_SIZE; i++) {
-        scheduled_process[ACTIVE_SIZE] = NULL;
+        scheduled_process[i] = NULL;
     }
     running_process_index = 0;
 	return;
 }
 
- /* 
- *  DESCRIPTION: initialize the active processes' pcb list
- *  INPUTS: none
- *  OUTPUTS: none
- *  RETURN VALUE: none
- *  SIDE EFFECTS: change scheduled_process 
+/**
+ * @brief pick the process to run after current_pid, round robin over the runnable ones
+ * 
+ * @param current_pid - pid of the process giving up the cpu
+ * @return pcb of the next process, NULL if there is none
  */
-void schedule_handler(void)
+static pcb_t* pick_next_pcb(int32_t current_pid)
 {
-    /* find PCB of the next process */
-    running_process_index = (running_process_index + 1) % ACTIVE_SIZE;
-    pcb_t* next_pcb = scheduled_process[running_process_index];
+    int32_t i, pid;
 
-    /* if next terminal has no shell, create one */
-    if (NULL == next_pcb)
-    {
-        execute((uint8_t*)"shell");
-        // this call to execute will never return, the following code will not reached
+    /* the current process comes last, so it only keeps the cpu if nobody else can run */
+    for (i = 1; i <= process_num_max; i++) {
+        pid = (current_pid + i) % process_num_max;
+        if (pcb_in_use(pid) && PROC_RUNNABLE == get_pcb(pid)->state)
+            return get_pcb(pid);
     }
 
-    /* change program memory mapping */
-    map_vir_to_phy_4M(program_mem, bottom + program_size * (next_pcb->pid));
+    /* nothing is runnable: resume a sleeping process, it goes back to hlt until woken up */
+    for (i = 0; i <= process_num_max; i++) {
+        pid = (current_pid + i) % process_num_max;
+        if (pcb_in_use(pid) && PROC_BLOCKED == get_pcb(pid)->state)
+            return get_pcb(pid);
+    }
+    return NULL;
+}
+
+/**
+ * @brief switch paging, vidmap and TSS to the next process
+ * 
+ * @param next_pcb
+ */
+static void prepare_switch(pcb_t* next_pcb)
+{
+    running_process_index = next_pcb->terminalid;
+
+    /* change program memory mapping, threads run in the page of their process */
+    map_vir_to_phy_4M(program_mem, bottom + program_size * (next_pcb->leader->pid));
+    shm_restore(next_pcb->leader);
     update_usr_vidmem(next_pcb->terminalid);
 
     /* change rtc rate */
@@ -57,7 +81,47 @@ void schedule_handler(void)
 
     /* modify TSS */
     tss.esp0 = bottom - block_size * (next_pcb->pid);
+}
+
+ /* 
+ *  DESCRIPTION: choose the next process to run and prepare the switch to it
+ *  INPUTS: none
+ *  OUTPUTS: none
+ *  RETURN VALUE: none
+ *  SIDE EFFECTS: change running_process_index, paging and TSS
+ */
+void schedule_handler(void)
+{
+    int32_t i;
 
+    /* if some terminal has no shell, create one */
+    for (i = 0; i < ACTIVE_SIZE; i++) {
+        if (NULL == scheduled_process[i]) {
+            running_process_index = i;
+            execute((uint8_t*)"shell");
+            // this call to execute will never return, the following code will not reached
+        }
+    }
+
+    /* the tick goes to the process it interrupted, not to one halted in sleep_on */
+    sched_stats.ticks++;
+    if (ACCT_IDLE == get_active_pcb()->acct_state)
+        ;
+    else if (pit_tick_cpl)
+        get_active_pcb()->user_ticks++;
+    else
+        get_active_pcb()->kernel_ticks++;
+
+    /* find PCB of the next process, the current one is always a candidate */
+    next_sched_pcb = pick_next_pcb(get_active_pcb()->pid);
+    if (next_sched_pcb != get_active_pcb()) {
+        sched_stats.switches++;
+        TRACE(TRACE_SWITCH, get_active_pcb()->pid, next_sched_pcb->pid);
+        cpu_acct_switch(get_active_pcb(), next_sched_pcb);
+    }
+    if (PROC_BLOCKED == next_sched_pcb->state)
+        sched_stats.idle_ticks++;
+    prepare_switch(next_sched_pcb);
     return;
 }
 
@@ -70,16 +134,132 @@ void schedule_handler(void)
  */
 int32_t store_current_shched_esp(uint32_t esp)
 {
-    pcb_t* current_pcb = scheduled_process[running_process_index];
-    if (NULL == current_pcb) return -1;
+    /* no shell has been started yet */
+    if (NULL == scheduled_process[0]) return -1;
+    pcb_t* current_pcb = get_active_pcb();
+    if (!pcb_in_use(current_pcb->pid)) return -1;
     current_pcb->sched_esp = esp;
     return 0;
 }
 
 uint32_t get_next_shched_esp(void)
 {
-    /* since running_process_index has changed in schedule_handler */
-    /* from the perspective of scheduler, running_process_index is the next scheduled process index */
-    pcb_t* current_pcb = scheduled_process[running_process_index];
-    return current_pcb->sched_esp;
+    return next_sched_pcb->sched_esp;
+}
+
+/**
+ * @brief sleep on a wait queue until wake_up is called on it
+ * 
+ * @param wq
+ * Caller disables interrupts, checks its condition and calls sleep_on in a loop,
+ * interrupts are disabled again when sleep_on returns.
+ */
+void sleep_on(wait_queue_t* wq)
+{
+    pcb_t* current_pcb = get_active_pcb();
+    current_pcb->state = PROC_BLOCKED;
+    wq->waiters |= (0x1 << current_pcb->pid);
+
+    /* the scheduler skips us while blocked, "sti; hlt" cannot miss the wake up interrupt */
+    while (PROC_BLOCKED == current_pcb->state) {
+        cpu_acct(current_pcb, ACCT_IDLE);
+        asm volatile ("sti; hlt; cli" : : : "memory");
+    }
+    cpu_acct(current_pcb, ACCT_KERNEL);
+}
+
+/**
+ * @brief make all the processes sleeping on a wait queue runnable, a poll call
+ *        hooked on it learns which of its fds to ask again
+ * 
+ * @param wq
+ */
+void wake_up(wait_queue_t* wq)
+{
+    int32_t pid;
+    for (pid = 0; pid < process_num_max; pid++) {
+        if (0 == (wq->waiters & (0x1 << pid)))
+            continue;
+        if (pcb_in_use(pid) && PROC_BLOCKED == get_pcb(pid)->state) {
+            get_pcb(pid)->state = PROC_RUNNABLE;
+            sched_stats.wakeups++;
+        }
+    }
+    wq->waiters = 0;
+    if (NULL != wq->polls)
+        poll_wake(wq);
+}
+
+/**
+ * @brief make one process sleeping on a wait queue runnable, the others keep sleeping
+ * 
+ * @param wq
+ * @param pid - the process, nothing happens if it is not on the queue
+ */
+void wake_up_one(wait_queue_t* wq, int32_t pid)
+{
+    if (0 == (wq->waiters & (0x1 << pid)))
+        return;
+    wq->waiters &= ~(0x1 << pid);
+    if (pcb_in_use(pid) && PROC_BLOCKED == get_pcb(pid)->state) {
+        get_pcb(pid)->state = PROC_RUNNABLE;
+        sched_stats.wakeups++;
+    }
+}
+
+/**
+ * @brief called by halt of a background process (already removed, interrupts disabled),
+ *        switch to another process without saving the current context
+ * 
+ * @return -1 if there is no other process, 0 is never returned
+ */
+int32_t schedule_exit(void)
+{
+    pcb_t* next_pcb = pick_next_pcb(get_active_pcb()->pid);
+    if (NULL == next_pcb)
+        return -1;
+    TRACE(TRACE_SWITCH, get_active_pcb()->pid, next_pcb->pid);
+    cpu_acct_switch(NULL, next_pcb);
+    prepare_switch(next_pcb);
+    switch_to_sched_esp(next_pcb->sched_esp);
+    return 0;
+}
+
+/**
+ * @brief charge the TSC cycles since the last charge to the user time, the kernel time
+ *        or the idle time, by what the process was doing
+ * 
+ * @param pcb - the process
+ * @param state - ACCT_USER, ACCT_KERNEL or ACCT_IDLE, what it does from now on
+ */
+void cpu_acct(pcb_t* pcb, int32_t state)
+{
+    uint64_t now, delta;
+    uint32_t flags;
+
+    cli_and_save(flags);
+    now = rdtsc();
+    delta = now - pcb->acct_mark;
+    if (ACCT_USER == pcb->acct_state)
+        pcb->user_tsc += delta;
+    else if (ACCT_KERNEL == pcb->acct_state)
+        pcb->kernel_tsc += delta;
+    else
+        sched_stats.idle_tsc += delta;
+    pcb->acct_mark = now;
+    pcb->acct_state = state;
+    restore_flags(flags);
+}
+
+/**
+ * @brief the cpu leaves from and runs to, which carries on with what it was doing
+ * 
+ * @param from - the process giving up the cpu, NULL if it has halted
+ * @param to - the process getting it
+ */
+void cpu_acct_switch(pcb_t* from, pcb_t* to)
+{
+    if (NULL != from)
+        cpu_acct(from, from->acct_state);
+    to->acct_mark = rdtsc();
 }
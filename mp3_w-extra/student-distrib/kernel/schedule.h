@@ -16,9 +16,45 @@
 #include "system_call.h"
 #include "../drivers/terminal.h"
 
+struct poll_entry;
+
+/* a wait queue is the set of processes sleeping on it, bit i stands for pid i,
+ * and the poll calls hooked on it */
+typedef struct wait_queue {
+    volatile uint32_t waiters;
+    struct poll_entry* polls;
+} wait_queue_t;
+
+/* counters of the scheduler since boot */
+typedef struct sched_stats {
+    uint32_t ticks;         // PIT ticks that ran the scheduler
+    uint32_t switches;      // ticks that switched to another process
+    uint32_t idle_ticks;    // ticks where every process was sleeping
+    uint32_t wakeups;       // processes made runnable by wake_up
+    uint64_t idle_tsc;      // TSC cycles spent in hlt with every process asleep
+} sched_stats_t;
+
+extern sched_stats_t sched_stats;
+/* privilege level the PIT tick interrupted, set by pit_handler_linkage */
+extern volatile uint32_t pit_tick_cpl;
+
 /* Externally-visible functions */
 extern void scheduler(void);
+/* resume a process from its sched_esp, never returns */
+extern void switch_to_sched_esp(uint32_t esp);
 /* Helper function: initialize active pcb list*/
 void schedule_init(void);
+/* block the running process on a wait queue, called with interrupts disabled */
+void sleep_on(wait_queue_t* wq);
+/* make every process sleeping on the wait queue runnable again, and the poll calls on it */
+void wake_up(wait_queue_t* wq);
+/* make only process pid sleeping on the wait queue runnable again */
+void wake_up_one(wait_queue_t* wq, int32_t pid);
+/* give up the cpu for good when a background process halts */
+int32_t schedule_exit(void);
+/* charge the cycles since the last charge to what pcb was doing, then it does state */
+void cpu_acct(struct pcb* pcb, int32_t state);
+/* the cpu goes from one process to another, from is NULL if it is gone */
+void cpu_acct_switch(struct pcb* from, struct pcb* to);
 
 #endif
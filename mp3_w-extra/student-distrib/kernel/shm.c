@@ -0,0 +1,296 @@
+/**
+ * @file shm.c
+ * @brief Shared memory segments. A segment is a set of 4KB frames taken from the
+ *        pool right above the program images, and every process that maps it gets
+ *        the same frames in its user shm window, so no kernel copy is needed.
+ *        Since all processes share kernel_page_dir, the window is rebuilt on every
+ *        context switch from the segment ids recorded in the pcb.
+ *        shm_create counts a reference for the process it returns the id to, as
+ *        shm_map does for each mapping, so a segment and its id live until the
+ *        last process holding either has halted or unmapped it.
+ * @version 0.1
+ * @date 2022-05-24
+ */
+
+#include "shm.h"
+#include "pcb.h"
+#include "paging.h"
+
+#define BITS_PER_WORD   32
+#define slot_addr(slot) (SHM_VIR_BEGIN + SHM_SLOT_SIZE * (slot))
+
+shm_seg_t shm_segs[SHM_SEG_MAX];
+
+/* one bit per frame in the pool, 1 for used */
+static uint32_t shm_frame_map[SHM_FRAME_NUM / BITS_PER_WORD];
+/* number of pages present in the user shm window right now */
+static uint32_t shm_window_pages = 0;
+
+/**
+ * @brief find a free frame in the shm pool
+ * @return physical address of the frame, 0 if the pool is used up
+ */
+static uint32_t shm_frame_alloc(void)
+{
+    uint32_t i, j;
+    for (i = 0; i < SHM_FRAME_NUM / BITS_PER_WORD; i++) {
+        if (0xFFFFFFFF == shm_frame_map[i]) continue;
+        for (j = 0; j < BITS_PER_WORD; j++) {
+            if (shm_frame_map[i] & (0x1 << j)) continue;
+            shm_frame_map[i] |= (0x1 << j);
+            return SHM_PHY_BEGIN + (i * BITS_PER_WORD + j) * SHM_PAGE_SIZE;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief give a frame back to the shm pool
+ * @param frame - physical address returned by shm_frame_alloc
+ */
+static void shm_frame_free(uint32_t frame)
+{
+    uint32_t index = (frame - SHM_PHY_BEGIN) / SHM_PAGE_SIZE;
+    shm_frame_map[index / BITS_PER_WORD] &= ~(0x1 << (index % BITS_PER_WORD));
+}
+
+/**
+ * @brief drop one reference of a segment, free its frames on the last one
+ * @param shmid - segment id
+ */
+static void shm_put(int32_t shmid)
+{
+    uint32_t i;
+    shm_seg_t* seg = &shm_segs[shmid];
+    if (--seg->refcount > 0) return;
+
+    for (i = 0; i < seg->page_num; i++)
+        shm_frame_free(seg->frames[i]);
+    seg->in_use = 0;
+    seg->page_num = 0;
+}
+
+/**
+ * @brief clear the segment table and the frame bitmap
+ */
+void shm_init(void)
+{
+    memset(shm_segs, 0, sizeof(shm_segs));
+    memset(shm_frame_map, 0, sizeof(shm_frame_map));
+    shm_window_pages = 0;
+}
+
+/**
+ * @brief the calling process holds the id of a segment, once, until it halts
+ *        must be called with interrupts disabled
+ * 
+ * @param shmid - segment id
+ */
+static void shm_hold(int32_t shmid)
+{
+    uint32_t bit = 0x1 << get_active_proc()->pid;
+    if (shm_segs[shmid].holders & bit) return;
+    shm_segs[shmid].holders |= bit;
+    shm_segs[shmid].refcount++;
+}
+
+/**
+ * @brief create a shared memory segment, or look up the existing one with the same key
+ * 
+ * @param key - user chosen key, processes agree on a key to share a segment
+ * @param size - size in bytes, at most SHM_SLOT_SIZE
+ * @return segment id for success, -1 for failure
+ */
+int32_t shm_create(int32_t key, uint32_t size)
+{
+    int32_t i;
+    int32_t shmid = -1;
+    uint32_t j, page_num, flags;
+
+    if (0 == size || size > SHM_SLOT_SIZE) return -1;
+    page_num = (size + SHM_PAGE_SIZE - 1) / SHM_PAGE_SIZE;
+
+    cli_and_save(flags);
+    for (i = 0; i < SHM_SEG_MAX; i++) {
+        if (shm_segs[i].in_use && shm_segs[i].key == key) {
+            /* the existing segment must be large enough */
+            if (page_num > shm_segs[i].page_num) {
+                restore_flags(flags);
+                return -1;
+            }
+            shm_hold(i);
+            restore_flags(flags);
+            return i;
+        }
+        if (!shm_segs[i].in_use && -1 == shmid)
+            shmid = i;
+    }
+    if (-1 == shmid) {
+        restore_flags(flags);
+        return -1;
+    }
+
+    /* take frames from the pool, the pool is identity mapped for the kernel */
+    for (j = 0; j < page_num; j++) {
+        if (0 == (shm_segs[shmid].frames[j] = shm_frame_alloc())) {
+            while (j-- > 0)
+                shm_frame_free(shm_segs[shmid].frames[j]);
+            restore_flags(flags);
+            return -1;
+        }
+        memset((void*)shm_segs[shmid].frames[j], 0, SHM_PAGE_SIZE);
+    }
+    shm_segs[shmid].in_use = 1;
+    shm_segs[shmid].key = key;
+    shm_segs[shmid].refcount = 0;
+    shm_segs[shmid].holders = 0;
+    shm_segs[shmid].page_num = page_num;
+    shm_hold(shmid);
+    restore_flags(flags);
+    return shmid;
+}
+
+/**
+ * @brief map a segment into the user shm window of the calling process
+ * 
+ * @param shmid - segment id returned by shm_create
+ * @param addr - where to store the user virtual address of the segment
+ * @return 0 for success, -1 for failure
+ */
+int32_t shm_map(int32_t shmid, uint8_t** addr)
+{
+    int32_t slot;
+    uint32_t flags;
+    pcb_t* pcb = get_active_proc();
+
+    /* sanity check */
+    if (addr == NULL ||
+        (uint32_t) addr <= PROGRAM_IMG_BEGIN ||
+        (uint32_t) addr >= PRPGRAM_IMG_END)
+        return -1;
+    if (shmid < 0 || shmid >= SHM_SEG_MAX || !shm_segs[shmid].in_use)
+        return -1;
+
+    cli_and_save(flags);
+    /* mapping the same segment twice gives the same address */
+    for (slot = 0; slot < SHM_SLOT_NUM; slot++) {
+        if (pcb->shm_ids[slot] == shmid) {
+            restore_flags(flags);
+            *addr = (uint8_t*)slot_addr(slot);
+            return 0;
+        }
+    }
+    for (slot = 0; slot < SHM_SLOT_NUM; slot++)
+        if (-1 == pcb->shm_ids[slot]) break;
+    if (SHM_SLOT_NUM == slot) {
+        restore_flags(flags);
+        return -1;
+    }
+
+    pcb->shm_ids[slot] = shmid;
+    shm_segs[shmid].refcount++;
+    map_usr_shm(slot_addr(slot), shm_segs[shmid].frames, shm_segs[shmid].page_num);
+    shm_window_pages += shm_segs[shmid].page_num;
+    restore_flags(flags);
+
+    *addr = (uint8_t*)slot_addr(slot);
+    return 0;
+}
+
+/**
+ * @brief unmap a segment from the calling process
+ * 
+ * @param addr - address returned by shm_map
+ * @return 0 for success, -1 for failure
+ */
+int32_t shm_unmap(uint8_t* addr)
+{
+    int32_t slot, shmid;
+    uint32_t flags;
+    pcb_t* pcb = get_active_proc();
+
+    for (slot = 0; slot < SHM_SLOT_NUM; slot++)
+        if ((uint32_t)addr == slot_addr(slot)) break;
+    if (SHM_SLOT_NUM == slot || -1 == (shmid = pcb->shm_ids[slot]))
+        return -1;
+
+    cli_and_save(flags);
+    unmap_usr_shm(slot_addr(slot), shm_segs[shmid].page_num);
+    shm_window_pages -= shm_segs[shmid].page_num;
+    pcb->shm_ids[slot] = -1;
+    shm_put(shmid);
+    restore_flags(flags);
+    return 0;
+}
+
+/**
+ * @brief rebuild the user shm window for the process being switched to
+ *        must be called with interrupts disabled
+ * 
+ * @param pcb - the process that will run next
+ */
+void shm_restore(pcb_t* pcb)
+{
+    int32_t slot;
+    int32_t mapped = 0;
+
+    for (slot = 0; slot < SHM_SLOT_NUM; slot++)
+        if (-1 != pcb->shm_ids[slot]) mapped = 1;
+    /* nothing to hide and nothing to show, skip the TLB flush */
+    if (0 == shm_window_pages && !mapped) return;
+
+    unmap_usr_shm(SHM_VIR_BEGIN, SHM_SLOT_NUM * SHM_SEG_PAGE_MAX);
+    shm_window_pages = 0;
+    for (slot = 0; slot < SHM_SLOT_NUM; slot++) {
+        if (-1 == pcb->shm_ids[slot]) continue;
+        map_usr_shm(slot_addr(slot), shm_segs[pcb->shm_ids[slot]].frames, shm_segs[pcb->shm_ids[slot]].page_num);
+        shm_window_pages += shm_segs[pcb->shm_ids[slot]].page_num;
+    }
+}
+
+/**
+ * @brief drop every mapping and every id held by a halting process
+ *        must be called with interrupts disabled, on the halting process
+ * 
+ * @param pcb - the halting process
+ */
+void shm_release(pcb_t* pcb)
+{
+    int32_t slot, shmid;
+    for (slot = 0; slot < SHM_SLOT_NUM; slot++) {
+        if (-1 == pcb->shm_ids[slot]) continue;
+        unmap_usr_shm(slot_addr(slot), shm_segs[pcb->shm_ids[slot]].page_num);
+        shm_window_pages -= shm_segs[pcb->shm_ids[slot]].page_num;
+        shm_put(pcb->shm_ids[slot]);
+        pcb->shm_ids[slot] = -1;
+    }
+    /* then the ids from shm_create, a segment nobody mapped is freed here */
+    for (shmid = 0; shmid < SHM_SEG_MAX; shmid++) {
+        if (!shm_segs[shmid].in_use || !(shm_segs[shmid].holders & (0x1 << pcb->pid))) continue;
+        shm_segs[shmid].holders &= ~(0x1 << pcb->pid);
+        shm_put(shmid);
+    }
+}
+
+/**
+ * @brief number of 4KB frames held by segments
+ */
+uint32_t shm_frames_used(void)
+{
+    uint32_t i, count = 0;
+    for (i = 0; i < SHM_FRAME_NUM; i++)
+        if (shm_frame_map[i / BITS_PER_WORD] & (0x1 << (i % BITS_PER_WORD)))
+            count++;
+    return count;
+}
+
+/**
+ * @brief number of segments that exist
+ */
+uint32_t shm_segs_used(void)
+{
+    uint32_t i, count = 0;
+    for (i = 0; i < SHM_SEG_MAX; i++)
+        count += (0 != shm_segs[i].in_use);
+    return count;
+}
@@ -0,0 +1,50 @@
+/**
+ * @file shm.h
+ * @brief Shared memory segments mapped into the page tables of several processes
+ * @version 0.1
+ * @date 2022-05-24
+ */
+
+#ifndef _SHM_H
+#define _SHM_H
+
+#include "../types.h"
+
+#define SHM_SEG_MAX         16          // shared memory segments in the whole system
+#define SHM_SEG_PAGE_MAX    16          // a segment is at most 16 pages (64KB)
+#define SHM_SLOT_NUM        4           // segments a process can map at the same time
+#define SHM_PAGE_SIZE       0x1000      // 4KB
+#define SHM_SLOT_SIZE       (SHM_SEG_PAGE_MAX * SHM_PAGE_SIZE)
+#define SHM_FRAME_NUM       1024        // SHM_PHY_SIZE / SHM_PAGE_SIZE
+
+typedef struct shm_seg
+{
+    int32_t     in_use;
+    int32_t     key;                        // user chosen key, same key gives same segment
+    int32_t     refcount;                   // holders plus mappings, freed when it drops to 0
+    uint32_t    holders;                    // 1 bit per pid of a process that got the id from shm_create
+    uint32_t    page_num;
+    uint32_t    frames[SHM_SEG_PAGE_MAX];   // physical address of each 4KB frame
+} shm_seg_t;
+
+struct pcb;
+
+/* clear the segment table and the frame bitmap */
+void shm_init(void);
+
+/* system calls */
+int32_t shm_create(int32_t key, uint32_t size);
+int32_t shm_map(int32_t shmid, uint8_t** addr);
+int32_t shm_unmap(uint8_t* addr);
+
+/* rebuild the user shm window for the process being switched to */
+void shm_restore(struct pcb* pcb);
+
+/* drop every mapping and every id held by a halting process */
+void shm_release(struct pcb* pcb);
+
+/* number of frames given to segments, and of segments in use */
+uint32_t shm_frames_used(void);
+uint32_t shm_segs_used(void);
+
+#endif /* _SHM_H */
@@ -0,0 +1,267 @@
+/**
+ * @file signal.c
+ * @brief Signals. Pending bits live in the pcb of each thread, the handlers in the
+ *        leader, so every thread of a process runs the same handler. A thread that
+ *        is in a handler has its signals masked until sigreturn: another signal
+ *        stays pending, except that one with no handler and a fatal default still
+ *        kills. The frame pushed for a handler is, from the user esp up:
+ *        the return address (the stub), the signal number, the hw_context_t and
+ *        the stub "movl $10, %eax; int $0x80" itself.
+ * @version 0.1
+ * @date 2022-06-03
+ */
+
+#include "signal.h"
+#include "pcb.h"
+#include "paging.h"
+#include "system_call.h"
+#include "idt.h"
+#include "trace.h"
+#include "../lib.h"
+#include "../x86_desc.h"
+
+#define SIGRETURN_NUM   10          // system call number of sigreturn
+#define EFLAGS_USER_MASK 0x0CD5     // CF PF AF ZF SF DF OF, what a handler may change
+#define CPL_USER        3
+
+/* "movl $10, %eax; int $0x80; nop" */
+static const uint8_t sigreturn_stub[SIG_STUB_SIZE] = { 0xB8, SIGRETURN_NUM, 0x00, 0x00, 0x00, 0xCD, 0x80, 0x90 };
+
+/* not sent by programs: the process is halting, the thread ends and no handler runs */
+#define SIG_KILL        NUM_SIGNALS
+
+/* signals whose default action is to kill, the others are ignored */
+static const uint32_t sig_fatal = (1 << SIG_DIV_ZERO) | (1 << SIG_SEGFAULT) | (1 << SIG_INTERRUPT) | (1 << SIG_KILL);
+
+static uint32_t alarm_ticks = 0;
+
+/* registers the system call linkage saved at the top of the kernel stack of the thread */
+#define syscall_ctx(pcb) ((hw_context_t*)(bottom - block_size * (pcb)->pid) - 1)
+
+/* [addr, addr + size) is inside the program page */
+#define user_range_ok(addr, size) \
+    ((addr) >= program_mem && (addr) <= program_mem + program_size - (size))
+
+/**
+ * @brief mark a signal that kills pending for every thread of a process and wake the
+ *        sleeping ones, called with interrupts disabled
+ * @param proc - the leader
+ * @param signum - SIG_* or SIG_KILL
+ */
+static void signal_process(pcb_t* proc, int32_t signum)
+{
+    pcb_t* thread;
+    int32_t pid;
+
+    for (pid = 0; pid < process_num_max; pid++) {
+        if (!pcb_in_use(pid) || (thread = get_pcb(pid))->leader != proc)
+            continue;
+        thread->sig_pending |= 1 << signum;
+        // the sleep loops see signal_fatal_pending and give up
+        if (PROC_BLOCKED == thread->state)
+            thread->state = PROC_RUNNABLE;
+    }
+}
+
+/**
+ * @brief mark a signal pending, it is delivered when the thread goes back to user mode.
+ *        One that kills goes to every thread of the process, and the sleeping ones
+ *        are woken, so none of them stays in the kernel while the main thread waits
+ *        for them in halt
+ * @param pcb - the thread
+ * @param signum - SIG_*
+ */
+void signal_send(struct pcb* pcb, int32_t signum)
+{
+    uint32_t flags;
+
+    if (NULL == pcb || signum < 0 || signum >= NUM_SIGNALS)
+        return;
+    cli_and_save(flags);
+    pcb->sig_pending |= 1 << signum;
+    if ((sig_fatal & (1 << signum)) && 0 == pcb->leader->sig_handlers[signum])
+        signal_process(pcb->leader, signum);
+    restore_flags(flags);
+}
+
+/**
+ * @brief the main thread is halting, make the other threads halt too: the ones in user
+ *        mode when they next leave it, the sleeping ones as soon as their sleep gives up
+ * @param proc - the leader, it is not marked itself
+ */
+void signal_kill_threads(struct pcb* proc)
+{
+    uint32_t flags;
+
+    cli_and_save(flags);
+    signal_process(proc, SIG_KILL);
+    proc->sig_pending &= ~(1 << SIG_KILL);
+    restore_flags(flags);
+}
+
+/**
+ * @brief pending signals of the current thread that have no handler and kill it,
+ *        a sleep in the kernel gives up for them
+ * @return nonzero if there is one
+ */
+int32_t signal_fatal_pending(void)
+{
+    pcb_t* pcb = get_active_pcb();
+    uint32_t fatal = pcb->sig_pending & sig_fatal;
+    int32_t signum;
+
+    for (signum = 0; signum < NUM_SIGNALS; signum++)
+        if (0 != pcb->leader->sig_handlers[signum])
+            fatal &= ~(1 << signum);
+    return fatal;
+}
+
+/**
+ * @brief an exception in user mode, send it as a signal if it can be handled
+ * @param signum - SIG_DIV_ZERO or SIG_SEGFAULT
+ * @return 0 if the handler gets it on the way out, -1 if the thread has to die now
+ *         (no handler, or it faulted inside its handler)
+ */
+int32_t signal_exception(int32_t signum)
+{
+    pcb_t* pcb = get_active_pcb();
+
+    if (0 == pcb->leader->sig_handlers[signum] || pcb->sig_masked)
+        return -1;
+    signal_send(pcb, signum);
+    return 0;
+}
+
+/**
+ * @brief run the default action of the lowest pending signal, or push a frame for its handler
+ * @param ctx - what the linkage saved, changed so the iret goes to the handler
+ */
+void signal_deliver(hw_context_t* ctx)
+{
+    pcb_t* pcb = get_active_pcb();
+    uint32_t handler, esp, stub, flags;
+    int32_t signum;
+
+    // only on the way back to user mode, the kernel is never interrupted by a handler
+    if (CPL_USER != (ctx->cs & CPL_USER))
+        return;
+    if (pcb->sig_pending & (1 << SIG_KILL)) {
+        sti();
+        halt(EXCEPTION_STATUS);
+    }
+    cli_and_save(flags);
+    for (signum = 0; signum < NUM_SIGNALS; signum++) {
+        if (!(pcb->sig_pending & (1 << signum)))
+            continue;
+        handler = pcb->leader->sig_handlers[signum];
+        if (0 != handler && pcb->sig_masked)
+            continue;
+        pcb->sig_pending &= ~(1 << signum);
+        if (0 != handler)
+            break;
+        if (sig_fatal & (1 << signum)) {
+            // the other threads die with it, a signal sent to one thread only reaches them here
+            signal_send(pcb, signum);
+            sti();
+            halt(EXCEPTION_STATUS);
+        }
+    }
+    if (signum == NUM_SIGNALS) {
+        restore_flags(flags);
+        return;
+    }
+    pcb->sig_masked = 1;
+    restore_flags(flags);
+
+    esp = ctx->esp - SIG_STUB_SIZE;
+    stub = esp;
+    esp -= sizeof(hw_context_t) + 2 * sizeof(uint32_t);
+    if (!user_range_ok(esp, ctx->esp - esp)) {
+        // no room for the frame, as if it had no handler
+        sti();
+        halt(EXCEPTION_STATUS);
+    }
+    TRACE(TRACE_SIGNAL, signum, handler);
+    memcpy((void*)stub, sigreturn_stub, SIG_STUB_SIZE);
+    memcpy((void*)(esp + 2 * sizeof(uint32_t)), ctx, sizeof(hw_context_t));
+    ((uint32_t*)esp)[1] = signum;
+    ((uint32_t*)esp)[0] = stub;
+    ctx->esp = esp;
+    ctx->eip = handler;
+}
+
+/**
+ * @brief called by pit_handler every tick, the program on the shown terminal gets an alarm
+ *        every SIG_ALARM_TICKS
+ */
+void signal_tick(void)
+{
+    pcb_t* pcb;
+
+    if (++alarm_ticks < SIG_ALARM_TICKS)
+        return;
+    alarm_ticks = 0;
+    if (NULL != (pcb = scheduled_process[current_active_termid]))
+        signal_send(pcb->leader, SIG_ALARM);
+}
+
+/**
+ * @brief system call, set the handler of a signal for the whole process
+ * @param signum - SIG_*
+ * @param handler_address - function in the program page taking the signal number,
+ *                          NULL for the default action
+ * @return 0 on success, -1 for a bad signal or address
+ */
+int32_t set_handler(int32_t signum, void* handler_address)
+{
+    uint32_t handler = (uint32_t)handler_address;
+
+    if (signum < 0 || signum >= NUM_SIGNALS)
+        return -1;
+    if (0 != handler && !user_range_ok(handler, 1))
+        return -1;
+    get_active_proc()->sig_handlers[signum] = handler;
+    return 0;
+}
+
+/**
+ * @brief system call, called by the stub when a handler returns: the registers it was
+ *        delivered with, maybe changed by it, are copied back over the ones the system
+ *        call linkage saved, so the iret goes where the signal came
+ * @return the saved eax, the linkage returns it to user mode
+ */
+int32_t sigreturn(void)
+{
+    pcb_t* pcb = get_active_pcb();
+    hw_context_t* ctx = syscall_ctx(pcb);
+    hw_context_t saved;
+    uint32_t frame = ctx->esp + sizeof(uint32_t);   // the signal number is under it
+
+    if (!pcb->sig_masked || !user_range_ok(frame, sizeof(hw_context_t)))
+        return -1;
+    memcpy(&saved, (void*)frame, sizeof(hw_context_t));
+    // the privilege level, segments and system flags are not the handler's to change
+    saved.cs = USER_CS;
+    saved.ss = USER_DS;
+    saved.ds = ctx->ds;
+    saved.es = ctx->es;
+    saved.fs = ctx->fs;
+    saved.eflags = (ctx->eflags & ~EFLAGS_USER_MASK) | (saved.eflags & EFLAGS_USER_MASK);
+    *ctx = saved;
+    pcb->sig_masked = 0;
+    return saved.eax;
+}
+
+/**
+ * @brief system call, send a signal to a process
+ * @param pid - the process or any of its threads
+ * @param signum - SIG_*
+ * @return 0 on success, -1 for a bad pid or signal
+ */
+int32_t kill(int32_t pid, int32_t signum)
+{
+    if (pid < 0 || pid >= process_num_max || !pcb_in_use(pid) || signum < 0 || signum >= NUM_SIGNALS)
+        return -1;
+    signal_send(get_pcb(pid)->leader, signum);
+    return 0;
+}
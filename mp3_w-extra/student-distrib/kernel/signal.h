@@ -0,0 +1,66 @@
+/**
+ * @file signal.h
+ * @brief Signals. A signal is a pending bit in the pcb of the thread it is sent to,
+ *        delivered when that thread goes back to user mode through the system call,
+ *        exception or PIT linkage: the registers saved by the linkage are copied to
+ *        the user stack under the signal number and a return address into a stub
+ *        that calls sigreturn, and the iret goes to the handler instead.
+ * @version 0.1
+ * @date 2022-06-03
+ */
+
+#ifndef _SIGNAL_H
+#define _SIGNAL_H
+
+#include "../types.h"
+
+#define SIG_DIV_ZERO    0       // divide error in user mode, kills by default
+#define SIG_SEGFAULT    1       // any other exception in user mode, kills by default
+#define SIG_INTERRUPT   2       // ctrl+c on the terminal, kills by default
+#define SIG_ALARM       3       // every 10 seconds to the program on the shown terminal, ignored by default
+#define SIG_USER1       4       // sent by a program with kill, ignored by default
+#define NUM_SIGNALS     5
+
+#define SIG_ALARM_TICKS 1000    // PIT ticks between two alarms, 10 s at 100 Hz
+#define SIG_STUB_SIZE   8       // sigreturn code at the top of a signal frame
+
+/* offsets in hw_context_t for the linkages */
+#define HW_CONTEXT_EAX  24
+#define HW_CONTEXT_CS   52
+
+#ifndef ASM
+
+/* what the linkages push under the interrupt frame, in the order the user handler sees it */
+typedef struct hw_context
+{
+    uint32_t    ebx, ecx, edx, esi, edi, ebp, eax;
+    uint32_t    ds, es, fs;
+    uint32_t    vector;                 // interrupt vector, 0x80 for a system call
+    uint32_t    err;                    // error code of the exception, 0 if it has none
+    uint32_t    eip, cs, eflags;
+    uint32_t    esp, ss;                // only there if the interrupt came from user mode
+} hw_context_t;
+
+struct pcb;
+
+/* mark signum pending for a thread, safe in interrupt handlers */
+void signal_send(struct pcb* pcb, int32_t signum);
+/* a pending signal of the current thread will kill it when it goes back to user mode */
+int32_t signal_fatal_pending(void);
+/* the process is halting, its other threads halt as soon as they can */
+void signal_kill_threads(struct pcb* proc);
+/* a user mode exception becomes a signal, 0 if the handler will get it, -1 if it must die */
+int32_t signal_exception(int32_t signum);
+/* called by the linkages right before the iret, with the saved registers */
+void signal_deliver(hw_context_t* ctx);
+/* called by pit_handler every tick, sends the alarm */
+void signal_tick(void);
+
+/* system calls */
+int32_t set_handler(int32_t signum, void* handler_address);
+int32_t sigreturn(void);
+int32_t kill(int32_t pid, int32_t signum);
+
+#endif /* ASM */
+
+#endif /* _SIGNAL_H */
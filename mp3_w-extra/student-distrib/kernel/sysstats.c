@@ -0,0 +1,128 @@
+/**
+ * @file sysstats.c
+ * @brief Per process and global system call counters. A process can be switched out
+ *        inside a system call (sleeping in read, waiting in execute), so the number and
+ *        the entry stamp are kept per pid and the exit is matched with them. The tables
+ *        are updated with interrupts off, the scheduler may preempt a system call.
+ * @version 0.1
+ * @date 2022-05-31
+ */
+
+#include "sysstats.h"
+#include "pcb.h"
+#include "schedule.h"
+#include "paging.h"
+#include "trace.h"
+#include "../lib.h"
+
+#define TABLE_SIZE      (SYSCALL_NUM + 1)
+
+static sysstats_entry_t global_stats[TABLE_SIZE];
+static sysstats_entry_t proc_stats[process_num_max][TABLE_SIZE];
+/* the call each process is in, and when it entered */
+static uint32_t entry_num[process_num_max];
+static uint64_t entry_tsc[process_num_max];
+
+/* index of the highest set bit, the log2 bucket */
+static uint32_t sysstats_bucket(uint64_t cycles)
+{
+    uint32_t bit;
+
+    if (cycles >> 31)
+        return SYSSTATS_HIST_SIZE - 1;
+    if (0 == cycles)
+        return 0;
+    asm ("bsrl %1, %0" : "=r" (bit) : "r" ((uint32_t)cycles));
+    return bit;
+}
+
+/**
+ * @brief count the call and stamp its entry
+ * @param num - system call number, already checked by the linkage
+ */
+void sysstats_enter(uint32_t num)
+{
+    int32_t pid = get_active_pcb()->pid;
+    uint32_t flags;
+
+    // the process leaves user mode, for its CPU time
+    cpu_acct(get_active_pcb(), ACCT_KERNEL);
+    cli_and_save(flags);
+    global_stats[num].calls++;
+    proc_stats[pid][num].calls++;
+    entry_num[pid] = num;
+    entry_tsc[pid] = rdtsc();
+    restore_flags(flags);
+}
+
+/**
+ * @brief time the call the current process entered last
+ * @param retval - what it returns to the user, negative for an error
+ */
+void sysstats_exit(int32_t retval)
+{
+    uint64_t cycles = rdtsc();
+    int32_t pid = get_active_pcb()->pid;
+    uint32_t num = entry_num[pid], bucket, flags;
+
+    cli_and_save(flags);
+    cycles -= entry_tsc[pid];
+    bucket = sysstats_bucket(cycles);
+    global_stats[num].cycles += cycles;
+    global_stats[num].hist[bucket]++;
+    proc_stats[pid][num].cycles += cycles;
+    proc_stats[pid][num].hist[bucket]++;
+    if (retval < 0) {
+        global_stats[num].errors++;
+        proc_stats[pid][num].errors++;
+    }
+    restore_flags(flags);
+    cpu_acct(get_active_pcb(), ACCT_USER);
+}
+
+/**
+ * @brief clear the counters of a pid that is given to a new process
+ * @param pid - the process
+ */
+void sysstats_reset(int32_t pid)
+{
+    memset(proc_stats[pid], 0, sizeof(proc_stats[pid]));
+}
+
+/**
+ * @brief the counters of one process or of the system
+ * @param pid - the process, SYSSTATS_GLOBAL for the system
+ * @return SYSCALL_NUM + 1 entries indexed by system call number, NULL if pid is not in use
+ */
+sysstats_entry_t* sysstats_get(int32_t pid)
+{
+    if (SYSSTATS_GLOBAL == pid)
+        return global_stats;
+    if (pid < 0 || pid >= process_num_max || !pcb_in_use(pid))
+        return NULL;
+    return proc_stats[pid];
+}
+
+/**
+ * @brief system call, copy the counters to the user
+ * @param pid - the process, SYSSTATS_GLOBAL for the whole system
+ * @param buf - room for entries indexed by system call number, entry 0 is unused
+ * @param nbytes - size of buf, the entries that do not fit are left out
+ * @return bytes copied, -1 for a bad pid or buffer
+ */
+int32_t sysstats(int32_t pid, sysstats_entry_t* buf, int32_t nbytes)
+{
+    sysstats_entry_t* table = sysstats_get(pid);
+    uint32_t flags;
+
+    if (NULL == table || nbytes < 0 || (uint32_t)buf < program_mem ||
+        (uint32_t)buf + nbytes > program_mem + program_size)
+        return -1;
+    if (nbytes > sizeof(global_stats))
+        nbytes = sizeof(global_stats);
+    nbytes -= nbytes % sizeof(sysstats_entry_t);
+    cli_and_save(flags);
+    memcpy(buf, table, nbytes);
+    restore_flags(flags);
+    return nbytes;
+}
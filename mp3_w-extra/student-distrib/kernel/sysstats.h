@@ -0,0 +1,41 @@
+/**
+ * @file sysstats.h
+ * @brief System call accounting. The system call linkage stamps every call with
+ *        the TSC on entry and exit; each system call number keeps its calls, the
+ *        calls that returned an error and a log2 histogram of the cycles they
+ *        took, for every process and for the whole system. The sysstats system
+ *        call copies them out.
+ * @version 0.1
+ * @date 2022-05-31
+ */
+
+#ifndef _SYSSTATS_H
+#define _SYSSTATS_H
+
+#include "../types.h"
+#include "asm_linkage.h"
+
+#define SYSSTATS_HIST_SIZE  32          // bucket i counts calls of 2^i ~ 2^(i+1) - 1 cycles, the last one also longer
+#define SYSSTATS_GLOBAL     (-1)        // pid for the totals of the whole system
+
+/* one system call number, entry 0 of a table is unused */
+typedef struct sysstats_entry
+{
+    uint32_t    calls;                  // entered, halt is counted but never timed
+    uint32_t    errors;                 // returned a negative value
+    uint64_t    cycles;                 // total of the returned calls
+    uint32_t    hist[SYSSTATS_HIST_SIZE];
+} sysstats_entry_t;
+
+/* called by system_call_linkage around the call */
+void sysstats_enter(uint32_t num);
+void sysstats_exit(int32_t retval);
+/* a new process starts from zero */
+void sysstats_reset(int32_t pid);
+/* the table of a process, or of the system for SYSSTATS_GLOBAL, NULL for a bad pid */
+sysstats_entry_t* sysstats_get(int32_t pid);
+
+/* system call */
+int32_t sysstats(int32_t pid, sysstats_entry_t* buf, int32_t nbytes);
+
+#endif /* _SYSSTATS_H */
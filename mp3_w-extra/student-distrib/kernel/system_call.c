@@ -9,6 +9,14 @@
  */
 
 #include "system_call.h"
+#include "schedule.h"
+#include "pipe.h"
+#include "poll.h"
+#include "profile.h"
+#include "sysstats.h"
+#include "procfs.h"
+#include "thread.h"
+#include "../drivers/serial.h"
 
 #define magic_len 4
 #define entry_info_location 24
@@ -52,16 +60,43 @@
 #define LOW2_MASK   3
 #define HIGH8_MASK  0xfc
 
+// QEMU's isa-debug-exit (-device isa-debug-exit,iobase=0xf4,iosize=0x04)
+// exits with (value << 1) | 1 when a value is written to it
+#define DEBUG_EXIT_PORT 0xF4
+
 extern inline int32_t transit_to_user(uint32_t user_esp, uint32_t user_eip);
 extern inline void jump_to_execute_ret(uint32_t kernel_esp, uint8_t status);
 
 int8_t magic_num[magic_len] = {0x7f, 0x45, 0x4c, 0x46};
 
-func_ptr terminal_operations[4] = {terminal_open, terminal_close, terminal_read, terminal_write};
-func_ptr rtc_operations[4]      = {rtc_open, rtc_close, rtc_read, rtc_write};
-func_ptr file_operations[4]     = {file_open, file_close, file_read, file_write};
-func_ptr dir_operations[4]      = {dir_open, dir_close, dir_read, dir_write};
+// set by execute right before transit_to_user when the child runs in the background
+static int32_t execute_background = 0;
+
+uint8_t init_command[INIT_COMMAND_LEN] = "shell";
+
+func_ptr terminal_operations[FOPS_NUM] = {terminal_open, terminal_close, terminal_read, terminal_write, terminal_poll};
+func_ptr rtc_operations[FOPS_NUM]      = {rtc_open, rtc_close, rtc_read, rtc_write, rtc_poll};
+func_ptr file_operations[FOPS_NUM]     = {file_open, file_close, file_read, file_write, poll_ready};
+func_ptr dir_operations[FOPS_NUM]      = {dir_open, dir_close, dir_read, dir_write, poll_ready};
+
 
+/* the file counts its references in OPEN and CLOSE (pipe ends, open files); the others,
+   the terminal and the RTC, reset their state in OPEN and must not be opened again */
+#define file_refcounted(file) \
+    (PIPE_TYPE == (file)->type || REG_TYPE == (file)->type || DIR_TYPE == (file)->type)
+
+/**
+ * @brief copy a file array entry into another fd, OPEN takes one more reference
+ *        for the files that count them
+ * @param dst - entry to fill, must be closed
+ * @param src - open entry
+ */
+static void dup_file_entry(file_array_entry_t* dst, const file_array_entry_t* src)
+{
+    *dst = *src;
+    if (file_refcounted(dst))
+        (*(dst->fops_ptr[OPEN]))(dst->inode_num);
+}
 
 /**
  * @brief: attempts to load and execute a new program,
@@ -69,19 +104,39 @@ func_ptr dir_operations[4]      = {dir_open, dir_close, dir_read, dir_write};
  * @param: command
  * @return: -1    -- the command cannot be executed,
  *                  the program does not exist,
- *                  or the filename specified is not an executable
+ *                  the filename specified is not an executable,
+ *                  or it is too large for the program page
  *         256   -- the program dies by an exception
  *         0~255 -- the program executes a halt system call,
  *                  in which case the value returned is that given by the program’s call to halt
+ *         for a command ending with '&', the pid of the child is returned right away
+ *         and the child keeps running in the background
+ *         only the main thread of a process can execute, -1 for the others
  */
 int32_t execute(const uint8_t* command)
 {
+    // a child returns to the thread that waits for it, keep that the main thread
+    if (NULL != scheduled_process[running_process_index] && get_active_pcb() != get_active_proc())
+        return -1;
+
     /* Parse command */
     uint8_t buf[buf_size];
     uint8_t *str_ptrs[buf_size] = {NULL};
     uint8_t* scan = buf;
     int32_t str_num = 0; // number of strings
     strncpy((int8_t*)buf, (int8_t*)command, buf_size);
+    buf[buf_size - 1] = '\0';
+    // a trailing '&' runs the program in the background
+    int32_t background = 0;
+    scan = buf + strlen((int8_t*)buf);
+    while (scan > buf && ' ' == *(scan - 1)) scan--;
+    if (scan > buf && '&' == *(scan - 1)) {
+        background = 1;
+        scan--;
+        while (scan > buf && ' ' == *(scan - 1)) scan--;
+    }
+    *scan = '\0';
+    scan = buf;
     // modify buf, make str_ptrs[i] point to different strings
     while (1)
     {
@@ -105,8 +160,11 @@ int32_t execute(const uint8_t* command)
         return -1;
     // file is not executable
     int8_t first_4B[magic_len];
-    read_data(temp_dentry.inode_num, 0, (uint8_t*)first_4B, magic_len);
-    if (0 != strncmp(first_4B, magic_num, magic_len))
+    if (magic_len != read_data(temp_dentry.inode_num, 0, (uint8_t*)first_4B, magic_len) ||
+        0 != strncmp(first_4B, magic_num, magic_len))
+        return -1;
+    // the image must fit in the program page, past it is the next process's page or the shm pool
+    if ((uint32_t)GET_FILE_SIZE((&temp_dentry)) > program_size - prog_offset)
         return -1;
 
     /* Create PCB */
@@ -114,38 +172,74 @@ int32_t execute(const uint8_t* command)
     if (-1 == (pid = create_pcb())) // cannot create more process
         return -2;
     pcb_t *child_pcb = get_pcb(pid);
+    // nobody sees the child yet, and the scheduler must not pick it while the image loads
+    child_pcb->state = PROC_WAITING;
+
+    /* Load file into memory, through the kernel's mapping of the child's page:
+     * the parent's paging is untouched, so a failure only frees the pcb */
+    uint32_t prog_entry;
+    int32_t prog_len = GET_FILE_SIZE((&temp_dentry));
+    // in a system call of the parent the disk is waited for by sleeping, not polled;
+    // the first shell of a terminal is started from the PIT handler and keeps interrupts off
+    if (NULL != child_pcb->parent_pcb)
+        sti();
+    if (prog_len != read_data(temp_dentry.inode_num, 0, (uint8_t *)(bottom + program_size * pid + prog_offset), prog_len) ||
+        entry_info_len != read_data(temp_dentry.inode_num, entry_info_location, (uint8_t *)(&prog_entry), entry_info_len)) {
+        cli();
+        free_pcb(pid);
+        return -1;
+    }
+    child_pcb->state = PROC_RUNNABLE;
+    sysstats_reset(pid);
+    pcb_t *parent_pcb = child_pcb->parent_pcb;
     cli();
-    // modify scheduled_process
-    scheduled_process[running_process_index] = child_pcb;
+    // modify scheduled_process, it only follows the foreground process of the terminal
+    if (!background && (NULL == scheduled_process[running_process_index] ||
+                        parent_pcb == scheduled_process[running_process_index]))
+        scheduled_process[running_process_index] = child_pcb;
+    // the parent sleeps in execute until the child halts, unless the child runs in the background
+    child_pcb->background = background;
+    if (!background && NULL != parent_pcb)
+        parent_pcb->state = PROC_WAITING;
 
     // store args for getargs
     strcpy((int8_t*)child_pcb->args, (int8_t*)(str_ptrs[1]));
-    // setup stdin and stdout
-    child_pcb->file_array[0].fops_ptr = terminal_operations;
-    child_pcb->file_array[0].flags = 1;
-    child_pcb->file_array[1].fops_ptr = terminal_operations;
-    child_pcb->file_array[1].flags = 1;
-    // open terminal
-    (*(child_pcb->file_array[0].fops_ptr[OPEN]))();
+    strncpy((int8_t*)child_pcb->name, (int8_t*)str_ptrs[0], filename_len_max);
+    child_pcb->name[filename_len_max] = '\0';
+    profile_exec(child_pcb->pid, child_pcb->name);
+    // setup stdin and stdout, inherited from the parent so that they can be pipes
+    if (NULL != parent_pcb) {
+        dup_file_entry(&child_pcb->file_array[0], &parent_pcb->file_array[0]);
+        dup_file_entry(&child_pcb->file_array[1], &parent_pcb->file_array[1]);
+    } else {
+        child_pcb->file_array[0].fops_ptr = terminal_operations;
+        child_pcb->file_array[0].flags = 1;
+        child_pcb->file_array[1].fops_ptr = terminal_operations;
+        child_pcb->file_array[1].flags = 1;
+    }
+    // open terminal, a background child does not take over the terminal
+    if (!background)
+        (*(terminal_operations[OPEN]))();
 
     /* Set up user program memory (paging) */
     map_vir_to_phy_4M(program_mem, bottom + program_size * (child_pcb->pid));
-
-    /* Load file into memory (must do this after setting up user paging) */
-    read_data(temp_dentry.inode_num, 0, (uint8_t *)(program_mem + prog_offset), GET_FILE_SIZE((&temp_dentry)));
+    shm_restore(child_pcb);
 
     /* Prepare for Context Switch (modify TSS) */
     tss.esp0 = bottom - block_size * (child_pcb->pid);
 
-    // find program entry point (the virtual address of the first instruction)
-    uint32_t prog_entry;
-    read_data(temp_dentry.inode_num, entry_info_location, (uint8_t *)(&prog_entry), entry_info_len);
-
     /* transfer to user program, when user program finishes, get exit status */
     int32_t status;
     /* store current process kernel esp into current (active) pcb, push IRET context to current process' kernel stack, and use IRET to switch to user */
     // sti will be called in transit_to_user
+    execute_background = background;
+    // the parent's time up to here is its own, the child starts out in user mode
+    cpu_acct_switch(parent_pcb, child_pcb);
+    child_pcb->acct_state = ACCT_USER;
     status = transit_to_user(user_prog_esp, prog_entry);
+    // a background launch gets here through the scheduler, see store_execute_esp
+    if (background)
+        return child_pcb->pid;
     return status;
 }
 
@@ -158,6 +252,10 @@ void store_execute_esp(uint32_t kernel_esp)
     // assumption: in the first call to execute in entry(), the esp in close to the bottom 0x800000
     pcb_t *active_pcb_ptr = get_active_pcb();
     active_pcb_ptr->execute_esp = kernel_esp;
+    // the parent of a background child stays runnable, the scheduler resumes it
+    // from this frame as if it had been preempted, and transit_to_user returns
+    if (execute_background)
+        active_pcb_ptr->sched_esp = kernel_esp;
 }
 
 /**
@@ -172,23 +270,49 @@ int32_t halt(uint16_t status)
     pcb_t *active_pcb_ptr = get_active_pcb();
     if (NULL == active_pcb_ptr)
         return -1;
+    // a thread ends alone, the main thread ends the process with all its threads
+    if (active_pcb_ptr != active_pcb_ptr->leader)
+        thread_exit(status);
+    thread_reap_all();
 
     /* close all files */
     int i;
     for (i = 0; i < file_array_len; i++)
     {
-        if (0 != active_pcb_ptr->file_array[i].flags)
-            (*(active_pcb_ptr->file_array[i].fops_ptr[CLOSE]))();
+        if (0 == active_pcb_ptr->file_array[i].flags)
+            continue;
+        // a background process does not own the terminal, leave it alone
+        if (active_pcb_ptr->background && terminal_operations == active_pcb_ptr->file_array[i].fops_ptr)
+            continue;
+        (*(active_pcb_ptr->file_array[i].fops_ptr[CLOSE]))(active_pcb_ptr->file_array[i].inode_num);
     }
 
     /* remove pcb */
     pcb_t *parent_pcb = active_pcb_ptr->parent_pcb;
-    // modify scheduled_process
     cli();
-    scheduled_process[running_process_index] = parent_pcb; // does the order matter?
+    shm_release(active_pcb_ptr);
+    if (active_pcb_ptr->background)
+    {
+        /* nobody waits for a background process, just run another one */
+        remove_pcb();
+        schedule_exit();
+        /* only reached if no process is left at all */
+        scheduled_process[running_process_index] = NULL;
+        execute((uint8_t*)"shell");
+    }
+    // modify scheduled_process
+    if (active_pcb_ptr == scheduled_process[running_process_index])
+        scheduled_process[running_process_index] = parent_pcb; // does the order matter?
     remove_pcb();
     if (NULL == parent_pcb) // no process remains
     {
+        // the init program of a headless run is done, the output must get out first
+        if (0 == running_process_index && 0 != strncmp((int8_t*)init_command, "shell", sizeof("shell"))) {
+            serial_flush();
+            outb(status, DEBUG_EXIT_PORT);
+            // still here without the device, go on interactively
+            strcpy((int8_t*)init_command, "shell");
+        }
         execute((uint8_t*)"shell"); // restart shell
     }
 
@@ -196,11 +320,14 @@ int32_t halt(uint16_t status)
     /* Prepare for Context Switch (modify TSS) */
     // if there is no problem, kernel esp should be at the bottom of the block after return to user
     tss.esp0 = bottom - block_size * (parent_pcb->pid);
+    parent_pcb->state = PROC_RUNNABLE;
 
     /* always unmap the user video memory, might cause problems */
     //unmap_usr_vidmem(VIRTUAL_VMEM_BEGIN);
     /* restore parent paging */
     map_vir_to_phy_4M(program_mem, bottom + program_size * (parent_pcb->pid));
+    shm_restore(parent_pcb);
+    cpu_acct_switch(NULL, parent_pcb);
 
     /* jump to execute_ret in transit_to_user */
     jump_to_execute_ret(parent_pcb->execute_esp, status);
@@ -221,13 +348,24 @@ int32_t open (const uint8_t* filename){
 
     //check input validity
     if (filename == NULL || *filename == '\0')    return -1;
-    pcb_t *active_pcb_ptr = get_active_pcb();
+    pcb_t *active_pcb_ptr = get_active_proc();
     //check whether available file descriptor space
     int32_t i;      // i will be the fd of the current file
     for (i = 2; i < file_array_len; i++)
         if (0 == active_pcb_ptr->file_array[i].flags)
             break;
     if (file_array_len == i)    return -1;
+
+    //synthetic files are not in the file system, their text is made when read
+    int32_t proc_index = procfs_lookup(filename);
+    if (-1 != proc_index) {
+        active_pcb_ptr->file_array[i].flags = 1;
+        active_pcb_ptr->file_array[i].inode_num = proc_index;
+        active_pcb_ptr->file_array[i].position = 0;
+        active_pcb_ptr->file_array[i].fops_ptr = procfs_operations;
+        active_pcb_ptr->file_array[i].type = PROC_TYPE;
+        return i;
+    }
     
     //check whether the named file exist
     uint32_t file_type;
@@ -262,7 +400,7 @@ int32_t open (const uint8_t* filename){
     }
 
     //check whether open success
-    if( -1 == (*(active_pcb_ptr->file_array[i].fops_ptr[OPEN]))() )
+    if( -1 == (*(active_pcb_ptr->file_array[i].fops_ptr[OPEN]))(temp_dentry.inode_num) )
         return -1;
 
     return i;
@@ -282,16 +420,44 @@ int32_t close (int32_t fd){
     if(fd < 2 || fd >= file_array_len){
         return -1;
     }
-    pcb_t *active_pcb_ptr = get_active_pcb();
+    pcb_t *active_pcb_ptr = get_active_proc();
     //the file is closed before
     if(0 == active_pcb_ptr->file_array[fd].flags){
         return -1;
     }
 
+    int32_t inode_num = active_pcb_ptr->file_array[fd].inode_num;
     active_pcb_ptr->file_array[fd].position = 0;
     active_pcb_ptr->file_array[fd].inode_num = -1;
     active_pcb_ptr->file_array[fd].flags = 0;
-    return (*(active_pcb_ptr->file_array[fd].fops_ptr[CLOSE]))();
+    return (*(active_pcb_ptr->file_array[fd].fops_ptr[CLOSE]))(inode_num);
+}
+
+/* 
+ *  int32_t dup2 (int32_t oldfd, int32_t newfd)
+ *  DESCRIPTION: make newfd refer to the same file as oldfd, newfd is closed first if needed,
+ *               used by the shell to redirect stdin and stdout to pipes
+ *  INPUTS:     oldfd -- open file descriptor
+ *              newfd -- file descriptor to overwrite, 0 and 1 are allowed
+ *  OUTPUTS:    none
+ *  RETURN VALUE: newfd for success, -1 for failure
+ */
+int32_t dup2(int32_t oldfd, int32_t newfd)
+{
+    //check input validity
+    if (oldfd < MIN_FD || oldfd >= MAX_FD || newfd < MIN_FD || newfd >= MAX_FD)
+        return -1;
+    pcb_t *active_pcb_ptr = get_active_proc();
+    if (0 == active_pcb_ptr->file_array[oldfd].flags)
+        return -1;
+    if (oldfd == newfd)
+        return newfd;
+
+    // only the files that count references are closed, see dup_file_entry
+    if (0 != active_pcb_ptr->file_array[newfd].flags && file_refcounted(&active_pcb_ptr->file_array[newfd]))
+        (*(active_pcb_ptr->file_array[newfd].fops_ptr[CLOSE]))(active_pcb_ptr->file_array[newfd].inode_num);
+    dup_file_entry(&active_pcb_ptr->file_array[newfd], &active_pcb_ptr->file_array[oldfd]);
+    return newfd;
 }
 
 /* 
@@ -311,8 +477,8 @@ int32_t read(int32_t fd, void* buf, int32_t nbytes)
     pcb_t* pcb;
     int32_t retval;
 
-    // get current pcb
-    pcb = get_active_pcb();
+    // the file array belongs to the process, all its threads share it
+    pcb = get_active_proc();
 
     //check input validity
     // fd should one of 0-7 and not be stdout(1)
@@ -328,16 +494,16 @@ int32_t read(int32_t fd, void* buf, int32_t nbytes)
         return -1;
     }
 
-    // Execute corresponding read operation
+    // Execute corresponding read operation, the ones that may block look at O_NONBLOCK
     int32_t position = pcb->file_array[fd].position;
     uint32_t inode_id = pcb->file_array[fd].inode_num;
-    retval = (*(pcb->file_array[fd].fops_ptr[READ]))(inode_id, position, buf, nbytes);
+    retval = (*(pcb->file_array[fd].fops_ptr[READ]))(inode_id, position, buf, nbytes, pcb->file_array[fd].flags);
 
     /* The position update need to be considered more */
     if (pcb->file_array[fd].type == DIR_TYPE)
         pcb->file_array[fd].position++;
-    else
-        pcb->file_array[fd].position += nbytes;
+    else if (retval > 0)
+        pcb->file_array[fd].position += retval;
     // what if retval = -1?
     return retval;
 }
@@ -359,8 +525,8 @@ int32_t write(int32_t fd, const void* buf, int32_t nbytes)
     pcb_t* pcb;
     int32_t retval;
 
-    // get current pcb
-    pcb = get_active_pcb();
+    // the file array belongs to the process, all its threads share it
+    pcb = get_active_proc();
 
     //check input validity
     // fd should one of 0-7 and not be stdin(0)
@@ -384,14 +550,94 @@ int32_t write(int32_t fd, const void* buf, int32_t nbytes)
         return -1;
     }
 
-    // Execute corresponding read operation
+    // Execute corresponding write operation, regular files write at the fd position
     uint32_t inode_id = pcb->file_array[fd].inode_num;
-    retval = (*(pcb->file_array[fd].fops_ptr[WRITE]))(inode_id,buf,nbytes);
-    // what if retval = -1?
+    retval = (*(pcb->file_array[fd].fops_ptr[WRITE]))(inode_id,buf,nbytes,pcb->file_array[fd].position,pcb->file_array[fd].flags);
+    if (pcb->file_array[fd].type == REG_TYPE && retval > 0)
+        pcb->file_array[fd].position += retval;
     return retval;
 }
 
 
+/* 
+ *  unlink
+ *  DESCRIPTION: remove a regular file from the file system
+ *  INPUTS:     filename -- the name of file
+ *  OUTPUTS:    none
+ *  RETURN VALUE: 0 for success, -1 for failure (no such file, or still open)
+ */
+int32_t unlink(const uint8_t* filename)
+{
+    return fs_unlink(filename);
+}
+
+/* 
+ *  truncate
+ *  DESCRIPTION: set the length of an open regular file, growing fills with zeros
+ *  INPUTS:     fd -- the index of file descriptor
+ *              length -- new length in bytes
+ *  OUTPUTS:    none
+ *  RETURN VALUE: 0 for success, -1 for failure
+ */
+int32_t truncate(int32_t fd, uint32_t length)
+{
+    if (fd < MIN_FD || fd >= MAX_FD)
+        return -1;
+    pcb_t* pcb = get_active_proc();
+    if (0 == pcb->file_array[fd].flags || REG_TYPE != pcb->file_array[fd].type)
+        return -1;
+    return fs_truncate(pcb->file_array[fd].inode_num, length);
+}
+
+/* 
+ *  seek
+ *  DESCRIPTION: set the position of an open regular file, the next read or write starts there
+ *  INPUTS:     fd -- the index of file descriptor
+ *              position -- offset in bytes, may be past the end
+ *  OUTPUTS:    none
+ *  RETURN VALUE: 0 for success, -1 for failure
+ */
+int32_t seek(int32_t fd, uint32_t position)
+{
+    if (fd < MIN_FD || fd >= MAX_FD)
+        return -1;
+    pcb_t* pcb = get_active_proc();
+    if (0 == pcb->file_array[fd].flags || REG_TYPE != pcb->file_array[fd].type)
+        return -1;
+    pcb->file_array[fd].position = position;
+    return 0;
+}
+
+/* 
+ *  ioctl
+ *  DESCRIPTION: requests on a file descriptor: FIONBIO on any of them turns
+ *               O_NONBLOCK on (arg nonzero) or off, and the terminal has
+ *               TERM_GETMODE and TERM_SETMODE for its line discipline
+ *  INPUTS:     fd -- the index of file descriptor
+ *              request -- what to do
+ *              arg -- argument of the request
+ *  OUTPUTS:    none
+ *  RETURN VALUE: depends on the request, -1 for failure
+ */
+int32_t ioctl(int32_t fd, int32_t request, int32_t arg)
+{
+    if (fd < MIN_FD || fd >= MAX_FD)
+        return -1;
+    pcb_t* pcb = get_active_proc();
+    if (0 == pcb->file_array[fd].flags)
+        return -1;
+    if (FIONBIO == request) {
+        if (arg)
+            pcb->file_array[fd].flags |= O_NONBLOCK;
+        else
+            pcb->file_array[fd].flags &= ~O_NONBLOCK;
+        return 0;
+    }
+    if (terminal_operations != pcb->file_array[fd].fops_ptr)
+        return -1;
+    return terminal_ioctl(request, arg);
+}
+
 /* 
  *  getargs
  *  DESCRIPTION: reads the program’s command line arguments into a user-level buffer. 
@@ -407,7 +653,7 @@ int32_t getargs(uint8_t* buf, int32_t nbytes)
     // check input
     if (NULL == buf) return -1;
 
-    pcb_t* active_pcb_ptr = get_active_pcb();
+    pcb_t* active_pcb_ptr = get_active_proc();
     // no arguments
     if ('\0' == *(active_pcb_ptr->args)) return -1;
 
@@ -450,30 +696,6 @@ int32_t vidmap(uint8_t** screen_start)
 }
 
 
-/**
- * @brief Set the handler object
- * 
- * @param signum 
- * @param handler_address 
- * @return int32_t 
- */
-int32_t set_handler(int32_t signum, void* handler_address)
-{
-    return 0;
-}
-
-
-/**
- * @brief 
- * 
- * @return int32_t 
- */
-int32_t sigreturn(void)
-{
-    return 0;
-}
-
-
 /* 
  *  syscall_sound
  *  DESCRIPTION: Play sound using built in PC speaker
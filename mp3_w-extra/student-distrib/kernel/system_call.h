@@ -9,9 +9,20 @@
 #include "pcb.h"
 #include "../drivers/filesystem.h"
 #include "paging.h"
+#include "shm.h"
+#include "signal.h"
 #include "../x86_desc.h"
 #include "../types.h"
 
+#define INIT_COMMAND_LEN 32
+
+/* ioctl on any fd, arg nonzero sets O_NONBLOCK and zero clears it */
+#define FIONBIO 3
+
+/* first program of terminal 0, "init=" on the kernel command line; unless it is
+ * the shell, its halt ends the run through QEMU's isa-debug-exit device */
+extern uint8_t init_command[INIT_COMMAND_LEN];
+
 int32_t halt(uint16_t status);
 
 int32_t execute(const uint8_t* command);
@@ -24,13 +35,19 @@ int32_t open(const uint8_t* filename);
 
 int32_t close(int32_t fd);
 
-int32_t getargs(uint8_t* buf, int32_t nbytes);
+int32_t dup2(int32_t oldfd, int32_t newfd);
 
-int32_t vidmap(uint8_t** screen_start);
+int32_t unlink(const uint8_t* filename);
 
-int32_t set_handler(int32_t signum, void* handler_address);
+int32_t truncate(int32_t fd, uint32_t length);
 
-int32_t sigreturn(void);
+int32_t seek(int32_t fd, uint32_t position);
+
+int32_t ioctl(int32_t fd, int32_t request, int32_t arg);
+
+int32_t getargs(uint8_t* buf, int32_t nbytes);
+
+int32_t vidmap(uint8_t** screen_start);
 
 int32_t sound(uint32_t nFrequence);
 
@@ -0,0 +1,230 @@
+/**
+ * @file thread.c
+ * @brief Threads. A new thread gets a free pcb and a sched_esp frame on its kernel
+ *        stack as if the scheduler had switched away from it, so the scheduler
+ *        starts it like any other process: the frame returns into thread_start,
+ *        which irets to the entry point. The user stack of a thread is carved out
+ *        of the program page below the main stack, and holds a few bytes of code
+ *        at its top that pass the return value of the entry to halt.
+ *        The slot of a halted thread is kept until it is joined. The halt of the
+ *        main thread ends the process: it makes the other threads halt and waits
+ *        for them, so the program page and the files are never taken away from a
+ *        running thread.
+ * @version 0.1
+ * @date 2022-06-02
+ */
+
+#include "thread.h"
+#include "schedule.h"
+#include "paging.h"
+#include "signal.h"
+#include "sysstats.h"
+#include "trace.h"
+#include "../lib.h"
+#include "../x86_desc.h"
+
+#define EFLAGS_USER     0x202   // IF set
+#define SCHED_REGS      4       // edi, esi, ebx, ebp popped by the scheduler
+
+/* joiners and halting main threads sleep here, indexed by the pid of the process */
+static wait_queue_t join_wq[process_num_max];
+/* status given to halt by each thread */
+static int32_t exit_status[process_num_max];
+
+/* "movl %eax, %ebx; movl $1, %eax; int $0x80", halt with what the entry returned */
+static const uint8_t exit_stub[] = { 0x89, 0xC3, 0xB8, 0x01, 0x00, 0x00, 0x00, 0xCD, 0x80 };
+
+/**
+ * @brief push the frame the scheduler pops, the registers and the address it returns to
+ * @param esp - top of the kernel stack, the values after the frame are already pushed
+ * @param start - where the first switch to the thread goes
+ * @return the sched_esp
+ */
+static uint32_t push_sched_frame(uint32_t* esp, void (*start)(void))
+{
+    int32_t i;
+    *--esp = (uint32_t)start;
+    for (i = 0; i < SCHED_REGS; i++)
+        *--esp = 0;
+    return (uint32_t)esp;
+}
+
+/**
+ * @brief system call, start a thread of the running process at entry(arg)
+ * @param entry - function in the program image, what it returns is the thread's status
+ * @param arg - its argument
+ * @return tid (the pid of the thread), -1 for a bad entry or no free pcb
+ */
+int32_t thread_create(uint32_t entry, uint32_t arg)
+{
+    pcb_t* proc = get_active_proc();
+    pcb_t* thread;
+    uint32_t* kstack;
+    uint32_t* ustack;
+    uint32_t top;
+    int32_t tid;
+    uint32_t flags;
+
+    if (entry < PROGRAM_IMG_BEGIN || entry >= PRPGRAM_IMG_END)
+        return -1;
+    cli_and_save(flags);
+    if (-1 == (tid = create_pcb())) {
+        restore_flags(flags);
+        return -1;
+    }
+    thread = get_pcb(tid);
+    sysstats_reset(tid);
+    thread->leader = proc;
+    thread->parent_pcb = proc;
+    thread->background = proc->background;
+    strcpy((int8_t*)thread->name, (int8_t*)proc->name);
+
+    /* user stack in the program page of the process, mapped right now */
+    top = program_mem + program_size - THREAD_MAIN_STACK - THREAD_STACK_SIZE * tid;
+    memcpy((void*)(top - THREAD_STUB_SIZE), exit_stub, sizeof(exit_stub));
+    ustack = (uint32_t*)(top - THREAD_STUB_SIZE);
+    *--ustack = arg;
+    *--ustack = top - THREAD_STUB_SIZE;     // entry returns into the stub
+
+    /* kernel stack: the iret context for thread_start under the scheduler's frame */
+    kstack = (uint32_t*)(bottom - block_size * tid);
+    *--kstack = USER_DS;
+    *--kstack = (uint32_t)ustack;
+    *--kstack = EFLAGS_USER;
+    *--kstack = USER_CS;
+    *--kstack = entry;
+    thread->sched_esp = push_sched_frame(kstack, thread_start);
+    thread->acct_state = ACCT_USER;
+    restore_flags(flags);
+    return tid;
+}
+
+/**
+ * @brief system call, wait for a thread of the same process to halt and free it
+ * @param tid - the thread, not the main thread and not the caller
+ * @return the status it halted with, -1 if tid is no such thread or it was joined already,
+ *         or if a signal kills the program meanwhile
+ */
+int32_t thread_join(int32_t tid)
+{
+    pcb_t* self = get_active_pcb();
+    pcb_t* thread = get_pcb(tid);
+    int32_t status;
+    uint32_t flags;
+
+    if (tid < 0 || tid >= process_num_max || tid == self->pid)
+        return -1;
+    cli_and_save(flags);
+    while (1) {
+        // checked again after every wake up, another joiner may have freed it
+        if (!pcb_in_use(tid) || thread->leader != self->leader || thread == thread->leader) {
+            restore_flags(flags);
+            return -1;
+        }
+        if (PROC_ZOMBIE == thread->state)
+            break;
+        if (signal_fatal_pending()) {
+            restore_flags(flags);
+            return -1;
+        }
+        sleep_on(&join_wq[self->leader->pid]);
+    }
+    status = exit_status[tid];
+    free_pcb(tid);
+    restore_flags(flags);
+    return status;
+}
+
+/**
+ * @brief halt of a thread, it stays a zombie for thread_join and the cpu goes to another one
+ * @param status - for thread_join
+ */
+void thread_exit(int32_t status)
+{
+    pcb_t* self = get_active_pcb();
+
+    cli();
+    exit_status[self->pid] = status;
+    self->state = PROC_ZOMBIE;
+    wake_up(&join_wq[self->leader->pid]);
+    schedule_exit();
+    // the main thread of the process is still there, so another process always exists
+    while (1)
+        asm volatile ("sti; hlt; cli" : : : "memory");
+}
+
+/**
+ * @brief halt of the main thread, make the other threads halt, wait for them and free them
+ */
+void thread_reap_all(void)
+{
+    pcb_t* self = get_active_pcb();
+    int32_t pid, live;
+    uint32_t flags;
+
+    cli_and_save(flags);
+    while (1) {
+        for (live = 0, pid = 0; pid < process_num_max; pid++) {
+            if (pid == self->pid || !pcb_in_use(pid) || get_pcb(pid)->leader != self)
+                continue;
+            if (PROC_ZOMBIE == get_pcb(pid)->state)
+                free_pcb(pid);
+            else
+                live = 1;
+        }
+        if (!live)
+            break;
+        // again on every pass, a dying thread may have started another one
+        signal_kill_threads(self);
+        sleep_on(&join_wq[self->pid]);
+    }
+    restore_flags(flags);
+}
+
+/**
+ * @brief start a kernel thread, it is scheduled like a process and runs with interrupts on
+ * @param func - what it runs, the thread ends when it returns
+ * @param arg - argument of func
+ * @param name - shown in proc/ps
+ * @return pid of the thread, -1 if there is no free pcb
+ */
+int32_t kthread_create(void (*func)(void*), void* arg, const int8_t* name)
+{
+    pcb_t* thread;
+    uint32_t* kstack;
+    int32_t pid;
+    uint32_t flags;
+
+    cli_and_save(flags);
+    if (-1 == (pid = create_pcb())) {
+        restore_flags(flags);
+        return -1;
+    }
+    thread = get_pcb(pid);
+    sysstats_reset(pid);
+    thread->parent_pcb = NULL;
+    thread->terminalid = 0;
+    thread->background = 1;
+    strncpy((int8_t*)thread->name, name, filename_len_max);
+    thread->name[filename_len_max] = '\0';
+
+    /* kthread_start pops func and calls it with arg */
+    kstack = (uint32_t*)(bottom - block_size * pid);
+    *--kstack = (uint32_t)arg;
+    *--kstack = (uint32_t)func;
+    thread->sched_esp = push_sched_frame(kstack, kthread_start);
+    restore_flags(flags);
+    return pid;
+}
+
+/**
+ * @brief a kernel thread is done, free its pcb and run another process
+ */
+void kthread_exit(void)
+{
+    cli();
+    remove_pcb();
+    schedule_exit();
+    while (1)
+        asm volatile ("sti; hlt; cli" : : : "memory");
+}
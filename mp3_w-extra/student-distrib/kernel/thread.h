@@ -0,0 +1,39 @@
+/**
+ * @file thread.h
+ * @brief Threads. A thread has a pcb of its own, so its own kernel stack, sched_esp,
+ *        state and CPU time, and its leader is the pcb of the process; the program
+ *        page, the file array, the shm slots and the arguments are the leader's.
+ *        Kernel threads are pcbs that never go to user mode; nothing starts one yet.
+ * @version 0.1
+ * @date 2022-06-02
+ */
+
+#ifndef _THREAD_H
+#define _THREAD_H
+
+#include "../types.h"
+#include "pcb.h"
+
+#define THREAD_MAIN_STACK   0x40000     // top 256KB of the program page stay for the main thread
+#define THREAD_STACK_SIZE   0x10000     // 64KB user stack per thread, below it by pid
+#define THREAD_STUB_SIZE    12          // exit code at the top of a thread stack
+
+/* system calls */
+int32_t thread_create(uint32_t entry, uint32_t arg);
+int32_t thread_join(int32_t tid);
+
+/* halt of a thread that is not the main thread, never returns */
+void thread_exit(int32_t status);
+/* halt of the main thread ends the other threads and frees them */
+void thread_reap_all(void);
+
+/* start func(arg) in a kernel thread, returns its pid or -1 */
+int32_t kthread_create(void (*func)(void*), void* arg, const int8_t* name);
+/* end of a kernel thread, when func returns, never returns */
+void kthread_exit(void);
+
+/* first code of a new thread, from its sched_esp frame, in thread_asm.S */
+extern void thread_start(void);
+extern void kthread_start(void);
+
+#endif /* _THREAD_H */
@@ -0,0 +1,210 @@
+/**
+ * @file trace.c
+ * @brief Ring of trace events. A writer reserves its slot with one locked xadd on
+ *        the head, so interrupts that nest inside a tracepoint get slots of their
+ *        own and no lock or cli is needed. The slot's seq is written last; the
+ *        dump skips slots whose seq does not match, i.e. writes it interrupted.
+ *        Only the last TRACE_RING_SIZE events are kept, older ones are overwritten.
+ * @version 0.1
+ * @date 2022-05-29
+ */
+
+#include "trace.h"
+#include "pcb.h"
+#include "idt.h"
+#include "../lib.h"
+#include "../drivers/serial.h"
+
+/* PIT channel 2, gated by port 0x61, counts down once for the calibration */
+#define PIT_CH2_DATA        0x42
+#define PIT_MODE_REG        0x43
+#define PIT_GATE_PORT       0x61
+#define PIT_CH2_ONESHOT     0xB0    // channel 2, low then high byte, mode 0
+#define PIT_CALIB_COUNT     11932   // 10 ms of the 1.193182 MHz clock
+#define PIT_CALIB_MS        10
+
+#define TRACE_LINE_LEN      41      // one event, "\n" included
+#define TRACE_HEADER_LEN    40      // room the header or the end line needs, with "\r"
+
+volatile int32_t trace_enabled = 0;
+
+static trace_event_t trace_ring[TRACE_RING_SIZE];
+static volatile uint32_t trace_head = 0;    // events ever reserved
+static uint32_t trace_drained = 0;          // events up to here were dumped
+static uint32_t trace_tsc_khz = 0;
+
+/* a dump asked for with F12, and how far the one being written has got */
+static volatile int32_t dump_requested = 0;
+static int32_t dumping = 0;
+static int32_t dump_enabled;                // trace_enabled before the dump
+static uint32_t dump_seq, dump_last;        // next event to write, end of the dump
+
+/* read the time stamp counter */
+uint64_t rdtsc(void)
+{
+    uint64_t tsc;
+    asm volatile ("rdtsc" : "=A" (tsc));
+    return tsc;
+}
+
+uint32_t rdtsc_khz(void)
+{
+    return trace_tsc_khz;
+}
+
+/**
+ * @brief count TSC cycles over 10 ms of PIT channel 2, the decoder needs the rate to
+ *        turn stamps into time
+ */
+static uint32_t trace_calibrate(void)
+{
+    uint64_t start;
+    uint8_t gate = inb(PIT_GATE_PORT);
+
+    // speaker off, gate on, then load the count
+    outb((gate & ~0x02) | 0x01, PIT_GATE_PORT);
+    outb(PIT_CH2_ONESHOT, PIT_MODE_REG);
+    outb(PIT_CALIB_COUNT & 0xFF, PIT_CH2_DATA);
+    outb(PIT_CALIB_COUNT >> 8, PIT_CH2_DATA);
+    start = rdtsc();
+    // the output bit rises when the count reaches 0
+    while (!(inb(PIT_GATE_PORT) & 0x20));
+    outb(gate, PIT_GATE_PORT);
+    return (uint32_t)(rdtsc() - start) / PIT_CALIB_MS;
+}
+
+/**
+ * @brief calibrate and start recording, after serial_init
+ */
+void trace_init(void)
+{
+    trace_tsc_khz = trace_calibrate();
+    trace_enabled = 1;
+}
+
+/**
+ * @brief append one event
+ * @param type - TRACE_*
+ * @param arg0, arg1 - meaning depends on the type
+ */
+void trace_record(uint8_t type, uint32_t arg0, uint32_t arg1)
+{
+    uint32_t seq = 1;
+    trace_event_t* ev;
+
+    asm volatile ("lock; xaddl %0, %1" : "+r" (seq), "+m" (trace_head) : : "memory");
+    ev = &trace_ring[seq & (TRACE_RING_SIZE - 1)];
+    ev->seq = ~0U;
+    ev->tsc = rdtsc();
+    ev->type = type;
+    // the pcb is at the bottom of the 8KB kernel stack
+    ev->pid = (NULL == scheduled_process[0]) ? TRACE_PID_NONE : get_active_pcb()->pid;
+    ev->arg0 = arg0;
+    ev->arg1 = arg1;
+    asm volatile ("" : : : "memory");
+    ev->seq = seq;
+}
+
+/* the entry hook of every interrupt linkage, also where the interrupts are counted */
+void trace_irq_enter(uint32_t vector)
+{
+    irq_count[vector & (NUM_VEC - 1)]++;
+    TRACE(TRACE_IRQ_ENTER, vector, 0);
+}
+
+void trace_irq_exit(uint32_t vector)
+{
+    TRACE(TRACE_IRQ_EXIT, vector, 0);
+}
+
+void trace_syscall_enter(uint32_t num, uint32_t arg)
+{
+    TRACE(TRACE_SYSCALL_ENTER, num, arg);
+}
+
+void trace_syscall_exit(uint32_t retval)
+{
+    TRACE(TRACE_SYSCALL_EXIT, retval, 0);
+}
+
+/* put val as width hex digits into buf */
+static void trace_hex(int8_t* buf, uint32_t val, int32_t width)
+{
+    static const int8_t digits[] = "0123456789abcdef";
+    while (width-- > 0) {
+        buf[width] = digits[val & 0xF];
+        val >>= 4;
+    }
+}
+
+/**
+ * @brief ask for a dump of the events not dumped yet, it is written by trace_dump_tick
+ */
+void trace_dump_request(void)
+{
+    dump_requested = 1;
+}
+
+/**
+ * @brief called by pit_handler every tick, writes as much of a requested dump to COM1
+ *        as the transmit ring takes without waiting, so a dump never stalls the kernel.
+ *        The dump is text so that it can share the port with other output:
+ *            TRACE BEGIN <version> <tsc kHz> <events>
+ *            <tsc, 16 hex> <type> <pid> <arg0> <arg1>     one line per event
+ *            TRACE END
+ *        Recording is off until the dump is done, so it does not trace itself and the
+ *        events being written are not overwritten.
+ */
+void trace_dump_tick(void)
+{
+    int8_t line[TRACE_LINE_LEN];
+    uint32_t seq, count = 0;
+    trace_event_t* ev;
+
+    if (!dumping) {
+        if (!dump_requested || serial_tx_room() < TRACE_HEADER_LEN)
+            return;
+        dump_requested = 0;
+        dumping = 1;
+        dump_enabled = trace_enabled;
+        trace_enabled = 0;
+        dump_last = trace_head;
+        dump_seq = dump_last - trace_drained > TRACE_RING_SIZE ? dump_last - TRACE_RING_SIZE : trace_drained;
+        for (seq = dump_seq; seq < dump_last; seq++)
+            count += (trace_ring[seq & (TRACE_RING_SIZE - 1)].seq == seq);
+
+        serial_write("TRACE BEGIN 1 ", 14);
+        trace_hex(line, trace_tsc_khz, 8);
+        line[8] = ' ';
+        trace_hex(line + 9, count, 8);
+        line[17] = '\n';
+        serial_write(line, 18);
+    }
+    for (; dump_seq < dump_last; dump_seq++) {
+        ev = &trace_ring[dump_seq & (TRACE_RING_SIZE - 1)];
+        if (ev->seq != dump_seq)
+            continue;
+        // the rest goes on the next tick, once the UART has sent some
+        if (serial_tx_room() < TRACE_LINE_LEN + 1)
+            return;
+        trace_hex(line, (uint32_t)(ev->tsc >> 32), 8);
+        trace_hex(line + 8, (uint32_t)ev->tsc, 8);
+        line[16] = ' ';
+        trace_hex(line + 17, ev->type, 2);
+        line[19] = ' ';
+        trace_hex(line + 20, ev->pid, 2);
+        line[22] = ' ';
+        trace_hex(line + 23, ev->arg0, 8);
+        line[31] = ' ';
+        trace_hex(line + 32, ev->arg1, 8);
+        line[40] = '\n';
+        serial_write(line, TRACE_LINE_LEN);
+    }
+    if (serial_tx_room() < TRACE_HEADER_LEN)
+        return;
+    serial_write("TRACE END\n", 10);
+
+    trace_drained = dump_last;
+    trace_enabled = dump_enabled;
+    dumping = 0;
+}
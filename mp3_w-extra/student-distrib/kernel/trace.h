@@ -0,0 +1,69 @@
+/**
+ * @file trace.h
+ * @brief Kernel event tracing. Tracepoints append TSC stamped events to a ring
+ *        that keeps the most recent TRACE_RING_SIZE of them; the ring is drained
+ *        over COM1 as text, which tracetools/tracedecode turns into a Chrome
+ *        trace / Perfetto JSON timeline.
+ * @version 0.1
+ * @date 2022-05-29
+ */
+
+#ifndef _TRACE_H
+#define _TRACE_H
+
+#include "../types.h"
+
+#define TRACE_RING_SIZE     4096        // events, a power of 2
+#define TRACE_PID_NONE      0xFF        // before the first shell
+
+/* event types, arg0 and arg1 are per type; keep tracetools/tracedecode.c in sync */
+#define TRACE_SYSCALL_ENTER 1           // arg0 system call number, arg1 first argument
+#define TRACE_SYSCALL_EXIT  2           // arg0 return value
+#define TRACE_IRQ_ENTER     3           // arg0 vector
+#define TRACE_IRQ_EXIT      4           // arg0 vector
+#define TRACE_SWITCH        5           // arg0 pid switched from, arg1 pid switched to
+#define TRACE_PAGE_FAULT    6           // arg0 faulting address
+#define TRACE_FS_READ_ENTER 7           // arg0 inode, arg1 length asked
+#define TRACE_FS_READ_EXIT  8           // arg0 inode, arg1 bytes read or -1
+#define TRACE_SIGNAL        9           // arg0 signal number, arg1 handler it is delivered to
+
+typedef struct trace_event
+{
+    uint64_t            tsc;
+    volatile uint32_t   seq;            // index of the event, written last
+    uint8_t             type;
+    uint8_t             pid;
+    uint16_t            reserved;
+    uint32_t            arg0;
+    uint32_t            arg1;
+} trace_event_t;
+
+/* 1 while tracepoints record, tested before anything else so a disabled tracepoint costs a load */
+extern volatile int32_t trace_enabled;
+
+/* measure the TSC against the PIT and start recording */
+void trace_init(void);
+/* append an event, safe from any context including nested interrupts */
+void trace_record(uint8_t type, uint32_t arg0, uint32_t arg1);
+/* ask for the events recorded since the last dump to be written to COM1, safe in interrupt handlers */
+void trace_dump_request(void);
+/* called by pit_handler every tick, writes the dump a piece at a time */
+void trace_dump_tick(void);
+/* read the time stamp counter */
+uint64_t rdtsc(void);
+/* TSC cycles per ms, measured by trace_init */
+uint32_t rdtsc_khz(void);
+
+/* called by the linkages in asm_linkage.S */
+void trace_irq_enter(uint32_t vector);
+void trace_irq_exit(uint32_t vector);
+void trace_syscall_enter(uint32_t num, uint32_t arg);
+void trace_syscall_exit(uint32_t retval);
+
+#define TRACE(type, arg0, arg1)                         \
+do {                                                    \
+    if (trace_enabled)                                  \
+        trace_record((type), (arg0), (arg1));           \
+} while (0)
+
+#endif /* _TRACE_H */
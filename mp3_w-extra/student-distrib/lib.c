@@ -6,6 +6,8 @@
 #include "drivers/keyboard.h"
 #include "kernel/pcb.h"
 #include "drivers/vbe.h"
+#include "drivers/serial.h"
+#include "drivers/scrollback.h"
 
 #define VIDEO       0xB8000
 #define NUM_COLS    80
@@ -17,6 +19,16 @@ static int screen_y;
 static char* video_mem = (char *)VIDEO;
 static int rtc_switch = 0;
 
+int32_t printf_serial = 0;
+
+/* the screen, and COM1 if printf_serial is set */
+static void console_putc(uint8_t c)
+{
+    putc(c);
+    if (printf_serial)
+        serial_putc(c);
+}
+
  /* void enable_cursor ()
  * inputs:          none
  * return value:    None  
@@ -150,7 +162,7 @@ format_char_switch:
                     switch (*buf) {
                         /* Print a literal '%' character */
                         case '%':
-                            putc('%');
+                            console_putc('%');
                             break;
 
                         /* Use alternate formatting */
@@ -212,7 +224,7 @@ format_char_switch:
 
                         /* Print a single character */
                         case 'c':
-                            putc((uint8_t) *((int32_t *)esp));
+                            console_putc((uint8_t) *((int32_t *)esp));
                             esp++;
                             break;
 
@@ -230,7 +242,7 @@ format_char_switch:
                 break;
 
             default:
-                putc(*buf);
+                console_putc(*buf);
                 break;
         }
         buf++;
@@ -245,7 +257,7 @@ format_char_switch:
 int32_t puts(int8_t* s) {
     register int32_t index = 0;
     while (s[index] != '\0') {
-        putc(s[index]);
+        console_putc(s[index]);
         index++;
     }
     return index;
@@ -286,7 +298,8 @@ void putc(uint8_t c)
     //scroll down
     if (NUM_ROWS == screen_y)
     {
-        // implement scrow down
+        // implement scrow down, the top row goes to the scrollback
+        scrollback_push(current_active_termid, (uint8_t*)video_mem);
         memmove(video_mem, video_mem + NUM_COLS * 2, NUM_COLS * (NUM_ROWS - 1) * 2);
         // clear the bottom row
         int32_t i;
@@ -304,20 +317,20 @@ void putc(uint8_t c)
 void putc(uint8_t c) {
     char* video_mem_local;
     int32_t display_flag = 0;  //if need display, change it to 1
+    int32_t draw_flag;         //0 while the terminal shows its scrollback, the text is kept but not drawn
     int32_t i;
-    vga_color_t fontcolor;
-    fontcolor.val = TERMINAL_FONT_COLOR;
-    vga_color_t backcolor;
-    backcolor.val = TERMINAL_BACKGROUND_COLOR;
+    uint8_t attrib;            //colors the terminal writes in, set by SGR sequences
     
     /* get the terminal for the current running process */
     terminal_t* current_run_terminal = &multi_terminals[get_active_pcb()->terminalid]; 
+    attrib = current_run_terminal->vt.attrib;
     screen_x = current_run_terminal->cursor_x;
     screen_y = current_run_terminal->cursor_y;
     video_mem_local = (char*) current_run_terminal->screen_buffer;
     
     /* if current running process's terminal is currently displaying terminal */
     if (get_active_pcb()->terminalid == current_active_termid) display_flag = 1;
+    draw_flag = !scrollback_viewing(current_run_terminal->tid);
     
     if(c == '\n' || c == '\r') {
         screen_y++;
@@ -325,14 +338,14 @@ void putc(uint8_t c) {
     } else {
         if(display_flag){
             *(uint8_t *)(video_mem + ((NUM_COLS * screen_y + screen_x) * 2)) = c;
-            *(uint8_t *)(video_mem + ((NUM_COLS * screen_y + screen_x) * 2) + 1) = ATTRIB;
+            *(uint8_t *)(video_mem + ((NUM_COLS * screen_y + screen_x) * 2) + 1) = attrib;
             *(uint8_t *)((char*)video_mem_local + ((NUM_COLS * screen_y + screen_x) * 2)) = c;
-            *(uint8_t *)((char*)video_mem_local + ((NUM_COLS * screen_y + screen_x) * 2) + 1) = ATTRIB;
-            vbe_putk(screen_x, screen_y, c, &fontcolor, &backcolor);
+            *(uint8_t *)((char*)video_mem_local + ((NUM_COLS * screen_y + screen_x) * 2) + 1) = attrib;
+            if (draw_flag) vbe_putcell(screen_x, screen_y, (attrib << 8) | c, 1);
         } else {
             *(uint8_t *)((char*)video_mem_local + ((NUM_COLS * screen_y + screen_x) * 2)) = c;
-            *(uint8_t *)((char*)video_mem_local + ((NUM_COLS * screen_y + screen_x) * 2) + 1) = ATTRIB;
-            vbe_putc(screen_x, screen_y, c, &fontcolor, &backcolor);
+            *(uint8_t *)((char*)video_mem_local + ((NUM_COLS * screen_y + screen_x) * 2) + 1) = attrib;
+            if (draw_flag) vbe_putcell(screen_x, screen_y, (attrib << 8) | c, 0);
         }
         screen_x++;
         if (NUM_COLS == screen_x){
@@ -340,8 +353,9 @@ void putc(uint8_t c) {
             screen_y++;
         }
     }
-    // implement scrow down
+    // implement scrow down, the top row goes to the scrollback
     if (NUM_ROWS == screen_y){
+        scrollback_push(current_run_terminal->tid, display_flag ? (uint8_t*)video_mem : (uint8_t*)video_mem_local);
         if(display_flag) memmove(video_mem, video_mem + NUM_COLS * 2, NUM_COLS * (NUM_ROWS - 1) * 2);
         else             memmove((char*)video_mem_local, (char*)video_mem_local + NUM_COLS * 2, NUM_COLS * (NUM_ROWS - 1) * 2);
         // clear the bottom row
@@ -350,7 +364,7 @@ void putc(uint8_t c) {
                 *(uint8_t *)((char*)video_mem_local + (i * 2)) = ' ';
                 *(uint8_t *)((char*)video_mem_local + (i * 2) + 1) = ATTRIB;
             }
-            vbe_rollup(0);
+            if (draw_flag) vbe_rollup(0);
         } else {
             for (i = NUM_COLS * (NUM_ROWS - 1); i < NUM_ROWS * NUM_COLS; i++){
                 *(uint8_t *)(video_mem + (i * 2)) = ' ';
@@ -358,7 +372,7 @@ void putc(uint8_t c) {
                 *(uint8_t *)((char*)video_mem_local + (i * 2)) = ' ';
                 *(uint8_t *)((char*)video_mem_local + (i * 2) + 1) = ATTRIB;
             }
-            vbe_rollup(1);
+            if (draw_flag) vbe_rollup(1);
         }
         screen_y--;
     }
@@ -381,14 +395,13 @@ void putc(uint8_t c) {
 void putk(uint8_t c)
 {
     if (show_picture)   return;
+    /* the echo is drawn on the live screen */
+    scrollback_reset();
     terminal_t* current_terminal = get_active_terminal();
     char* video_mem_local = (char*) current_terminal->screen_buffer;
     screen_x = current_terminal->cursor_x;
     screen_y = current_terminal->cursor_y;
-    vga_color_t fontcolor;
-    fontcolor.val = TERMINAL_FONT_COLOR;
-    vga_color_t backcolor;
-    backcolor.val = TERMINAL_BACKGROUND_COLOR;
+    uint8_t attrib = current_terminal->vt.attrib;
     if (c == '\n' || c == '\r')
     {
         screen_x = 0;
@@ -397,11 +410,11 @@ void putk(uint8_t c)
     else
     {
         *(uint8_t *)(video_mem + ((NUM_COLS * screen_y + screen_x) << 1)) = c;
-        *(uint8_t *)(video_mem + ((NUM_COLS * screen_y + screen_x) << 1) + 1) = ATTRIB;
+        *(uint8_t *)(video_mem + ((NUM_COLS * screen_y + screen_x) << 1) + 1) = attrib;
         *(uint8_t *)(video_mem_local + ((NUM_COLS * screen_y + screen_x) << 1)) = c;
-        *(uint8_t *)(video_mem_local + ((NUM_COLS * screen_y + screen_x) << 1) + 1) = ATTRIB;
-        vbe_putk(screen_x, screen_y, c, &fontcolor, &backcolor);
-        //vbe_transfer(video_mem_local, current_picture_addr(), &fontcolor, &backcolor);
+        *(uint8_t *)(video_mem_local + ((NUM_COLS * screen_y + screen_x) << 1) + 1) = attrib;
+        vbe_putcell(screen_x, screen_y, (attrib << 8) | c, 1);
+        //vbe_transfer(video_mem_local, current_picture_addr());
         screen_x++;
         if (NUM_COLS == screen_x)
         {
@@ -412,7 +425,8 @@ void putk(uint8_t c)
     //scroll down
     if (NUM_ROWS == screen_y)
     {
-        // implement scrow down
+        // implement scrow down, the top row goes to the scrollback
+        scrollback_push(current_active_termid, (uint8_t*)video_mem);
         memmove(video_mem, video_mem + NUM_COLS * 2, NUM_COLS * (NUM_ROWS - 1) * 2);
         // clear the bottom row
         int32_t i;
@@ -652,6 +666,62 @@ void* memmove(void* dest, const void* src, uint32_t n) {
     return dest;
 }
 
+/* int32_t lz4_decompress(const uint8_t* src, uint32_t src_len, uint8_t* dst, uint32_t dst_len);
+ * Inputs: const uint8_t* src = LZ4 block (sequences of literals and matches)
+ *               uint32_t src_len = length of the block
+ *               uint8_t* dst = output buffer
+ *               uint32_t dst_len = size of the output buffer
+ * Return Value: number of bytes produced, -1 if the block is corrupted or does not fit
+ * Function: decompress an LZ4 block, every length and offset is checked */
+int32_t lz4_decompress(const uint8_t* src, uint32_t src_len, uint8_t* dst, uint32_t dst_len) {
+    const uint8_t* ip = src;
+    const uint8_t* src_end = src + src_len;
+    const uint8_t* match;
+    uint8_t* op = dst;
+    uint8_t* dst_end = dst + dst_len;
+    uint32_t token, len, offset;
+
+    while (ip < src_end) {
+        token = *ip++;
+        /* literals, a length of 15 continues in the following bytes */
+        len = token >> 4;
+        if (15 == len) {
+            do {
+                if (ip >= src_end) return -1;
+                len += *ip;
+            } while (255 == *ip++);
+        }
+        if (len > (uint32_t)(src_end - ip) || len > (uint32_t)(dst_end - op)) return -1;
+        memcpy(op, ip, len);
+        op += len;
+        ip += len;
+        /* the last sequence has no match */
+        if (ip == src_end) break;
+
+        if (src_end - ip < 2) return -1;
+        offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if (0 == offset || offset > (uint32_t)(op - dst)) return -1;
+        len = (token & 0xF) + 4;
+        if (19 == len) {
+            do {
+                if (ip >= src_end) return -1;
+                len += *ip;
+            } while (255 == *ip++);
+        }
+        if (len > (uint32_t)(dst_end - op)) return -1;
+        match = op - offset;
+        if (offset >= len) {
+            memcpy(op, match, len);
+            op += len;
+        } else {
+            /* overlapping match repeats the last offset bytes */
+            while (len--) *op++ = *match++;
+        }
+    }
+    return op - dst;
+}
+
 /* int32_t strncmp(const int8_t* s1, const int8_t* s2, uint32_t n)
  * Inputs: const int8_t* s1 = first string to compare
  *         const int8_t* s2 = second string to compare
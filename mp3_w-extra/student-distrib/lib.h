@@ -22,6 +22,9 @@
 #define CURSOR_FOUR 0x0E
 #define SHIFT_8 8
 
+/* 1 to copy what printf and puts write to COM1 as well */
+extern int32_t printf_serial;
+
 int32_t printf(int8_t *format, ...);
 void putc(uint8_t c);
 void putk(uint8_t c);
@@ -40,6 +43,7 @@ void* memset_word(void* s, int32_t c, uint32_t n);
 void* memset_dword(void* s, int32_t c, uint32_t n);
 void* memcpy(void* dest, const void* src, uint32_t n);
 void* memmove(void* dest, const void* src, uint32_t n);
+int32_t lz4_decompress(const uint8_t* src, uint32_t src_len, uint8_t* dst, uint32_t dst_len);
 int32_t strncmp(const int8_t* s1, const int8_t* s2, uint32_t n);
 int8_t* strcpy(int8_t* dest, const int8_t*src);
 int8_t* strncpy(int8_t* dest, const int8_t*src, uint32_t n);
@@ -406,6 +406,45 @@ int filesystem_test_6(void)
 }
 
 
+/* filesystem_test_7
+ *
+ * fs tests for create, write past the end, truncate and unlink
+ * Inputs: None
+ * Outputs: None
+ * Side Effects: print effects on screen
+ * Files: filesystem.h/c
+ */
+int filesystem_test_7(void)
+{
+	TEST_HEADER;
+	int32_t i;
+	uint8_t buf[BUF_SIZE];
+	dentry_t my_dentry;
+
+	if (0 != fs_create((uint8_t *)"test7.txt") || 0 != read_dentry_by_name((uint8_t *)"test7.txt", &my_dentry))
+		return FAIL;
+	// a second create with the same name fails
+	if (-1 != fs_create((uint8_t *)"test7.txt"))
+		return FAIL;
+	// write across a block boundary, leaving a hole at the beginning
+	memset(buf, 'a', BUF_SIZE);
+	if (BUF_SIZE != file_write(my_dentry.inode_num, buf, BUF_SIZE, blk_size - BUF_SIZE / 2))
+		return FAIL;
+	if (blk_size + BUF_SIZE / 2 != GET_FILE_SIZE((&my_dentry)))
+		return FAIL;
+	// the hole reads as zeros
+	if (BUF_SIZE != read_data(my_dentry.inode_num, 0, buf, BUF_SIZE))
+		return FAIL;
+	for (i = 0; i < BUF_SIZE; i++)
+		if (0 != buf[i]) return FAIL;
+	if (0 != fs_truncate(my_dentry.inode_num, 1) || 1 != GET_FILE_SIZE((&my_dentry)))
+		return FAIL;
+	if (0 != fs_unlink((uint8_t *)"test7.txt") || -1 != read_dentry_by_name((uint8_t *)"test7.txt", &my_dentry))
+		return FAIL;
+	return PASS;
+}
+
+
 /* terminal_driver_read_test
  *
  * tests for terminal read()
@@ -483,6 +522,7 @@ void launch_tests()
 		TEST_OUTPUT("filesystem_test_4", filesystem_test_4());
 		TEST_OUTPUT("filesystem_test_5", filesystem_test_5());
 		TEST_OUTPUT("filesystem_test_6", filesystem_test_6());
+		TEST_OUTPUT("filesystem_test_7", filesystem_test_7());
 	}
 	#endif
 
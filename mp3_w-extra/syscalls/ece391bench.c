@@ -0,0 +1,303 @@
+#include <stdint.h>
+
+#include "ece391support.h"
+#include "ece391syscall.h"
+
+/*
+ * Benchmark suite, run headless by "make bench" in student-distrib as the
+ * init program (init=bench), or by hand from the shell. Every result is a
+ * line "BENCH <name> <value> <unit>" on stdout, the last one is
+ * "BENCH done <failures> failed". Times come from the TSC, converted with
+ * the rate measured against the RTC by the first test.
+ *
+ * "bench nop" and "bench pong" are the children of the execute and
+ * context switch tests.
+ */
+
+#define SYSCALL_ITERS   100000
+#define PINGPONG_ITERS  100
+#define EXEC_ITERS      100
+#define RTC_RATE        1024
+#define RTC_TICKS       256
+#define FILE_KB         1024
+#define FILE_PASSES     4
+#define TERM_KB         64
+#define CHUNK           (64 * 1024)
+#define NAME            "bench.dat"
+
+static uint8_t data[CHUNK];
+static uint32_t tsc_khz;
+static int32_t failures;
+
+static uint64_t
+rdtsc (void)
+{
+    uint32_t lo, hi;
+    asm volatile ("rdtsc" : "=a" (lo), "=d" (hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+/* 64 by 32 bit division without libgcc, the quotient must fit in 32 bits */
+static uint32_t
+div64 (uint64_t n, uint32_t d)
+{
+    uint32_t q = 0;
+    int32_t i;
+    if (0 == d)
+        return 0;
+    for (i = 31; i >= 0; i--) {
+        if ((n >> i) >= d) {
+            n -= (uint64_t)d << i;
+            q |= 1U << i;
+        }
+    }
+    return q;
+}
+
+/* cycles to nanoseconds, for short times */
+static uint32_t
+to_ns (uint64_t cycles)
+{
+    return div64 (cycles * 1000000, tsc_khz);
+}
+
+/* cycles to microseconds */
+static uint32_t
+to_us (uint64_t cycles)
+{
+    return div64 (cycles * 1000, tsc_khz);
+}
+
+static void
+report (const char* name, uint32_t value, const char* unit)
+{
+    uint8_t num[16];
+    ece391_fdputs (1, (uint8_t*)"BENCH ");
+    ece391_fdputs (1, (uint8_t*)name);
+    ece391_fdputs (1, (uint8_t*)" ");
+    ece391_fdputs (1, ece391_itoa (value, num, 10));
+    ece391_fdputs (1, (uint8_t*)" ");
+    ece391_fdputs (1, (uint8_t*)unit);
+    ece391_fdputs (1, (uint8_t*)"\n");
+}
+
+static void
+fail (const char* name)
+{
+    ece391_fdputs (1, (uint8_t*)"BENCH ");
+    ece391_fdputs (1, (uint8_t*)name);
+    ece391_fdputs (1, (uint8_t*)" failed\n");
+    failures++;
+}
+
+/*
+ * RTC wakeups at 1024 Hz: the mean period gives the TSC rate, the jitter is
+ * how far single periods are from it
+ */
+static int32_t
+bench_rtc (void)
+{
+    static uint64_t stamps[RTC_TICKS + 1];
+    int32_t fd, i, rate = RTC_RATE;
+    uint32_t period, d, max_dev = 0;
+    uint64_t dev_sum = 0;
+
+    if (-1 == (fd = ece391_open ((uint8_t*)"rtc")) || -1 == ece391_write (fd, &rate, 4)) {
+        fail ("rtc");
+        return -1;
+    }
+    ece391_read (fd, &rate, 4);        /* start on a tick */
+    for (i = 0; i <= RTC_TICKS; i++) {
+        ece391_read (fd, &rate, 4);
+        stamps[i] = rdtsc ();
+    }
+    ece391_close (fd);
+
+    period = div64 (stamps[RTC_TICKS] - stamps[0], RTC_TICKS);
+    tsc_khz = div64 ((uint64_t)period * RTC_RATE, 1000);
+    if (0 == tsc_khz) {
+        fail ("rtc");
+        return -1;
+    }
+    for (i = 1; i <= RTC_TICKS; i++) {
+        d = (uint32_t)(stamps[i] - stamps[i - 1]);
+        d = d > period ? d - period : period - d;
+        dev_sum += d;
+        if (d > max_dev)
+            max_dev = d;
+    }
+    report ("tsc_khz", tsc_khz, "kHz");
+    report ("rtc_period", to_ns (period), "ns");
+    report ("rtc_jitter_avg", to_ns (div64 (dev_sum, RTC_TICKS)), "ns");
+    report ("rtc_jitter_max", to_ns (max_dev), "ns");
+    return 0;
+}
+
+/* the cheapest trip through the system call path, close checks the fd and fails */
+static void
+bench_syscall (void)
+{
+    uint64_t start;
+    int32_t i;
+
+    start = rdtsc ();
+    for (i = 0; i < SYSCALL_ITERS; i++)
+        ece391_close (-1);
+    report ("null_syscall", div64 (rdtsc () - start, SYSCALL_ITERS), "cycles");
+}
+
+/*
+ * one byte back and forth between this process and a "bench pong" child
+ * over two pipes, a round trip is two context switches
+ */
+static void
+bench_pingpong (void)
+{
+    int32_t ping[2], pong[2], i;
+    uint8_t c = 'x';
+    uint64_t start;
+
+    if (-1 == ece391_pipe (ping) || -1 == ece391_pipe (pong)) {
+        fail ("ctx_switch");
+        return;
+    }
+    /* the child gets the pipes as stdin and stdout */
+    ece391_dup2 (0, 6);
+    ece391_dup2 (1, 7);
+    ece391_dup2 (ping[0], 0);
+    ece391_dup2 (pong[1], 1);
+    i = ece391_execute ((uint8_t*)"bench pong &");
+    ece391_dup2 (6, 0);
+    ece391_dup2 (7, 1);
+    ece391_close (6);
+    ece391_close (7);
+    ece391_close (ping[0]);
+    ece391_close (pong[1]);
+    if (i < 0) {
+        ece391_close (ping[1]);
+        ece391_close (pong[0]);
+        fail ("ctx_switch");
+        return;
+    }
+
+    start = rdtsc ();
+    for (i = 0; i < PINGPONG_ITERS; i++) {
+        if (1 != ece391_write (ping[1], &c, 1) || 1 != ece391_read (pong[0], &c, 1))
+            break;
+    }
+    if (PINGPONG_ITERS == i)
+        report ("ctx_switch", to_ns (div64 (rdtsc () - start, 2 * PINGPONG_ITERS)), "ns");
+    else
+        fail ("ctx_switch");
+
+    /* end of file for the child, then wait for its exit */
+    ece391_close (ping[1]);
+    while (ece391_read (pong[0], &c, 1) > 0);
+    ece391_close (pong[0]);
+}
+
+static int32_t
+pong (void)
+{
+    uint8_t c;
+    while (1 == ece391_read (0, &c, 1))
+        ece391_write (1, &c, 1);
+    return 0;
+}
+
+static void
+bench_exec (void)
+{
+    uint64_t start;
+    int32_t i;
+
+    start = rdtsc ();
+    for (i = 0; i < EXEC_ITERS; i++) {
+        if (0 != ece391_execute ((uint8_t*)"bench nop")) {
+            fail ("execute_halt");
+            return;
+        }
+    }
+    report ("execute_halt", to_ns (div64 (rdtsc () - start, EXEC_ITERS)), "ns");
+}
+
+/* a file written once, then read whole a few times in 64KB reads */
+static void
+bench_file_read (void)
+{
+    int32_t dir_fd, fd, i, pass;
+    uint64_t start, total;
+
+    for (i = 0; i < CHUNK; i++)
+        data[i] = 'a' + i % 26;
+    ece391_unlink ((uint8_t*)NAME);
+    if (-1 == (dir_fd = ece391_open ((uint8_t*)".")) ||
+        -1 == ece391_write (dir_fd, (uint8_t*)NAME, ece391_strlen ((uint8_t*)NAME)) ||
+        -1 == (fd = ece391_open ((uint8_t*)NAME))) {
+        fail ("file_read");
+        return;
+    }
+    ece391_close (dir_fd);
+    for (i = 0; i < FILE_KB * 1024 / CHUNK; i++) {
+        if (CHUNK != ece391_write (fd, data, CHUNK)) {
+            fail ("file_read");
+            ece391_close (fd);
+            ece391_unlink ((uint8_t*)NAME);
+            return;
+        }
+    }
+    ece391_close (fd);
+
+    fd = ece391_open ((uint8_t*)NAME);
+    total = 0;
+    for (pass = 0; pass < FILE_PASSES; pass++) {
+        ece391_seek (fd, 0);
+        start = rdtsc ();
+        for (i = 0; i < FILE_KB * 1024 / CHUNK; i++)
+            if (CHUNK != ece391_read (fd, data, CHUNK))
+                break;
+        total += rdtsc () - start;
+    }
+    ece391_close (fd);
+    ece391_unlink ((uint8_t*)NAME);
+    report ("file_read", div64 ((uint64_t)FILE_KB * FILE_PASSES * 1000000, to_us (total) + 1), "KB/s");
+}
+
+/* lines of text to stdout, the screen or COM1 with console=serial */
+static void
+bench_term_write (void)
+{
+    uint64_t start, total;
+    int32_t i;
+
+    for (i = 0; i < 1024; i++)
+        data[i] = (63 == i % 64) ? '\n' : 'A' + i % 26;
+    start = rdtsc ();
+    for (i = 0; i < TERM_KB; i++)
+        ece391_write (1, data, 1024);
+    total = rdtsc () - start;
+    report ("term_write", div64 ((uint64_t)TERM_KB * 1000000, to_us (total) + 1), "KB/s");
+}
+
+int main ()
+{
+    uint8_t arg[16];
+
+    if (0 == ece391_getargs (arg, 16)) {
+        if (0 == ece391_strcmp (arg, (uint8_t*)"nop"))
+            return 0;
+        if (0 == ece391_strcmp (arg, (uint8_t*)"pong"))
+            return pong ();
+    }
+
+    ece391_fdputs (1, (uint8_t*)"BENCH start\n");
+    if (0 == bench_rtc ()) {
+        bench_syscall ();
+        bench_pingpong ();
+        bench_exec ();
+        bench_file_read ();
+        bench_term_write ();
+    }
+    report ("done", failures, "failed");
+    return failures ? 1 : 0;
+}
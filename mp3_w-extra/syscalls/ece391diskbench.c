@@ -0,0 +1,141 @@
+#include <stdint.h>
+
+#include "ece391support.h"
+#include "ece391syscall.h"
+
+/*
+ * Disk benchmark. Writes a file of SIZE_MB megabytes (or the argument),
+ * then reads it sequentially in CHUNK sized reads and at RANDOM_NUM
+ * random block aligned offsets. The file should be larger than the
+ * kernel's buffer cache (4MB) so that reads reach the disk; with the
+ * file system in memory it measures the copy instead.
+ * Times are TSC cycles.
+ */
+
+#define CHUNK (64 * 1024)
+#define BLOCK 4096
+#define SIZE_MB 16
+#define RANDOM_NUM 1024
+#define NAME "diskbench.dat"
+
+static uint8_t data[CHUNK];
+
+static uint64_t
+rdtsc (void)
+{
+    uint32_t lo, hi;
+    asm volatile ("rdtsc" : "=a" (lo), "=d" (hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+/* 64 by 32 bit division without libgcc, the quotient must fit in 32 bits */
+static uint32_t
+div64 (uint64_t n, uint32_t d)
+{
+    uint32_t q = 0;
+    int32_t i;
+    if (0 == d)
+        return 0;
+    for (i = 31; i >= 0; i--) {
+        if ((n >> i) >= d) {
+            n -= (uint64_t)d << i;
+            q |= 1U << i;
+        }
+    }
+    return q;
+}
+
+static void
+report (const char* what, uint32_t value, const char* unit)
+{
+    uint8_t num[16];
+    ece391_fdputs (1, (uint8_t*)what);
+    ece391_fdputs (1, ece391_itoa (value, num, 10));
+    ece391_fdputs (1, (uint8_t*)unit);
+}
+
+static uint32_t
+atoi (const uint8_t* s)
+{
+    uint32_t n = 0;
+    while (*s >= '0' && *s <= '9')
+        n = n * 10 + (*s++ - '0');
+    return n;
+}
+
+int main ()
+{
+    int32_t dir_fd, fd, i;
+    uint32_t size, done, pos, seed, cycles, max;
+    uint64_t start, total;
+    uint8_t arg[16];
+
+    size = SIZE_MB;
+    if (0 == ece391_getargs (arg, 16) && 0 != atoi (arg))
+        size = atoi (arg);
+    size *= 1024 * 1024;
+    for (i = 0; i < CHUNK; i++)
+        data[i] = 'a' + i % 26;
+
+    /* files are created by writing their name to the directory */
+    ece391_unlink ((uint8_t*)NAME);
+    if (-1 == (dir_fd = ece391_open ((uint8_t*)".")) ||
+        -1 == ece391_write (dir_fd, (uint8_t*)NAME, ece391_strlen ((uint8_t*)NAME)) ||
+        -1 == (fd = ece391_open ((uint8_t*)NAME))) {
+        ece391_fdputs (1, (uint8_t*)"create failed\n");
+        return 2;
+    }
+    ece391_close (dir_fd);
+
+    /* closing the file writes it back to the disk */
+    start = rdtsc ();
+    for (done = 0; done < size; done += CHUNK) {
+        if (CHUNK != ece391_write (fd, data, CHUNK)) {
+            ece391_fdputs (1, (uint8_t*)"write failed, file system full?\n");
+            break;
+        }
+    }
+    ece391_close (fd);
+    total = rdtsc () - start;
+    if (done < CHUNK)
+        return 2;
+    size = done;
+    report ("write ", size / 1024, " KB: ");
+    report ("", div64 (total, size / 1024), " cycles/KB\n");
+
+    /* sequential, every read covers 16 blocks */
+    fd = ece391_open ((uint8_t*)NAME);
+    start = rdtsc ();
+    for (done = 0; done < size; done += CHUNK) {
+        if (CHUNK != ece391_read (fd, data, CHUNK)) {
+            ece391_fdputs (1, (uint8_t*)"read failed\n");
+            break;
+        }
+    }
+    total = rdtsc () - start;
+    report ("sequential read: ", div64 (total, size / 1024), " cycles/KB\n");
+
+    /* random blocks, most of them miss the cache */
+    seed = 391;
+    total = 0;
+    max = 0;
+    for (i = 0; i < RANDOM_NUM; i++) {
+        seed = seed * 1103515245 + 12345;
+        pos = ((seed >> 8) % (size / BLOCK)) * BLOCK;
+        start = rdtsc ();
+        ece391_seek (fd, pos);
+        if (BLOCK != ece391_read (fd, data, BLOCK)) {
+            ece391_fdputs (1, (uint8_t*)"read failed\n");
+            break;
+        }
+        cycles = (uint32_t)(rdtsc () - start);
+        total += cycles;
+        if (cycles > max) max = cycles;
+    }
+    report ("random 4KB read: avg ", div64 (total, RANDOM_NUM), " cycles, ");
+    report ("max ", max, " cycles\n");
+
+    ece391_close (fd);
+    ece391_unlink ((uint8_t*)NAME);
+    return 0;
+}
@@ -0,0 +1,121 @@
+#include <stdint.h>
+
+#include "ece391support.h"
+#include "ece391syscall.h"
+
+/*
+ * File system benchmark. Measures sequential write throughput (appending
+ * to a new file in CHUNK sized writes) and the latency of the operations
+ * that allocate or free inodes and blocks: create, truncate and unlink.
+ * Times are TSC cycles.
+ */
+
+#define CHUNK 4096
+#define TOTAL (256 * 1024)
+#define FILE_NUM 32
+#define NAME "fsbench.dat"
+
+static uint8_t data[CHUNK];
+
+static uint32_t
+rdtsc (void)
+{
+    uint32_t lo, hi;
+    asm volatile ("rdtsc" : "=a" (lo), "=d" (hi));
+    return lo;
+}
+
+static void
+report (const char* what, uint32_t value, const char* unit)
+{
+    uint8_t num[16];
+    ece391_fdputs (1, (uint8_t*)what);
+    ece391_fdputs (1, ece391_itoa (value, num, 10));
+    ece391_fdputs (1, (uint8_t*)unit);
+}
+
+/* files are created by writing their name to the directory */
+static int32_t
+create (int32_t dir_fd, const uint8_t* name)
+{
+    return ece391_write (dir_fd, name, ece391_strlen (name));
+}
+
+int main ()
+{
+    int32_t dir_fd, fd, i, done;
+    uint32_t start, cycles, max, sum;
+    uint8_t name[16];
+
+    if (-1 == (dir_fd = ece391_open ((uint8_t*)"."))) {
+        ece391_fdputs (1, (uint8_t*)"directory open failed\n");
+        return 2;
+    }
+    for (i = 0; i < CHUNK; i++)
+        data[i] = 'a' + i % 26;
+
+    /* sequential write, every chunk allocates a new block */
+    ece391_unlink ((uint8_t*)NAME);
+    if (-1 == create (dir_fd, (uint8_t*)NAME) || -1 == (fd = ece391_open ((uint8_t*)NAME))) {
+        ece391_fdputs (1, (uint8_t*)"create failed\n");
+        return 2;
+    }
+    start = rdtsc ();
+    for (done = 0; done < TOTAL; done += CHUNK) {
+        if (CHUNK != ece391_write (fd, data, CHUNK)) {
+            ece391_fdputs (1, (uint8_t*)"write failed, file system full?\n");
+            break;
+        }
+    }
+    cycles = rdtsc () - start;
+    report ("append ", done / 1024, " KB: ");
+    report ("", cycles / (done / 1024 ? done / 1024 : 1), " cycles/KB\n");
+
+    /* rewrite in place, no allocation */
+    ece391_close (fd);
+    fd = ece391_open ((uint8_t*)NAME);
+    start = rdtsc ();
+    for (i = 0; i < done; i += CHUNK)
+        ece391_write (fd, data, CHUNK);
+    cycles = rdtsc () - start;
+    report ("overwrite: ", cycles / (done / 1024 ? done / 1024 : 1), " cycles/KB\n");
+
+    start = rdtsc ();
+    ece391_truncate (fd, 0);
+    report ("truncate to 0: ", rdtsc () - start, " cycles\n");
+    ece391_close (fd);
+    ece391_unlink ((uint8_t*)NAME);
+
+    /* inode and dentry allocation */
+    sum = max = 0;
+    for (i = 0; i < FILE_NUM; i++) {
+        ece391_strcpy (name, (uint8_t*)"fsb");
+        ece391_itoa (i, name + 3, 10);
+        start = rdtsc ();
+        if (-1 == create (dir_fd, name)) {
+            ece391_fdputs (1, (uint8_t*)"create failed\n");
+            break;
+        }
+        cycles = rdtsc () - start;
+        sum += cycles;
+        if (cycles > max) max = cycles;
+    }
+    report ("create: avg ", sum / FILE_NUM, " cycles, ");
+    report ("max ", max, " cycles\n");
+
+    sum = max = 0;
+    for (i = 0; i < FILE_NUM; i++) {
+        ece391_strcpy (name, (uint8_t*)"fsb");
+        ece391_itoa (i, name + 3, 10);
+        start = rdtsc ();
+        ece391_unlink (name);
+        cycles = rdtsc () - start;
+        sum += cycles;
+        if (cycles > max) max = cycles;
+    }
+    report ("unlink: avg ", sum / FILE_NUM, " cycles, ");
+    report ("max ", max, " cycles\n");
+
+    ece391_close (dir_fd);
+    return 0;
+}
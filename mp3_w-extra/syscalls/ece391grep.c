@@ -13,7 +13,10 @@ do_one_file (const char* s, const char* fname)
     uint8_t data[BUFSIZE+1];
 
     s_len = ece391_strlen ((uint8_t*)s);
-    if (-1 == (fd = ece391_open ((uint8_t*)fname))) {
+    /* "-" is the standard input, e.g. the read end of a pipe */
+    if (0 == ece391_strcmp ((uint8_t*)fname, (uint8_t*)"-"))
+        fd = 0;
+    else if (-1 == (fd = ece391_open ((uint8_t*)fname))) {
         ece391_fdputs (1, (uint8_t*)"file open failed\n");
         return -1;
     }
@@ -42,8 +45,10 @@ do_one_file (const char* s, const char* fname)
 	    for (check = line_start; check < line_end; check++) {
 		if (s[0] == data[check] && 
 		    0 == ece391_strncmp ((uint8_t*)(data + check), (uint8_t*)s, s_len)) {
-		    ece391_fdputs (1, (uint8_t*)fname);
-		    ece391_fdputs (1, (uint8_t*)":");
+		    if (0 != fd) {
+			ece391_fdputs (1, (uint8_t*)fname);
+			ece391_fdputs (1, (uint8_t*)":");
+		    }
 		    ece391_fdputs (1, data + line_start);
 		    ece391_fdputs (1, (uint8_t*)"\n");
 		    break;
@@ -58,7 +63,7 @@ do_one_file (const char* s, const char* fname)
 	if (0 == cnt)
 	    break;
     }
-    if (-1 == ece391_close (fd)) {
+    if (0 != fd && -1 == ece391_close (fd)) {
         ece391_fdputs (1, (uint8_t*)"file close failed\n");
         return -1;
     }
@@ -76,6 +81,13 @@ int main ()
         return 3;
     }
 
+    /* "grep pattern -" searches the standard input instead of every file */
+    cnt = ece391_strlen (search);
+    if (cnt >= 2 && ' ' == search[cnt - 2] && '-' == search[cnt - 1]) {
+        search[cnt - 2] = '\0';
+        return (0 == do_one_file ((char*)search, "-")) ? 0 : 3;
+    }
+
     if (-1 == (fd = ece391_open ((uint8_t*)"."))) {
         ece391_fdputs (1, (uint8_t*)"directory open failed\n");
 	return 2;
@@ -0,0 +1,72 @@
+#include <stdint.h>
+
+#include "ece391support.h"
+#include "ece391syscall.h"
+
+/*
+ * Keys and a clock in one loop:
+ *
+ *   keys
+ *
+ * Puts the terminal in raw mode without echo and polls it together with the
+ * RTC (at 2 Hz) and a 3 second timeout. Every key is printed with its code,
+ * every RTC tick bumps a counter that is printed each second, and the timeout
+ * prints "idle". The RTC fd is nonblocking, so the tick is read until the
+ * read fails. 'q' ends the program; its halt puts the terminal back.
+ */
+
+#define RTC_RATE        2
+#define IDLE_MS         3000
+
+int main ()
+{
+    struct ece391_pollfd fds[2];
+    uint8_t num[16], key;
+    int32_t rtc_fd, rate = RTC_RATE, ticks = 0, n;
+
+    if (-1 == (rtc_fd = ece391_open ((uint8_t*)"rtc"))) {
+        ece391_fdputs (1, (uint8_t*)"rtc open failed\n");
+        return 2;
+    }
+    ece391_write (rtc_fd, &rate, sizeof (rate));
+    ece391_ioctl (rtc_fd, FIONBIO, 1);
+    if (-1 == ece391_ioctl (0, TERM_SETMODE, 0)) {
+        ece391_fdputs (1, (uint8_t*)"stdin is not a terminal\n");
+        return 2;
+    }
+    ece391_fdputs (1, (uint8_t*)"press keys, q quits\n");
+
+    fds[0].fd = 0;
+    fds[0].events = POLLIN;
+    fds[1].fd = rtc_fd;
+    fds[1].events = POLLIN;
+    while (1) {
+        n = ece391_poll (fds, 2, IDLE_MS);
+        if (-1 == n)
+            return 3;
+        if (0 == n) {
+            ece391_fdputs (1, (uint8_t*)"idle\n");
+            continue;
+        }
+        if (fds[0].revents & POLLIN) {
+            if (1 != ece391_read (0, &key, 1))
+                continue;
+            if ('q' == key)
+                break;
+            ece391_fdputs (1, (uint8_t*)"key ");
+            ece391_fdputs (1, ece391_itoa (key, num, 10));
+            ece391_fdputs (1, (uint8_t*)"\n");
+        }
+        if (fds[1].revents & POLLIN) {
+            while (0 == ece391_read (rtc_fd, num, 4))
+                ticks++;
+            if (0 == ticks % RTC_RATE) {
+                ece391_fdputs (1, (uint8_t*)"tick ");
+                ece391_fdputs (1, ece391_itoa (ticks, num, 10));
+                ece391_fdputs (1, (uint8_t*)"\n");
+            }
+        }
+    }
+    ece391_close (rtc_fd);
+    return 0;
+}
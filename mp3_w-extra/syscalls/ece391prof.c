@@ -0,0 +1,45 @@
+#include <stdint.h>
+
+#include "ece391support.h"
+#include "ece391syscall.h"
+
+/*
+ * Sampling profiler control.
+ *
+ *   prof start          start sampling, whatever runs meanwhile is profiled
+ *   prof stop           stop and dump the samples to COM1
+ *   prof <command>      profile one command, e.g. "prof fsbench"
+ *
+ * tracetools/profreport turns the dump in the serial log into profiles.
+ */
+
+#define PROF_STOP   0
+#define PROF_START  1
+
+int main ()
+{
+    uint8_t cmd[128];
+    uint8_t num[16];
+    int32_t status;
+
+    if (0 != ece391_getargs (cmd, 128)) {
+        ece391_fdputs (1, (uint8_t*)"usage: prof start | stop | <command>\n");
+        return 3;
+    }
+    if (0 == ece391_strcmp (cmd, (uint8_t*)"start"))
+        return ece391_profile (PROF_START) ? 2 : 0;
+    if (0 == ece391_strcmp (cmd, (uint8_t*)"stop"))
+        return ece391_profile (PROF_STOP) ? 2 : 0;
+
+    ece391_profile (PROF_START);
+    status = ece391_execute (cmd);
+    ece391_profile (PROF_STOP);
+    if (status < 0) {
+        ece391_fdputs (1, (uint8_t*)"no such command\n");
+        return 1;
+    }
+    ece391_fdputs (1, (uint8_t*)"profiled, exit status ");
+    ece391_fdputs (1, ece391_itoa (status, num, 10));
+    ece391_fdputs (1, (uint8_t*)", samples are on COM1\n");
+    return 0;
+}
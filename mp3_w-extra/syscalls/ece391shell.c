@@ -4,12 +4,73 @@
 #include "ece391syscall.h"
 
 #define BUFSIZE 1024
+#define MAX_STAGES 4
+#define SAVE_IN_FD 6    /* the shell's own stdin and stdout, kept for the whole session */
+#define SAVE_OUT_FD 7
+
+/*
+ * Run "a | b | c".  Every stage but the last one runs in the background
+ * with its stdout on a pipe; execute hands stdin and stdout down to the
+ * child, so the shell only has to redirect its own fds around each call.
+ */
+int32_t run_pipeline (uint8_t* buf)
+{
+    uint8_t* stages[MAX_STAGES];
+    uint8_t cmd[BUFSIZE + 2];
+    int32_t n = 1, i, len, rval = 0;
+    int32_t fds[2], in_fd = -1;
+    uint8_t* scan;
+
+    stages[0] = buf;
+    for (scan = buf; '\0' != *scan; scan++) {
+	if ('|' != *scan)
+	    continue;
+	if (MAX_STAGES == n)
+	    return -1;
+	*scan = '\0';
+	stages[n++] = scan + 1;
+    }
+
+    for (i = 0; i < n; i++) {
+	ece391_strcpy (cmd, stages[i]);
+	if (i < n - 1) {
+	    if (-1 == ece391_pipe (fds)) {
+		rval = -1;
+		break;
+	    }
+	    ece391_dup2 (fds[1], 1);
+	    ece391_close (fds[1]);
+	    len = ece391_strlen (cmd);
+	    cmd[len] = '&';
+	    cmd[len + 1] = '\0';
+	}
+	if (-1 != in_fd) {
+	    ece391_dup2 (in_fd, 0);
+	    ece391_close (in_fd);
+	    in_fd = -1;
+	}
+	rval = ece391_execute (cmd);
+	if (i < n - 1)
+	    in_fd = fds[0];
+	ece391_dup2 (SAVE_IN_FD, 0);
+	ece391_dup2 (SAVE_OUT_FD, 1);
+	if (i < n - 1 && rval < 0)
+	    break;
+    }
+    /* drop the read end if a stage could not be started */
+    if (-1 != in_fd)
+	ece391_close (in_fd);
+    return rval;
+}
 
 int main ()
 {
-    int32_t cnt, rval;
+    int32_t cnt, rval, background;
     uint8_t buf[BUFSIZE];
+    uint8_t* scan;
     ece391_fdputs (1, (uint8_t*)"Starting 391 Shell\n");
+    ece391_dup2 (0, SAVE_IN_FD);
+    ece391_dup2 (1, SAVE_OUT_FD);
 
     while (1) {
         ece391_fdputs (1, (uint8_t*)"391OS> ");
@@ -24,7 +85,17 @@ int main ()
 	    return 0;
 	if ('\0' == buf[0])
 	    continue;
-	rval = ece391_execute (buf);
+	/* "cmd &" returns at once with the pid, nothing to report */
+	background = 0;
+	for (scan = buf; '\0' != *scan; scan++) {
+	    if ('&' == *scan)
+		background = 1;
+	    else if (' ' != *scan)
+		background = 0;
+	}
+	rval = run_pipeline (buf);
+	if (background && rval >= 0)
+	    continue;
 	if (-1 == rval)
 	    ece391_fdputs (1, (uint8_t*)"no such command\n");
 	else if (-2 == rval)
@@ -0,0 +1,72 @@
+#include <stdint.h>
+
+#include "ece391support.h"
+#include "ece391syscall.h"
+
+/*
+ * Shared memory demo. Run "shm w" on one terminal and "shm r" on another:
+ * every line typed into the writer shows up on the reader, and the text
+ * never goes through the kernel, both processes map the same frames.
+ */
+
+#define SHM_KEY 391
+#define BUFSIZE 128
+#define RTC_FREQ 32
+
+typedef struct message {
+    volatile uint32_t seq;      // bumped by the writer after the text is ready
+    uint8_t text[BUFSIZE];
+} message_t;
+
+int main ()
+{
+    int32_t shmid, cnt, rtc_fd, garbage;
+    uint32_t seen = 0;
+    uint8_t mode[BUFSIZE];
+    uint8_t buf[BUFSIZE];
+    message_t* msg;
+
+    if (0 != ece391_getargs (mode, BUFSIZE) || ('w' != mode[0] && 'r' != mode[0])) {
+        ece391_fdputs (1, (uint8_t*)"usage: shm w | shm r\n");
+        return 3;
+    }
+    if (-1 == (shmid = ece391_shm_create (SHM_KEY, sizeof (message_t))) ||
+        -1 == ece391_shm_map (shmid, (uint8_t**)&msg)) {
+        ece391_fdputs (1, (uint8_t*)"shared memory is not available\n");
+        return 2;
+    }
+
+    if ('w' == mode[0]) {
+        ece391_fdputs (1, (uint8_t*)"type lines to share, \"exit\" to quit\n");
+        while (1) {
+            if (-1 == (cnt = ece391_read (0, buf, BUFSIZE - 1)))
+                break;
+            if (cnt > 0 && '\n' == buf[cnt - 1])
+                cnt--;
+            buf[cnt] = '\0';
+            ece391_strcpy (msg->text, buf);
+            msg->seq++;
+            if (0 == ece391_strcmp (buf, (uint8_t*)"exit"))
+                break;
+        }
+    } else {
+        rtc_fd = ece391_open ((uint8_t*)"rtc");
+        garbage = RTC_FREQ;
+        ece391_write (rtc_fd, &garbage, 4);
+        seen = msg->seq;
+        while (1) {
+            ece391_read (rtc_fd, &garbage, 4);
+            if (seen == msg->seq)
+                continue;
+            seen = msg->seq;
+            ece391_fdputs (1, msg->text);
+            ece391_fdputs (1, (uint8_t*)"\n");
+            if (0 == ece391_strcmp (msg->text, (uint8_t*)"exit"))
+                break;
+        }
+        ece391_close (rtc_fd);
+    }
+
+    ece391_shm_unmap ((uint8_t*)msg);
+    return 0;
+}
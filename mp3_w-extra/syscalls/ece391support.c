@@ -102,3 +102,76 @@ uint8_t* ece391_strrev(uint8_t* s)
    return s;
 }
 
+/* atomically replace *p by v, return the old value */
+static int32_t xchg(volatile int32_t* p, int32_t v)
+{
+    asm volatile ("xchgl %0, %1" : "+r" (v), "+m" (*p) : : "memory");
+    return v;
+}
+
+/* atomically set *p to v if it holds old, return what it held */
+static int32_t cmpxchg(volatile int32_t* p, int32_t old, int32_t v)
+{
+    asm volatile ("lock; cmpxchgl %2, %1" : "+a" (old), "+m" (*p) : "r" (v) : "memory");
+    return old;
+}
+
+/* Mutex after Drepper's "Futexes Are Tricky": an uncontended lock and unlock
+ * are one atomic instruction each, the system call is only made when the
+ * state says someone may be sleeping. */
+void ece391_mutex_lock(ece391_mutex_t* m)
+{
+    int32_t c = cmpxchg(&m->state, 0, 1);
+
+    if (0 == c)
+        return;
+    if (2 != c)
+        c = xchg(&m->state, 2);
+    while (0 != c) {
+        ece391_futex(&m->state, FUTEX_WAIT, 2);
+        c = xchg(&m->state, 2);
+    }
+}
+
+/* 0 if the mutex was taken, -1 if it is held */
+int32_t ece391_mutex_trylock(ece391_mutex_t* m)
+{
+    return (0 == cmpxchg(&m->state, 0, 1)) ? 0 : -1;
+}
+
+void ece391_mutex_unlock(ece391_mutex_t* m)
+{
+    if (2 == xchg(&m->state, 0))
+        ece391_futex(&m->state, FUTEX_WAKE, 1);
+}
+
+/* Wait for a signal with the mutex held, it is held again on return. A signal
+ * between the unlock and the futex call changes seq, so it is not lost.
+ * Spurious returns can happen, check the condition in a loop. */
+void ece391_cond_wait(ece391_cond_t* c, ece391_mutex_t* m)
+{
+    int32_t seq = c->seq;
+
+    c->waiters++;
+    ece391_mutex_unlock(m);
+    ece391_futex(&c->seq, FUTEX_WAIT, seq);
+    /* others may be asleep on the mutex too, lock it as contended */
+    while (0 != xchg(&m->state, 2))
+        ece391_futex(&m->state, FUTEX_WAIT, 2);
+    c->waiters--;
+}
+
+/* wake one waiter, no system call if nobody waits; call with the mutex held */
+void ece391_cond_signal(ece391_cond_t* c)
+{
+    xchg(&c->seq, c->seq + 1);
+    if (c->waiters > 0)
+        ece391_futex(&c->seq, FUTEX_WAKE, 1);
+}
+
+void ece391_cond_broadcast(ece391_cond_t* c)
+{
+    xchg(&c->seq, c->seq + 1);
+    if (c->waiters > 0)
+        ece391_futex(&c->seq, FUTEX_WAKE, c->waiters);
+}
@@ -9,5 +9,25 @@ extern int32_t ece391_strncmp(const uint8_t* s1, const uint8_t* s2, uint32_t n);
 extern uint8_t *ece391_itoa(uint32_t value, uint8_t* buf, int32_t radix);
 extern uint8_t *ece391_strrev(uint8_t* s);
 
+/* mutex and condition variable on futexes, they also work in shared memory */
+typedef struct ece391_mutex {
+    volatile int32_t state;     /* 0 unlocked, 1 locked, 2 locked and maybe waited for */
+} ece391_mutex_t;
+
+typedef struct ece391_cond {
+    volatile int32_t seq;       /* bumped by every signal */
+    volatile int32_t waiters;
+} ece391_cond_t;
+
+#define ECE391_MUTEX_INIT   { 0 }
+#define ECE391_COND_INIT    { 0, 0 }
+
+extern void ece391_mutex_lock(ece391_mutex_t* m);
+extern int32_t ece391_mutex_trylock(ece391_mutex_t* m);
+extern void ece391_mutex_unlock(ece391_mutex_t* m);
+extern void ece391_cond_wait(ece391_cond_t* c, ece391_mutex_t* m);
+extern void ece391_cond_signal(ece391_cond_t* c);
+extern void ece391_cond_broadcast(ece391_cond_t* c);
+
 #endif /* ECE391SUPPORT_H */
 
@@ -23,6 +23,46 @@ extern int32_t ece391_set_handler (int32_t signum, void* handler);
 extern int32_t ece391_sigreturn (void);
 extern int32_t ece391_sound(uint32_t nFrequence);
 extern int32_t ece391_nosound(void);
+extern int32_t ece391_shm_create(int32_t key, uint32_t size);
+extern int32_t ece391_shm_map(int32_t shmid, uint8_t** addr);
+extern int32_t ece391_shm_unmap(uint8_t* addr);
+extern int32_t ece391_pipe(int32_t* fds);
+extern int32_t ece391_dup2(int32_t oldfd, int32_t newfd);
+extern int32_t ece391_unlink(const uint8_t* filename);
+extern int32_t ece391_truncate(int32_t fd, uint32_t length);
+extern int32_t ece391_seek(int32_t fd, uint32_t position);
+extern int32_t ece391_profile(int32_t cmd);
+extern int32_t ece391_sysstats(int32_t pid, void* buf, int32_t nbytes);
+extern int32_t ece391_thread_create(int32_t (*entry)(void*), void* arg);
+extern int32_t ece391_thread_join(int32_t tid);
+extern int32_t ece391_futex(volatile int32_t* uaddr, int32_t op, int32_t val);
+extern int32_t ece391_kill(int32_t pid, int32_t signum);
+extern int32_t ece391_ioctl(int32_t fd, int32_t request, int32_t arg);
+
+struct ece391_pollfd {
+	int32_t fd;		/* negative to skip the entry */
+	int16_t events;		/* POLLIN and POLLOUT */
+	int16_t revents;	/* what is ready, POLLERR POLLHUP POLLNVAL too */
+};
+extern int32_t ece391_poll(struct ece391_pollfd* fds, int32_t nfds, int32_t timeout_ms);
+
+/* ops of ece391_futex */
+#define FUTEX_WAIT	0	/* sleep if *uaddr == val */
+#define FUTEX_WAKE	1	/* wake at most val sleepers */
+
+/* requests of ece391_ioctl on the terminal, and its mode bits */
+#define TERM_GETMODE	1	/* returns the mode */
+#define TERM_SETMODE	2	/* arg is the new mode */
+#define TERM_CANON	0x1	/* reads return whole edited lines */
+#define TERM_ECHO	0x2	/* keys are echoed */
+#define FIONBIO		3	/* any fd: arg nonzero makes read and write fail instead of blocking */
+
+/* events of ece391_poll */
+#define POLLIN		0x01
+#define POLLOUT		0x04
+#define POLLERR		0x08
+#define POLLHUP		0x10
+#define POLLNVAL	0x20
 
 enum signums {
 	DIV_ZERO = 0,
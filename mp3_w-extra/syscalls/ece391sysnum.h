@@ -13,5 +13,21 @@
 #define SYS_SIGRETURN  10
 #define SYS_SOUND  11
 #define SYS_NOSOUND  12
+#define SYS_SHM_CREATE  13
+#define SYS_SHM_MAP  14
+#define SYS_SHM_UNMAP  15
+#define SYS_PIPE  16
+#define SYS_DUP2  17
+#define SYS_UNLINK  18
+#define SYS_TRUNCATE  19
+#define SYS_SEEK  20
+#define SYS_PROFILE  21
+#define SYS_SYSSTATS  22
+#define SYS_THREAD_CREATE  23
+#define SYS_THREAD_JOIN  24
+#define SYS_FUTEX  25
+#define SYS_KILL   26
+#define SYS_IOCTL  27
+#define SYS_POLL   28
 
 #endif /* ECE391SYSNUM_H */
@@ -0,0 +1,121 @@
+#include <stdint.h>
+
+#include "ece391support.h"
+#include "ece391syscall.h"
+
+/*
+ * System call statistics, of the whole system or of one process:
+ *
+ *   sysstat [pid]
+ *
+ * One line per system call that was used: calls, calls that failed, mean
+ * cycles, and the median and 99th percentile from the log2 histogram (the
+ * upper end of the bucket they fall in). halt never returns, so it is
+ * counted but not timed.
+ */
+
+#define SYSCALL_NUM     28
+#define HIST_SIZE       32
+#define GLOBAL          (-1)
+
+/* must match sysstats_entry_t in student-distrib/kernel/sysstats.h */
+typedef struct entry
+{
+    uint32_t    calls;
+    uint32_t    errors;
+    uint64_t    cycles;
+    uint32_t    hist[HIST_SIZE];
+} entry_t;
+
+static const char* names[SYSCALL_NUM + 1] = {
+    "", "halt", "execute", "read", "write", "open", "close", "getargs", "vidmap",
+    "set_handler", "sigreturn", "sound", "nosound", "shm_create", "shm_map",
+    "shm_unmap", "pipe", "dup2", "unlink", "truncate", "seek", "profile", "sysstats",
+    "thread_create", "thread_join", "futex", "kill", "ioctl", "poll",
+};
+
+static entry_t table[SYSCALL_NUM + 1];
+
+/* 64 by 32 bit division without libgcc, a quotient over 32 bits is clamped */
+static uint32_t
+div64 (uint64_t n, uint32_t d)
+{
+    uint32_t q = 0;
+    int32_t i;
+    if (0 == d)
+        return 0;
+    if ((n >> 32) >= d)
+        return 0xFFFFFFFF;
+    for (i = 31; i >= 0; i--) {
+        if ((n >> i) >= d) {
+            n -= (uint64_t)d << i;
+            q |= 1U << i;
+        }
+    }
+    return q;
+}
+
+/* value right aligned in width columns */
+static void
+put_num (uint32_t value, int32_t width)
+{
+    uint8_t num[16];
+    int32_t len;
+
+    ece391_itoa (value, num, 10);
+    for (len = ece391_strlen (num); len < width; len++)
+        ece391_fdputs (1, (uint8_t*)" ");
+    ece391_fdputs (1, num);
+}
+
+/* upper end of the bucket holding the part (in percent) of the timed calls */
+static uint32_t
+percentile (entry_t* e, uint32_t percent)
+{
+    uint32_t timed = 0, sum = 0, i;
+
+    for (i = 0; i < HIST_SIZE; i++)
+        timed += e->hist[i];
+    for (i = 0; i < HIST_SIZE; i++) {
+        sum += e->hist[i];
+        if (sum * 100 >= timed * percent)
+            break;
+    }
+    return (i >= HIST_SIZE - 1) ? 0xFFFFFFFF : (2U << i) - 1;
+}
+
+int main ()
+{
+    uint8_t arg[16];
+    int32_t pid = GLOBAL, num, timed, i, len;
+
+    if (0 == ece391_getargs (arg, 16))
+        for (pid = 0, i = 0; arg[i] >= '0' && arg[i] <= '9'; i++)
+            pid = pid * 10 + arg[i] - '0';
+    if (-1 == ece391_sysstats (pid, table, sizeof (table))) {
+        ece391_fdputs (1, (uint8_t*)"no such process\n");
+        return 1;
+    }
+
+    ece391_fdputs (1, (uint8_t*)"syscall          calls  errors  mean cycles     p50 <=     p99 <=\n");
+    for (num = 1; num <= SYSCALL_NUM; num++) {
+        if (0 == table[num].calls)
+            continue;
+        ece391_fdputs (1, (uint8_t*)names[num]);
+        for (len = ece391_strlen ((uint8_t*)names[num]); len < 12; len++)
+            ece391_fdputs (1, (uint8_t*)" ");
+        put_num (table[num].calls, 10);
+        put_num (table[num].errors, 8);
+        for (timed = 0, i = 0; i < HIST_SIZE; i++)
+            timed += table[num].hist[i];
+        if (0 == timed) {
+            ece391_fdputs (1, (uint8_t*)"            -          -          -\n");
+            continue;
+        }
+        put_num (div64 (table[num].cycles, timed), 13);
+        put_num (percentile (&table[num], 50), 11);
+        put_num (percentile (&table[num], 99), 11);
+        ece391_fdputs (1, (uint8_t*)"\n");
+    }
+    return 0;
+}
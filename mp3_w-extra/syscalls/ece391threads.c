@@ -0,0 +1,91 @@
+#include <stdint.h>
+
+#include "ece391support.h"
+#include "ece391syscall.h"
+
+/*
+ * Threads of one process:
+ *
+ *   threads [count]
+ *
+ * Starts count threads (3 unless told otherwise) that wait on a condition
+ * variable until all are created, then each sums its part of 1..N into a
+ * global array, bumps a counter under a mutex LOCKS times and prints a line
+ * through the shared stdout; the main thread joins them. The status of a
+ * thread is what its function returns, the low 16 bits of it.
+ */
+
+#define THREAD_MAX      6
+#define N               1200000
+#define LOCKS           20000
+
+static uint32_t sums[THREAD_MAX];
+static int32_t count = 3;
+static ece391_mutex_t lock = ECE391_MUTEX_INIT;
+static ece391_cond_t start = ECE391_COND_INIT;
+static int32_t go = 0;
+static volatile uint32_t counter = 0;
+
+static int32_t
+worker (void* arg)
+{
+    int32_t id = (int32_t)arg;
+    uint32_t i, sum = 0, first = N / count * id + 1, last = N / count * (id + 1);
+    uint8_t num[16];
+
+    ece391_mutex_lock (&lock);
+    while (!go)
+        ece391_cond_wait (&start, &lock);
+    ece391_mutex_unlock (&lock);
+
+    for (i = first; i <= last; i++)
+        sum += i;
+    sums[id] = sum;
+    for (i = 0; i < LOCKS; i++) {
+        ece391_mutex_lock (&lock);
+        counter++;
+        ece391_mutex_unlock (&lock);
+    }
+    ece391_fdputs (1, (uint8_t*)"thread ");
+    ece391_fdputs (1, ece391_itoa (id, num, 10));
+    ece391_fdputs (1, (uint8_t*)" done\n");
+    return id + 100;
+}
+
+int main ()
+{
+    uint8_t arg[16], num[16];
+    int32_t tids[THREAD_MAX], i, status, failed = 0;
+    uint32_t total = 0, expect = 0;
+
+    if (0 == ece391_getargs (arg, 16) && arg[0] >= '1' && arg[0] <= '0' + THREAD_MAX)
+        count = arg[0] - '0';
+    for (i = 0; i < count; i++) {
+        if (-1 == (tids[i] = ece391_thread_create (worker, (void*)i))) {
+            ece391_fdputs (1, (uint8_t*)"thread_create failed\n");
+            count = i;
+            failed = 1;
+            break;
+        }
+    }
+    ece391_mutex_lock (&lock);
+    go = 1;
+    ece391_cond_broadcast (&start);
+    ece391_mutex_unlock (&lock);
+
+    for (i = 0; i < count; i++) {
+        status = ece391_thread_join (tids[i]);
+        if (status != i + 100)
+            failed = 1;
+        total += sums[i];
+    }
+    for (i = 1; i <= N / count * count; i++)
+        expect += i;
+
+    if (counter != LOCKS * count)
+        failed = 1;
+    ece391_fdputs (1, (uint8_t*)"sum ");
+    ece391_fdputs (1, ece391_itoa (total, num, 10));
+    ece391_fdputs (1, (uint8_t*)(total == expect && !failed ? " ok\n" : " wrong\n"));
+    return (total == expect && !failed) ? 0 : 1;
+}
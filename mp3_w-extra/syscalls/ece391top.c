@@ -0,0 +1,244 @@
+#include <stdint.h>
+
+#include "ece391support.h"
+#include "ece391syscall.h"
+
+/*
+ * Live CPU usage of every process, from proc/cpu:
+ *
+ *   top [refreshes]
+ *
+ * The view is redrawn twice a second, 20 times unless told otherwise. CPU%
+ * is the share of the PIT ticks since the last refresh that interrupted the
+ * process, split into user and kernel mode; the ms columns are the TSC time
+ * since it started. Each frame is built off screen and copied to the vidmap
+ * page in one go, so the screen is never cleared and does not flicker.
+ */
+
+#define NUM_COLS        80
+#define NUM_ROWS        25
+#define ATTRIB          0x07
+#define ATTRIB_HEADER   0x70
+#define PROC_MAX        8
+#define RTC_HZ          2
+#define REFRESHES       20
+#define TEXT_SIZE       4096
+#define NAME_LEN        32
+
+typedef struct proc
+{
+    int32_t     used;
+    uint32_t    user_ticks;
+    uint32_t    kernel_ticks;
+    uint32_t    user_ms;
+    uint32_t    kernel_ms;
+    uint8_t     name[NAME_LEN + 1];
+} proc_t;
+
+typedef struct snapshot
+{
+    uint32_t    ticks;
+    uint32_t    idle_ticks;
+    uint32_t    idle_ms;
+    uint32_t    tsc_khz;
+    proc_t      procs[PROC_MAX];
+} snapshot_t;
+
+static uint8_t text[TEXT_SIZE + 1];
+static uint16_t frame[NUM_ROWS * NUM_COLS];
+static snapshot_t snaps[2];
+
+/* number at *p after anything that is not a digit, *p ends up after it */
+static uint32_t
+next_num (uint8_t** p)
+{
+    uint32_t value = 0;
+
+    while (**p && '\n' != **p && (**p < '0' || **p > '9'))
+        (*p)++;
+    while (**p >= '0' && **p <= '9')
+        value = value * 10 + *(*p)++ - '0';
+    return value;
+}
+
+/* start of the next line */
+static uint8_t*
+next_line (uint8_t* p)
+{
+    while (*p && '\n' != *p)
+        p++;
+    return *p ? p + 1 : p;
+}
+
+/* read and parse proc/cpu, see gen_cpu in student-distrib/kernel/procfs.c */
+static int32_t
+read_cpu (snapshot_t* s)
+{
+    int32_t fd, len = 0, cnt, i, pid;
+    uint8_t* p;
+    proc_t* proc;
+
+    if (-1 == (fd = ece391_open ((uint8_t*)"proc/cpu")))
+        return -1;
+    while (len < TEXT_SIZE && 0 < (cnt = ece391_read (fd, text + len, TEXT_SIZE - len)))
+        len += cnt;
+    ece391_close (fd);
+    text[len] = '\0';
+
+    p = text;
+    s->ticks = next_num (&p);
+    p = next_line (p);
+    s->idle_ticks = next_num (&p);
+    p = next_line (p);
+    s->idle_ms = next_num (&p);
+    p = next_line (p);
+    s->tsc_khz = next_num (&p);
+    p = next_line (p);
+    p = next_line (p);      // the column header
+
+    for (pid = 0; pid < PROC_MAX; pid++)
+        s->procs[pid].used = 0;
+    for (; *p; p = next_line (p)) {
+        pid = next_num (&p);
+        if (pid >= PROC_MAX)
+            continue;
+        proc = &s->procs[pid];
+        proc->used = 1;
+        proc->user_ticks = next_num (&p);
+        proc->kernel_ticks = next_num (&p);
+        proc->user_ms = next_num (&p);
+        proc->kernel_ms = next_num (&p);
+        while (' ' == *p)
+            p++;
+        for (i = 0; i < NAME_LEN && *p && '\n' != *p; i++)
+            proc->name[i] = *p++;
+        proc->name[i] = '\0';
+    }
+    return 0;
+}
+
+/* put s at row, col of the frame, cut at the right edge */
+static int32_t
+put_str (int32_t row, int32_t col, const uint8_t* s, uint8_t attr)
+{
+    while (*s && col < NUM_COLS)
+        frame[row * NUM_COLS + col++] = (attr << 8) | *s++;
+    return col;
+}
+
+/* value right aligned in width columns */
+static int32_t
+put_num (int32_t row, int32_t col, uint32_t value, int32_t width, uint8_t attr)
+{
+    uint8_t num[16];
+    int32_t len;
+
+    ece391_itoa (value, num, 10);
+    for (len = ece391_strlen (num); len < width; len++)
+        col = put_str (row, col, (uint8_t*)" ", attr);
+    return put_str (row, col, num, attr);
+}
+
+/* part of total in percent with one decimal, right aligned in 6 columns */
+static int32_t
+put_pct (int32_t row, int32_t col, uint32_t part, uint32_t total, uint8_t attr)
+{
+    uint32_t tenths = total ? (part * 1000 + total / 2) / total : 0;
+
+    col = put_num (row, col, tenths / 10, 4, attr);
+    col = put_str (row, col, (uint8_t*)".", attr);
+    return put_num (row, col, tenths % 10, 1, attr);
+}
+
+/* ticks since the previous snapshot, all of them if the pid was given to another program */
+static uint32_t
+delta (proc_t* cur, proc_t* prev, uint32_t now, uint32_t before)
+{
+    if (!prev->used || now < before || 0 != ece391_strcmp (cur->name, prev->name))
+        return now;
+    return now - before;
+}
+
+static void
+draw (snapshot_t* cur, snapshot_t* prev, int32_t refresh, int32_t refreshes)
+{
+    uint32_t total = cur->ticks - prev->ticks, user, kernel;
+    int32_t pid, row, col, procs = 0;
+    proc_t* proc;
+
+    for (row = 0; row < NUM_ROWS * NUM_COLS; row++)
+        frame[row] = (ATTRIB << 8) | ' ';
+    for (pid = 0; pid < PROC_MAX; pid++)
+        procs += cur->procs[pid].used;
+
+    col = put_str (0, 0, (uint8_t*)"top - uptime ", ATTRIB);
+    col = put_num (0, col, cur->ticks / 100, 0, ATTRIB);
+    col = put_str (0, col, (uint8_t*)" s, ", ATTRIB);
+    col = put_num (0, col, procs, 0, ATTRIB);
+    col = put_str (0, col, (uint8_t*)" processes, idle", ATTRIB);
+    col = put_pct (0, col, cur->idle_ticks - prev->idle_ticks, total, ATTRIB);
+    col = put_str (0, col, (uint8_t*)"%, idle ", ATTRIB);
+    col = put_num (0, col, cur->idle_ms, 0, ATTRIB);
+    col = put_str (0, col, (uint8_t*)" ms, tsc ", ATTRIB);
+    col = put_num (0, col, cur->tsc_khz, 0, ATTRIB);
+    put_str (0, col, (uint8_t*)" kHz", ATTRIB);
+
+    put_str (2, 0, (uint8_t*)"  PID   CPU%   USR%   SYS%     USER ms   KERNEL ms  NAME"
+                             "                        ", ATTRIB_HEADER);
+    for (row = 3, pid = 0; pid < PROC_MAX; pid++) {
+        proc = &cur->procs[pid];
+        if (!proc->used)
+            continue;
+        user = delta (proc, &prev->procs[pid], proc->user_ticks, prev->procs[pid].user_ticks);
+        kernel = delta (proc, &prev->procs[pid], proc->kernel_ticks, prev->procs[pid].kernel_ticks);
+        col = put_num (row, 0, pid, 5, ATTRIB);
+        col = put_pct (row, col + 1, user + kernel, total, ATTRIB);
+        col = put_pct (row, col + 1, user, total, ATTRIB);
+        col = put_pct (row, col + 1, kernel, total, ATTRIB);
+        col = put_num (row, col, proc->user_ms, 12, ATTRIB);
+        col = put_num (row, col, proc->kernel_ms, 12, ATTRIB);
+        put_str (row++, col + 2, proc->name, ATTRIB);
+    }
+
+    col = put_str (row + 1, 0, (uint8_t*)"refresh ", ATTRIB);
+    col = put_num (row + 1, col, refresh, 0, ATTRIB);
+    col = put_str (row + 1, col, (uint8_t*)" of ", ATTRIB);
+    put_num (row + 1, col, refreshes, 0, ATTRIB);
+}
+
+int main ()
+{
+    uint8_t arg[16];
+    uint32_t* screen;
+    int32_t rtc_fd, refreshes = REFRESHES, refresh, i, garbage;
+
+    if (0 == ece391_getargs (arg, 16) && arg[0] >= '0' && arg[0] <= '9')
+        for (refreshes = 0, i = 0; arg[i] >= '0' && arg[i] <= '9'; i++)
+            refreshes = refreshes * 10 + arg[i] - '0';
+    if (-1 == ece391_vidmap ((uint8_t**)&screen)) {
+        ece391_fdputs (1, (uint8_t*)"vidmap failed\n");
+        return 1;
+    }
+    if (-1 == (rtc_fd = ece391_open ((uint8_t*)"rtc"))) {
+        ece391_fdputs (1, (uint8_t*)"no rtc\n");
+        return 1;
+    }
+    i = RTC_HZ;
+    ece391_write (rtc_fd, &i, 4);
+    if (-1 == read_cpu (&snaps[0])) {
+        ece391_fdputs (1, (uint8_t*)"no proc/cpu\n");
+        return 1;
+    }
+
+    for (refresh = 1; refresh <= refreshes; refresh++) {
+        ece391_read (rtc_fd, &garbage, 4);
+        if (-1 == read_cpu (&snaps[refresh & 1]))
+            break;
+        draw (&snaps[refresh & 1], &snaps[(refresh - 1) & 1], refresh, refreshes);
+        // the whole frame at once, 32 bits at a time
+        for (i = 0; i < NUM_ROWS * NUM_COLS / 2; i++)
+            screen[i] = ((uint32_t*)frame)[i];
+    }
+    ece391_close (rtc_fd);
+    return 0;
+}
@@ -0,0 +1,439 @@
+/*
+ * profreport: symbolize the profiler samples in a serial log and print a flat
+ * profile and a call graph
+ *
+ *   usage: profreport [-k bootimg] [-u dir] [-n count] [-c] [log]
+ *
+ * The log is what COM1 printed (qemu -serial file:log), the kernel dumps the
+ * samples when the profiler is stopped, see student-distrib/kernel/profile.c
+ * for the format. Kernel addresses are looked up in bootimg (-k, default
+ * ../student-distrib/bootimg), user addresses in the ELF the process was
+ * running, <dir>/<program>.exe (-u, default ../syscalls, where they are built).
+ *
+ * The flat profile has the samples that were in each function (self) and the
+ * samples with the function anywhere on the stack (total). The call graph
+ * lists, for the -n functions with the most total samples, where they were
+ * called from and what they called. -c prints collapsed stacks instead, one
+ * "program;outer;...;inner count" line per stack, the input of flamegraph.pl.
+ */
+#include <elf.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DEPTH_MAX       16          // at least PROF_DEPTH_MAX + 1 of the kernel
+#define PID_MAX         256
+#define IMAGE_MAX       64
+#define NAME_MAX_LEN    160
+#define HASH_SIZE       4096
+
+typedef struct sym
+{
+    uint32_t    addr;
+    const char  *name;
+} sym_t;
+
+/* an ELF whose symbols are loaded, a program name may have no file */
+typedef struct image
+{
+    char        name[64];
+    sym_t       *syms;
+    int32_t     count;
+} image_t;
+
+/* names interned to ids, with the counts kept for each */
+typedef struct entry
+{
+    char            *name;
+    int32_t         id;         // index in func_by_id, for functions
+    long            self;
+    long            total;
+    long            stamp;      // last sample that counted total, so recursion counts once
+    struct entry    *next;
+} entry_t;
+
+typedef struct edge
+{
+    int32_t         caller;
+    int32_t         callee;
+    long            count;
+    struct edge     *next;
+} edge_t;
+
+static image_t images[IMAGE_MAX];
+static int32_t image_count;
+static image_t *pid_image[PID_MAX];
+static const char *user_dir = "../syscalls";
+
+static entry_t *funcs[HASH_SIZE];
+static entry_t **func_by_id;
+static int32_t func_count, func_alloc;
+static entry_t *stacks[HASH_SIZE];
+static edge_t *edges[HASH_SIZE];
+
+static void *
+xmalloc (size_t size)
+{
+    void *p = malloc (size);
+    if (NULL == p) {
+        fprintf (stderr, "out of memory\n");
+        exit (1);
+    }
+    return p;
+}
+
+static uint32_t
+hash (const char *s)
+{
+    uint32_t h = 5381;
+    while (*s)
+        h = h * 33 + (unsigned char)*s++;
+    return h;
+}
+
+/* find or add name, functions are also numbered */
+static entry_t *
+lookup (entry_t **table, const char *name, int32_t is_func)
+{
+    uint32_t h = hash (name) % HASH_SIZE;
+    entry_t *e;
+
+    for (e = table[h]; NULL != e; e = e->next)
+        if (0 == strcmp (e->name, name))
+            break;
+    if (NULL == e) {
+        e = xmalloc (sizeof (*e));
+        memset (e, 0, sizeof (*e));
+        e->name = strdup (name);
+        e->stamp = -1;
+        e->next = table[h];
+        table[h] = e;
+        if (is_func) {
+            if (func_count == func_alloc) {
+                func_alloc = func_alloc ? 2 * func_alloc : 256;
+                func_by_id = realloc (func_by_id, func_alloc * sizeof (entry_t *));
+            }
+            e->id = func_count;
+            func_by_id[func_count++] = e;
+        }
+    }
+    return e;
+}
+
+static void
+add_edge (int32_t caller, int32_t callee)
+{
+    uint32_t h = ((uint32_t)caller * 31 + callee) % HASH_SIZE;
+    edge_t *e;
+
+    for (e = edges[h]; NULL != e; e = e->next)
+        if (e->caller == caller && e->callee == callee)
+            break;
+    if (NULL == e) {
+        e = xmalloc (sizeof (*e));
+        e->caller = caller;
+        e->callee = callee;
+        e->count = 0;
+        e->next = edges[h];
+        edges[h] = e;
+    }
+    e->count++;
+}
+
+static int
+sym_cmp (const void *a, const void *b)
+{
+    uint32_t x = ((const sym_t *)a)->addr, y = ((const sym_t *)b)->addr;
+    return x < y ? -1 : x > y;
+}
+
+/* the function and label symbols of an ELF, sorted by address */
+static void
+load_symbols (image_t *img, const char *path)
+{
+    FILE *f;
+    long size;
+    char *data;
+    Elf32_Ehdr *eh;
+    Elf32_Shdr *sh;
+    Elf32_Sym *st;
+    const char *strtab;
+    int32_t i, j, n, type;
+
+    if (NULL == (f = fopen (path, "rb"))) {
+        fprintf (stderr, "%s: no symbols, addresses are printed as they are\n", path);
+        return;
+    }
+    fseek (f, 0, SEEK_END);
+    size = ftell (f);
+    rewind (f);
+    data = xmalloc (size);
+    if (1 != fread (data, size, 1, f)) {
+        fclose (f);
+        return;
+    }
+    fclose (f);
+
+    eh = (Elf32_Ehdr *)data;
+    if (size < (long)sizeof (*eh) || 0 != memcmp (eh->e_ident, ELFMAG, SELFMAG) ||
+        ELFCLASS32 != eh->e_ident[EI_CLASS] || eh->e_shoff + eh->e_shnum * sizeof (*sh) > (unsigned long)size) {
+        fprintf (stderr, "%s: not a 32 bit ELF\n", path);
+        return;
+    }
+    sh = (Elf32_Shdr *)(data + eh->e_shoff);
+    for (i = 0; i < eh->e_shnum; i++) {
+        if (SHT_SYMTAB != sh[i].sh_type || sh[i].sh_link >= eh->e_shnum)
+            continue;
+        st = (Elf32_Sym *)(data + sh[i].sh_offset);
+        n = sh[i].sh_size / sizeof (*st);
+        strtab = data + sh[sh[i].sh_link].sh_offset;
+        img->syms = xmalloc (n * sizeof (sym_t));
+        for (j = 0; j < n; j++) {
+            type = ELF32_ST_TYPE (st[j].st_info);
+            // functions, and the labels of the assembly files
+            if ((STT_FUNC != type && STT_NOTYPE != type) || SHN_UNDEF == st[j].st_shndx ||
+                st[j].st_shndx >= SHN_LORESERVE || '\0' == strtab[st[j].st_name] ||
+                '.' == strtab[st[j].st_name])
+                continue;
+            img->syms[img->count].addr = st[j].st_value;
+            img->syms[img->count].name = strtab + st[j].st_name;
+            img->count++;
+        }
+        qsort (img->syms, img->count, sizeof (sym_t), sym_cmp);
+        return;
+    }
+    fprintf (stderr, "%s: no symbol table\n", path);
+}
+
+static image_t *
+get_image (const char *name, const char *path)
+{
+    int32_t i;
+
+    for (i = 0; i < image_count; i++)
+        if (0 == strcmp (images[i].name, name))
+            return &images[i];
+    if (IMAGE_MAX == image_count)
+        return &images[0];
+    strncpy (images[image_count].name, name, sizeof (images[0].name) - 1);
+    load_symbols (&images[image_count], path);
+    return &images[image_count++];
+}
+
+static image_t *
+user_image (const char *program)
+{
+    char path[512];
+    snprintf (path, sizeof (path), "%s/%s.exe", user_dir, program);
+    return get_image (program, path);
+}
+
+/* "function" in the kernel, "program:function" in a user program */
+static void
+symbolize (char *buf, image_t *img, int32_t kernel, uint32_t addr)
+{
+    int32_t lo = 0, hi = img->count - 1, mid;
+    const char *prefix = kernel ? "" : img->name;
+    const char *colon = kernel ? "" : ":";
+
+    if (hi < 0 || addr < img->syms[0].addr) {
+        snprintf (buf, NAME_MAX_LEN, "%s%s0x%08x", prefix, colon, addr);
+        return;
+    }
+    while (lo < hi) {
+        mid = (lo + hi + 1) / 2;
+        if (img->syms[mid].addr <= addr)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+    snprintf (buf, NAME_MAX_LEN, "%s%s%s", prefix, colon, img->syms[lo].name);
+}
+
+static long samples, kernel_samples;
+
+static void
+add_sample (uint32_t pid, uint32_t cpl, uint32_t *addrs, int32_t depth)
+{
+    char names[DEPTH_MAX][NAME_MAX_LEN];
+    char stack[DEPTH_MAX * NAME_MAX_LEN + 64];
+    image_t *img, *kernel = &images[0];
+    int32_t ids[DEPTH_MAX], i;
+    entry_t *e;
+
+    img = (0 == cpl || NULL == pid_image[pid]) ? kernel : pid_image[pid];
+    for (i = 0; i < depth; i++) {
+        // return addresses point after the call, which may be the next function
+        symbolize (names[i], img, img == kernel, i ? addrs[i] - 1 : addrs[i]);
+        e = lookup (funcs, names[i], 1);
+        ids[i] = e->id;
+        if (0 == i)
+            e->self++;
+        if (e->stamp != samples) {
+            e->stamp = samples;
+            e->total++;
+        }
+        if (i > 0)
+            add_edge (ids[i], ids[i - 1]);
+    }
+
+    // collapsed stack, outermost first, under the program or "kernel"
+    snprintf (stack, sizeof (stack), "%s",
+              NULL != pid_image[pid] ? pid_image[pid]->name : "kernel");
+    if (0 == cpl && NULL != pid_image[pid])
+        strcat (stack, ";[kernel]");
+    for (i = depth - 1; i >= 0; i--) {
+        strcat (stack, ";");
+        strcat (stack, names[i]);
+    }
+    lookup (stacks, stack, 0)->self++;
+
+    samples++;
+    kernel_samples += (0 == cpl);
+}
+
+static int
+total_cmp (const void *a, const void *b)
+{
+    const entry_t *x = *(entry_t * const *)a, *y = *(entry_t * const *)b;
+    if (x->total != y->total)
+        return x->total < y->total ? 1 : -1;
+    return strcmp (x->name, y->name);
+}
+
+static int
+self_cmp (const void *a, const void *b)
+{
+    const entry_t *x = *(entry_t * const *)a, *y = *(entry_t * const *)b;
+    if (x->self != y->self)
+        return x->self < y->self ? 1 : -1;
+    return total_cmp (a, b);
+}
+
+static void
+print_call_graph (int32_t top)
+{
+    entry_t **sorted = xmalloc (func_count * sizeof (entry_t *));
+    edge_t *e;
+    int32_t i, h, id;
+
+    memcpy (sorted, func_by_id, func_count * sizeof (entry_t *));
+    qsort (sorted, func_count, sizeof (entry_t *), total_cmp);
+    printf ("\ncall graph, callers above and callees below each function:\n\n");
+    printf ("%8s %7s %7s  %s\n", "total%", "total", "self", "function");
+    for (i = 0; i < func_count && i < top; i++) {
+        id = sorted[i]->id;
+        for (h = 0; h < HASH_SIZE; h++)
+            for (e = edges[h]; NULL != e; e = e->next)
+                if (e->callee == id)
+                    printf ("%8s %7ld %7s      %s\n", "", e->count, "", func_by_id[e->caller]->name);
+        printf ("%7.1f%% %7ld %7ld  %s\n", 100.0 * sorted[i]->total / samples,
+                sorted[i]->total, sorted[i]->self, sorted[i]->name);
+        for (h = 0; h < HASH_SIZE; h++)
+            for (e = edges[h]; NULL != e; e = e->next)
+                if (e->caller == id)
+                    printf ("%8s %7ld %7s      %s\n", "", e->count, "", func_by_id[e->callee]->name);
+        printf ("\n");
+    }
+    free (sorted);
+}
+
+static void
+print_flat (int32_t top)
+{
+    entry_t **sorted = xmalloc (func_count * sizeof (entry_t *));
+    int32_t i;
+
+    memcpy (sorted, func_by_id, func_count * sizeof (entry_t *));
+    qsort (sorted, func_count, sizeof (entry_t *), self_cmp);
+    printf ("\nflat profile:\n\n");
+    printf ("%7s %7s %8s %7s  %s\n", "self%", "self", "total%", "total", "function");
+    for (i = 0; i < func_count && i < top && sorted[i]->self > 0; i++)
+        printf ("%6.1f%% %7ld %7.1f%% %7ld  %s\n", 100.0 * sorted[i]->self / samples, sorted[i]->self,
+                100.0 * sorted[i]->total / samples, sorted[i]->total, sorted[i]->name);
+    free (sorted);
+}
+
+static void
+usage (const char *prog)
+{
+    fprintf (stderr, "usage: %s [-k bootimg] [-u dir] [-n count] [-c] [log]\n", prog);
+    exit (1);
+}
+
+int
+main (int argc, char *argv[])
+{
+    const char *kernel_path = "../student-distrib/bootimg";
+    FILE *in = stdin;
+    char line[512], name[64], *p, *end;
+    unsigned int version, hz = 0, count, dropped = 0, pid, cpl;
+    uint32_t addrs[DEPTH_MAX];
+    int32_t i, depth, top = 30, collapsed = 0, in_dump = 0, h;
+    entry_t *e;
+
+    for (i = 1; i < argc && '-' == argv[i][0]; i++) {
+        if (0 == strcmp (argv[i], "-k") && i + 1 < argc)
+            kernel_path = argv[++i];
+        else if (0 == strcmp (argv[i], "-u") && i + 1 < argc)
+            user_dir = argv[++i];
+        else if (0 == strcmp (argv[i], "-n") && i + 1 < argc)
+            top = atoi (argv[++i]);
+        else if (0 == strcmp (argv[i], "-c"))
+            collapsed = 1;
+        else
+            usage (argv[0]);
+    }
+    if (i + 1 < argc)
+        usage (argv[0]);
+    if (i < argc && NULL == (in = fopen (argv[i], "r"))) {
+        perror (argv[i]);
+        exit (1);
+    }
+    get_image ("kernel", kernel_path);
+
+    while (NULL != fgets (line, sizeof (line), in)) {
+        line[strcspn (line, "\r\n")] = '\0';
+        if (4 == sscanf (line, "PROF BEGIN %u %x %x %x", &version, &hz, &count, &dropped)) {
+            if (1 != version) {
+                fprintf (stderr, "profile version %u is not supported\n", version);
+                exit (1);
+            }
+            // a new run, the pids start over
+            memset (pid_image, 0, sizeof (pid_image));
+            in_dump = 1;
+        } else if (0 == strcmp (line, "PROF END")) {
+            in_dump = 0;
+        } else if (in_dump && 2 == sscanf (line, "PROF EXEC %x %63s", &pid, name)) {
+            pid_image[pid % PID_MAX] = user_image (name);
+        } else if (in_dump && 2 == sscanf (line, "%x %x", &pid, &cpl)) {
+            p = line + 4;
+            for (depth = 0; depth < DEPTH_MAX; depth++) {
+                addrs[depth] = strtoul (p, &end, 16);
+                if (end == p)
+                    break;
+                p = end;
+            }
+            if (depth > 0)
+                add_sample (pid % PID_MAX, cpl, addrs, depth);
+        }
+    }
+
+    if (collapsed) {
+        for (h = 0; h < HASH_SIZE; h++)
+            for (e = stacks[h]; NULL != e; e = e->next)
+                printf ("%s %ld\n", e->name, e->self);
+        return 0;
+    }
+    printf ("%ld samples at %u Hz, %.1f%% in the kernel", samples, hz,
+            samples ? 100.0 * kernel_samples / samples : 0.0);
+    if (dropped)
+        printf (", %u more were dropped, the buffer was full", dropped);
+    printf ("\n");
+    if (0 == samples)
+        return 0;
+    print_flat (top);
+    print_call_graph (top);
+    return 0;
+}
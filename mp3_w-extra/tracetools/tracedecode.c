@@ -0,0 +1,277 @@
+/*
+ * tracedecode: turn the kernel trace dumps in a serial log into a Chrome
+ * trace, which chrome://tracing and ui.perfetto.dev open as a timeline
+ *
+ *   usage: tracedecode [-o trace.json] [log]
+ *
+ * The log is what COM1 printed (qemu -serial file:log), the kernel writes a
+ * dump on F12, see student-distrib/kernel/trace.c for its format. Other
+ * output around the dumps is skipped, and several dumps are joined.
+ *
+ * Every process is a thread of the timeline, with its system calls, file
+ * system reads and the interrupts it was running when they came in as
+ * nested slices. A "cpu" thread shows which process had the CPU between
+ * context switches, page faults are instant events.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* event types, must match student-distrib/kernel/trace.h */
+#define TRACE_SYSCALL_ENTER 1
+#define TRACE_SYSCALL_EXIT  2
+#define TRACE_IRQ_ENTER     3
+#define TRACE_IRQ_EXIT      4
+#define TRACE_SWITCH        5
+#define TRACE_PAGE_FAULT    6
+#define TRACE_FS_READ_ENTER 7
+#define TRACE_FS_READ_EXIT  8
+#define TRACE_SIGNAL        9
+#define TRACE_PID_NONE      0xFF
+
+#define TID_CPU             1000        /* thread of the cpu track */
+#define TID_MAX             256
+#define DEPTH_MAX           64
+
+static const char *syscall_names[] = {
+    NULL, "halt", "execute", "read", "write", "open", "close", "getargs", "vidmap",
+    "set_handler", "sigreturn", "sound", "nosound", "shm_create", "shm_map",
+    "shm_unmap", "pipe", "dup2", "unlink", "truncate", "seek", "profile", "sysstats",
+    "thread_create", "thread_join", "futex", "kill", "ioctl", "poll",
+};
+#define SYSCALL_NAME_COUNT  (sizeof (syscall_names) / sizeof (syscall_names[0]))
+
+/* slices open on every thread, closed in order by the exit events */
+static int32_t depth[TID_MAX];
+static int32_t seen[TID_CPU + 1];
+
+static FILE *out;
+static int32_t first_event = 1;
+static uint32_t tsc_khz;
+static uint64_t tsc_base;
+static int32_t have_base;
+static double last_us;
+
+/* cpu track */
+static int32_t cpu_tid = -1;
+static double cpu_since;
+
+static double
+to_us (uint64_t tsc)
+{
+    if (!have_base) {
+        tsc_base = tsc;
+        have_base = 1;
+    }
+    return (double)(tsc - tsc_base) * 1000.0 / tsc_khz;
+}
+
+static void
+event_start (void)
+{
+    fputs (first_event ? "\n  " : ",\n  ", out);
+    first_event = 0;
+}
+
+static void
+name_thread (int32_t tid)
+{
+    if (seen[tid])
+        return;
+    seen[tid] = 1;
+    event_start ();
+    fprintf (out, "{\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"name\":\"thread_name\",\"args\":{\"name\":\"", tid);
+    if (TID_CPU == tid)
+        fputs ("cpu", out);
+    else if (TRACE_PID_NONE == tid)
+        fputs ("boot", out);
+    else
+        fprintf (out, "pid %d", tid);
+    fputs ("\"}}", out);
+}
+
+static void
+irq_name (char *buf, uint32_t vector)
+{
+    switch (vector) {
+    case 0x20: strcpy (buf, "irq pit"); break;
+    case 0x21: strcpy (buf, "irq keyboard"); break;
+    case 0x24: strcpy (buf, "irq serial"); break;
+    case 0x28: strcpy (buf, "irq rtc"); break;
+    case 0x2C: strcpy (buf, "irq mouse"); break;
+    case 0x2E: strcpy (buf, "irq ata0"); break;
+    case 0x2F: strcpy (buf, "irq ata1"); break;
+    case 0x25: case 0x29: case 0x2A: case 0x2B:
+        sprintf (buf, "irq pci %d", vector - 0x20);
+        break;
+    default:
+        if (vector >= 0x30 && vector < 0x40)
+            sprintf (buf, "msi 0x%x", vector);
+        else
+            sprintf (buf, "vector 0x%x", vector);
+    }
+}
+
+static void
+slice_begin (int32_t tid, double us, const char *name, const char *args)
+{
+    name_thread (tid);
+    event_start ();
+    fprintf (out, "{\"ph\":\"B\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"name\":\"%s\",\"args\":{%s}}",
+             tid, us, name, args);
+    if (depth[tid] < DEPTH_MAX)
+        depth[tid]++;
+}
+
+/* an exit whose entry was overwritten in the ring, or never recorded, is dropped */
+static void
+slice_end (int32_t tid, double us, const char *args)
+{
+    if (0 == depth[tid])
+        return;
+    depth[tid]--;
+    event_start ();
+    fprintf (out, "{\"ph\":\"E\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"args\":{%s}}", tid, us, args);
+}
+
+static void
+cpu_switch (int32_t tid, double us)
+{
+    if (cpu_tid >= 0 && us > cpu_since) {
+        name_thread (TID_CPU);
+        event_start ();
+        fprintf (out, "{\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,\"name\":\"pid %d\"}",
+                 TID_CPU, cpu_since, us - cpu_since, cpu_tid);
+    }
+    cpu_tid = tid;
+    cpu_since = us;
+}
+
+static void
+decode (uint64_t tsc, uint32_t type, uint32_t pid, uint32_t arg0, uint32_t arg1)
+{
+    char name[64], args[96];
+    double us = to_us (tsc);
+
+    pid &= TID_MAX - 1;
+    last_us = us;
+    if (cpu_tid < 0)
+        cpu_switch (pid, us);
+    switch (type) {
+    case TRACE_SYSCALL_ENTER:
+        if (arg0 < SYSCALL_NAME_COUNT && NULL != syscall_names[arg0])
+            strcpy (name, syscall_names[arg0]);
+        else
+            sprintf (name, "syscall %u", arg0);
+        sprintf (args, "\"arg\":\"0x%x\"", arg1);
+        slice_begin (pid, us, name, args);
+        break;
+    case TRACE_SYSCALL_EXIT:
+        sprintf (args, "\"ret\":%d", (int32_t)arg0);
+        slice_end (pid, us, args);
+        break;
+    case TRACE_IRQ_ENTER:
+        irq_name (name, arg0);
+        slice_begin (pid, us, name, "");
+        break;
+    case TRACE_IRQ_EXIT:
+        slice_end (pid, us, "");
+        break;
+    case TRACE_FS_READ_ENTER:
+        sprintf (args, "\"inode\":%u,\"length\":%u", arg0, arg1);
+        slice_begin (pid, us, "fs read", args);
+        break;
+    case TRACE_FS_READ_EXIT:
+        sprintf (args, "\"read\":%d", (int32_t)arg1);
+        slice_end (pid, us, args);
+        break;
+    case TRACE_SWITCH:
+        cpu_switch (arg1 & (TID_MAX - 1), us);
+        name_thread (pid);
+        event_start ();
+        fprintf (out, "{\"ph\":\"i\",\"s\":\"t\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"name\":\"switch to %u\"}",
+                 pid, us, arg1);
+        break;
+    case TRACE_PAGE_FAULT:
+        name_thread (pid);
+        event_start ();
+        fprintf (out, "{\"ph\":\"i\",\"s\":\"t\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"name\":\"page fault\","
+                 "\"args\":{\"addr\":\"0x%x\"}}", pid, us, arg0);
+        break;
+    case TRACE_SIGNAL:
+        name_thread (pid);
+        event_start ();
+        fprintf (out, "{\"ph\":\"i\",\"s\":\"t\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"name\":\"signal %u\","
+                 "\"args\":{\"handler\":\"0x%x\"}}", pid, us, arg0, arg1);
+        break;
+    default:
+        fprintf (stderr, "unknown event type %u\n", type);
+    }
+}
+
+static void
+usage (const char *prog)
+{
+    fprintf (stderr, "usage: %s [-o trace.json] [log]\n", prog);
+    exit (1);
+}
+
+int
+main (int argc, char *argv[])
+{
+    const char *out_path = NULL;
+    FILE *in = stdin;
+    char line[256];
+    unsigned int version, khz, count, type, pid, arg0, arg1, hi, lo;
+    long events = 0, dumps = 0;
+    int32_t in_dump = 0, i;
+
+    for (i = 1; i < argc && '-' == argv[i][0]; i++) {
+        if (0 == strcmp (argv[i], "-o") && i + 1 < argc)
+            out_path = argv[++i];
+        else
+            usage (argv[0]);
+    }
+    if (i + 1 < argc)
+        usage (argv[0]);
+    if (i < argc && NULL == (in = fopen (argv[i], "r"))) {
+        perror (argv[i]);
+        exit (1);
+    }
+    out = stdout;
+    if (NULL != out_path && NULL == (out = fopen (out_path, "w"))) {
+        perror (out_path);
+        exit (1);
+    }
+
+    fputs ("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[", out);
+    while (NULL != fgets (line, sizeof (line), in)) {
+        line[strcspn (line, "\r\n")] = '\0';
+        if (3 == sscanf (line, "TRACE BEGIN %u %x %x", &version, &khz, &count)) {
+            if (1 != version) {
+                fprintf (stderr, "trace version %u is not supported\n", version);
+                exit (1);
+            }
+            tsc_khz = khz ? khz : 1;
+            in_dump = 1;
+            dumps++;
+        } else if (0 == strcmp (line, "TRACE END")) {
+            in_dump = 0;
+        } else if (in_dump && 6 == sscanf (line, "%8x%8x %x %x %x %x", &hi, &lo, &type, &pid, &arg0, &arg1)) {
+            decode ((uint64_t)hi << 32 | lo, type, pid, arg0, arg1);
+            events++;
+        }
+    }
+    /* slices still open end with the last event */
+    for (i = 0; i < TID_MAX; i++)
+        while (depth[i] > 0)
+            slice_end (i, last_us, "");
+    cpu_switch (-1, last_us);
+    fputs ("\n]}\n", out);
+
+    fprintf (stderr, "%ld events from %ld dumps\n", events, dumps);
+    if (stdout != out)
+        fclose (out);
+    return 0;
+}